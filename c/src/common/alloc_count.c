@@ -0,0 +1,76 @@
+// Copyright 2023, Viveris Technologies
+// Distributed under the terms of the MIT License
+
+#include <errno.h>
+#include <stdatomic.h>
+#include <stddef.h>
+
+#include "alloc_count.h"
+
+static _Atomic uint64_t allocs;
+static uint64_t mark;
+
+#ifdef DEBUG
+
+// Allocation functions of the C library behind the counting ones
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t nmemb, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void *__libc_memalign(size_t alignment, size_t size);
+
+void *malloc(size_t size)
+{
+	atomic_fetch_add_explicit(&allocs, 1, memory_order_relaxed);
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+	atomic_fetch_add_explicit(&allocs, 1, memory_order_relaxed);
+	return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+	atomic_fetch_add_explicit(&allocs, 1, memory_order_relaxed);
+	return __libc_realloc(ptr, size);
+}
+
+void *memalign(size_t alignment, size_t size)
+{
+	atomic_fetch_add_explicit(&allocs, 1, memory_order_relaxed);
+	return __libc_memalign(alignment, size);
+}
+
+void *aligned_alloc(size_t alignment, size_t size)
+{
+	return memalign(alignment, size);
+}
+
+int posix_memalign(void **memptr, size_t alignment, size_t size)
+{
+	void *ptr;
+
+	if(alignment < sizeof(void *) || (alignment & (alignment - 1)) != 0)
+	{
+		return EINVAL;
+	}
+	if((ptr = memalign(alignment, size)) == NULL)
+	{
+		return ENOMEM;
+	}
+	*memptr = ptr;
+	return 0;
+}
+
+#endif
+
+void alloc_count_mark(void)
+{
+	mark = atomic_load(&allocs);
+}
+
+uint64_t alloc_count_since_mark(void)
+{
+	return atomic_load(&allocs) - mark;
+}
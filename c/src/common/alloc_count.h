@@ -0,0 +1,27 @@
+// Copyright 2023, Viveris Technologies
+// Distributed under the terms of the MIT License
+
+#ifndef __ALLOC_COUNT_H__
+#define __ALLOC_COUNT_H__
+
+#include <stdint.h>
+
+/*
+ * Count of the heap allocations of the whole process, libraries included
+ *
+ * The counting replaces the allocation functions of the C library, so it is
+ * only built into the debug builds (-DDEBUG). Otherwise, nothing is counted
+ * and the count is always 0.
+ */
+
+/**
+ * Mark the start of the steady state
+ */
+void alloc_count_mark(void);
+
+/**
+ * Get the number of heap allocations since the mark
+ */
+uint64_t alloc_count_since_mark(void);
+
+#endif
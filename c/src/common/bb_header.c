@@ -0,0 +1,55 @@
+// Copyright 2023, Viveris Technologies
+// Distributed under the terms of the MIT License
+
+#include "bb_header.h"
+
+#define BB_CRC8_POLY 0xD5 // x^8 + x^7 + x^6 + x^4 + x^2 + 1
+
+/**
+ * Compute the CRC-8 of the baseband header fields
+ */
+uint8_t bb_header_crc8(const unsigned char *data, size_t len)
+{
+	uint8_t crc = 0;
+	size_t i;
+	int bit;
+
+	for(i = 0; i < len; i++)
+	{
+		crc ^= data[i];
+		for(bit = 0; bit < 8; bit++)
+		{
+			crc = (crc & 0x80) ? (crc << 1) ^ BB_CRC8_POLY : crc << 1;
+		}
+	}
+	return crc;
+}
+
+void bb_header_write(const struct bb_header *hdr, unsigned char *buffer)
+{
+	buffer[0] = hdr->matype1;
+	buffer[1] = hdr->matype2;
+	buffer[2] = (hdr->upl >> 8) & 0xff;
+	buffer[3] = hdr->upl & 0xff;
+	buffer[4] = (hdr->dfl >> 8) & 0xff;
+	buffer[5] = hdr->dfl & 0xff;
+	buffer[6] = hdr->sync;
+	buffer[7] = (hdr->syncd >> 8) & 0xff;
+	buffer[8] = hdr->syncd & 0xff;
+	buffer[9] = bb_header_crc8(buffer, BB_HEADER_LEN - 1);
+}
+
+int bb_header_parse(const unsigned char *buffer, size_t len, struct bb_header *hdr)
+{
+	if(len < BB_HEADER_LEN || bb_header_crc8(buffer, BB_HEADER_LEN - 1) != buffer[9])
+	{
+		return -1;
+	}
+	hdr->matype1 = buffer[0];
+	hdr->matype2 = buffer[1];
+	hdr->upl = (buffer[2] << 8) | buffer[3];
+	hdr->dfl = (buffer[4] << 8) | buffer[5];
+	hdr->sync = buffer[6];
+	hdr->syncd = (buffer[7] << 8) | buffer[8];
+	return 0;
+}
@@ -0,0 +1,52 @@
+// Copyright 2023, Viveris Technologies
+// Distributed under the terms of the MIT License
+
+#ifndef __BB_HEADER_H__
+#define __BB_HEADER_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * DVB-S2 baseband header (EN 302 307-1, 5.1.6), optionally put at the start
+ * of each GSE frame to make it a whole BBFrame
+ *
+ * +---------+---------+-------+-------+------+-------+-------+
+ * | MATYPE  | MATYPE  |  UPL  |  DFL  | SYNC | SYNCD | CRC-8 |
+ * | 1 byte  | 1 byte  |   2   |   2   |  1   |   2   |   1   |
+ * +---------+---------+-------+-------+------+-------+-------+
+ *
+ * The GSE frames are a generic continuous stream (TS 102 606-1): UPL, SYNC
+ * and SYNCD are 0, and DFL is the length of the data field in bits. The
+ * CRC-8 covers the first 9 bytes.
+ */
+#define BB_HEADER_LEN 10
+
+// First MATYPE byte: generic continuous stream, single input stream, ACM,
+// roll-off 0.35
+#define BB_MATYPE1_GSE_ACM 0x60
+
+struct bb_header
+{
+	uint8_t matype1;
+	uint8_t matype2;
+	uint16_t upl;
+	uint16_t dfl;
+	uint8_t sync;
+	uint16_t syncd;
+};
+
+/**
+ * Write a baseband header and its CRC-8 at the start of a buffer of
+ * BB_HEADER_LEN bytes
+ */
+void bb_header_write(const struct bb_header *hdr, unsigned char *buffer);
+
+/**
+ * Parse the baseband header at the start of a buffer
+ *
+ * Return 0 on success, -1 if the header is truncated or its CRC-8 is wrong
+ */
+int bb_header_parse(const unsigned char *buffer, size_t len, struct bb_header *hdr);
+
+#endif
@@ -0,0 +1,39 @@
+// Copyright 2023, Viveris Technologies
+// Distributed under the terms of the MIT License
+
+#ifndef __CRC32_H__
+#define __CRC32_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Initial value of the GSE CRC-32, there is no final XOR
+#define CRC32_INIT 0xffffffff
+
+/**
+ * Pick the fastest CRC-32 implementation the CPU supports: folding with the
+ * carry-less multiplication of PCLMULQDQ on x86 or PMULL on ARMv8, the table
+ * otherwise. The table is used until it is called.
+ */
+void crc32_init(void);
+
+/**
+ * Get the name of the CRC-32 implementation in use
+ */
+const char *crc32_impl_name(void);
+
+/**
+ * Update the CRC-32 (MPEG-2 variant, as used by GSE) of a buffer
+ *
+ * Start from CRC32_INIT, the CRC of data split in several buffers is got by
+ * chaining the calls.
+ */
+uint32_t crc32_update(uint32_t crc, const unsigned char *data, size_t len);
+
+/**
+ * Update the CRC-32 of a buffer a byte at a time with a table, the reference
+ * of the other implementations
+ */
+uint32_t crc32_update_table(uint32_t crc, const unsigned char *data, size_t len);
+
+#endif
@@ -0,0 +1,424 @@
+// Copyright 2023, Viveris Technologies
+// Distributed under the terms of the MIT License
+
+#include <string.h>
+
+#include "flow_batch.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define FLOW_BATCH_AVX2
+#define FLOW_BATCH_TARGET __attribute__((target("avx2,pclmul")))
+#endif
+
+#define FLOW_BATCH_LANES 8   // frames side by side in the AVX2 registers
+#define FLOW_BATCH_STAGE 128 // bytes of the headers of a frame copied side by side
+
+typedef void (*flow_batch_impl_t)(const struct flow_hasher *hasher, const unsigned char *const *frames,
+                                  const size_t *lens, unsigned int count, struct flow_batch *batch);
+
+static flow_batch_impl_t flow_batch_impl = flow_batch_classify_scalar;
+static const char *flow_batch_name = "scalar";
+
+/**
+ * Store the flow of the frame i of the batch
+ */
+static void flow_batch_store(struct flow_batch *batch, unsigned int i, const unsigned char *frame,
+                             const struct flow_key *key, uint32_t hash)
+{
+	batch->level[i] = key->level;
+	batch->version[i] = key->family;
+	batch->proto[i] = key->proto;
+	batch->dscp[i] = key->dscp;
+	batch->pcp[i] = key->vlan_count > 0 ? frame[14] >> 5 : 0;
+	batch->vlan_count[i] = key->vlan_count;
+	batch->tuple_len[i] = key->tuple_len;
+	batch->ether_type[i] = key->ether_type;
+	batch->sport[i] = key->sport;
+	batch->dport[i] = key->dport;
+	batch->hash[i] = hash;
+	memset(batch->tuple[i], 0, FLOW_TUPLE_MAX);
+	memcpy(batch->tuple[i], key->tuple, key->tuple_len);
+}
+
+void flow_batch_classify_scalar(const struct flow_hasher *hasher, const unsigned char *const *frames,
+                                const size_t *lens, unsigned int count, struct flow_batch *batch)
+{
+	struct flow_key key;
+	unsigned int i;
+
+	batch->count = count;
+	for(i = 0; i < count; i++)
+	{
+		flow_key_parse(frames[i], lens[i], &key);
+		flow_batch_store(batch, i, frames[i], &key, flow_hash(hasher, &key));
+	}
+}
+
+#ifdef FLOW_BATCH_AVX2
+
+/**
+ * Gather the 4 bytes at an offset of the staged headers of each frame, the
+ * offsets past them are clamped: their lanes are left out of the results
+ */
+static inline FLOW_BATCH_TARGET __m256i flow_gather(const uint8_t *stage, __m256i rows, __m256i offset)
+{
+	offset = _mm256_min_epi32(offset, _mm256_set1_epi32(FLOW_BATCH_STAGE - 4));
+	return _mm256_i32gather_epi32((const int *)stage, _mm256_add_epi32(rows, offset), 1);
+}
+
+/**
+ * Get the first 16 bits of the bytes gathered, in host byte order
+ */
+static inline FLOW_BATCH_TARGET __m256i flow_be16_first(__m256i bytes)
+{
+	const __m256i swap = _mm256_setr_epi8(1, 0, -1, -1, 5, 4, -1, -1, 9, 8, -1, -1, 13, 12, -1, -1,
+	                                      1, 0, -1, -1, 5, 4, -1, -1, 9, 8, -1, -1, 13, 12, -1, -1);
+
+	return _mm256_shuffle_epi8(bytes, swap);
+}
+
+/**
+ * Get the last 16 bits of the bytes gathered, in host byte order
+ */
+static inline FLOW_BATCH_TARGET __m256i flow_be16_last(__m256i bytes)
+{
+	const __m256i swap = _mm256_setr_epi8(3, 2, -1, -1, 7, 6, -1, -1, 11, 10, -1, -1, 15, 14, -1, -1,
+	                                      3, 2, -1, -1, 7, 6, -1, -1, 11, 10, -1, -1, 15, 14, -1, -1);
+
+	return _mm256_shuffle_epi8(bytes, swap);
+}
+
+static inline FLOW_BATCH_TARGET __m256i flow_eq(__m256i a, int b)
+{
+	return _mm256_cmpeq_epi32(a, _mm256_set1_epi32(b));
+}
+
+/**
+ * Mask of the lanes where offset + size > len, the fields out of the frame
+ */
+static inline FLOW_BATCH_TARGET __m256i flow_past(__m256i offset, int size, __m256i len)
+{
+	return _mm256_cmpgt_epi32(_mm256_add_epi32(offset, _mm256_set1_epi32(size)), len);
+}
+
+static inline FLOW_BATCH_TARGET __m256i flow_vlan_tpid(__m256i type)
+{
+	return _mm256_or_si256(_mm256_or_si256(flow_eq(type, 0x8100), flow_eq(type, 0x88A8)), flow_eq(type, 0x9100));
+}
+
+/**
+ * Store the 8 lanes of values below 256, or 65536, as bytes, or 16-bit words
+ */
+static inline FLOW_BATCH_TARGET void flow_store8(uint8_t *dst, __m256i values)
+{
+	__m128i words = _mm_packus_epi32(_mm256_castsi256_si128(values), _mm256_extracti128_si256(values, 1));
+
+	_mm_storel_epi64((__m128i *)dst, _mm_packus_epi16(words, words));
+}
+
+static inline FLOW_BATCH_TARGET void flow_store16(uint16_t *dst, __m256i values)
+{
+	_mm_storeu_si128((__m128i *)dst,
+	                 _mm_packus_epi32(_mm256_castsi256_si128(values), _mm256_extracti128_si256(values, 1)));
+}
+
+/**
+ * Reverse the bits of each byte
+ */
+static inline FLOW_BATCH_TARGET __m128i flow_reverse_bits(__m128i bytes)
+{
+	const __m128i low = _mm_setr_epi8(0x00, 0x80, 0x40, 0xc0, 0x20, 0xa0, 0x60, 0xe0, 0x10, 0x90, 0x50, 0xd0, 0x30,
+	                                  0xb0, 0x70, 0xf0);
+	const __m128i high = _mm_setr_epi8(0x0, 0x8, 0x4, 0xc, 0x2, 0xa, 0x6, 0xe, 0x1, 0x9, 0x5, 0xd, 0x3, 0xb, 0x7, 0xf);
+	const __m128i nibble = _mm_set1_epi8(0x0f);
+
+	return _mm_or_si128(_mm_shuffle_epi8(low, _mm_and_si128(bytes, nibble)),
+	                    _mm_shuffle_epi8(high, _mm_and_si128(_mm_srli_epi16(bytes, 4), nibble)));
+}
+
+/**
+ * Toeplitz hash of a tuple of 36 bytes at most, zero-padded in 3 registers
+ *
+ * Bit j of the hash is the XOR of the key bits i + j over the set bits i of
+ * the tuple, counted from the most significant bit of the first byte: with
+ * the bits of each tuple byte reversed, it is bit 319 - j of the carry-less
+ * product of the tuple by the 320 bits of the key read as a big-endian
+ * integer. Only the products of the 64-bit words reaching the bits 288 to
+ * 319 are computed, those of the words 0 and 1 of the tuple alone up to 16
+ * bytes of tuple. The key words are 1 and 0, 3 and 2, then 4 in the registers.
+ */
+static inline FLOW_BATCH_TARGET uint32_t flow_toeplitz(const __m128i *key, __m128i t0, __m128i t1, __m128i t2,
+                                                       size_t len)
+{
+	__m128i a01 = flow_reverse_bits(t0), a23, a4;
+	__m128i x3, x4;
+
+	x3 = _mm_xor_si128(_mm_clmulepi64_si128(a01, key[1], 0x10), _mm_clmulepi64_si128(a01, key[1], 0x01));
+	x4 = _mm_xor_si128(_mm_clmulepi64_si128(a01, key[2], 0x00), _mm_clmulepi64_si128(a01, key[1], 0x11));
+	if(len > 16)
+	{
+		a23 = flow_reverse_bits(t1);
+		a4 = flow_reverse_bits(t2);
+		x3 = _mm_xor_si128(x3, _mm_xor_si128(_mm_clmulepi64_si128(a23, key[0], 0x10),
+		                                     _mm_clmulepi64_si128(a23, key[0], 0x01)));
+		x4 = _mm_xor_si128(x4, _mm_xor_si128(_mm_clmulepi64_si128(a23, key[1], 0x00),
+		                                     _mm_clmulepi64_si128(a23, key[0], 0x11)));
+		x4 = _mm_xor_si128(x4, _mm_clmulepi64_si128(a4, key[0], 0x00));
+	}
+	return (uint32_t)_mm_extract_epi32(x3, 3) ^ (uint32_t)_mm_extract_epi32(x4, 1);
+}
+
+/**
+ * Classify up to FLOW_BATCH_LANES frames from the frame first of the batch
+ *
+ * Their headers are staged side by side, then each step of flow_key_parse
+ * runs on all the frames at once, masking out those which take another way.
+ * The frames whose IPv6 extension headers run past the staged headers, too
+ * rare to be worth a wider stage, are parsed alone with flow_key_parse.
+ */
+static FLOW_BATCH_TARGET void flow_batch_lanes(const struct flow_hasher *hasher, const __m128i *key,
+                                               const unsigned char *const *frames, const size_t *lens,
+                                               unsigned int first, unsigned int count, struct flow_batch *batch)
+{
+	uint8_t stage[FLOW_BATCH_LANES][FLOW_BATCH_STAGE] __attribute__((aligned(32)));
+	int32_t lane_len[FLOW_BATCH_LANES] __attribute__((aligned(32)));
+	int32_t l3_lanes[FLOW_BATCH_LANES] __attribute__((aligned(32)));
+	int32_t l4_lanes[FLOW_BATCH_LANES] __attribute__((aligned(32)));
+	const __m256i rows = _mm256_setr_epi32(0, 1 * FLOW_BATCH_STAGE, 2 * FLOW_BATCH_STAGE, 3 * FLOW_BATCH_STAGE,
+	                                       4 * FLOW_BATCH_STAGE, 5 * FLOW_BATCH_STAGE, 6 * FLOW_BATCH_STAGE,
+	                                       7 * FLOW_BATCH_STAGE);
+	const __m128i macs = _mm_setr_epi8(6, 7, 8, 9, 10, 11, 0, 1, 2, 3, 4, 5, -1, -1, -1, -1);
+	const __m256i byte = _mm256_set1_epi32(0xff);
+	const __m256i zero = _mm256_setzero_si256();
+	__m256i len, valid, bytes, type, tag, inner_tag, pcp, l3, b0, b1, ihl, ipv4, ipv6, ip, dscp, proto, l4;
+	__m256i no_ports, slow, ext, next, step, hop, auth, frag, ports;
+	__m128i t0, t1, t2;
+	struct flow_key key_slow;
+	const uint8_t *headers;
+	unsigned int lane, i, k, slow_lanes;
+	uint8_t *tuple;
+	size_t frame_len;
+	uint32_t word;
+
+	for(lane = 0; lane < FLOW_BATCH_LANES; lane++)
+	{
+		frame_len = lane < count ? lens[first + lane] : 0;
+		if(frame_len >= FLOW_BATCH_STAGE)
+		{
+			for(i = 0; i < FLOW_BATCH_STAGE; i += 32)
+			{
+				_mm256_store_si256((__m256i *)(stage[lane] + i),
+				                   _mm256_loadu_si256((const __m256i *)(frames[first + lane] + i)));
+			}
+		}
+		else
+		{
+			for(i = 0; i < FLOW_BATCH_STAGE; i += 32)
+			{
+				_mm256_store_si256((__m256i *)(stage[lane] + i), zero);
+			}
+			if(frame_len > 0)
+			{
+				memcpy(stage[lane], frames[first + lane], frame_len);
+			}
+		}
+		lane_len[lane] = frame_len > 0xffff ? 0xffff : (int32_t)frame_len;
+	}
+	len = _mm256_load_si256((const __m256i *)lane_len);
+	valid = _mm256_cmpgt_epi32(len, _mm256_set1_epi32(13));
+
+	// VLAN tags, read at the offsets of the types after none, one or two
+	// tags so that the loads do not wait for each other
+	bytes = flow_gather(stage[0], rows, _mm256_set1_epi32(12));
+	type = flow_be16_first(bytes);
+	tag = _mm256_and_si256(flow_vlan_tpid(type), valid);
+	tag = _mm256_andnot_si256(flow_past(_mm256_set1_epi32(12), 6, len), tag);
+	pcp = _mm256_and_si256(tag, _mm256_srli_epi32(flow_be16_last(bytes), 13));
+	bytes = flow_be16_first(flow_gather(stage[0], rows, _mm256_set1_epi32(16)));
+	inner_tag = _mm256_and_si256(flow_vlan_tpid(bytes), tag);
+	inner_tag = _mm256_andnot_si256(flow_past(_mm256_set1_epi32(16), 6, len), inner_tag);
+	type = _mm256_blendv_epi8(type, bytes, tag);
+	type = _mm256_blendv_epi8(type, flow_be16_first(flow_gather(stage[0], rows, _mm256_set1_epi32(20))), inner_tag);
+	type = _mm256_and_si256(type, valid);
+	l3 = _mm256_add_epi32(_mm256_set1_epi32(14), _mm256_and_si256(_mm256_set1_epi32(4), tag));
+	l3 = _mm256_add_epi32(l3, _mm256_and_si256(_mm256_set1_epi32(4), inner_tag));
+	flow_store8(batch->pcp + first, pcp);
+	flow_store8(batch->vlan_count + first, _mm256_sub_epi32(_mm256_sub_epi32(zero, tag), inner_tag));
+	flow_store16(batch->ether_type + first, type);
+
+	// IPv4 or IPv6 header
+	bytes = flow_gather(stage[0], rows, l3);
+	b0 = _mm256_and_si256(bytes, byte);
+	b1 = _mm256_and_si256(_mm256_srli_epi32(bytes, 8), byte);
+	ihl = _mm256_slli_epi32(_mm256_and_si256(b0, _mm256_set1_epi32(0x0f)), 2);
+	ipv4 = _mm256_and_si256(flow_eq(type, 0x0800), flow_eq(_mm256_srli_epi32(b0, 4), 4));
+	ipv4 = _mm256_andnot_si256(flow_past(l3, 20, len), ipv4);
+	ipv4 = _mm256_and_si256(ipv4, _mm256_cmpgt_epi32(ihl, _mm256_set1_epi32(19)));
+	ipv4 = _mm256_andnot_si256(_mm256_cmpgt_epi32(_mm256_add_epi32(l3, ihl), len), ipv4);
+	ipv6 = _mm256_and_si256(flow_eq(type, 0x86DD), flow_eq(_mm256_srli_epi32(b0, 4), 6));
+	ipv6 = _mm256_andnot_si256(flow_past(l3, 40, len), ipv6);
+	ip = _mm256_or_si256(ipv4, ipv6);
+	dscp = _mm256_or_si256(
+	    _mm256_and_si256(ipv4, _mm256_srli_epi32(b1, 2)),
+	    _mm256_and_si256(ipv6, _mm256_or_si256(_mm256_slli_epi32(_mm256_and_si256(b0, _mm256_set1_epi32(0x0f)), 2),
+	                                           _mm256_srli_epi32(b1, 6))));
+	flow_store8(batch->version + first,
+	            _mm256_or_si256(_mm256_and_si256(ipv4, _mm256_set1_epi32(4)),
+	                            _mm256_and_si256(ipv6, _mm256_set1_epi32(6))));
+	flow_store8(batch->dscp + first, dscp);
+
+	// Bytes 6 to 9: the fragment field then the protocol of IPv4, the next header of IPv6
+	bytes = flow_gather(stage[0], rows, _mm256_add_epi32(l3, _mm256_set1_epi32(6)));
+	proto = _mm256_or_si256(_mm256_and_si256(ipv4, _mm256_srli_epi32(bytes, 24)),
+	                        _mm256_and_si256(ipv6, _mm256_and_si256(bytes, byte)));
+	no_ports = _mm256_andnot_si256(
+	    flow_eq(_mm256_and_si256(flow_be16_first(bytes), _mm256_set1_epi32(0x3fff)), 0), ipv4);
+	l4 = _mm256_add_epi32(l3, _mm256_blendv_epi8(_mm256_set1_epi32(40), ihl, ipv4));
+
+	// IPv6 extension headers
+	slow = zero;
+	for(i = 0; i < FLOW_MAX_IPV6_EXT; i++)
+	{
+		hop = _mm256_or_si256(_mm256_or_si256(flow_eq(proto, 0), flow_eq(proto, 43)), flow_eq(proto, 60));
+		auth = flow_eq(proto, 51);
+		frag = flow_eq(proto, 44);
+		ext = _mm256_and_si256(_mm256_or_si256(_mm256_or_si256(hop, auth), frag), ipv6);
+		ext = _mm256_andnot_si256(_mm256_or_si256(no_ports, flow_past(l4, 8, len)), ext);
+		slow = _mm256_or_si256(slow, _mm256_and_si256(ext, flow_past(l4, 8, _mm256_set1_epi32(FLOW_BATCH_STAGE))));
+		ext = _mm256_andnot_si256(slow, ext);
+		if(_mm256_testz_si256(ext, ext))
+		{
+			break;
+		}
+		bytes = flow_gather(stage[0], rows, l4);
+		next = _mm256_and_si256(bytes, byte);
+		b1 = _mm256_and_si256(_mm256_srli_epi32(bytes, 8), byte);
+		step = _mm256_and_si256(hop, _mm256_slli_epi32(_mm256_add_epi32(b1, _mm256_set1_epi32(1)), 3));
+		step = _mm256_or_si256(step,
+		                       _mm256_and_si256(auth, _mm256_slli_epi32(_mm256_add_epi32(b1, _mm256_set1_epi32(2)), 2)));
+		step = _mm256_or_si256(step, _mm256_and_si256(frag, _mm256_set1_epi32(8)));
+		// A fragment with an offset, or the first one of several: no ports
+		frag = _mm256_andnot_si256(
+		    flow_eq(_mm256_and_si256(flow_be16_last(bytes), _mm256_set1_epi32(0xfff9)), 0), frag);
+		no_ports = _mm256_or_si256(no_ports, _mm256_and_si256(ext, frag));
+		l4 = _mm256_add_epi32(l4, _mm256_and_si256(ext, step));
+		proto = _mm256_blendv_epi8(proto, next, ext);
+	}
+	flow_store8(batch->proto + first, proto);
+
+	// TCP, UDP, UDP-Lite or SCTP ports
+	ports = _mm256_or_si256(_mm256_or_si256(flow_eq(proto, 6), flow_eq(proto, 17)),
+	                        _mm256_or_si256(flow_eq(proto, 132), flow_eq(proto, 136)));
+	ports = _mm256_andnot_si256(_mm256_or_si256(no_ports, flow_past(l4, 4, len)), _mm256_and_si256(ports, ip));
+	slow = _mm256_or_si256(slow, _mm256_and_si256(ports, flow_past(l4, 4, _mm256_set1_epi32(FLOW_BATCH_STAGE))));
+	bytes = flow_gather(stage[0], rows, l4);
+	flow_store16(batch->sport + first, _mm256_and_si256(ports, flow_be16_first(bytes)));
+	flow_store16(batch->dport + first, _mm256_and_si256(ports, flow_be16_last(bytes)));
+	flow_store8(batch->level + first, _mm256_sub_epi32(_mm256_sub_epi32(zero, ip), ports));
+
+	// Addresses, 32, 8 or 12 bytes by the IP version, then ports
+	type = _mm256_blendv_epi8(_mm256_set1_epi32(12), _mm256_set1_epi32(8), ipv4);
+	type = _mm256_blendv_epi8(type, _mm256_set1_epi32(32), ipv6);
+	flow_store8(batch->tuple_len + first,
+	            _mm256_and_si256(valid, _mm256_add_epi32(type, _mm256_and_si256(ports, _mm256_set1_epi32(4)))));
+	_mm256_store_si256((__m256i *)l3_lanes, l3);
+	_mm256_store_si256((__m256i *)l4_lanes, l4);
+
+	// The tuples are built and hashed a frame at a time, from the registers
+	slow_lanes = _mm256_movemask_ps(_mm256_castsi256_ps(slow));
+	for(lane = 0; lane < count; lane++)
+	{
+		k = first + lane;
+		tuple = batch->tuple[k];
+		if(slow_lanes & (1 << lane))
+		{
+			flow_key_parse(frames[k], lens[k], &key_slow);
+			flow_batch_store(batch, k, frames[k], &key_slow, flow_hash(hasher, &key_slow));
+			continue;
+		}
+		headers = stage[lane];
+		t1 = _mm_setzero_si128();
+		t2 = _mm_setzero_si128();
+		word = 0;
+		if(batch->level[k] == flow_l4)
+		{
+			memcpy(&word, headers + l4_lanes[lane], 4);
+		}
+		if(batch->version[k] == 6)
+		{
+			t0 = _mm_loadu_si128((const __m128i *)(headers + l3_lanes[lane] + 8));
+			t1 = _mm_loadu_si128((const __m128i *)(headers + l3_lanes[lane] + 24));
+			t2 = _mm_cvtsi32_si128(word);
+		}
+		else if(batch->version[k] == 4)
+		{
+			t0 = _mm_loadl_epi64((const __m128i *)(headers + l3_lanes[lane] + 12));
+			t0 = _mm_insert_epi32(t0, word, 2);
+		}
+		else if(batch->tuple_len[k] != 0)
+		{
+			t0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)headers), macs);
+		}
+		else
+		{
+			t0 = _mm_setzero_si128();
+		}
+		_mm_storeu_si128((__m128i *)tuple, t0);
+		_mm_storeu_si128((__m128i *)(tuple + 16), t1);
+		word = _mm_cvtsi128_si32(t2);
+		memcpy(tuple + 32, &word, 4);
+		batch->hash[k] = flow_toeplitz(key, t0, t1, t2, batch->tuple_len[k]);
+	}
+}
+
+static FLOW_BATCH_TARGET void flow_batch_classify_avx2(const struct flow_hasher *hasher,
+                                                       const unsigned char *const *frames, const size_t *lens,
+                                                       unsigned int count, struct flow_batch *batch)
+{
+	__m128i key[3];
+	uint64_t words[5];
+	unsigned int first, i;
+
+	// The key as a big-endian integer of 320 bits, least significant word first
+	for(i = 0; i < 5; i++)
+	{
+		memcpy(&(words[i]), hasher->key + FLOW_RSS_KEY_LEN - 8 * (i + 1), 8);
+		words[i] = __builtin_bswap64(words[i]);
+	}
+	key[0] = _mm_set_epi64x(words[1], words[0]);
+	key[1] = _mm_set_epi64x(words[3], words[2]);
+	key[2] = _mm_set_epi64x(0, words[4]);
+
+	batch->count = count;
+	for(first = 0; first < count; first += FLOW_BATCH_LANES)
+	{
+		flow_batch_lanes(hasher, key, frames, lens, first,
+		                 count - first < FLOW_BATCH_LANES ? count - first : FLOW_BATCH_LANES, batch);
+	}
+}
+
+#endif
+
+void flow_batch_init(void)
+{
+#ifdef FLOW_BATCH_AVX2
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("pclmul"))
+	{
+		flow_batch_impl = flow_batch_classify_avx2;
+		flow_batch_name = "avx2";
+	}
+#endif
+}
+
+const char *flow_batch_impl_name(void)
+{
+	return flow_batch_name;
+}
+
+void flow_batch_classify(const struct flow_hasher *hasher, const unsigned char *const *frames, const size_t *lens,
+                         unsigned int count, struct flow_batch *batch)
+{
+	flow_batch_impl(hasher, frames, lens, count, batch);
+}
@@ -0,0 +1,67 @@
+// Copyright 2023, Viveris Technologies
+// Distributed under the terms of the MIT License
+
+#ifndef __FLOW_BATCH_H__
+#define __FLOW_BATCH_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "flow_hash.h"
+
+#define FLOW_BATCH_MAX 16 // frames classified at once
+
+/**
+ * Classification of a batch of frames, one array per field so that the same
+ * field of every frame is extracted at once
+ *
+ * The entry i of each array is the one of the frame i. The fields are those
+ * of the flow_key of each frame, plus the priority of its outer VLAN tag. The
+ * tuple of a frame starts with its source then destination addresses, of 6
+ * bytes at level flow_l2, 4 or 16 bytes by the IP version otherwise, then
+ * holds its ports at level flow_l4. It is zero-padded to FLOW_TUPLE_MAX.
+ */
+struct flow_batch
+{
+	unsigned int count;
+	uint8_t level[FLOW_BATCH_MAX];       // flow_level_t
+	uint8_t version[FLOW_BATCH_MAX];     // IP version, 4 or 6, 0 when not IP
+	uint8_t proto[FLOW_BATCH_MAX];
+	uint8_t dscp[FLOW_BATCH_MAX];
+	uint8_t pcp[FLOW_BATCH_MAX];         // of the outer VLAN tag, 0 untagged
+	uint8_t vlan_count[FLOW_BATCH_MAX];
+	uint8_t tuple_len[FLOW_BATCH_MAX];
+	uint16_t ether_type[FLOW_BATCH_MAX]; // after the VLAN tags
+	uint16_t sport[FLOW_BATCH_MAX];
+	uint16_t dport[FLOW_BATCH_MAX];
+	uint32_t hash[FLOW_BATCH_MAX];       // Toeplitz hash of the tuple, as flow_hash
+	uint8_t tuple[FLOW_BATCH_MAX][FLOW_TUPLE_MAX];
+};
+
+/**
+ * Pick the fastest batch classifier the CPU supports: 8 frames side by side
+ * in the AVX2 registers on x86, a frame at a time otherwise. The latter is
+ * used until it is called.
+ */
+void flow_batch_init(void);
+
+/**
+ * Get the name of the batch classifier in use
+ */
+const char *flow_batch_impl_name(void);
+
+/**
+ * Classify up to FLOW_BATCH_MAX Ethernet frames: parse them as
+ * flow_key_parse, and hash their tuples as flow_hash
+ */
+void flow_batch_classify(const struct flow_hasher *hasher, const unsigned char *const *frames, const size_t *lens,
+                         unsigned int count, struct flow_batch *batch);
+
+/**
+ * Classify the frames a frame at a time with flow_key_parse and flow_hash,
+ * the reference of the other classifiers
+ */
+void flow_batch_classify_scalar(const struct flow_hasher *hasher, const unsigned char *const *frames,
+                                const size_t *lens, unsigned int count, struct flow_batch *batch);
+
+#endif
@@ -0,0 +1,229 @@
+// Copyright 2023, Viveris Technologies
+// Distributed under the terms of the MIT License
+
+#include <string.h>
+
+#include "flow_hash.h"
+
+#define ETH_HEADER_LEN  14
+#define VLAN_TAG_LEN    4
+#define IPV4_HEADER_LEN 20
+#define IPV6_HEADER_LEN 40
+
+const uint8_t flow_rss_key[FLOW_RSS_KEY_LEN] = {
+	0x6d, 0x5a, 0x56, 0xda, 0x25, 0x5b, 0x0e, 0xc2, 0x41, 0x67,
+	0x25, 0x3d, 0x43, 0xa3, 0x8f, 0xb0, 0xd0, 0xca, 0x2b, 0xcb,
+	0xae, 0x7b, 0x30, 0xb4, 0x77, 0xcb, 0x2d, 0xa3, 0x80, 0x30,
+	0xf2, 0x0c, 0x6a, 0x42, 0xb7, 0x3b, 0xbe, 0xac, 0x01, 0xfa,
+};
+
+uint16_t flow_read16(const unsigned char *buffer)
+{
+	return (buffer[0] << 8) | buffer[1];
+}
+
+/**
+ * Parse the TCP, UDP, UDP-Lite or SCTP ports, which all start the header
+ */
+void flow_parse_ports(const unsigned char *buffer, size_t len, size_t offset, struct flow_key *key)
+{
+	if(key->proto != 6 && key->proto != 17 && key->proto != 132 && key->proto != 136)
+	{
+		return;
+	}
+	if(offset + 4 > len)
+	{
+		return;
+	}
+	memcpy(key->tuple + key->tuple_len, buffer + offset, 4);
+	key->tuple_len += 4;
+	key->sport = flow_read16(buffer + offset);
+	key->dport = flow_read16(buffer + offset + 2);
+	key->level = flow_l4;
+}
+
+void flow_parse_ipv4(const unsigned char *buffer, size_t len, size_t offset, struct flow_key *key)
+{
+	const unsigned char *ip = buffer + offset;
+	size_t ihl;
+
+	if(offset + IPV4_HEADER_LEN > len || (ip[0] >> 4) != 4)
+	{
+		return;
+	}
+	ihl = (ip[0] & 0x0f) * 4;
+	if(ihl < IPV4_HEADER_LEN || offset + ihl > len)
+	{
+		return;
+	}
+	key->family = 4;
+	key->dscp = ip[1] >> 2;
+	key->proto = ip[9];
+	memcpy(key->tuple, ip + 12, 8);
+	key->tuple_len = 8;
+	key->level = flow_l3;
+
+	// More fragments or an offset: the ports are in the first fragment only
+	if((flow_read16(ip + 6) & 0x3fff) != 0)
+	{
+		return;
+	}
+	flow_parse_ports(buffer, len, offset + ihl, key);
+}
+
+void flow_parse_ipv6(const unsigned char *buffer, size_t len, size_t offset, struct flow_key *key)
+{
+	const unsigned char *ip = buffer + offset;
+	const unsigned char *ext;
+	unsigned int i;
+	uint8_t next;
+
+	if(offset + IPV6_HEADER_LEN > len || (ip[0] >> 4) != 6)
+	{
+		return;
+	}
+	key->family = 6;
+	key->dscp = ((ip[0] & 0x0f) << 2) | (ip[1] >> 6);
+	memcpy(key->tuple, ip + 8, 32);
+	key->tuple_len = 32;
+	key->level = flow_l3;
+
+	next = ip[6];
+	offset += IPV6_HEADER_LEN;
+	for(i = 0; i < FLOW_MAX_IPV6_EXT && offset + 8 <= len; i++)
+	{
+		ext = buffer + offset;
+		if(next == 0 || next == 43 || next == 60) // hop-by-hop, routing, destination
+		{
+			next = ext[0];
+			offset += (ext[1] + 1) * 8;
+		}
+		else if(next == 51) // authentication header
+		{
+			next = ext[0];
+			offset += (ext[1] + 2) * 4;
+		}
+		else if(next == 44) // fragment
+		{
+			if((flow_read16(ext + 2) & 0xfff9) != 0)
+			{
+				key->proto = ext[0];
+				return;
+			}
+			next = ext[0];
+			offset += 8;
+		}
+		else
+		{
+			break;
+		}
+	}
+	key->proto = next;
+	flow_parse_ports(buffer, len, offset, key);
+}
+
+void flow_key_parse(const unsigned char *buffer, size_t len, struct flow_key *key)
+{
+	size_t offset = 12;
+	uint16_t type;
+
+	key->level = flow_l2;
+	key->family = 0;
+	key->proto = 0;
+	key->dscp = 0;
+	key->vlan_count = 0;
+	key->ether_type = 0;
+	key->sport = 0;
+	key->dport = 0;
+	key->tuple_len = 0;
+	if(len < ETH_HEADER_LEN)
+	{
+		return;
+	}
+
+	// Source then destination, as the IP addresses
+	memcpy(key->tuple, buffer + 6, 6);
+	memcpy(key->tuple + 6, buffer, 6);
+	key->tuple_len = 12;
+
+	type = flow_read16(buffer + offset);
+	while((type == 0x8100 || type == 0x88A8 || type == 0x9100) && key->vlan_count < FLOW_MAX_VLANS &&
+	      offset + VLAN_TAG_LEN + 2 <= len)
+	{
+		key->vlans[key->vlan_count++] = flow_read16(buffer + offset + 2) & 0x0fff;
+		offset += VLAN_TAG_LEN;
+		type = flow_read16(buffer + offset);
+	}
+	key->ether_type = type;
+	offset += 2;
+
+	if(type == 0x0800)
+	{
+		flow_parse_ipv4(buffer, len, offset, key);
+	}
+	else if(type == 0x86DD)
+	{
+		flow_parse_ipv6(buffer, len, offset, key);
+	}
+}
+
+void flow_hasher_init(struct flow_hasher *hasher, const uint8_t *rss_key)
+{
+	unsigned int pos, bit, value, first;
+	uint64_t window;
+	uint32_t sub[8];
+
+	memcpy(hasher->key, rss_key, FLOW_RSS_KEY_LEN);
+	for(pos = 0; pos < FLOW_TUPLE_MAX; pos++)
+	{
+		// The 32 bits of the key starting at each bit of the tuple byte
+		window = 0;
+		for(first = 0; first < 5; first++)
+		{
+			window = (window << 8) | (pos + first < FLOW_RSS_KEY_LEN ? rss_key[pos + first] : 0);
+		}
+		for(bit = 0; bit < 8; bit++)
+		{
+			sub[bit] = (uint32_t)(window >> (8 - bit));
+		}
+		for(value = 0; value < 256; value++)
+		{
+			hasher->table[pos][value] = 0;
+			for(bit = 0; bit < 8; bit++)
+			{
+				if(value & (0x80 >> bit))
+				{
+					hasher->table[pos][value] ^= sub[bit];
+				}
+			}
+		}
+	}
+}
+
+uint32_t flow_hash(const struct flow_hasher *hasher, const struct flow_key *key)
+{
+	uint32_t hash = 0;
+	size_t i;
+
+	for(i = 0; i < key->tuple_len; i++)
+	{
+		hash ^= hasher->table[i][key->tuple[i]];
+	}
+	return hash;
+}
+
+void flow_steer_init(struct flow_steer *steer, unsigned int count)
+{
+	unsigned int i;
+
+	steer->count = count;
+	for(i = 0; i < FLOW_RETA_SIZE; i++)
+	{
+		steer->reta[i] = i % count;
+	}
+}
+
+unsigned int flow_steer_worker(const struct flow_steer *steer, uint32_t hash)
+{
+	return steer->reta[hash & (FLOW_RETA_SIZE - 1)];
+}
@@ -0,0 +1,100 @@
+// Copyright 2023, Viveris Technologies
+// Distributed under the terms of the MIT License
+
+#ifndef __FLOW_HASH_H__
+#define __FLOW_HASH_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define FLOW_RSS_KEY_LEN 40
+#define FLOW_TUPLE_MAX   36  // IPv6 addresses and ports
+#define FLOW_MAX_VLANS   2   // 802.1Q, or 802.1AD (Q in Q) then 802.1Q
+#define FLOW_MAX_IPV6_EXT 8  // IPv6 extension headers skipped at most
+#define FLOW_RETA_SIZE   128 // indirection table entries, as NICs steer RSS
+
+typedef enum {
+	flow_l2 = 0,  // not IP or truncated: MAC addresses
+	flow_l3 = 1,  // IP addresses only: fragment, or neither TCP, UDP nor SCTP
+	flow_l4 = 2   // IP addresses and ports
+} flow_level_t;
+
+/**
+ * Flow of a frame, parsed in a single pass
+ *
+ * The tuple is laid out as the RSS hash input: source address, destination
+ * address, source port, destination port, in network byte order. The
+ * fragments of a datagram are hashed on their addresses only, so that they
+ * stay with the first one which alone carries the ports.
+ */
+struct flow_key
+{
+	flow_level_t level;
+	uint8_t family;    // 4 or 6, 0 when not IP
+	uint8_t proto;     // IP protocol, or next header after the extensions
+	uint8_t dscp;
+	uint8_t vlan_count;
+	uint16_t vlans[FLOW_MAX_VLANS]; // VLAN IDs, outer first
+	uint16_t ether_type;            // after the VLAN tags
+	uint16_t sport;
+	uint16_t dport;
+
+	size_t tuple_len;
+	uint8_t tuple[FLOW_TUPLE_MAX];
+};
+
+/**
+ * Toeplitz hash of the tuples, the hash of a NIC RSS with the same key
+ *
+ * The key is expanded into one table of 256 entries per byte of tuple, the
+ * hash of a tuple is the XOR of one lookup per byte. The key is kept as is
+ * for the batch classifier, which multiplies the tuples by it instead.
+ */
+struct flow_hasher
+{
+	uint32_t table[FLOW_TUPLE_MAX][256];
+	uint8_t key[FLOW_RSS_KEY_LEN];
+};
+
+/**
+ * Steering of the flows to workers by their hash
+ */
+struct flow_steer
+{
+	unsigned int count;
+	uint8_t reta[FLOW_RETA_SIZE];
+};
+
+// The default RSS key of the NICs, from the Microsoft RSS specification
+extern const uint8_t flow_rss_key[FLOW_RSS_KEY_LEN];
+
+/**
+ * Parse the flow of an Ethernet frame: VLAN and Q in Q tags, IPv4 or IPv6
+ * with its extension headers, TCP, UDP, UDP-Lite or SCTP ports
+ *
+ * Never fails: a frame which is not IP, or is truncated, falls back to its
+ * MAC addresses, or to nothing below the Ethernet header length.
+ */
+void flow_key_parse(const unsigned char *buffer, size_t len, struct flow_key *key);
+
+/**
+ * Expand an RSS key of FLOW_RSS_KEY_LEN bytes
+ */
+void flow_hasher_init(struct flow_hasher *hasher, const uint8_t *rss_key);
+
+/**
+ * Hash the tuple of a flow
+ */
+uint32_t flow_hash(const struct flow_hasher *hasher, const struct flow_key *key);
+
+/**
+ * Spread the entries of the indirection table over count workers in turn
+ */
+void flow_steer_init(struct flow_steer *steer, unsigned int count);
+
+/**
+ * Get the worker of a flow hash
+ */
+unsigned int flow_steer_worker(const struct flow_steer *steer, uint32_t hash);
+
+#endif
@@ -0,0 +1,189 @@
+// Copyright 2023, Viveris Technologies
+// Distributed under the terms of the MIT License
+
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define GF256_X86
+#endif
+
+#include "gf256.h"
+
+#define GF256_POLY 0x11d
+
+static uint8_t gf256_exp[512];
+static uint8_t gf256_log[256];
+
+// Products of every element by the low and the high nibbles, the vector
+// implementations look them up with a byte shuffle
+static uint8_t gf256_nibble_lo[256][16];
+static uint8_t gf256_nibble_hi[256][16];
+
+typedef void (*gf256_madd_t)(uint8_t *dst, const uint8_t *src, uint8_t c, size_t len);
+
+void gf256_madd_c(uint8_t *dst, const uint8_t *src, uint8_t c, size_t len);
+static gf256_madd_t gf256_madd_impl = gf256_madd_c;
+static const char *gf256_impl_name = "C";
+
+void gf256_xor_c(uint8_t *dst, const uint8_t *src, size_t len)
+{
+	size_t i;
+	uint64_t d, s;
+
+	for(i = 0; i + sizeof(uint64_t) <= len; i += sizeof(uint64_t))
+	{
+		memcpy(&d, dst + i, sizeof(uint64_t));
+		memcpy(&s, src + i, sizeof(uint64_t));
+		d ^= s;
+		memcpy(dst + i, &d, sizeof(uint64_t));
+	}
+	for(; i < len; i++)
+	{
+		dst[i] ^= src[i];
+	}
+}
+
+void gf256_madd_c(uint8_t *dst, const uint8_t *src, uint8_t c, size_t len)
+{
+	const uint8_t *lo = gf256_nibble_lo[c];
+	const uint8_t *hi = gf256_nibble_hi[c];
+	size_t i;
+
+	if(c == 1)
+	{
+		gf256_xor_c(dst, src, len);
+		return;
+	}
+	for(i = 0; i < len; i++)
+	{
+		dst[i] ^= lo[src[i] & 0x0f] ^ hi[src[i] >> 4];
+	}
+}
+
+#ifdef GF256_X86
+__attribute__((target("ssse3")))
+void gf256_madd_ssse3(uint8_t *dst, const uint8_t *src, uint8_t c, size_t len)
+{
+	const __m128i lo = _mm_loadu_si128((const __m128i *)gf256_nibble_lo[c]);
+	const __m128i hi = _mm_loadu_si128((const __m128i *)gf256_nibble_hi[c]);
+	const __m128i mask = _mm_set1_epi8(0x0f);
+	__m128i s, d, p;
+	size_t i;
+
+	for(i = 0; i + 16 <= len; i += 16)
+	{
+		s = _mm_loadu_si128((const __m128i *)(src + i));
+		d = _mm_loadu_si128((const __m128i *)(dst + i));
+		if(c == 1)
+		{
+			p = s;
+		}
+		else
+		{
+			p = _mm_xor_si128(_mm_shuffle_epi8(lo, _mm_and_si128(s, mask)),
+			                  _mm_shuffle_epi8(hi, _mm_and_si128(_mm_srli_epi64(s, 4), mask)));
+		}
+		_mm_storeu_si128((__m128i *)(dst + i), _mm_xor_si128(d, p));
+	}
+	gf256_madd_c(dst + i, src + i, c, len - i);
+}
+
+__attribute__((target("avx2")))
+void gf256_madd_avx2(uint8_t *dst, const uint8_t *src, uint8_t c, size_t len)
+{
+	const __m256i lo = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)gf256_nibble_lo[c]));
+	const __m256i hi = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)gf256_nibble_hi[c]));
+	const __m256i mask = _mm256_set1_epi8(0x0f);
+	__m256i s, d, p;
+	size_t i;
+
+	for(i = 0; i + 32 <= len; i += 32)
+	{
+		s = _mm256_loadu_si256((const __m256i *)(src + i));
+		d = _mm256_loadu_si256((const __m256i *)(dst + i));
+		if(c == 1)
+		{
+			p = s;
+		}
+		else
+		{
+			p = _mm256_xor_si256(_mm256_shuffle_epi8(lo, _mm256_and_si256(s, mask)),
+			                     _mm256_shuffle_epi8(hi, _mm256_and_si256(_mm256_srli_epi64(s, 4), mask)));
+		}
+		_mm256_storeu_si256((__m256i *)(dst + i), _mm256_xor_si256(d, p));
+	}
+	gf256_madd_c(dst + i, src + i, c, len - i);
+}
+#endif
+
+void gf256_init(void)
+{
+	unsigned int i, c, x = 1;
+
+	for(i = 0; i < 255; i++)
+	{
+		gf256_exp[i] = x;
+		gf256_log[x] = i;
+		x <<= 1;
+		if(x & 0x100)
+		{
+			x ^= GF256_POLY;
+		}
+	}
+	// Doubled so that the sum of two logarithms needs no modulo
+	for(i = 255; i < 512; i++)
+	{
+		gf256_exp[i] = gf256_exp[i - 255];
+	}
+	for(c = 0; c < 256; c++)
+	{
+		for(i = 0; i < 16; i++)
+		{
+			gf256_nibble_lo[c][i] = gf256_mul(c, i);
+			gf256_nibble_hi[c][i] = gf256_mul(c, i << 4);
+		}
+	}
+
+#ifdef GF256_X86
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("avx2"))
+	{
+		gf256_madd_impl = gf256_madd_avx2;
+		gf256_impl_name = "AVX2";
+	}
+	else if(__builtin_cpu_supports("ssse3"))
+	{
+		gf256_madd_impl = gf256_madd_ssse3;
+		gf256_impl_name = "SSSE3";
+	}
+#endif
+}
+
+const char *gf256_impl(void)
+{
+	return gf256_impl_name;
+}
+
+uint8_t gf256_mul(uint8_t a, uint8_t b)
+{
+	if(a == 0 || b == 0)
+	{
+		return 0;
+	}
+	return gf256_exp[gf256_log[a] + gf256_log[b]];
+}
+
+uint8_t gf256_inv(uint8_t a)
+{
+	return gf256_exp[255 - gf256_log[a]];
+}
+
+void gf256_madd(uint8_t *dst, const uint8_t *src, uint8_t c, size_t len)
+{
+	if(c == 0)
+	{
+		return;
+	}
+	gf256_madd_impl(dst, src, c, len);
+}
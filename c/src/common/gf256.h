@@ -0,0 +1,42 @@
+// Copyright 2023, Viveris Technologies
+// Distributed under the terms of the MIT License
+
+#ifndef __GF256_H__
+#define __GF256_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Arithmetic over GF(2^8), polynomial x^8 + x^4 + x^3 + x^2 + 1 (0x11d)
+ *
+ * The region operations pick the widest vector unit available at run time
+ * (AVX2, SSSE3 or plain C), gf256_init must be called once before any use.
+ */
+
+/**
+ * Build the tables and select the region operations
+ */
+void gf256_init(void);
+
+/**
+ * Get the name of the selected region operations implementation
+ */
+const char *gf256_impl(void);
+
+/**
+ * Multiply two elements
+ */
+uint8_t gf256_mul(uint8_t a, uint8_t b);
+
+/**
+ * Get the inverse of a non-zero element
+ */
+uint8_t gf256_inv(uint8_t a);
+
+/**
+ * Multiply a region by a constant and add it to another one: dst ^= c * src
+ */
+void gf256_madd(uint8_t *dst, const uint8_t *src, uint8_t c, size_t len);
+
+#endif
@@ -0,0 +1,81 @@
+// Copyright 2023, Viveris Technologies
+// Distributed under the terms of the MIT License
+
+#include <string.h>
+
+#include "gse_header.h"
+
+unsigned int gse_label_len(uint8_t label_type)
+{
+	switch(label_type)
+	{
+		case GSE_LT_6_BYTES:
+		return 6;
+
+		case GSE_LT_3_BYTES:
+		return 3;
+
+		default:
+		return 0;
+	}
+}
+
+int gse_parse_header(const unsigned char *buffer, size_t len, struct gse_header *hdr)
+{
+	size_t pos = GSE_FIXED_HEADER_LEN;
+
+	if(len < 1 || (buffer[0] & 0xf0) == 0)
+	{
+		// S = E = 0 and LT = 00: the rest of the frame is padding
+		return 1;
+	}
+	if(len < GSE_FIXED_HEADER_LEN)
+	{
+		return -1;
+	}
+	hdr->start = (buffer[0] >> 7) & 0x1;
+	hdr->end = (buffer[0] >> 6) & 0x1;
+	hdr->label_type = (buffer[0] >> 4) & 0x3;
+	hdr->packet_len = (((buffer[0] & 0x0f) << 8) | buffer[1]) + GSE_FIXED_HEADER_LEN;
+	if(hdr->packet_len > len)
+	{
+		return -1;
+	}
+
+	// Check the whole header lies inside the packet before reading it
+	hdr->label_len = hdr->start ? gse_label_len(hdr->label_type) : 0;
+	hdr->header_len = GSE_FIXED_HEADER_LEN + ((!hdr->start || !hdr->end) ? 1 : 0) +
+	                  ((hdr->start && !hdr->end) ? 2 : 0) +
+	                  (hdr->start ? 2 + hdr->label_len : 0);
+	if(hdr->header_len > hdr->packet_len ||
+	   (!hdr->start && hdr->end && hdr->header_len + GSE_CRC_LEN > hdr->packet_len))
+	{
+		return -1;
+	}
+
+	hdr->frag_id = 0;
+	if(!hdr->start || !hdr->end)
+	{
+		hdr->frag_id = buffer[pos++];
+	}
+	hdr->total_length = 0;
+	if(hdr->start && !hdr->end)
+	{
+		hdr->total_length = (buffer[pos] << 8) | buffer[pos + 1];
+		pos += 2;
+	}
+	hdr->protocol = 0;
+	if(hdr->start)
+	{
+		hdr->protocol = (buffer[pos] << 8) | buffer[pos + 1];
+		pos += 2;
+		memcpy(hdr->label, buffer + pos, hdr->label_len);
+	}
+	return 0;
+}
+
+int gse_complete_packet(const struct gse_header *hdr)
+{
+	return hdr->start && hdr->end && hdr->protocol >= GSE_PROTOCOL_MIN &&
+	       hdr->packet_len > hdr->header_len;
+}
@@ -0,0 +1,60 @@
+// Copyright 2023, Viveris Technologies
+// Distributed under the terms of the MIT License
+
+#ifndef __GSE_HEADER_H__
+#define __GSE_HEADER_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define GSE_FIXED_HEADER_LEN 2  // S, E, LT and GSE length fields
+#define GSE_FRAG_COUNT 256      // Number of fragment IDs
+#define GSE_CRC_LEN 4
+#define GSE_PROTOCOL_MIN 0x0600 // Lower values are extension headers
+
+// Label types
+#define GSE_LT_6_BYTES 0
+#define GSE_LT_3_BYTES 1
+#define GSE_LT_BROADCAST 2
+#define GSE_LT_REUSE 3
+
+/**
+ * Fields of a GSE packet header
+ */
+struct gse_header
+{
+	uint8_t start;
+	uint8_t end;
+	uint8_t label_type;
+	uint8_t frag_id;          // only if not both start and end
+	uint16_t total_length;    // only for a first fragment
+	uint16_t protocol;        // only for a start packet
+	uint8_t label_len;
+	uint8_t label[6];
+
+	uint16_t header_len;      // up to the label, extensions excluded
+	uint16_t packet_len;      // whole GSE packet
+};
+
+/**
+ * Parse the header of the GSE packet at the start of a buffer
+ *
+ * Return 0 on success, 1 if the buffer only holds padding, -1 if the packet is
+ * invalid or truncated
+ */
+int gse_parse_header(const unsigned char *buffer, size_t len, struct gse_header *hdr);
+
+/**
+ * Tell whether a parsed packet carries a whole PDU, without any extension
+ * header, that needs no reassembly
+ *
+ * Return 1 if so, 0 otherwise
+ */
+int gse_complete_packet(const struct gse_header *hdr);
+
+/**
+ * Get the label length of a label type
+ */
+unsigned int gse_label_len(uint8_t label_type);
+
+#endif
@@ -0,0 +1,146 @@
+// Copyright 2023, Viveris Technologies
+// Distributed under the terms of the MIT License
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "hugemem.h"
+
+// Buffers of the process, shared by all the threads but only mapped and
+// unmapped at startup and at exit
+static struct hugemem_region regions[HUGEMEM_MAX_REGIONS];
+static int enabled;
+static int locked;
+
+void hugemem_enable(void)
+{
+	enabled = 1;
+}
+
+int hugemem_lock(void)
+{
+	if(mlockall(MCL_CURRENT | MCL_FUTURE) != 0)
+	{
+		fprintf(stderr, "Memory locking failed: %s (%d), check the RLIMIT_MEMLOCK limit or the CAP_IPC_LOCK "
+		        "capability\n", strerror(errno), errno);
+		return -1;
+	}
+	locked = 1;
+	return 0;
+}
+
+/**
+ * Map len bytes on hugepages, or on regular pages when there are none left
+ *
+ * Return the mapping on success, MAP_FAILED otherwise
+ */
+void *hugemem_map(size_t len, struct hugemem_region *region)
+{
+	size_t page_len = sysconf(_SC_PAGESIZE);
+	void *addr;
+
+	region->len = (len + HUGEMEM_PAGE_LEN - 1) & ~((size_t)HUGEMEM_PAGE_LEN - 1);
+	addr = mmap(NULL, region->len, PROT_READ | PROT_WRITE,
+	            MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_POPULATE, -1, 0);
+	if(addr != MAP_FAILED)
+	{
+		region->huge = 1;
+		return addr;
+	}
+
+	region->len = (len + page_len - 1) & ~(page_len - 1);
+	region->huge = 0;
+	addr = mmap(NULL, region->len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if(addr == MAP_FAILED)
+	{
+		return MAP_FAILED;
+	}
+	// The advice must come before the pages are faulted in
+	madvise(addr, region->len, MADV_HUGEPAGE);
+	memset(addr, 0, region->len);
+	return addr;
+}
+
+void *hugemem_alloc(size_t len)
+{
+	struct hugemem_region *region = NULL;
+	int i;
+
+	if(!enabled)
+	{
+		return malloc(len);
+	}
+	for(i = 0; i < HUGEMEM_MAX_REGIONS && region == NULL; i++)
+	{
+		if(regions[i].addr == NULL)
+		{
+			region = &(regions[i]);
+		}
+	}
+	if(region == NULL)
+	{
+		fprintf(stderr, "Memory mapping failed: more than %d buffers\n", HUGEMEM_MAX_REGIONS);
+		return NULL;
+	}
+	if((region->addr = hugemem_map(len, region)) == MAP_FAILED)
+	{
+		fprintf(stderr, "Memory mapping of %zu bytes failed: %s (%d)\n", len, strerror(errno), errno);
+		region->addr = NULL;
+		return NULL;
+	}
+	return region->addr;
+}
+
+void hugemem_free(void *addr)
+{
+	int i;
+
+	if(addr == NULL)
+	{
+		return;
+	}
+	for(i = 0; i < HUGEMEM_MAX_REGIONS; i++)
+	{
+		if(regions[i].addr == addr)
+		{
+			munmap(addr, regions[i].len);
+			regions[i].addr = NULL;
+			return;
+		}
+	}
+	free(addr);
+}
+
+void hugemem_print_stats(void)
+{
+	size_t huge_len = 0, page_len = 0;
+	int buffers = 0;
+	int i;
+
+	if(!enabled)
+	{
+		return;
+	}
+	for(i = 0; i < HUGEMEM_MAX_REGIONS; i++)
+	{
+		if(regions[i].addr == NULL)
+		{
+			continue;
+		}
+		buffers++;
+		if(regions[i].huge)
+		{
+			huge_len += regions[i].len;
+		}
+		else
+		{
+			page_len += regions[i].len;
+		}
+	}
+	fprintf(stdout, "Memory mapped up front: %d buffers, %zu kB on hugepages, %zu kB on regular pages, %s\n",
+	        buffers, huge_len / 1024, page_len / 1024, locked ? "locked" : "not locked");
+}
@@ -0,0 +1,57 @@
+// Copyright 2023, Viveris Technologies
+// Distributed under the terms of the MIT License
+
+#ifndef __HUGEMEM_H__
+#define __HUGEMEM_H__
+
+#include <stddef.h>
+
+#define HUGEMEM_PAGE_LEN (2 * 1024 * 1024)
+
+// Buffers mapped at once, each one from its own mapping
+#define HUGEMEM_MAX_REGIONS 64
+
+/**
+ * Buffer mapped by hugemem_alloc()
+ */
+struct hugemem_region
+{
+	void *addr;
+	size_t len;
+	int huge;
+};
+
+/**
+ * Map the next buffers of hugemem_alloc() up front instead of leaving them
+ * to the heap: each one is faulted in before being handed out, on 2 MiB
+ * hugepages when the system has some reserved, on regular pages advised
+ * for transparent hugepages otherwise
+ */
+void hugemem_enable(void);
+
+/**
+ * Lock the current and future memory of the process in RAM
+ *
+ * Return 0 on success, -1 otherwise
+ */
+int hugemem_lock(void);
+
+/**
+ * Allocate a buffer of len bytes, from the heap unless hugemem_enable()
+ * was called
+ *
+ * Return the buffer on success, NULL otherwise
+ */
+void *hugemem_alloc(size_t len);
+
+/**
+ * Free a buffer of hugemem_alloc(), nothing is done for NULL
+ */
+void hugemem_free(void *addr);
+
+/**
+ * Print the memory mapped up front, when enabled
+ */
+void hugemem_print_stats(void);
+
+#endif
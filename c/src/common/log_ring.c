@@ -0,0 +1,306 @@
+// Copyright 2023, Viveris Technologies
+// Distributed under the terms of the MIT License
+
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "log_ring.h"
+
+#define LOG_RING_PERIOD 10000000 // ns between two polls of the ring
+#define LOG_LINE_LEN 512
+
+// Single logger of the process, shared by all the threads
+static struct log_ring logger;
+
+/**
+ * Format a message into a line, the length modifiers of the integer
+ * conversions are replaced to match the 64 bits arguments
+ */
+void log_format(char *line, size_t capa, const char *format, const uint64_t *args)
+{
+	const char *p = format, *start;
+	char spec[32];
+	size_t len = 0, spec_len;
+	unsigned int arg = 0;
+	int ret = 0;
+
+	while(*p != '\0' && len + 1 < capa)
+	{
+		if(*p != '%' || p[1] == '%')
+		{
+			line[len++] = *p;
+			p += *p == '%' ? 2 : 1;
+			continue;
+		}
+
+		// Flags, width and precision are kept
+		start = p++;
+		while(*p != '\0' && strchr("-+ #0123456789.", *p) != NULL)
+		{
+			p++;
+		}
+		spec_len = p - start;
+		while(*p != '\0' && strchr("hlLqjzt", *p) != NULL)
+		{
+			p++;
+		}
+		if(*p == '\0' || spec_len + 4 > sizeof(spec) || arg >= LOG_RING_MAX_ARGS)
+		{
+			break;
+		}
+		memcpy(spec, start, spec_len);
+		switch(*p)
+		{
+			case 's':
+			memcpy(spec + spec_len, "s", 2);
+			ret = snprintf(line + len, capa - len, spec, (const char *)(uintptr_t)args[arg++]);
+			break;
+
+			case 'd':
+			case 'i':
+			memcpy(spec + spec_len, "lld", 4);
+			ret = snprintf(line + len, capa - len, spec, (long long)(int64_t)args[arg++]);
+			break;
+
+			case 'u':
+			case 'x':
+			case 'X':
+			case 'o':
+			memcpy(spec + spec_len, "ll", 2);
+			spec[spec_len + 2] = *p;
+			spec[spec_len + 3] = '\0';
+			ret = snprintf(line + len, capa - len, spec, (unsigned long long)args[arg++]);
+			break;
+
+			default:
+			ret = 0;
+			break;
+		}
+		if(ret > 0)
+		{
+			len += (size_t)ret < capa - len ? (size_t)ret : capa - len - 1;
+		}
+		p++;
+	}
+	line[len] = '\0';
+}
+
+void log_print(unsigned int type, const uint64_t *args)
+{
+	char line[LOG_LINE_LEN];
+
+	log_format(line, sizeof(line), logger.types[type].format, args);
+	fputs(line, stderr);
+}
+
+/**
+ * Count a message against the rate limit of its type
+ *
+ * Return 1 when the message may be printed, 0 otherwise
+ */
+int log_allow(unsigned int type)
+{
+	struct log_limit *limit = &(logger.limits[type]);
+	struct timespec now;
+	uint64_t last;
+
+	if(logger.types[type].limit == 0)
+	{
+		return 1;
+	}
+	clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+	last = atomic_load_explicit(&(limit->second), memory_order_relaxed);
+	if(last != (uint64_t)now.tv_sec &&
+	   atomic_compare_exchange_strong(&(limit->second), &last, (uint64_t)now.tv_sec))
+	{
+		atomic_store_explicit(&(limit->count), 0, memory_order_relaxed);
+	}
+	if(atomic_fetch_add_explicit(&(limit->count), 1, memory_order_relaxed) < logger.types[type].limit)
+	{
+		return 1;
+	}
+	atomic_fetch_add_explicit(&(limit->suppressed), 1, memory_order_relaxed);
+	return 0;
+}
+
+/**
+ * Print the counts of the messages left out since the last report
+ */
+void log_report(void)
+{
+	const char *format;
+	unsigned int type, count;
+
+	for(type = 0; type < logger.type_count; type++)
+	{
+		if((count = atomic_exchange(&(logger.limits[type].suppressed), 0)) > 0)
+		{
+			format = logger.types[type].format;
+			fprintf(stderr, "%u messages suppressed: \"%.*s\"\n", count, (int)strcspn(format, "\n"), format);
+		}
+	}
+	if((count = atomic_exchange(&(logger.dropped), 0)) > 0)
+	{
+		fprintf(stderr, "%u messages dropped: log ring full\n", count);
+	}
+}
+
+/**
+ * Print the messages of the ring (consumer side)
+ */
+void log_drain(void)
+{
+	struct log_record *rec;
+
+	for(;;)
+	{
+		rec = &(logger.records[logger.head & logger.mask]);
+		if(atomic_load_explicit(&(rec->seq), memory_order_acquire) != logger.head + 1)
+		{
+			break;
+		}
+		log_print(rec->type, rec->args);
+		atomic_store_explicit(&(rec->seq), logger.head + logger.mask + 1, memory_order_release);
+		logger.head++;
+	}
+}
+
+void *log_thread(__attribute__((unused)) void *arg)
+{
+	struct timespec period = {0, LOG_RING_PERIOD};
+	unsigned int ticks = 0;
+
+	while(atomic_load(&(logger.running)))
+	{
+		log_drain();
+		if(++ticks * (uint64_t)LOG_RING_PERIOD >= 1000000000)
+		{
+			log_report();
+			ticks = 0;
+		}
+		nanosleep(&period, NULL);
+	}
+	log_drain();
+	log_report();
+	return NULL;
+}
+
+int log_ring_start(const struct log_type *types, unsigned int type_count, size_t size)
+{
+	sigset_t sigmask, oldmask;
+	size_t capa = 1, i;
+	int ret;
+
+	free(logger.limits);
+	if((logger.limits = (struct log_limit *)calloc(type_count, sizeof(struct log_limit))) == NULL)
+	{
+		return -1;
+	}
+	logger.types = types;
+	logger.type_count = type_count;
+	if(size == 0)
+	{
+		return 0;
+	}
+
+	while(capa < size)
+	{
+		capa <<= 1;
+	}
+	if((logger.records = (struct log_record *)malloc(capa * sizeof(struct log_record))) == NULL)
+	{
+		return -1;
+	}
+	for(i = 0; i < capa; i++)
+	{
+		atomic_init(&(logger.records[i].seq), i);
+	}
+	logger.mask = capa - 1;
+	logger.head = 0;
+	atomic_init(&(logger.tail), 0);
+	atomic_init(&(logger.dropped), 0);
+	atomic_init(&(logger.running), 1);
+
+	// The stop signals are left to the processing threads
+	sigfillset(&sigmask);
+	pthread_sigmask(SIG_BLOCK, &sigmask, &oldmask);
+	ret = pthread_create(&(logger.thread), NULL, log_thread, NULL);
+	pthread_sigmask(SIG_SETMASK, &oldmask, NULL);
+	if(ret != 0)
+	{
+		fprintf(stderr, "Function pthread_create failed: %s (%d)\n", strerror(ret), ret);
+		free(logger.records);
+		logger.records = NULL;
+		return -1;
+	}
+	return 0;
+}
+
+void log_ring_stop(void)
+{
+	if(logger.records == NULL)
+	{
+		return;
+	}
+	atomic_store(&(logger.running), 0);
+	pthread_join(logger.thread, NULL);
+	free(logger.records);
+	logger.records = NULL;
+}
+
+void log_ring_write(unsigned int type, ...)
+{
+	struct log_record *rec;
+	uint64_t args[LOG_RING_MAX_ARGS] = {0};
+	unsigned int i;
+	size_t pos, seq;
+	va_list ap;
+
+	if(type >= logger.type_count || !log_allow(type))
+	{
+		return;
+	}
+	va_start(ap, type);
+	for(i = 0; i < logger.types[type].argc && i < LOG_RING_MAX_ARGS; i++)
+	{
+		args[i] = va_arg(ap, uint64_t);
+	}
+	va_end(ap);
+	if(logger.records == NULL)
+	{
+		log_print(type, args);
+		return;
+	}
+
+	// Claim the record at the tail, unless the consumer has not freed it yet
+	pos = atomic_load_explicit(&(logger.tail), memory_order_relaxed);
+	for(;;)
+	{
+		rec = &(logger.records[pos & logger.mask]);
+		seq = atomic_load_explicit(&(rec->seq), memory_order_acquire);
+		if(seq == pos)
+		{
+			if(atomic_compare_exchange_weak_explicit(&(logger.tail), &pos, pos + 1,
+			                                         memory_order_relaxed, memory_order_relaxed))
+			{
+				break;
+			}
+		}
+		else if((intptr_t)(seq - pos) < 0)
+		{
+			atomic_fetch_add_explicit(&(logger.dropped), 1, memory_order_relaxed);
+			return;
+		}
+		else
+		{
+			pos = atomic_load_explicit(&(logger.tail), memory_order_relaxed);
+		}
+	}
+	rec->type = type;
+	memcpy(rec->args, args, sizeof(args));
+	atomic_store_explicit(&(rec->seq), pos + 1, memory_order_release);
+}
@@ -0,0 +1,100 @@
+// Copyright 2023, Viveris Technologies
+// Distributed under the terms of the MIT License
+
+#ifndef __LOG_RING_H__
+#define __LOG_RING_H__
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ring.h"
+
+#define LOG_RING_MAX_ARGS 4
+
+// Arguments of a message, each one stored on 64 bits
+#define LOG_INT(x) ((uint64_t)(int64_t)(x))
+#define LOG_STR(s) ((uint64_t)(uintptr_t)(s))
+
+/**
+ * Type of message: a printf format of up to LOG_RING_MAX_ARGS integer or
+ * string conversions, and the number of messages printed per second, all
+ * of them when 0. Strings must outlive the message, like the static ones
+ * of strerror() or gse_get_status().
+ */
+struct log_type
+{
+	const char *format;
+	unsigned int argc;
+	unsigned int limit;
+};
+
+/**
+ * Rate limit state of a type of message
+ */
+struct log_limit
+{
+	_Atomic uint64_t second;
+	atomic_uint count;
+	atomic_uint suppressed;
+};
+
+/**
+ * Binary record of a message
+ */
+struct log_record
+{
+	_Atomic size_t seq;
+	unsigned int type;
+	uint64_t args[LOG_RING_MAX_ARGS];
+};
+
+/**
+ * Lock-free multiple-producer single-consumer ring of binary messages
+ *
+ * The producers only store the type and the arguments of a message into a
+ * free record, a background thread formats and prints them to stderr. A
+ * message is dropped when the ring is full or when its type exceeds its
+ * rate limit, the counts of the messages left out are printed every second.
+ */
+struct log_ring
+{
+	// Producers side
+	_Atomic size_t tail __attribute__((aligned(RING_CACHE_LINE)));
+	atomic_uint dropped;
+
+	// Consumer side
+	size_t head __attribute__((aligned(RING_CACHE_LINE)));
+	pthread_t thread;
+	atomic_int running;
+
+	// Shared read-only part
+	size_t mask __attribute__((aligned(RING_CACHE_LINE)));
+	struct log_record *records;
+	const struct log_type *types;
+	struct log_limit *limits;
+	unsigned int type_count;
+};
+
+/**
+ * Set the types of messages and start the logging thread with a ring of at
+ * least size records, the messages are printed at once when size is 0
+ *
+ * Return 0 on success, -1 otherwise
+ */
+int log_ring_start(const struct log_type *types, unsigned int type_count, size_t size);
+
+/**
+ * Print the messages left and stop the logging thread, the next messages
+ * are printed at once
+ */
+void log_ring_stop(void);
+
+/**
+ * Log a message of a type, followed by its arguments given by LOG_INT()
+ * or LOG_STR(), nothing is logged before log_ring_start()
+ */
+void log_ring_write(unsigned int type, ...);
+
+#endif
@@ -0,0 +1,244 @@
+// Copyright 2023, Viveris Technologies
+// Distributed under the terms of the MIT License
+
+#include <errno.h>
+#include <linux/perf_event.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "perf_counters.h"
+
+static const uint64_t perf_events[PERF_EVENT_COUNT] = {
+	PERF_COUNT_HW_CPU_CYCLES,
+	PERF_COUNT_HW_INSTRUCTIONS,
+	PERF_COUNT_HW_CACHE_MISSES,
+	PERF_COUNT_HW_BRANCH_MISSES,
+};
+
+static const char *perf_event_names[PERF_EVENT_COUNT] = {
+	"cycles",
+	"instructions",
+	"cache misses",
+	"branch misses",
+};
+
+static const char *perf_bucket_names[PERF_SIZE_BUCKETS] = {
+	"0-127 bytes",
+	"128-255 bytes",
+	"256-511 bytes",
+	"512-1023 bytes",
+	"1024-1518 bytes",
+	"1519+ bytes",
+};
+
+int perf_open(uint64_t config, int group_fd, int user_only)
+{
+	struct perf_event_attr attr;
+
+	memset(&attr, 0, sizeof(struct perf_event_attr));
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.size = sizeof(struct perf_event_attr);
+	attr.config = config;
+	attr.disabled = group_fd < 0;
+	attr.exclude_kernel = user_only;
+	attr.exclude_hv = 1;
+	attr.read_format = PERF_FORMAT_GROUP;
+	return syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0);
+}
+
+struct perf_counters *perf_counters_create(const char **names, unsigned int stage_count, unsigned int period)
+{
+	struct perf_counters *perf;
+	int i;
+
+	if((perf = (struct perf_counters *)calloc(1, sizeof(struct perf_counters))) == NULL)
+	{
+		return NULL;
+	}
+	if((perf->stats = (struct perf_stage_stats *)calloc(stage_count * PERF_SIZE_BUCKETS,
+	                                                    sizeof(struct perf_stage_stats))) == NULL)
+	{
+		free(perf);
+		return NULL;
+	}
+	perf->names = names;
+	perf->stage_count = stage_count;
+	perf->period = period > 0 ? period : 1;
+
+	// The kernel side, where the syscalls are spent, may not be allowed
+	if((perf->fds[0] = perf_open(perf_events[0], -1, 0)) < 0 &&
+	   (errno == EACCES || errno == EPERM))
+	{
+		perf->user_only = 1;
+		perf->fds[0] = perf_open(perf_events[0], -1, 1);
+	}
+	if(perf->fds[0] < 0)
+	{
+		fprintf(stderr, "Hardware counters opening failed: %s (%d)\n", strerror(errno), errno);
+		free(perf->stats);
+		free(perf);
+		return NULL;
+	}
+	perf->event_count = 1;
+
+	// Events missing from the PMU are only left out
+	for(i = 1; i < PERF_EVENT_COUNT; i++)
+	{
+		if((perf->fds[i] = perf_open(perf_events[i], perf->fds[0], perf->user_only)) >= 0)
+		{
+			perf->event_count++;
+		}
+	}
+	ioctl(perf->fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+	ioctl(perf->fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+	return perf;
+}
+
+void perf_counters_delete(struct perf_counters *perf)
+{
+	int i;
+
+	if(perf == NULL)
+	{
+		return;
+	}
+	for(i = PERF_EVENT_COUNT - 1; i >= 0; i--)
+	{
+		if(perf->fds[i] >= 0)
+		{
+			close(perf->fds[i]);
+		}
+	}
+	free(perf->stats);
+	free(perf);
+}
+
+/**
+ * Read the counters, in the order of the events, 0 for a missing one
+ */
+void perf_read(struct perf_counters *perf, uint64_t *values)
+{
+	uint64_t buf[1 + PERF_EVENT_COUNT];
+	int i, pos = 1;
+
+	if(read(perf->fds[0], buf, (1 + perf->event_count) * sizeof(uint64_t)) < 0)
+	{
+		memset(values, 0, PERF_EVENT_COUNT * sizeof(uint64_t));
+		return;
+	}
+	for(i = 0; i < PERF_EVENT_COUNT; i++)
+	{
+		values[i] = perf->fds[i] >= 0 ? buf[pos++] : 0;
+	}
+}
+
+void perf_counters_start(struct perf_counters *perf)
+{
+	if(perf == NULL)
+	{
+		return;
+	}
+	if(perf->depth == 0)
+	{
+		perf->skip = (perf->tick++ % perf->period) != 0;
+	}
+	if(!perf->skip && perf->depth < PERF_MAX_DEPTH)
+	{
+		memset(perf->nested[perf->depth], 0, sizeof(perf->nested[perf->depth]));
+		perf_read(perf, perf->start[perf->depth]);
+	}
+	perf->depth++;
+}
+
+unsigned int perf_bucket(size_t len)
+{
+	if(len < 128)
+	{
+		return 0;
+	}
+	if(len < 256)
+	{
+		return 1;
+	}
+	if(len < 512)
+	{
+		return 2;
+	}
+	if(len < 1024)
+	{
+		return 3;
+	}
+	return len <= 1518 ? 4 : 5;
+}
+
+void perf_counters_stop(struct perf_counters *perf, unsigned int stage, size_t len)
+{
+	struct perf_stage_stats *stats;
+	uint64_t now[PERF_EVENT_COUNT];
+	uint64_t delta;
+	int depth;
+	int i;
+
+	if(perf == NULL)
+	{
+		return;
+	}
+	depth = --perf->depth;
+	if(perf->skip || depth >= PERF_MAX_DEPTH)
+	{
+		return;
+	}
+	perf_read(perf, now);
+	stats = &(perf->stats[stage * PERF_SIZE_BUCKETS + perf_bucket(len)]);
+	stats->calls++;
+	for(i = 0; i < PERF_EVENT_COUNT; i++)
+	{
+		delta = now[i] - perf->start[depth][i];
+		stats->values[i] += delta - perf->nested[depth][i];
+		if(depth > 0)
+		{
+			perf->nested[depth - 1][i] += delta;
+		}
+	}
+}
+
+void perf_counters_print_stats(struct perf_counters *perf)
+{
+	struct perf_stage_stats *stats;
+	unsigned int stage, bucket;
+	int i;
+
+	fprintf(stdout, "Hardware counters per call (%s, 1 outermost call in %u measured)\n",
+	        perf->user_only ? "user space only" : "user and kernel space", perf->period);
+	for(stage = 0; stage < perf->stage_count; stage++)
+	{
+		fprintf(stdout, "  - %s\n", perf->names[stage]);
+		for(bucket = 0; bucket < PERF_SIZE_BUCKETS; bucket++)
+		{
+			stats = &(perf->stats[stage * PERF_SIZE_BUCKETS + bucket]);
+			if(stats->calls == 0)
+			{
+				continue;
+			}
+			fprintf(stdout, "    - %-16s %lu calls", perf_bucket_names[bucket], stats->calls);
+			for(i = 0; i < PERF_EVENT_COUNT; i++)
+			{
+				if(perf->fds[i] < 0)
+				{
+					fprintf(stdout, ", n/a %s", perf_event_names[i]);
+					continue;
+				}
+				fprintf(stdout, ", %.0f %s", (double)stats->values[i] / stats->calls, perf_event_names[i]);
+			}
+			if(stats->values[0] > 0 && perf->fds[1] >= 0)
+			{
+				fprintf(stdout, " (IPC %.2f)", (double)stats->values[1] / stats->values[0]);
+			}
+			fprintf(stdout, "\n");
+		}
+	}
+}
@@ -0,0 +1,84 @@
+// Copyright 2023, Viveris Technologies
+// Distributed under the terms of the MIT License
+
+#ifndef __PERF_COUNTERS_H__
+#define __PERF_COUNTERS_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Cycles, instructions, cache misses and branch misses
+#define PERF_EVENT_COUNT 4
+
+// Packet sizes up to 127, 255, 511, 1023, 1518 bytes and beyond
+#define PERF_SIZE_BUCKETS 6
+
+// Stages nested in another one, whose counts are left out of the outer one
+#define PERF_MAX_DEPTH 4
+
+/**
+ * Counts of a stage for a packet size bucket
+ */
+struct perf_stage_stats
+{
+	uint64_t calls;
+	uint64_t values[PERF_EVENT_COUNT];
+};
+
+/**
+ * Hardware counters of the calling thread, accounted to processing stages
+ *
+ * The counters are a single perf_event group read at once at the start and
+ * at the stop of a stage. One outermost stage in every period is measured,
+ * the stages nested into it are measured along.
+ */
+struct perf_counters
+{
+	int fds[PERF_EVENT_COUNT];
+	int event_count;
+	int user_only;
+
+	unsigned int period;
+	unsigned int tick;
+
+	unsigned int stage_count;
+	const char **names;
+	struct perf_stage_stats *stats;
+
+	// Stages in progress
+	int depth;
+	int skip;
+	uint64_t start[PERF_MAX_DEPTH][PERF_EVENT_COUNT];
+	uint64_t nested[PERF_MAX_DEPTH][PERF_EVENT_COUNT];
+};
+
+/**
+ * Open the hardware counters of the calling thread for stages named by
+ * names, measuring one outermost stage in every period
+ *
+ * Return the counters on success, NULL otherwise
+ */
+struct perf_counters *perf_counters_create(const char **names, unsigned int stage_count, unsigned int period);
+
+/**
+ * Close the hardware counters
+ */
+void perf_counters_delete(struct perf_counters *perf);
+
+/**
+ * Start a stage, nothing is done without counters
+ */
+void perf_counters_start(struct perf_counters *perf);
+
+/**
+ * Stop the last stage started, accounting it for a packet of len bytes,
+ * nothing is done without counters
+ */
+void perf_counters_stop(struct perf_counters *perf, unsigned int stage, size_t len);
+
+/**
+ * Print the counts per call of each stage and packet size bucket
+ */
+void perf_counters_print_stats(struct perf_counters *perf);
+
+#endif
@@ -1,21 +1,22 @@
 // Copyright 2023, Viveris Technologies
 // Distributed under the terms of the MIT License
 
+#include <endian.h>
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
 
 #include "pkt_header.h"
 
-uint64_t compile_mac_address(uint8_t byte0, uint8_t byte1, uint8_t byte2, uint8_t byte3, uint8_t byte4, uint8_t byte5)
+/**
+ * Read a MAC address, in one load rather than a byte at a time
+ */
+static inline uint64_t read_mac_address(const unsigned char *buffer)
 {
-	uint64_t addr = byte0;
-	addr = (addr << 8) + byte1;
-	addr = (addr << 8) + byte2;
-	addr = (addr << 8) + byte3;
-	addr = (addr << 8) + byte4;
-	addr = (addr << 8) + byte5;
-	return addr;
+	uint64_t addr = 0;
+
+	memcpy((uint8_t *)&addr + 2, buffer, 6);
+	return be64toh(addr);
 }
 
 void mac_address_str(uint64_t addr, char* str)
@@ -39,27 +40,20 @@ int parse_mac_header(unsigned char* buffer, unsigned int len, struct pkt_header*
 {
 	uint16_t type;
 
+	// On the path of every frame: the callers report the short ones
 	if(len < MIN_MAC_PKT_SIZE)
 	{
-		fprintf(stderr, "The packet (%u bytes) is smaller than the Ethernet minimal length (%u bytes)\n", len, MIN_MAC_PKT_SIZE);
 		return -1;
 	}
 
-	// Check packet is the Ethernet type
-	type = (buffer[12] << 8) + buffer[13];
-
 	// Extract src, dst and qos to create encap id
-	pkth->dst = compile_mac_address(buffer[0], buffer[1], buffer[2], \
-			buffer[3], buffer[4], buffer[5]);
-	pkth->src = compile_mac_address(buffer[6], buffer[7], buffer[8], \
-			buffer[9], buffer[10], buffer[11]);
-	if(type == 0x8100) // 802.1Q
+	memcpy(&type, buffer + 12, 2);
+	type = be16toh(type);
+	pkth->dst = read_mac_address(buffer);
+	pkth->src = read_mac_address(buffer + 6);
+	if(type == 0x8100 || type == 0x88A8 || type == 0x9100) // 802.1Q, 802.1AD (Q in Q)
 	{
-		pkth->qos = (buffer[14] >> 1) & 0x7; // PCP
-	}
-	else if(type == 0x88A8 || type == 0x9100) // 802.1AD (Q in Q)
-	{
-		pkth->qos = (buffer[16] >> 1) & 0x7; // PCP
+		pkth->qos = buffer[14] >> 5; // PCP of the outer tag
 	}
 	else
 	{
@@ -68,11 +62,6 @@ int parse_mac_header(unsigned char* buffer, unsigned int len, struct pkt_header*
 	return 0;
 }
 
-uint32_t compile_ipv4_address(uint8_t byte0, uint8_t byte1, uint8_t byte2, uint8_t byte3)
-{
-	return (uint32_t)(byte0 << 24) + (byte1 << 16) + (byte2 << 8) + byte3;
-}
-
 void ipv4_address_str(uint32_t addr, char* str)
 {
 	uint8_t b0, b1, b2, b3;
@@ -85,24 +74,19 @@ void ipv4_address_str(uint32_t addr, char* str)
 
 int parse_ipv4_header(unsigned char* buffer, unsigned int len, struct pkt_header* pkth)
 {
-	unsigned int version;
+	uint32_t addr;
 
 	// Check packet is an IPv4 packet
-	version = (buffer[0] & 0xf0) >> 4;
-	if(version != 4)
-	{
-		fprintf(stderr, "The packet is not an IPv4 packet (version %u)\n", version);
-		return -1;
-	}
-	else if(len < MIN_IP_PKT_SIZE)
+	if(len < MIN_IP_PKT_SIZE || (buffer[0] >> 4) != 4)
 	{
-		fprintf(stderr, "The packet (%u bytes) is smaller than the IPv4 minimal length (%u bytes)\n", len, MIN_IP_PKT_SIZE);
 		return -1;
 	}
 
 	// Extract src, dst and qos to create encap id
-	pkth->src = compile_ipv4_address(buffer[12], buffer[13], buffer[14], buffer[15]);
-	pkth->dst = compile_ipv4_address(buffer[16], buffer[17], buffer[18], buffer[19]);
+	memcpy(&addr, buffer + 12, 4);
+	pkth->src = be32toh(addr);
+	memcpy(&addr, buffer + 16, 4);
+	pkth->dst = be32toh(addr);
 	pkth->qos = buffer[1] >> 2; // DSCP
 	return 0;
 }
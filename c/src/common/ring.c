@@ -0,0 +1,195 @@
+// Copyright 2023, Viveris Technologies
+// Distributed under the terms of the MIT License
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include "ring.h"
+
+size_t ring_used(struct ring *ring)
+{
+	return atomic_load_explicit(&(ring->tail), memory_order_acquire) -
+		atomic_load_explicit(&(ring->head), memory_order_acquire);
+}
+
+void ring_notify(int fd, atomic_int *waiting)
+{
+	uint64_t val = 1;
+
+	// Pairs with the flag store of the waiting side
+	atomic_thread_fence(memory_order_seq_cst);
+	if(atomic_load_explicit(waiting, memory_order_relaxed) != 0)
+	{
+		if(write(fd, &val, sizeof(val)) < 0 && errno != EAGAIN)
+		{
+			fprintf(stderr, "Function write failed: %s (%d)\n", strerror(errno), errno);
+		}
+	}
+}
+
+int ring_wait(int fd, atomic_int *waiting, const struct timespec *timeout)
+{
+	struct pollfd pfd;
+	uint64_t val;
+	int ret;
+
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+	pfd.revents = 0;
+	ret = ppoll(&pfd, 1, timeout, NULL);
+	atomic_store(waiting, 0);
+	if(ret < 0)
+	{
+		if(errno == EINTR)
+		{
+			return 1;
+		}
+		fprintf(stderr, "Function ppoll failed: %s (%d)\n", strerror(errno), errno);
+		return -1;
+	}
+	if(ret == 0)
+	{
+		return 1;
+	}
+	// Reset the eventfd counter, the wakeup may be spurious
+	if(read(fd, &val, sizeof(val)) < 0 && errno != EAGAIN)
+	{
+		fprintf(stderr, "Function read failed: %s (%d)\n", strerror(errno), errno);
+		return -1;
+	}
+	return 0;
+}
+
+struct ring *ring_create(size_t size)
+{
+	struct ring *ring;
+	size_t capa = 1;
+
+	while(capa < size)
+	{
+		capa <<= 1;
+	}
+	if((ring = (struct ring *)aligned_alloc(RING_CACHE_LINE, sizeof(struct ring))) == NULL)
+	{
+		return NULL;
+	}
+	memset(ring, 0, sizeof(struct ring));
+	ring->mask = capa - 1;
+	if((ring->slots = (void **)calloc(capa, sizeof(void *))) == NULL)
+	{
+		free(ring);
+		return NULL;
+	}
+	if((ring->data_fd = eventfd(0, EFD_NONBLOCK)) < 0)
+	{
+		fprintf(stderr, "Function eventfd failed: %s (%d)\n", strerror(errno), errno);
+		free(ring->slots);
+		free(ring);
+		return NULL;
+	}
+	if((ring->space_fd = eventfd(0, EFD_NONBLOCK)) < 0)
+	{
+		fprintf(stderr, "Function eventfd failed: %s (%d)\n", strerror(errno), errno);
+		close(ring->data_fd);
+		free(ring->slots);
+		free(ring);
+		return NULL;
+	}
+	return ring;
+}
+
+void ring_delete(struct ring *ring)
+{
+	if(ring == NULL)
+	{
+		return;
+	}
+	close(ring->space_fd);
+	close(ring->data_fd);
+	free(ring->slots);
+	free(ring);
+}
+
+size_t ring_capacity(struct ring *ring)
+{
+	return ring->mask + 1;
+}
+
+int ring_push(struct ring *ring, void *ptr)
+{
+	size_t tail = atomic_load_explicit(&(ring->tail), memory_order_relaxed);
+	size_t head = atomic_load_explicit(&(ring->head), memory_order_acquire);
+
+	if(tail - head > ring->mask)
+	{
+		return 1;
+	}
+	ring->slots[tail & ring->mask] = ptr;
+	atomic_store_explicit(&(ring->tail), tail + 1, memory_order_release);
+	if(tail + 1 - head > ring->max_used)
+	{
+		ring->max_used = tail + 1 - head;
+	}
+	ring_notify(ring->data_fd, &(ring->data_waiting));
+	return 0;
+}
+
+int ring_pop(struct ring *ring, void **ptr)
+{
+	size_t head = atomic_load_explicit(&(ring->head), memory_order_relaxed);
+	size_t tail = atomic_load_explicit(&(ring->tail), memory_order_acquire);
+
+	if(head == tail)
+	{
+		return 1;
+	}
+	*ptr = ring->slots[head & ring->mask];
+	atomic_store_explicit(&(ring->head), head + 1, memory_order_release);
+	ring_notify(ring->space_fd, &(ring->space_waiting));
+	return 0;
+}
+
+int ring_wait_data(struct ring *ring, const struct timespec *timeout)
+{
+	if(ring_used(ring) != 0)
+	{
+		return 0;
+	}
+	ring->empty_count++;
+	atomic_store(&(ring->data_waiting), 1);
+	// Check again to not miss a push done before the flag was raised
+	if(ring_used(ring) != 0)
+	{
+		atomic_store(&(ring->data_waiting), 0);
+		return 0;
+	}
+	return ring_wait(ring->data_fd, &(ring->data_waiting), timeout);
+}
+
+void ring_wake(struct ring *ring)
+{
+	ring_notify(ring->data_fd, &(ring->data_waiting));
+}
+
+int ring_wait_space(struct ring *ring, const struct timespec *timeout)
+{
+	if(ring_used(ring) <= ring->mask)
+	{
+		return 0;
+	}
+	ring->full_count++;
+	atomic_store(&(ring->space_waiting), 1);
+	// Check again to not miss a pop done before the flag was raised
+	if(ring_used(ring) <= ring->mask)
+	{
+		atomic_store(&(ring->space_waiting), 0);
+		return 0;
+	}
+	return ring_wait(ring->space_fd, &(ring->space_waiting), timeout);
+}
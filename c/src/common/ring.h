@@ -0,0 +1,93 @@
+// Copyright 2023, Viveris Technologies
+// Distributed under the terms of the MIT License
+
+#ifndef __RING_H__
+#define __RING_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <time.h>
+
+#define RING_CACHE_LINE 64
+
+/**
+ * Lock-free single-producer single-consumer ring of pointers
+ *
+ * Only the pointers are exchanged, so the ownership of the pointed buffers
+ * moves from the producer to the consumer without any copy. Each side may
+ * sleep on an eventfd when the ring is empty (consumer) or full (producer),
+ * the other side only issues a wakeup when somebody is actually waiting.
+ */
+struct ring
+{
+	// Producer side
+	_Atomic size_t tail __attribute__((aligned(RING_CACHE_LINE)));
+	size_t max_used;
+	uint64_t full_count;
+	atomic_int space_waiting;
+	int space_fd;
+
+	// Consumer side
+	_Atomic size_t head __attribute__((aligned(RING_CACHE_LINE)));
+	uint64_t empty_count;
+	atomic_int data_waiting;
+	int data_fd;
+
+	// Shared read-only part
+	size_t mask __attribute__((aligned(RING_CACHE_LINE)));
+	void **slots;
+};
+
+/**
+ * Create a ring able to hold at least size pointers
+ *
+ * Return the ring on success, NULL otherwise
+ */
+struct ring *ring_create(size_t size);
+
+/**
+ * Delete a ring, the pointers still queued are not released
+ */
+void ring_delete(struct ring *ring);
+
+/**
+ * Get the number of pointers the ring can hold
+ */
+size_t ring_capacity(struct ring *ring);
+
+/**
+ * Push a pointer into the ring (producer side)
+ *
+ * Return 0 on success, 1 if the ring is full
+ */
+int ring_push(struct ring *ring, void *ptr);
+
+/**
+ * Pop a pointer from the ring (consumer side)
+ *
+ * Return 0 on success, 1 if the ring is empty
+ */
+int ring_pop(struct ring *ring, void **ptr);
+
+/**
+ * Wait until the ring is not empty (consumer side)
+ *
+ * Return 0 when data is available, 1 on timeout, -1 on error
+ */
+int ring_wait_data(struct ring *ring, const struct timespec *timeout);
+
+/**
+ * Wake up the consumer waiting for data without pushing any, so that it
+ * checks its stop flag (producer side)
+ */
+void ring_wake(struct ring *ring);
+
+/**
+ * Wait until the ring is not full (producer side)
+ *
+ * Return 0 when space is available, 1 on timeout, -1 on error
+ */
+int ring_wait_space(struct ring *ring, const struct timespec *timeout);
+
+#endif
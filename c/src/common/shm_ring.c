@@ -0,0 +1,262 @@
+// Copyright 2023, Viveris Technologies
+// Distributed under the terms of the MIT License
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "shm_ring.h"
+
+#define SHM_RING_ATTACH_TRIES 100 // waits of 10 ms for the creator to be done
+
+// The layout is shared with other programs, it must not move
+_Static_assert(sizeof(struct shm_ring_header) <= SHM_RING_HEADER_LEN, "shm ring header too long");
+_Static_assert(offsetof(struct shm_ring_header, slot_stride) == 16, "shm ring layout changed");
+_Static_assert(offsetof(struct shm_ring_header, tail) == 64, "shm ring layout changed");
+_Static_assert(offsetof(struct shm_ring_header, drops) == 72, "shm ring layout changed");
+_Static_assert(offsetof(struct shm_ring_header, head) == 128, "shm ring layout changed");
+_Static_assert(offsetof(struct shm_ring_header, waiting) == 192, "shm ring layout changed");
+
+int shm_futex(_Atomic uint32_t *addr, int op, uint32_t val, const struct timespec *timeout)
+{
+	return syscall(SYS_futex, addr, op, val, timeout, NULL, 0);
+}
+
+/**
+ * Map the shared memory file, initializing the ring when created
+ *
+ * Return 0 on success, -1 otherwise
+ */
+int shm_ring_map(struct shm_ring *ring, int fd, int created, size_t slot_count, size_t slot_len)
+{
+	struct shm_ring_header *hdr;
+	size_t stride = (SHM_RING_SLOT_HEADER_LEN + slot_len + RING_CACHE_LINE - 1) & ~((size_t)RING_CACHE_LINE - 1);
+	struct stat st;
+	int tries = 0;
+
+	if(created)
+	{
+		ring->map_len = SHM_RING_HEADER_LEN + slot_count * stride;
+		if(ftruncate(fd, ring->map_len) != 0)
+		{
+			fprintf(stderr, "Function ftruncate failed: %s (%d)\n", strerror(errno), errno);
+			return -1;
+		}
+	}
+	else
+	{
+		// The creator may not be done yet
+		while(fstat(fd, &st) == 0 && (size_t)st.st_size < SHM_RING_HEADER_LEN && tries++ < SHM_RING_ATTACH_TRIES)
+		{
+			usleep(10000);
+		}
+		if((size_t)st.st_size < SHM_RING_HEADER_LEN)
+		{
+			fprintf(stderr, "Invalid shared memory ring: file too short\n");
+			return -1;
+		}
+		ring->map_len = st.st_size;
+	}
+	if((hdr = (struct shm_ring_header *)mmap(NULL, ring->map_len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) ==
+	   MAP_FAILED)
+	{
+		fprintf(stderr, "Function mmap failed: %s (%d)\n", strerror(errno), errno);
+		return -1;
+	}
+	ring->hdr = hdr;
+
+	if(created)
+	{
+		hdr->version = SHM_RING_VERSION;
+		hdr->slot_count = slot_count;
+		hdr->slot_len = slot_len;
+		hdr->slot_stride = stride;
+		atomic_store(&(hdr->magic), SHM_RING_MAGIC);
+	}
+	while(atomic_load(&(hdr->magic)) != SHM_RING_MAGIC && tries++ < SHM_RING_ATTACH_TRIES)
+	{
+		usleep(10000);
+	}
+	if(atomic_load(&(hdr->magic)) != SHM_RING_MAGIC || hdr->version != SHM_RING_VERSION)
+	{
+		fprintf(stderr, "Invalid shared memory ring: unknown magic or version\n");
+		return -1;
+	}
+	if(hdr->slot_count == 0 || (hdr->slot_count & (hdr->slot_count - 1)) != 0 ||
+	   hdr->slot_stride < SHM_RING_SLOT_HEADER_LEN + hdr->slot_len ||
+	   SHM_RING_HEADER_LEN + (size_t)hdr->slot_count * hdr->slot_stride > ring->map_len)
+	{
+		fprintf(stderr, "Invalid shared memory ring: inconsistent dimensions\n");
+		return -1;
+	}
+	ring->slots = (unsigned char *)hdr + SHM_RING_HEADER_LEN;
+	ring->mask = hdr->slot_count - 1;
+	return 0;
+}
+
+struct shm_ring *shm_ring_open(const char *name, size_t slot_count, size_t slot_len)
+{
+	struct shm_ring *ring;
+	int fd, created = 1;
+	char path[NAME_MAX + 2];
+
+	if(slot_count == 0 || (slot_count & (slot_count - 1)) != 0 || slot_count > UINT32_MAX || slot_len > UINT32_MAX)
+	{
+		fprintf(stderr, "Invalid shared memory ring dimensions: %zu slots of %zu bytes\n", slot_count, slot_len);
+		return NULL;
+	}
+	snprintf(path, sizeof(path), "/%s", name);
+	if((fd = shm_open(path, O_RDWR | O_CREAT | O_EXCL, 0600)) < 0 && errno == EEXIST)
+	{
+		created = 0;
+		fd = shm_open(path, O_RDWR, 0);
+	}
+	if(fd < 0)
+	{
+		fprintf(stderr, "Function shm_open failed (name: %s): %s (%d)\n", path, strerror(errno), errno);
+		return NULL;
+	}
+	if((ring = (struct shm_ring *)calloc(1, sizeof(struct shm_ring))) == NULL)
+	{
+		close(fd);
+		return NULL;
+	}
+	if(shm_ring_map(ring, fd, created, slot_count, slot_len) != 0)
+	{
+		if(created)
+		{
+			shm_unlink(path);
+		}
+		close(fd);
+		shm_ring_close(ring);
+		return NULL;
+	}
+	close(fd);
+	return ring;
+}
+
+void shm_ring_close(struct shm_ring *ring)
+{
+	if(ring == NULL)
+	{
+		return;
+	}
+	if(ring->hdr != NULL)
+	{
+		munmap(ring->hdr, ring->map_len);
+	}
+	free(ring);
+}
+
+int shm_ring_write_iov(struct shm_ring *ring, const struct iovec *iov, int count)
+{
+	struct shm_ring_header *hdr = ring->hdr;
+	uint64_t tail = atomic_load_explicit(&(hdr->tail), memory_order_relaxed);
+	unsigned char *slot;
+	size_t len = 0;
+	uint32_t slot_len;
+	int i;
+
+	for(i = 0; i < count; i++)
+	{
+		len += iov[i].iov_len;
+	}
+	if(len > hdr->slot_len)
+	{
+		return -1;
+	}
+	if(tail - atomic_load_explicit(&(hdr->head), memory_order_acquire) > ring->mask)
+	{
+		atomic_fetch_add_explicit(&(hdr->drops), 1, memory_order_relaxed);
+		ring->drops++;
+		return 1;
+	}
+
+	slot = ring->slots + (tail & ring->mask) * hdr->slot_stride;
+	slot_len = len;
+	memcpy(slot, &slot_len, sizeof(uint32_t));
+	slot += SHM_RING_SLOT_HEADER_LEN;
+	for(i = 0; i < count; i++)
+	{
+		memcpy(slot, iov[i].iov_base, iov[i].iov_len);
+		slot += iov[i].iov_len;
+	}
+	atomic_store(&(hdr->tail), tail + 1);
+	ring->frames++;
+	ring->bytes += len;
+
+	if(atomic_load(&(hdr->waiting)) != 0 && atomic_exchange(&(hdr->waiting), 0) != 0)
+	{
+		shm_futex(&(hdr->waiting), FUTEX_WAKE, 1, NULL);
+	}
+	return 0;
+}
+
+int shm_ring_peek(struct shm_ring *ring, unsigned char **data, size_t *len)
+{
+	struct shm_ring_header *hdr = ring->hdr;
+	uint64_t head = atomic_load_explicit(&(hdr->head), memory_order_relaxed);
+	unsigned char *slot;
+	uint32_t slot_len;
+
+	if(head == atomic_load_explicit(&(hdr->tail), memory_order_acquire))
+	{
+		return 1;
+	}
+	slot = ring->slots + (head & ring->mask) * hdr->slot_stride;
+	memcpy(&slot_len, slot, sizeof(uint32_t));
+	*data = slot + SHM_RING_SLOT_HEADER_LEN;
+	// A corrupted length is cut to the slot
+	*len = slot_len <= hdr->slot_len ? slot_len : hdr->slot_len;
+	return 0;
+}
+
+void shm_ring_release(struct shm_ring *ring)
+{
+	struct shm_ring_header *hdr = ring->hdr;
+	uint64_t head = atomic_load_explicit(&(hdr->head), memory_order_relaxed);
+
+	ring->frames++;
+	atomic_store_explicit(&(hdr->head), head + 1, memory_order_release);
+}
+
+int shm_ring_wait(struct shm_ring *ring, const struct timespec *timeout)
+{
+	struct shm_ring_header *hdr = ring->hdr;
+	uint64_t head = atomic_load_explicit(&(hdr->head), memory_order_relaxed);
+
+	if(head != atomic_load(&(hdr->tail)))
+	{
+		return 0;
+	}
+	// The producer sees the flag, or the check below sees its frame
+	atomic_store(&(hdr->waiting), 1);
+	if(head == atomic_load(&(hdr->tail)))
+	{
+		shm_futex(&(hdr->waiting), FUTEX_WAIT, 1, timeout);
+	}
+	atomic_store(&(hdr->waiting), 0);
+	return head != atomic_load(&(hdr->tail)) ? 0 : 1;
+}
+
+void shm_ring_print_stats(struct shm_ring *ring, const char *side)
+{
+	struct shm_ring_header *hdr = ring->hdr;
+
+	fprintf(stdout, "Shared memory ring statistics (%s)\n", side);
+	fprintf(stdout, "  - memory:             %u slots of %u bytes\n", hdr->slot_count, hdr->slot_len);
+	fprintf(stdout, "  - frames:             %lu\n", ring->frames);
+	if(ring->bytes > 0 || ring->drops > 0)
+	{
+		fprintf(stdout, "  - bytes:              %lu\n", ring->bytes);
+		fprintf(stdout, "  - dropped, ring full: %lu\n", ring->drops);
+	}
+}
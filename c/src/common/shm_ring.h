@@ -0,0 +1,141 @@
+// Copyright 2023, Viveris Technologies
+// Distributed under the terms of the MIT License
+
+#ifndef __SHM_RING_H__
+#define __SHM_RING_H__
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/uio.h>
+#include <time.h>
+
+#include "ring.h"
+
+/*
+ * Ring of frames in a shared memory file, from a single producer process to
+ * a single consumer process
+ *
+ * The file /dev/shm/NAME is laid out as follows, all the integers in the
+ * byte order of the host:
+ *
+ *   offset  size  field
+ *   0       4     magic, "GSER" (0x52455347 read as an integer), written
+ *                 last by the creator once the ring is ready
+ *   4       4     version, 1
+ *   8       4     slot count, a power of 2
+ *   12      4     slot length, the max frame length in bytes
+ *   16      4     slot stride, the distance between two slots in bytes
+ *   64      8     tail: count of the frames written, only written by the
+ *                 producer
+ *   72      8     drops: count of the frames dropped on a full ring
+ *   128     8     head: count of the frames read, only written by the
+ *                 consumer
+ *   192     4     waiting: 1 while the consumer sleeps, a futex word
+ *   4096          slots, each one made of the frame length on 4 bytes, 4
+ *                 reserved bytes, then the frame itself
+ *
+ * The frame of the index i is in the slot i modulo the slot count. The
+ * producer fills the slot of the tail when tail - head is lower than the
+ * slot count, then increments the tail, with release semantics. The
+ * consumer reads the slot of the head when it is lower than the tail, read
+ * with acquire semantics, then increments the head.
+ *
+ * A consumer which finds the ring empty stores 1 into the waiting word,
+ * checks the tail again, and sleeps with FUTEX_WAIT on the waiting word
+ * while it is 1. A producer which finds 1 in the waiting word after
+ * incrementing the tail exchanges it for 0 and wakes the consumer with
+ * FUTEX_WAKE. Both futex operations are shared between processes.
+ */
+
+#define SHM_RING_MAGIC 0x52455347
+#define SHM_RING_VERSION 1
+#define SHM_RING_HEADER_LEN 4096
+#define SHM_RING_SLOT_HEADER_LEN 8
+
+#define SHM_RING_DEFAULT_SLOTS 1024
+
+/**
+ * Header of the shared memory file, see above
+ */
+struct shm_ring_header
+{
+	_Atomic uint32_t magic;
+	uint32_t version;
+	uint32_t slot_count;
+	uint32_t slot_len;
+	uint32_t slot_stride;
+
+	_Atomic uint64_t tail __attribute__((aligned(RING_CACHE_LINE)));
+	_Atomic uint64_t drops;
+
+	_Atomic uint64_t head __attribute__((aligned(RING_CACHE_LINE)));
+
+	_Atomic uint32_t waiting __attribute__((aligned(RING_CACHE_LINE)));
+};
+
+/**
+ * Ring attached by a process
+ */
+struct shm_ring
+{
+	struct shm_ring_header *hdr;
+	unsigned char *slots;
+	size_t map_len;
+	uint64_t mask;
+
+	// Frames written or read by this process
+	uint64_t frames;
+	uint64_t bytes;
+	uint64_t drops;
+};
+
+/**
+ * Attach the ring of a shared memory file, created with slot_count slots
+ * of slot_len bytes when it does not exist yet
+ *
+ * Return the ring on success, NULL otherwise
+ */
+struct shm_ring *shm_ring_open(const char *name, size_t slot_count, size_t slot_len);
+
+/**
+ * Detach a ring, the shared memory file is left for the other side
+ */
+void shm_ring_close(struct shm_ring *ring);
+
+/**
+ * Write a frame gathered from several buffers into the ring, waking the
+ * consumer up when it sleeps
+ *
+ * Return 0 on success, 1 when the ring is full, -1 when the frame is longer
+ * than a slot
+ */
+int shm_ring_write_iov(struct shm_ring *ring, const struct iovec *iov, int count);
+
+/**
+ * Get the oldest frame of the ring, in place: it is left in the ring until
+ * shm_ring_release()
+ *
+ * Return 0 on success, 1 when the ring is empty
+ */
+int shm_ring_peek(struct shm_ring *ring, unsigned char **data, size_t *len);
+
+/**
+ * Give the frame of shm_ring_peek() back to the producer
+ */
+void shm_ring_release(struct shm_ring *ring);
+
+/**
+ * Sleep until a frame is written into the ring, a signal comes or the
+ * timeout expires
+ *
+ * Return 0 when a frame is waiting, 1 otherwise
+ */
+int shm_ring_wait(struct shm_ring *ring, const struct timespec *timeout);
+
+/**
+ * Print the counts of the ring, as seen by producer or consumer
+ */
+void shm_ring_print_stats(struct shm_ring *ring, const char *side);
+
+#endif
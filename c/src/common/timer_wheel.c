@@ -0,0 +1,117 @@
+// Copyright 2023, Viveris Technologies
+// Distributed under the terms of the MIT License
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "timer_wheel.h"
+
+struct timer_wheel *timer_wheel_create(size_t slot_count, uint64_t now)
+{
+	struct timer_wheel *wheel;
+	size_t capa = 1;
+	size_t i;
+
+	while(capa < slot_count)
+	{
+		capa <<= 1;
+	}
+	if((wheel = (struct timer_wheel *)malloc(sizeof(struct timer_wheel))) == NULL)
+	{
+		return NULL;
+	}
+	if((wheel->slots = (struct tw_timer *)calloc(capa, sizeof(struct tw_timer))) == NULL)
+	{
+		free(wheel);
+		return NULL;
+	}
+	// Each slot is the head of a circular list
+	for(i = 0; i < capa; i++)
+	{
+		wheel->slots[i].next = &(wheel->slots[i]);
+		wheel->slots[i].prev = &(wheel->slots[i]);
+	}
+	wheel->mask = capa - 1;
+	wheel->now = now;
+	return wheel;
+}
+
+void timer_wheel_delete(struct timer_wheel *wheel)
+{
+	if(wheel == NULL)
+	{
+		return;
+	}
+	free(wheel->slots);
+	free(wheel);
+}
+
+void timer_wheel_add(struct timer_wheel *wheel, struct tw_timer *timer, uint64_t expire)
+{
+	struct tw_timer *head;
+
+	timer_wheel_cancel(timer);
+	if(expire <= wheel->now)
+	{
+		expire = wheel->now + 1;
+	}
+	timer->expire = expire;
+	head = &(wheel->slots[expire & wheel->mask]);
+	timer->next = head;
+	timer->prev = head->prev;
+	head->prev->next = timer;
+	head->prev = timer;
+}
+
+void timer_wheel_cancel(struct tw_timer *timer)
+{
+	if(timer->next == NULL)
+	{
+		return;
+	}
+	timer->prev->next = timer->next;
+	timer->next->prev = timer->prev;
+	timer->next = NULL;
+	timer->prev = NULL;
+}
+
+int timer_wheel_pending(struct tw_timer *timer)
+{
+	return timer->next != NULL;
+}
+
+size_t timer_wheel_advance(struct timer_wheel *wheel, uint64_t now, tw_expire_t handler, void *arg)
+{
+	struct tw_timer *head, *timer, *next;
+	uint64_t steps, i;
+	size_t fired = 0;
+
+	if(now <= wheel->now)
+	{
+		return 0;
+	}
+	// Every slot is visited once at most, even after a long idle period
+	steps = now - wheel->now;
+	if(steps > wheel->mask + 1)
+	{
+		steps = wheel->mask + 1;
+	}
+	for(i = 1; i <= steps; i++)
+	{
+		head = &(wheel->slots[(wheel->now + i) & wheel->mask]);
+		for(timer = head->next; timer != head; timer = next)
+		{
+			next = timer->next;
+			// Timers of a later round stay in the slot
+			if(timer->expire > now)
+			{
+				continue;
+			}
+			timer_wheel_cancel(timer);
+			handler(timer, arg);
+			fired++;
+		}
+	}
+	wheel->now = now;
+	return fired;
+}
@@ -0,0 +1,73 @@
+// Copyright 2023, Viveris Technologies
+// Distributed under the terms of the MIT License
+
+#ifndef __TIMER_WHEEL_H__
+#define __TIMER_WHEEL_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Timer linked into a wheel slot, to embed into the object it times out
+ */
+struct tw_timer
+{
+	struct tw_timer *next;
+	struct tw_timer *prev;
+	uint64_t expire;
+};
+
+/**
+ * Hashed timer wheel
+ *
+ * Time is counted in ticks, a timer is linked into the slot of its expiry tick
+ * modulo the slot count, so adding and cancelling a timer are O(1) and an
+ * advance only visits the slots of the elapsed ticks.
+ */
+struct timer_wheel
+{
+	size_t mask;
+	uint64_t now;
+	struct tw_timer *slots;
+};
+
+/**
+ * Handler of an expired timer, the timer is already unlinked
+ */
+typedef void (*tw_expire_t)(struct tw_timer *timer, void *arg);
+
+/**
+ * Create a wheel of at least slot_count slots starting at tick now
+ *
+ * Return the wheel on success, NULL otherwise
+ */
+struct timer_wheel *timer_wheel_create(size_t slot_count, uint64_t now);
+
+/**
+ * Delete a wheel, the pending timers are not fired
+ */
+void timer_wheel_delete(struct timer_wheel *wheel);
+
+/**
+ * Start a timer expiring at a tick, at the next tick if it is already past
+ */
+void timer_wheel_add(struct timer_wheel *wheel, struct tw_timer *timer, uint64_t expire);
+
+/**
+ * Stop a timer, nothing is done if it is not pending
+ */
+void timer_wheel_cancel(struct tw_timer *timer);
+
+/**
+ * Check if a timer is pending
+ */
+int timer_wheel_pending(struct tw_timer *timer);
+
+/**
+ * Advance the wheel up to tick now and fire the expired timers
+ *
+ * Return the number of fired timers
+ */
+size_t timer_wheel_advance(struct timer_wheel *wheel, uint64_t now, tw_expire_t handler, void *arg);
+
+#endif
@@ -0,0 +1,30 @@
+// Copyright 2023, Viveris Technologies
+// Distributed under the terms of the MIT License
+
+#include "tunnel_header.h"
+
+void tunnel_header_write(const struct tunnel_header *hdr, unsigned char *buffer)
+{
+	buffer[0] = (TUNNEL_VERSION << 4) | (hdr->type & 0x0f);
+	buffer[1] = hdr->flags;
+	buffer[2] = (hdr->aux >> 8) & 0xff;
+	buffer[3] = hdr->aux & 0xff;
+	buffer[4] = (hdr->seq >> 24) & 0xff;
+	buffer[5] = (hdr->seq >> 16) & 0xff;
+	buffer[6] = (hdr->seq >> 8) & 0xff;
+	buffer[7] = hdr->seq & 0xff;
+}
+
+int tunnel_header_parse(const unsigned char *buffer, size_t len, struct tunnel_header *hdr)
+{
+	if(len < TUNNEL_HEADER_LEN || (buffer[0] >> 4) != TUNNEL_VERSION)
+	{
+		return -1;
+	}
+	hdr->type = buffer[0] & 0x0f;
+	hdr->flags = buffer[1];
+	hdr->aux = (buffer[2] << 8) | buffer[3];
+	hdr->seq = ((uint32_t)buffer[4] << 24) | ((uint32_t)buffer[5] << 16) |
+	           ((uint32_t)buffer[6] << 8) | buffer[7];
+	return 0;
+}
@@ -0,0 +1,52 @@
+// Copyright 2023, Viveris Technologies
+// Distributed under the terms of the MIT License
+
+#ifndef __TUNNEL_HEADER_H__
+#define __TUNNEL_HEADER_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Optional header prepended to each UDP datagram of the tunnel
+ *
+ *  0                   1                   2                   3
+ *  0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1
+ * +-------+-------+---------------+-------------------------------+
+ * |Version| Type  |     Flags     |          Type specific        |
+ * +-------+-------+---------------+-------------------------------+
+ * |                        Sequence number                        |
+ * +---------------------------------------------------------------+
+ *
+ * All fields are in network byte order. The sequence number is incremented
+ * for each datagram sent to a given remote.
+ */
+#define TUNNEL_HEADER_LEN 8
+#define TUNNEL_VERSION 1
+
+// Datagram types
+#define TUNNEL_TYPE_DATA 0   // GSE frame
+#define TUNNEL_TYPE_PARITY 1 // FEC parity of the data frames from the sequence
+                             // number on, see tap_udp/fec.h
+
+struct tunnel_header
+{
+	uint8_t type;
+	uint8_t flags;
+	uint16_t aux;
+	uint32_t seq;
+};
+
+/**
+ * Write a tunnel header at the start of a buffer of TUNNEL_HEADER_LEN bytes
+ */
+void tunnel_header_write(const struct tunnel_header *hdr, unsigned char *buffer);
+
+/**
+ * Parse the tunnel header at the start of a buffer
+ *
+ * Return 0 on success, -1 if the header is truncated or of another version
+ */
+int tunnel_header_parse(const unsigned char *buffer, size_t len, struct tunnel_header *hdr);
+
+#endif
@@ -0,0 +1,541 @@
+// Copyright 2023, Viveris Technologies
+// Distributed under the terms of the MIT License
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench_traffic.h"
+#include "gse_header.h"
+#include "utils.h"
+
+#define ETH_LEN 14
+#define IPV4_LEN 20
+#define UDP_LEN 8
+#define STAMP_OFFSET (ETH_LEN + IPV4_LEN + UDP_LEN)
+#define STAMP_LEN 20 // magic, sequence and timestamp
+#define PATTERN_OFFSET (STAMP_OFFSET + STAMP_LEN)
+#define STAMP_MAGIC 0x53415442 // "SATB"
+
+uint64_t bench_rand(uint64_t *state)
+{
+	uint64_t x = *state;
+
+	x ^= x >> 12;
+	x ^= x << 25;
+	x ^= x >> 27;
+	*state = x;
+	return x * 0x2545F4914F6CDD1DULL;
+}
+
+int bench_parse_weighted(const char *str, unsigned int max_count, unsigned int max_value,
+                         unsigned int *count, unsigned int *values, unsigned int *weights, unsigned int *total)
+{
+	char buf[256];
+	char *item, *value, *weight, *save, *item_save;
+	unsigned long val;
+
+	if(strlen(str) >= sizeof(buf))
+	{
+		return -1;
+	}
+	strcpy(buf, str);
+	*count = 0;
+	*total = 0;
+	for(item = strtok_r(buf, ",", &save); item != NULL; item = strtok_r(NULL, ",", &save))
+	{
+		value = strtok_r(item, ":", &item_save);
+		weight = strtok_r(NULL, ":", &item_save);
+		if(*count == max_count || value == NULL || strtok_r(NULL, ":", &item_save) != NULL)
+		{
+			return -1;
+		}
+		if(parse_unsigned_long(value, &val) != 0 || val > max_value)
+		{
+			return -1;
+		}
+		values[*count] = val;
+		val = 1;
+		if(weight != NULL && (parse_unsigned_long(weight, &val) != 0 || val == 0 || val > 1000000))
+		{
+			return -1;
+		}
+		weights[*count] = val;
+		*total += val;
+		(*count)++;
+	}
+	return *count > 0 ? 0 : -1;
+}
+
+int bench_parse_sizes(const char *str, struct bench_sizes *sizes)
+{
+	char buf[32];
+	char *min, *max, *save;
+	unsigned long val;
+	unsigned int i;
+
+	memset(sizes, 0, sizeof(struct bench_sizes));
+	if(strcmp(str, "imix") == 0)
+	{
+		return bench_parse_sizes("64:7,594:4,1518:1", sizes);
+	}
+	if(strchr(str, ',') != NULL || strchr(str, ':') != NULL)
+	{
+		if(bench_parse_weighted(str, BENCH_MAX_SIZES, BENCH_MAX_FRAME_LEN, &(sizes->count), sizes->len,
+		                        sizes->weight, &(sizes->total)) != 0)
+		{
+			return -1;
+		}
+		for(i = 0; i < sizes->count; i++)
+		{
+			if(sizes->len[i] < BENCH_MIN_FRAME_LEN)
+			{
+				return -1;
+			}
+		}
+		return 0;
+	}
+
+	if(strlen(str) >= sizeof(buf))
+	{
+		return -1;
+	}
+	strcpy(buf, str);
+	min = strtok_r(buf, "-", &save);
+	max = strtok_r(NULL, "-", &save);
+	if(min == NULL || strtok_r(NULL, "-", &save) != NULL)
+	{
+		return -1;
+	}
+	if(parse_unsigned_long(min, &val) != 0 || val < BENCH_MIN_FRAME_LEN || val > BENCH_MAX_FRAME_LEN)
+	{
+		return -1;
+	}
+	sizes->min = val;
+	sizes->max = val;
+	if(max != NULL)
+	{
+		if(parse_unsigned_long(max, &val) != 0 || val < sizes->min || val > BENCH_MAX_FRAME_LEN)
+		{
+			return -1;
+		}
+		sizes->max = val;
+	}
+	return 0;
+}
+
+int bench_parse_dscp(const char *str, struct bench_dscp *dscp)
+{
+	unsigned int values[BENCH_MAX_DSCPS];
+	unsigned int i;
+
+	memset(dscp, 0, sizeof(struct bench_dscp));
+	if(bench_parse_weighted(str, BENCH_MAX_DSCPS, 63, &(dscp->count), values, dscp->weight, &(dscp->total)) != 0)
+	{
+		return -1;
+	}
+	for(i = 0; i < dscp->count; i++)
+	{
+		dscp->dscp[i] = values[i];
+	}
+	return 0;
+}
+
+void bench_gen_init(struct bench_gen *gen, const struct bench_sizes *sizes, const struct bench_dscp *dscp)
+{
+	memset(gen, 0, sizeof(struct bench_gen));
+	memcpy(&(gen->sizes), sizes, sizeof(struct bench_sizes));
+	memcpy(&(gen->dscp), dscp, sizeof(struct bench_dscp));
+	// Fixed seed, the runs draw the same frames
+	gen->rand = 0x9E3779B97F4A7C15ULL;
+}
+
+/**
+ * Draw an index among weighted entries
+ */
+unsigned int bench_draw(uint64_t *state, const unsigned int *weights, unsigned int count, unsigned int total)
+{
+	unsigned int r;
+	unsigned int i;
+
+	if(count == 1)
+	{
+		return 0;
+	}
+	r = bench_rand(state) % total;
+	for(i = 0; i + 1 < count && r >= weights[i]; i++)
+	{
+		r -= weights[i];
+	}
+	return i;
+}
+
+uint16_t bench_ipv4_checksum(const unsigned char *hdr)
+{
+	uint32_t sum = 0;
+	unsigned int i;
+
+	for(i = 0; i < IPV4_LEN; i += 2)
+	{
+		sum += (hdr[i] << 8) | hdr[i + 1];
+	}
+	while(sum >> 16)
+	{
+		sum = (sum & 0xffff) + (sum >> 16);
+	}
+	return ~sum;
+}
+
+size_t bench_gen_frame(struct bench_gen *gen, unsigned char *buffer, uint64_t now_ns)
+{
+	static const unsigned char eth[ETH_LEN] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x02,
+	                                           0x02, 0x00, 0x00, 0x00, 0x00, 0x01, 0x08, 0x00};
+	struct bench_sizes *sizes = &(gen->sizes);
+	unsigned char *ip = buffer + ETH_LEN;
+	unsigned char *udp = ip + IPV4_LEN;
+	uint32_t magic = STAMP_MAGIC;
+	uint16_t csum;
+	size_t len;
+	uint8_t dscp;
+
+	if(sizes->count > 0)
+	{
+		len = sizes->len[bench_draw(&(gen->rand), sizes->weight, sizes->count, sizes->total)];
+	}
+	else
+	{
+		len = sizes->min + (sizes->max > sizes->min ? bench_rand(&(gen->rand)) % (sizes->max - sizes->min + 1) : 0);
+	}
+	dscp = gen->dscp.dscp[bench_draw(&(gen->rand), gen->dscp.weight, gen->dscp.count, gen->dscp.total)];
+
+	memcpy(buffer, eth, ETH_LEN);
+
+	ip[0] = 0x45;
+	ip[1] = dscp << 2;
+	ip[2] = (len - ETH_LEN) >> 8;
+	ip[3] = (len - ETH_LEN) & 0xff;
+	ip[4] = (gen->seq >> 8) & 0xff;
+	ip[5] = gen->seq & 0xff;
+	ip[6] = 0x40; // don't fragment
+	ip[7] = 0x00;
+	ip[8] = 64;
+	ip[9] = 17;
+	ip[10] = 0;
+	ip[11] = 0;
+	memcpy(ip + 12, "\x0a\x00\x00\x01\x0a\x00\x00\x02", 8);
+	csum = bench_ipv4_checksum(ip);
+	ip[10] = csum >> 8;
+	ip[11] = csum & 0xff;
+
+	udp[0] = 5001 >> 8;
+	udp[1] = 5001 & 0xff;
+	udp[2] = 5002 >> 8;
+	udp[3] = 5002 & 0xff;
+	udp[4] = (len - ETH_LEN - IPV4_LEN) >> 8;
+	udp[5] = (len - ETH_LEN - IPV4_LEN) & 0xff;
+	udp[6] = 0;
+	udp[7] = 0;
+
+	// The stamp keeps the host byte order, the sink runs on the same host to
+	// share its clock
+	memcpy(buffer + STAMP_OFFSET, &magic, sizeof(magic));
+	memcpy(buffer + STAMP_OFFSET + 4, &(gen->seq), sizeof(gen->seq));
+	memcpy(buffer + STAMP_OFFSET + 12, &now_ns, sizeof(now_ns));
+	memset(buffer + PATTERN_OFFSET, (uint8_t)gen->seq, len - PATTERN_OFFSET);
+
+	gen->seq++;
+	gen->bytes += len;
+	return len;
+}
+
+size_t bench_flow_frame(struct bench_gen *gen, uint64_t flows, unsigned char *buffer)
+{
+	static const unsigned char macs[12] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x02, 0x02, 0x00, 0x00, 0x00, 0x00, 0x01};
+	uint64_t flow = bench_rand(&(gen->rand)) % flows;
+	unsigned int kind = flow % 4;
+	unsigned char *l3, *l4;
+	size_t offset = 12;
+	uint8_t proto = kind % 2 == 0 ? 17 : 6;
+
+	memset(buffer, 0, BENCH_FLOW_FRAME_LEN);
+	memcpy(buffer, macs, 12);
+	if(kind == 1)
+	{
+		memcpy(buffer + offset, "\x81\x00\x00\x05", 4);
+		offset += 4;
+	}
+	else if(kind == 2)
+	{
+		memcpy(buffer + offset, "\x88\xa8\x00\x0a\x81\x00\x00\x14", 8);
+		offset += 8;
+	}
+	l3 = buffer + offset + 2;
+	if(kind < 2)
+	{
+		buffer[offset] = 0x08;
+		buffer[offset + 1] = 0x00;
+		l3[0] = 0x45;
+		l3[2] = (BENCH_FLOW_FRAME_LEN - offset - 2) >> 8;
+		l3[3] = (BENCH_FLOW_FRAME_LEN - offset - 2) & 0xff;
+		l3[8] = 64;
+		l3[9] = proto;
+		l3[12] = 10;
+		l3[13] = (flow >> 16) & 0xff;
+		l3[14] = (flow >> 8) & 0xff;
+		l3[15] = flow & 0xff;
+		memcpy(l3 + 16, "\x0a\xff\x00\x01", 4);
+		l4 = l3 + IPV4_LEN;
+	}
+	else
+	{
+		buffer[offset] = 0x86;
+		buffer[offset + 1] = 0xdd;
+		l3[0] = 0x60;
+		l3[4] = (BENCH_FLOW_FRAME_LEN - offset - 2 - 40) >> 8;
+		l3[5] = (BENCH_FLOW_FRAME_LEN - offset - 2 - 40) & 0xff;
+		l3[6] = kind == 3 ? 0 : proto;
+		l3[7] = 64;
+		l3[8] = 0x20;
+		l3[9] = 0x01;
+		l3[20] = (flow >> 24) & 0xff;
+		l3[21] = (flow >> 16) & 0xff;
+		l3[22] = (flow >> 8) & 0xff;
+		l3[23] = flow & 0xff;
+		l3[24] = 0x20;
+		l3[25] = 0x01;
+		l3[39] = 0x01;
+		l4 = l3 + 40;
+		if(kind == 3)
+		{
+			// Hop-by-hop options header of 8 bytes
+			l4[0] = proto;
+			l4 += 8;
+		}
+	}
+	l4[0] = (1024 + (flow >> 24)) >> 8;
+	l4[1] = (1024 + (flow >> 24)) & 0xff;
+	l4[2] = 5001 >> 8;
+	l4[3] = 5001 & 0xff;
+
+	gen->seq++;
+	gen->bytes += BENCH_FLOW_FRAME_LEN;
+	return BENCH_FLOW_FRAME_LEN;
+}
+
+void bench_gse_frame(struct bench_gen *gen, unsigned char *buffer, size_t len)
+{
+	size_t pos = 0, header_len, pdu_len, gse_len, i;
+	uint8_t start, end, label_type;
+	uint16_t protocol;
+	unsigned int flips;
+	uint64_t r;
+
+	while(pos + GSE_FIXED_HEADER_LEN < len && bench_rand(&(gen->rand)) % 8 != 0)
+	{
+		// Half complete packets, then first, middle and last fragments
+		r = bench_rand(&(gen->rand));
+		start = (r % 6) < 4;
+		end = (r % 6) < 3 || (r % 6) == 5;
+		label_type = (r >> 8) & 0x3;
+		header_len = GSE_FIXED_HEADER_LEN + ((!start || !end) ? 1 : 0) + ((start && !end) ? 2 : 0) +
+		             (start ? 2 + gse_label_len(label_type) : 0);
+		if(pos + header_len >= len)
+		{
+			break;
+		}
+		pdu_len = 1 + (r >> 16) % BENCH_GSE_MAX_PDU_LEN;
+		if(pos + header_len + pdu_len > len)
+		{
+			pdu_len = len - pos - header_len;
+		}
+		gse_len = header_len + pdu_len - GSE_FIXED_HEADER_LEN;
+		if(gse_len > 0x0fff)
+		{
+			gse_len = 0x0fff;
+			pdu_len = gse_len + GSE_FIXED_HEADER_LEN - header_len;
+		}
+
+		buffer[pos] = (start << 7) | (end << 6) | (label_type << 4) | (gse_len >> 8);
+		buffer[pos + 1] = gse_len & 0xff;
+		i = pos + GSE_FIXED_HEADER_LEN;
+		if(!start || !end)
+		{
+			buffer[i++] = (r >> 32) & 0xff;
+		}
+		if(start && !end)
+		{
+			buffer[i++] = (r >> 40) & 0xff;
+			buffer[i++] = (r >> 48) & 0xff;
+		}
+		if(start)
+		{
+			// One in eight is an extension header
+			protocol = (r >> 61) == 0 ? (r >> 40) % GSE_PROTOCOL_MIN :
+			           GSE_PROTOCOL_MIN + (r >> 40) % (0x10000 - GSE_PROTOCOL_MIN);
+			buffer[i++] = protocol >> 8;
+			buffer[i++] = protocol & 0xff;
+		}
+		// The label, the PDU and the CRC of a last fragment
+		for(; i < pos + header_len + pdu_len; i++)
+		{
+			buffer[i] = bench_rand(&(gen->rand)) & 0xff;
+		}
+		pos += header_len + pdu_len;
+	}
+	memset(buffer + pos, 0, len - pos);
+
+	if(bench_rand(&(gen->rand)) % 4 == 0)
+	{
+		flips = 1 + bench_rand(&(gen->rand)) % 4;
+		while(flips-- > 0)
+		{
+			r = bench_rand(&(gen->rand));
+			buffer[r % len] ^= 1 << ((r >> 32) % 8);
+		}
+	}
+	gen->seq++;
+	gen->bytes += len;
+}
+
+int bench_sink_init(struct bench_sink *sink)
+{
+	memset(sink, 0, sizeof(struct bench_sink));
+	sink->lat_min = UINT64_MAX;
+	if((sink->lat_hist = (uint64_t *)calloc(BENCH_LATENCY_BUCKETS, sizeof(uint64_t))) == NULL)
+	{
+		return -1;
+	}
+	return 0;
+}
+
+void bench_sink_release(struct bench_sink *sink)
+{
+	free(sink->lat_hist);
+	sink->lat_hist = NULL;
+}
+
+/**
+ * Check the headers, the stamp and the pattern of a frame
+ *
+ * Return 0 on success, -1 otherwise
+ */
+int bench_check_frame(const unsigned char *data, size_t len, uint64_t *seq, uint64_t *stamp)
+{
+	uint32_t magic;
+	uint8_t pattern;
+	size_t i;
+
+	if(len < BENCH_MIN_FRAME_LEN || (size_t)((data[ETH_LEN + 2] << 8) | data[ETH_LEN + 3]) != len - ETH_LEN ||
+	   bench_ipv4_checksum(data + ETH_LEN) != 0)
+	{
+		return -1;
+	}
+	memcpy(&magic, data + STAMP_OFFSET, sizeof(magic));
+	if(magic != STAMP_MAGIC)
+	{
+		return -1;
+	}
+	memcpy(seq, data + STAMP_OFFSET + 4, sizeof(*seq));
+	memcpy(stamp, data + STAMP_OFFSET + 12, sizeof(*stamp));
+	pattern = (uint8_t)*seq;
+	for(i = PATTERN_OFFSET; i < len; i++)
+	{
+		if(data[i] != pattern)
+		{
+			return -1;
+		}
+	}
+	return 0;
+}
+
+void bench_sink_frame(struct bench_sink *sink, const unsigned char *data, size_t len, uint64_t now_ns)
+{
+	uint64_t seq, stamp, lat, s;
+	uint64_t *word;
+	uint64_t bit;
+
+	if(bench_check_frame(data, len, &seq, &stamp) != 0)
+	{
+		sink->corrupted++;
+		return;
+	}
+
+	if(seq >= sink->next)
+	{
+		// The frames skipped are lost until they show up late
+		sink->lost += seq - sink->next;
+		for(s = seq - sink->next > BENCH_SEQ_WINDOW ? seq - BENCH_SEQ_WINDOW : sink->next; s < seq; s++)
+		{
+			sink->seen[(s % BENCH_SEQ_WINDOW) / 64] &= ~(1ULL << (s % 64));
+		}
+		sink->seen[(seq % BENCH_SEQ_WINDOW) / 64] |= 1ULL << (seq % 64);
+		sink->next = seq + 1;
+	}
+	else
+	{
+		word = &(sink->seen[(seq % BENCH_SEQ_WINDOW) / 64]);
+		bit = 1ULL << (seq % 64);
+		if(sink->next - seq <= BENCH_SEQ_WINDOW && (*word & bit) != 0)
+		{
+			sink->duplicates++;
+			return;
+		}
+		if(sink->next - seq <= BENCH_SEQ_WINDOW)
+		{
+			*word |= bit;
+		}
+		sink->late++;
+		if(sink->lost > 0)
+		{
+			sink->lost--;
+		}
+	}
+
+	sink->received++;
+	sink->bytes += len;
+	lat = now_ns > stamp ? now_ns - stamp : 0;
+	sink->lat_sum += lat;
+	sink->lat_min = lat < sink->lat_min ? lat : sink->lat_min;
+	sink->lat_max = lat > sink->lat_max ? lat : sink->lat_max;
+	lat /= 1000;
+	sink->lat_hist[lat < BENCH_LATENCY_BUCKETS ? lat : BENCH_LATENCY_BUCKETS - 1]++;
+}
+
+/**
+ * Get the latency (us) under which a ratio of the frames were received
+ */
+uint64_t bench_percentile(struct bench_sink *sink, double ratio)
+{
+	uint64_t target = (uint64_t)(ratio * sink->received);
+	uint64_t sum = 0;
+	uint64_t i;
+
+	for(i = 0; i < BENCH_LATENCY_BUCKETS - 1; i++)
+	{
+		sum += sink->lat_hist[i];
+		if(sum > target)
+		{
+			break;
+		}
+	}
+	return i;
+}
+
+void bench_sink_print_stats(struct bench_sink *sink)
+{
+	fprintf(stdout, "Sink statistics\n");
+	fprintf(stdout, "  - received:   %lu frames, %lu bytes\n", sink->received, sink->bytes);
+	fprintf(stdout, "  - lost:       %lu frames\n", sink->lost);
+	fprintf(stdout, "  - late:       %lu frames\n", sink->late);
+	fprintf(stdout, "  - duplicated: %lu frames\n", sink->duplicates);
+	fprintf(stdout, "  - corrupted:  %lu frames\n", sink->corrupted);
+	if(sink->received == 0)
+	{
+		return;
+	}
+	fprintf(stdout, "  - latency:    min %.1f us, avg %.1f us, max %.1f us\n", sink->lat_min / 1000.0,
+	        (double)sink->lat_sum / sink->received / 1000.0, sink->lat_max / 1000.0);
+	fprintf(stdout, "  - percentile: p50 %lu us, p99 %lu us, p99.9 %lu us%s\n", bench_percentile(sink, 0.5),
+	        bench_percentile(sink, 0.99), bench_percentile(sink, 0.999),
+	        sink->lat_max / 1000 >= BENCH_LATENCY_BUCKETS - 1 ? " (capped)" : "");
+}
@@ -0,0 +1,153 @@
+// Copyright 2023, Viveris Technologies
+// Distributed under the terms of the MIT License
+
+#ifndef __BENCH_TRAFFIC_H__
+#define __BENCH_TRAFFIC_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define BENCH_MAX_SIZES 16
+#define BENCH_MAX_DSCPS 16
+#define BENCH_MIN_FRAME_LEN 64   // Ethernet, IPv4 and UDP headers then the stamp
+#define BENCH_MAX_FRAME_LEN 9014 // jumbo frame without FCS
+#define BENCH_LATENCY_BUCKETS 100000 // 1 us buckets, the last one holds the overflow
+#define BENCH_SEQ_WINDOW 1024 // frames tracked behind the latest one to sort late and duplicated frames
+#define BENCH_FLOW_FRAME_LEN 128 // headers of the flows and some payload
+#define BENCH_GSE_MAX_PDU_LEN 1600 // of the GSE packets drawn to fuzz the decoders
+
+/**
+ * Distribution of the generated frame lengths, either a length drawn
+ * uniformly between min and max or a weighted mix of lengths
+ */
+struct bench_sizes
+{
+	unsigned int min;
+	unsigned int max;
+
+	unsigned int count;
+	unsigned int len[BENCH_MAX_SIZES];
+	unsigned int weight[BENCH_MAX_SIZES];
+	unsigned int total;
+};
+
+/**
+ * Weighted mix of DSCP values
+ */
+struct bench_dscp
+{
+	unsigned int count;
+	uint8_t dscp[BENCH_MAX_DSCPS];
+	unsigned int weight[BENCH_MAX_DSCPS];
+	unsigned int total;
+};
+
+/**
+ * Generator of synthetic Ethernet/IPv4/UDP frames, each one stamped with a
+ * sequence number and its generation time
+ */
+struct bench_gen
+{
+	struct bench_sizes sizes;
+	struct bench_dscp dscp;
+	uint64_t rand;
+
+	uint64_t seq;
+	uint64_t bytes;
+};
+
+/**
+ * Sink of the generated frames, checking their order, integrity and latency
+ */
+struct bench_sink
+{
+	uint64_t received;
+	uint64_t bytes;
+	uint64_t lost;
+	uint64_t late;
+	uint64_t duplicates;
+	uint64_t corrupted;
+
+	// Sequences seen behind the latest one
+	uint64_t next;
+	uint64_t seen[BENCH_SEQ_WINDOW / 64];
+
+	uint64_t lat_min;
+	uint64_t lat_max;
+	uint64_t lat_sum;
+	uint64_t *lat_hist;
+};
+
+/**
+ * Draw a pseudo-random number (xorshift64*)
+ */
+uint64_t bench_rand(uint64_t *state);
+
+/**
+ * Parse a frame lengths distribution: "LEN", "MIN-MAX", "LEN:WEIGHT,..."
+ * or "imix" (64, 594 and 1518 bytes in a 7:4:1 ratio)
+ *
+ * Return 0 on success, -1 otherwise
+ */
+int bench_parse_sizes(const char *str, struct bench_sizes *sizes);
+
+/**
+ * Parse a DSCP mix: "DSCP:WEIGHT,..." where the weight may be omitted
+ *
+ * Return 0 on success, -1 otherwise
+ */
+int bench_parse_dscp(const char *str, struct bench_dscp *dscp);
+
+/**
+ * Initialize a generator
+ */
+void bench_gen_init(struct bench_gen *gen, const struct bench_sizes *sizes, const struct bench_dscp *dscp);
+
+/**
+ * Write the next frame, stamped with the time now_ns, in a buffer of at least
+ * BENCH_MAX_FRAME_LEN bytes
+ *
+ * Return the frame length
+ */
+size_t bench_gen_frame(struct bench_gen *gen, unsigned char *buffer, uint64_t now_ns);
+
+/**
+ * Write a frame of a flow drawn among flows ones, in a buffer of at least
+ * BENCH_FLOW_FRAME_LEN bytes. The flows take turns between IPv4/UDP,
+ * IPv4/TCP in a VLAN, IPv6/UDP in Q in Q and IPv6/TCP behind a hop-by-hop
+ * options header.
+ *
+ * Return the frame length
+ */
+size_t bench_flow_frame(struct bench_gen *gen, uint64_t flows, unsigned char *buffer);
+
+/**
+ * Fill a buffer with a GSE frame to fuzz the decoders: complete packets,
+ * fragments and extension headers of every label type, then padding. A
+ * quarter of the frames get some bits flipped.
+ */
+void bench_gse_frame(struct bench_gen *gen, unsigned char *buffer, size_t len);
+
+/**
+ * Initialize a sink
+ *
+ * Return 0 on success, -1 otherwise
+ */
+int bench_sink_init(struct bench_sink *sink);
+
+/**
+ * Release the resources of a sink
+ */
+void bench_sink_release(struct bench_sink *sink);
+
+/**
+ * Account a frame received at the time now_ns
+ */
+void bench_sink_frame(struct bench_sink *sink, const unsigned char *data, size_t len, uint64_t now_ns);
+
+/**
+ * Print the sink counters and latency percentiles
+ */
+void bench_sink_print_stats(struct bench_sink *sink);
+
+#endif
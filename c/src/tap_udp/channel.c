@@ -0,0 +1,289 @@
+// Copyright 2023, Viveris Technologies
+// Distributed under the terms of the MIT License
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "channel.h"
+#include "hugemem.h"
+
+/**
+ * Output of the frames fired by an advance of the wheel
+ */
+struct channel_delivery
+{
+	struct channel *chan;
+	channel_output_t output;
+	void *arg;
+	int ret;
+};
+
+/**
+ * Draw a pseudo-random number in [0, 1) (xorshift64*)
+ */
+double channel_rand(struct channel *chan)
+{
+	uint64_t x = chan->rand;
+
+	x ^= x >> 12;
+	x ^= x << 25;
+	x ^= x >> 27;
+	chan->rand = x;
+	return ((x * 0x2545F4914F6CDD1DULL) >> 11) * 0x1.0p-53;
+}
+
+/**
+ * Parse a probability in percents
+ *
+ * Return 0 on success, -1 otherwise
+ */
+int channel_parse_percent(const char *str, double *prob)
+{
+	char *end;
+	double val;
+
+	val = strtod(str, &end);
+	if(end == str || *end != '\0' || val < 0 || val > 100)
+	{
+		return -1;
+	}
+	*prob = val / 100;
+	return 0;
+}
+
+int channel_parse_loss(const char *str, struct channel_params *params)
+{
+	char buf[64];
+	char *fields[4], *item, *save;
+	int count = 0;
+
+	if(strlen(str) >= sizeof(buf))
+	{
+		return -1;
+	}
+	strcpy(buf, str);
+	for(item = strtok_r(buf, ":", &save); item != NULL; item = strtok_r(NULL, ":", &save))
+	{
+		if(count == 4)
+		{
+			return -1;
+		}
+		fields[count++] = item;
+	}
+
+	// Independent losses: a good state never left
+	if(count == 1)
+	{
+		params->p_bad = 0;
+		params->p_good = 1;
+		params->loss_bad = 1;
+		return channel_parse_percent(fields[0], &(params->loss_good));
+	}
+	if(count != 2 && count != 4)
+	{
+		return -1;
+	}
+	params->loss_good = 0;
+	params->loss_bad = 1;
+	if(channel_parse_percent(fields[0], &(params->p_bad)) != 0 ||
+	   channel_parse_percent(fields[1], &(params->p_good)) != 0)
+	{
+		return -1;
+	}
+	if(count == 4 &&
+	   (channel_parse_percent(fields[2], &(params->loss_good)) != 0 ||
+	    channel_parse_percent(fields[3], &(params->loss_bad)) != 0))
+	{
+		return -1;
+	}
+	return 0;
+}
+
+struct channel *channel_create(struct channel_params *params, size_t frame_len, uint64_t now_ns)
+{
+	struct channel *chan;
+	size_t slot_count;
+	size_t i;
+
+	if((chan = (struct channel *)malloc(sizeof(struct channel))) == NULL)
+	{
+		return NULL;
+	}
+	memset(chan, 0, sizeof(struct channel));
+	memcpy(&(chan->params), params, sizeof(struct channel_params));
+	chan->frame_len = frame_len;
+	// A null state would stay null
+	chan->rand = params->seed != 0 ? params->seed : 0x9E3779B97F4A7C15ULL;
+	chan->link_free_ns = now_ns;
+
+	// A round of the wheel covers the delay and the jitter, the frames held
+	// longer by the serialization wait for the next rounds
+	slot_count = (params->delay_us + params->jitter_us) * 1000 / CHANNEL_TICK_NS + 1;
+	if(slot_count > CHANNEL_MAX_WHEEL_SLOTS)
+	{
+		slot_count = CHANNEL_MAX_WHEEL_SLOTS;
+	}
+	if((chan->arena = (unsigned char *)hugemem_alloc(params->frames * frame_len)) == NULL ||
+	   (chan->frames = (struct channel_frame *)calloc(params->frames, sizeof(struct channel_frame))) == NULL ||
+	   (chan->free_stack = (struct channel_frame **)calloc(params->frames, sizeof(struct channel_frame *))) == NULL ||
+	   (chan->wheel = timer_wheel_create(slot_count, now_ns / CHANNEL_TICK_NS)) == NULL)
+	{
+		channel_delete(chan);
+		return NULL;
+	}
+	for(i = 0; i < params->frames; i++)
+	{
+		chan->frames[i].data = chan->arena + i * frame_len;
+		chan->free_stack[i] = &(chan->frames[i]);
+	}
+	chan->free_count = params->frames;
+	return chan;
+}
+
+void channel_delete(struct channel *chan)
+{
+	if(chan == NULL)
+	{
+		return;
+	}
+	timer_wheel_delete(chan->wheel);
+	free(chan->free_stack);
+	free(chan->frames);
+	hugemem_free(chan->arena);
+	free(chan);
+}
+
+void channel_set_rate(struct channel *chan, unsigned long rate_kbps)
+{
+	chan->params.rate_kbps = rate_kbps;
+}
+
+int channel_push(struct channel *chan, struct udp_addr *remote, const struct iovec *iov, int count, uint64_t now_ns)
+{
+	struct channel_params *params = &(chan->params);
+	struct channel_frame *frame;
+	uint64_t arrival_ns;
+	double delay_ns, loss;
+	size_t len = 0, in_flight;
+	int i;
+
+	chan->stats.frames++;
+	for(i = 0; i < count; i++)
+	{
+		len += iov[i].iov_len;
+	}
+	if(len > chan->frame_len)
+	{
+		chan->stats.too_long++;
+		return 1;
+	}
+
+	// Loss model, drawn for every frame so that the state goes on over time
+	if(chan->bad)
+	{
+		chan->bad = channel_rand(chan) >= params->p_good;
+	}
+	else
+	{
+		chan->bad = channel_rand(chan) < params->p_bad;
+	}
+	chan->stats.bad_frames += chan->bad;
+	loss = chan->bad ? params->loss_bad : params->loss_good;
+	if(loss > 0 && channel_rand(chan) < loss)
+	{
+		chan->stats.lost++;
+		return 1;
+	}
+
+	if(chan->free_count == 0)
+	{
+		chan->stats.queue_full++;
+		return 1;
+	}
+	frame = chan->free_stack[--chan->free_count];
+	in_flight = params->frames - chan->free_count;
+	if(in_flight > chan->stats.max_in_flight)
+	{
+		chan->stats.max_in_flight = in_flight;
+	}
+	frame->remote = *remote;
+	frame->len = len;
+	len = 0;
+	for(i = 0; i < count; i++)
+	{
+		memcpy(frame->data + len, iov[i].iov_base, iov[i].iov_len);
+		len += iov[i].iov_len;
+	}
+
+	// The frame waits for the end of the previous one on the link
+	if(chan->link_free_ns < now_ns)
+	{
+		chan->link_free_ns = now_ns;
+	}
+	if(params->rate_kbps > 0)
+	{
+		chan->link_free_ns += len * 8000000ULL / params->rate_kbps;
+	}
+	delay_ns = params->delay_us * 1000.0;
+	if(params->jitter_us > 0)
+	{
+		delay_ns += (channel_rand(chan) * 2 - 1) * params->jitter_us * 1000.0;
+	}
+	arrival_ns = chan->link_free_ns + (delay_ns > 0 ? (uint64_t)delay_ns : 0);
+	timer_wheel_add(chan->wheel, &(frame->timer), (arrival_ns + CHANNEL_TICK_NS - 1) / CHANNEL_TICK_NS);
+	return 0;
+}
+
+/**
+ * Give a frame arrived to the output handler and its buffer back to the
+ * arena
+ */
+void channel_deliver(struct tw_timer *timer, void *arg)
+{
+	struct channel_delivery *delivery = (struct channel_delivery *)arg;
+	struct channel_frame *frame = (struct channel_frame *)timer;
+	struct channel *chan = delivery->chan;
+
+	if(delivery->output(&(frame->remote), frame->data, frame->len, delivery->arg) != 0)
+	{
+		delivery->ret = -1;
+	}
+	chan->stats.delivered++;
+	chan->free_stack[chan->free_count++] = frame;
+}
+
+int channel_advance(struct channel *chan, uint64_t now_ns, channel_output_t output, void *arg)
+{
+	struct channel_delivery delivery = {chan, output, arg, 0};
+
+	timer_wheel_advance(chan->wheel, now_ns / CHANNEL_TICK_NS, channel_deliver, &delivery);
+	return delivery.ret;
+}
+
+size_t channel_in_flight(struct channel *chan)
+{
+	return chan->params.frames - chan->free_count;
+}
+
+uint64_t channel_backlog_ns(struct channel *chan, uint64_t now_ns)
+{
+	return chan->link_free_ns > now_ns ? chan->link_free_ns - now_ns : 0;
+}
+
+void channel_print_stats(struct channel *chan)
+{
+	struct channel_params *params = &(chan->params);
+	struct channel_stats *stats = &(chan->stats);
+
+	fprintf(stdout, "Channel emulation statistics\n");
+	fprintf(stdout, "  - settings:           %lu us delay, %lu us jitter, %lu kbit/s\n",
+	        params->delay_us, params->jitter_us, params->rate_kbps);
+	fprintf(stdout, "  - memory:             %zu buffers of %zu bytes, %zu used at most\n",
+	        params->frames, chan->frame_len, stats->max_in_flight);
+	fprintf(stdout, "  - frames:             %lu sent, %lu delivered, %zu in flight\n",
+	        stats->frames, stats->delivered, channel_in_flight(chan));
+	fprintf(stdout, "  - frames dropped:     %lu lost, %lu full, %lu too long\n",
+	        stats->lost, stats->queue_full, stats->too_long);
+	fprintf(stdout, "  - loss model:         %lu frames in the bad state\n", stats->bad_frames);
+}
@@ -0,0 +1,157 @@
+// Copyright 2023, Viveris Technologies
+// Distributed under the terms of the MIT License
+
+#ifndef __CHANNEL_H__
+#define __CHANNEL_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/uio.h>
+
+#include "timer_wheel.h"
+#include "udp.h"
+
+#define CHANNEL_TICK_NS 100000 // Granularity of the frame deliveries
+#define CHANNEL_MAX_WHEEL_SLOTS (1 << 16)
+
+/**
+ * Channel emulation settings, disabled when frames is 0
+ *
+ * The losses follow a Gilbert-Elliott model: before each frame, the channel
+ * goes from the good to the bad state with probability p_bad, and back with
+ * probability p_good, then the frame is lost with the loss probability of
+ * the state.
+ */
+struct channel_params
+{
+	unsigned long delay_us;   // propagation delay
+	unsigned long jitter_us;  // uniform delay variation, on both sides of the delay
+	unsigned long rate_kbps;  // serialization rate, unlimited when 0
+
+	double p_bad;
+	double p_good;
+	double loss_good;
+	double loss_bad;
+
+	uint64_t seed;  // same seed, same losses and delays
+	size_t frames;  // frames in flight at most
+};
+
+/**
+ * Frame in flight on the channel
+ */
+struct channel_frame
+{
+	// First member, the expiry handler gets the frame back from the timer
+	struct tw_timer timer;
+
+	struct udp_addr remote;
+	size_t len;
+	unsigned char *data;
+};
+
+/**
+ * Channel counters
+ */
+struct channel_stats
+{
+	uint64_t frames;
+	uint64_t delivered;
+	uint64_t lost;        // dropped by the loss model
+	uint64_t bad_frames;  // frames seen in the bad state
+	uint64_t queue_full;  // dropped, every frame buffer being in flight
+	uint64_t too_long;
+	size_t max_in_flight;
+};
+
+/**
+ * Emulated satellite channel
+ *
+ * The frames are copied into buffers carved once from an arena, wait for the
+ * serialization of the previous ones at the channel rate, then are held
+ * for the delay and the jitter by a timer wheel. The random draws come from
+ * a generator seeded by the settings, so that a run is reproduced with the
+ * same seed. The jitter may reorder the frames. Not thread-safe.
+ */
+struct channel
+{
+	struct channel_params params;
+	size_t frame_len;
+
+	unsigned char *arena;
+	struct channel_frame *frames;
+	struct channel_frame **free_stack;
+	size_t free_count;
+	struct timer_wheel *wheel;
+
+	uint64_t rand;
+	int bad;               // state of the loss model
+	uint64_t link_free_ns; // end of the serialization of the last frame
+
+	struct channel_stats stats;
+};
+
+/**
+ * Handler of a frame coming out of the channel
+ *
+ * Return 0 on success, -1 otherwise
+ */
+typedef int (*channel_output_t)(struct udp_addr *remote, unsigned char *data, size_t len, void *arg);
+
+/**
+ * Parse loss settings (format: "LOSS" for independent losses, or
+ * "P_BAD:P_GOOD[:LOSS_GOOD:LOSS_BAD]" for a Gilbert-Elliott model, all in
+ * percents, LOSS_GOOD being 0 and LOSS_BAD 100 by default)
+ *
+ * Return 0 on success, -1 otherwise
+ */
+int channel_parse_loss(const char *str, struct channel_params *params);
+
+/**
+ * Create a channel of frame buffers of frame_len bytes, at time now_ns
+ *
+ * Return the channel on success, NULL otherwise
+ */
+struct channel *channel_create(struct channel_params *params, size_t frame_len, uint64_t now_ns);
+
+/**
+ * Delete a channel, the frames in flight are dropped
+ */
+void channel_delete(struct channel *chan);
+
+/**
+ * Change the serialization rate, unlimited when 0, from the next frame: the
+ * frames pushed before keep their departure
+ */
+void channel_set_rate(struct channel *chan, unsigned long rate_kbps);
+
+/**
+ * Put a frame gathered from several buffers on the channel at time now_ns
+ *
+ * Return 0 when the frame is in flight, 1 when it is dropped
+ */
+int channel_push(struct channel *chan, struct udp_addr *remote, const struct iovec *iov, int count, uint64_t now_ns);
+
+/**
+ * Give the frames arrived at time now_ns to the output handler
+ *
+ * Return 0 on success, -1 if the handler failed
+ */
+int channel_advance(struct channel *chan, uint64_t now_ns, channel_output_t output, void *arg);
+
+/**
+ * Get the number of frames in flight
+ */
+size_t channel_in_flight(struct channel *chan);
+
+/**
+ * Get the time to serialize the frames queued on the link at time now_ns
+ */
+uint64_t channel_backlog_ns(struct channel *chan, uint64_t now_ns);
+
+/**
+ * Print the channel counters
+ */
+void channel_print_stats(struct channel *chan);
+
+#endif
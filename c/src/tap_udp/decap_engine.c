@@ -0,0 +1,388 @@
+// Copyright 2023, Viveris Technologies
+// Distributed under the terms of the MIT License
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "bb_header.h"
+#include "crc32.h"
+#include "decap_engine.h"
+#include "gf256.h"
+#include "gse_header.h"
+#include "pkt_header.h"
+#include "tunnel_header.h"
+#include "tunnel_log.h"
+#include "utils.h"
+
+#define FRAG_ID_COUNT 255 // libGSE reassembles one PDU per QoS, used as fragment ID
+
+/**
+ * Destination of the frames delivered by the reorder window
+ */
+struct decap_deliver {
+  struct decap_ctxt *ctxt;
+  decap_pdu_handler_t handler;
+  void *arg;
+};
+
+int deliver_frame(unsigned char *data, size_t len, void *arg);
+int recover_frame(uint32_t seq, unsigned char *data, size_t len, void *arg);
+int reasm_frame(struct decap_ctxt *ctxt, unsigned char *data, size_t len,
+                decap_pdu_handler_t handler, void *arg);
+
+const char *decap_perf_names[DECAP_PERF_COUNT] = {"UDP receive",
+                                                  "GSE de-encap", "TAP write"};
+
+int decap_datagram(struct decap_ctxt *ctxt, unsigned char *data, size_t len,
+                   decap_pdu_handler_t handler, void *arg) {
+  struct tunnel_header hdr;
+  struct decap_deliver deliver = {ctxt, handler, arg};
+
+  if (ctxt->reorder == NULL) {
+    return decap_frame(ctxt, data, len, handler, arg);
+  }
+  if (tunnel_header_parse(data, len, &hdr) != 0) {
+    ctxt->reorder->stats.invalid++;
+    return 0;
+  }
+  if (hdr.type == TUNNEL_TYPE_PARITY) {
+    if (ctxt->fec == NULL) {
+      return 0;
+    }
+    return fec_decoder_parity(ctxt->fec, &hdr, data + TUNNEL_HEADER_LEN,
+                              len - TUNNEL_HEADER_LEN, recover_frame,
+                              &deliver);
+  } else if (hdr.type != TUNNEL_TYPE_DATA) {
+    ctxt->reorder->stats.invalid++;
+    return 0;
+  }
+  if (ctxt->fec != NULL) {
+    fec_decoder_data(ctxt->fec, hdr.seq, data + TUNNEL_HEADER_LEN,
+                     len - TUNNEL_HEADER_LEN);
+  }
+  return reorder_frame(ctxt->reorder, hdr.seq, data + TUNNEL_HEADER_LEN,
+                       len - TUNNEL_HEADER_LEN, monotonic_ms(), deliver_frame,
+                       &deliver);
+}
+
+int deliver_frame(unsigned char *data, size_t len, void *arg) {
+  struct decap_deliver *deliver = (struct decap_deliver *)arg;
+
+  return decap_frame(deliver->ctxt, data, len, deliver->handler,
+                     deliver->arg);
+}
+
+int recover_frame(uint32_t seq, unsigned char *data, size_t len, void *arg) {
+  struct decap_deliver *deliver = (struct decap_deliver *)arg;
+
+  // Rebuilt frames come late, the reorder window puts them back in place
+  return reorder_frame(deliver->ctxt->reorder, seq, data, len, monotonic_ms(),
+                       deliver_frame, arg);
+}
+
+int flush_frames(struct decap_ctxt *ctxt, decap_pdu_handler_t handler,
+                 void *arg) {
+  struct decap_deliver deliver = {ctxt, handler, arg};
+
+  if (ctxt->reorder == NULL) {
+    return 0;
+  }
+  return reorder_flush(ctxt->reorder, monotonic_ms(), deliver_frame, &deliver);
+}
+
+int drain_frames(struct decap_ctxt *ctxt, decap_pdu_handler_t handler,
+                 void *arg) {
+  struct decap_deliver deliver = {ctxt, handler, arg};
+  int draining = ctxt->draining;
+  int ret;
+
+  if (ctxt->reorder == NULL) {
+    return 0;
+  }
+  ctxt->draining = 1;
+  ret = reorder_flush(ctxt->reorder, UINT64_MAX, deliver_frame, &deliver);
+  ctxt->draining = draining;
+  return ret;
+}
+
+int decap_frame(struct decap_ctxt *ctxt, unsigned char *data_received,
+                size_t len_received, decap_pdu_handler_t handler, void *arg) {
+  int ret;
+  size_t len_decapsulated;
+
+  uint8_t label_type;
+  uint8_t label[6];
+  uint16_t protocol;
+  uint16_t gse_length;
+  struct gse_header hdr;
+
+  gse_vfrag_t *vfrag_pkt = NULL;
+  struct decap_pdu pdu;
+  struct bb_header bb;
+
+  // Only the data field of a BBFrame holds GSE packets
+  if (ctxt->bb_header) {
+    if (bb_header_parse(data_received, len_received, &bb) != 0 ||
+        bb.dfl / 8 > len_received - BB_HEADER_LEN) {
+      log_ring_write(log_invalid_bb_header);
+      return 0;
+    }
+    data_received += BB_HEADER_LEN;
+    len_received = bb.dfl / 8;
+  }
+  if (ctxt->reasm != NULL) {
+    return reasm_frame(ctxt, data_received, len_received, handler, arg);
+  }
+  if (ctxt->filter != NULL) {
+    label_filter_new_frame(ctxt->filter);
+  }
+  memset(&pdu, 0, sizeof(struct decap_pdu));
+
+  len_decapsulated = 0;
+  while (len_decapsulated < len_received &&
+         (alive == 0 || ctxt->draining)) {
+    // Padding, labels and complete packets in a single pass, before any copy
+    ret = gse_parse_header(data_received + len_decapsulated,
+                           len_received - len_decapsulated, &hdr);
+    if (ret > 0) {
+      // No more packets, only padding left
+      break;
+    } else if (ret == 0) {
+      // Skip the packets addressed to other terminals
+      if (ctxt->filter != NULL && !label_filter_accept(ctxt->filter, &hdr)) {
+        len_decapsulated += hdr.packet_len;
+        continue;
+      }
+      // A complete packet needs no reassembly: its PDU is handed in place
+      if (ctxt->in_place && gse_complete_packet(&hdr)) {
+        pdu.data = data_received + len_decapsulated + hdr.header_len;
+        pdu.len = hdr.packet_len - hdr.header_len;
+        if (handler(&pdu, arg) != 0) {
+          return -1;
+        }
+        len_decapsulated += hdr.packet_len;
+        continue;
+      }
+    }
+
+    ret = gse_create_vfrag_with_data(
+        &vfrag_pkt, len_received - len_decapsulated, 0, 0,
+        data_received + len_decapsulated, len_received - len_decapsulated);
+    if (ret > GSE_STATUS_OK) {
+      log_ring_write(log_decap_vfrag_failed, LOG_STR(gse_get_status(ret)),
+                     LOG_INT(ret), LOG_INT(len_decapsulated),
+                     LOG_INT(len_received));
+      return -1;
+    }
+
+    ret = gse_deencap_packet(vfrag_pkt, ctxt->decap, &label_type, label,
+                             &protocol, &(pdu.vfrag), &gse_length);
+
+    if ((ret > GSE_STATUS_OK) && (ret != GSE_STATUS_PDU_RECEIVED) &&
+        (ret != GSE_STATUS_DATA_OVERWRITTEN) &&
+        (ret != GSE_STATUS_PADDING_DETECTED)) {
+      log_ring_write(log_decap_packet_failed, LOG_STR(gse_get_status(ret)),
+                     LOG_INT(ret));
+    }
+
+    if (ret == GSE_STATUS_INVALID_DATA_LENGTH) {
+      log_ring_write(log_decap_invalid_length, LOG_STR(gse_get_status(ret)),
+                     LOG_INT(ret));
+    }
+
+    len_decapsulated += gse_length;
+    if (ret == GSE_STATUS_DATA_OVERWRITTEN) {
+      log_ring_write(log_decap_pdu_dropped);
+    }
+
+    if (ret == GSE_STATUS_PADDING_DETECTED) {
+      // No more packets, only padding left
+      break;
+    }
+
+    if (ret == GSE_STATUS_PDU_RECEIVED) {
+      pdu.data = gse_get_vfrag_start(pdu.vfrag);
+      pdu.len = gse_get_vfrag_length(pdu.vfrag);
+      if (handler(&pdu, arg) != 0) {
+        return -1;
+      }
+      pdu.vfrag = NULL;
+    }
+  }
+  return 0;
+}
+
+int reasm_frame(struct decap_ctxt *ctxt, unsigned char *data_received,
+                size_t len_received, decap_pdu_handler_t handler, void *arg) {
+  int ret;
+  size_t len_decapsulated = 0;
+  struct gse_header hdr;
+  struct decap_pdu pdu;
+
+  expire_pdus(ctxt);
+  if (ctxt->filter != NULL) {
+    label_filter_new_frame(ctxt->filter);
+  }
+  memset(&pdu, 0, sizeof(struct decap_pdu));
+
+  while (len_decapsulated < len_received &&
+         (alive == 0 || ctxt->draining)) {
+    ret = gse_parse_header(data_received + len_decapsulated,
+                           len_received - len_decapsulated, &hdr);
+    if (ret > 0) {
+      // No more packets, only padding left
+      break;
+    } else if (ret < 0) {
+      log_ring_write(log_invalid_gse_packet);
+      break;
+    }
+    if (ctxt->filter == NULL || label_filter_accept(ctxt->filter, &hdr)) {
+      if (reasm_packet(ctxt->reasm, data_received + len_decapsulated, &hdr,
+                       &(pdu.slot)) > 0) {
+        pdu.data = pdu.slot->data;
+        pdu.len = pdu.slot->len;
+        if (handler(&pdu, arg) != 0) {
+          return -1;
+        }
+        pdu.slot = NULL;
+      }
+    }
+    len_decapsulated += hdr.packet_len;
+  }
+  return 0;
+}
+
+void release_pdu(struct decap_ctxt *ctxt, struct decap_pdu *pdu) {
+  int ret;
+
+  if (pdu->vfrag != NULL &&
+      (ret = gse_free_vfrag(&(pdu->vfrag))) != GSE_STATUS_OK) {
+    fprintf(stdout, "Decapsulation PDU cleaning failed: %s (%d)\n",
+            gse_get_status(ret), ret);
+  }
+  if (pdu->slot != NULL) {
+    reasm_release(ctxt->reasm, pdu->slot);
+  }
+  memset(pdu, 0, sizeof(struct decap_pdu));
+}
+
+void expire_pdus(struct decap_ctxt *ctxt) {
+  if (ctxt->reasm != NULL) {
+    reasm_expire(ctxt->reasm, monotonic_ms());
+  }
+}
+
+struct decap_ctxt *create_ctxt(struct process_decap_params *params) {
+  struct decap_ctxt *ctxt;
+  int ret;
+
+  if ((ctxt = (struct decap_ctxt *)malloc(sizeof(struct decap_ctxt))) == NULL) {
+    return NULL;
+  }
+  memset(ctxt, 0, sizeof(struct decap_ctxt));
+  memcpy(&(ctxt->timeout), &(params->read_timeout), sizeof(struct timespec));
+  memcpy(&(ctxt->remote), &(params->remote), sizeof(struct udp_addr));
+  ctxt->recv_len = params->payload_len;
+  ctxt->bb_header = params->bb_header;
+  ctxt->in_place = 1;
+  ctxt->tap_fd = -1;
+
+  ctxt->udp_fd = -1;
+  if (params->shm_name[0] != '\0') {
+    // Same dimensions as the encapsulation side, whichever creates the ring
+    if ((ctxt->shm = shm_ring_open(params->shm_name, SHM_RING_DEFAULT_SLOTS,
+                                   params->payload_len + TUNNEL_HEADER_LEN +
+                                       FEC_LEN_PREFIX)) == NULL) {
+      fprintf(stderr, "Shared memory ring %s opening failed\n",
+              params->shm_name);
+      free(ctxt);
+      return NULL;
+    }
+  } else if ((ctxt->udp_fd = handoff_take_udp(params->handoff,
+                                               &(params->local))) < 0 &&
+             (ctxt->udp_fd = open_udp(&(params->local))) < 0) {
+    char l_addr[256];
+    ipv4_address_str(params->local.addr, l_addr);
+    fprintf(stderr, "UDP tunnel opening on %s:%u failed\n", l_addr,
+            params->local.port);
+    free(ctxt);
+    return NULL;
+  }
+  if (label_filter_enabled(&(params->filter))) {
+    if ((ctxt->filter = (struct label_filter *)malloc(
+             sizeof(struct label_filter))) == NULL) {
+      delete_ctxt(ctxt);
+      return NULL;
+    }
+    memcpy(ctxt->filter, &(params->filter), sizeof(struct label_filter));
+  }
+  if (params->reorder_window > 0) {
+    // The tunnel header comes on top of the GSE frame
+    ctxt->recv_len += TUNNEL_HEADER_LEN;
+    if ((ctxt->reorder = reorder_create(
+             params->reorder_window, params->payload_len,
+             time_to_long(params->reorder_timeout))) == NULL) {
+      fprintf(stderr, "Reorder window allocation failed\n");
+      delete_ctxt(ctxt);
+      return NULL;
+    }
+    if (params->fec_history > 0) {
+      gf256_init();
+      if ((ctxt->fec = fec_decoder_create(params->fec_history,
+                                          params->payload_len)) == NULL) {
+        fprintf(stderr, "FEC decoder allocation failed\n");
+        delete_ctxt(ctxt);
+        return NULL;
+      }
+    }
+  }
+  if (params->reasm_slots > 0) {
+    crc32_init();
+    if ((ctxt->reasm = reasm_create(params->reasm_slots, params->buffer_len,
+                                    time_to_long(params->reasm_timeout),
+                                    monotonic_ms())) == NULL) {
+      fprintf(stderr, "Reassembly buffers allocation failed\n");
+      delete_ctxt(ctxt);
+      return NULL;
+    }
+  } else if ((ret = gse_deencap_init(FRAG_ID_COUNT, &(ctxt->decap))) !=
+             GSE_STATUS_OK) {
+    fprintf(stderr, "Deencapsulator initialization failed: %s (%d)\n",
+            gse_get_status(ret), ret);
+    ctxt->decap = NULL;
+    delete_ctxt(ctxt);
+    return NULL;
+  }
+  if (params->perf_period > 0 &&
+      (ctxt->perf = perf_counters_create(decap_perf_names, DECAP_PERF_COUNT,
+                                         params->perf_period)) == NULL) {
+    delete_ctxt(ctxt);
+    return NULL;
+  }
+
+  return ctxt;
+}
+
+void delete_ctxt(struct decap_ctxt *ctxt) {
+  if (ctxt == NULL) {
+    return;
+  }
+  perf_counters_delete(ctxt->perf);
+  if (ctxt->decap != NULL) {
+    gse_deencap_release(ctxt->decap);
+  }
+  reasm_delete(ctxt->reasm);
+  fec_decoder_delete(ctxt->fec);
+  reorder_delete(ctxt->reorder);
+  free(ctxt->filter);
+  shm_ring_close(ctxt->shm);
+  if (ctxt->udp_fd >= 0) {
+    close(ctxt->udp_fd);
+  }
+  if (ctxt->tap_fd >= 0) {
+    close(ctxt->tap_fd);
+  }
+  free(ctxt);
+}
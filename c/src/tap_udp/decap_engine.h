@@ -0,0 +1,143 @@
+// Copyright 2023, Viveris Technologies
+// Distributed under the terms of the MIT License
+
+#ifndef __DECAP_ENGINE_H__
+#define __DECAP_ENGINE_H__
+
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdint.h>
+
+#include "fec.h"
+#include "label_filter.h"
+#include "perf_counters.h"
+#include "process_decap.h"
+#include "reasm.h"
+#include "reorder.h"
+#include "shm_ring.h"
+
+/*
+ * De-encapsulation engine: from the UDP frames to the PDUs, whatever the
+ * PDUs go to
+ */
+
+// Stop flag of the processing loops, defined by each program: set by the
+// signal handler and by the threads stopping the others, hence atomic, and
+// lock-free so that the handler may write it
+extern atomic_int alive;
+
+// Stages of the de-encapsulation accounted by the hardware counters
+enum decap_perf_stage {
+  DECAP_PERF_UDP_RECV = 0,
+  DECAP_PERF_DEENCAP,
+  DECAP_PERF_TAP_WRITE,
+  DECAP_PERF_COUNT
+};
+
+struct decap_ctxt {
+  struct timespec timeout;
+  sigset_t sigmask;
+  struct udp_addr remote;
+
+  int udp_fd;           // -1 when the frames come from a shared memory ring
+  struct shm_ring *shm; // NULL when the frames come from UDP
+  int tap_fd; // opened by the program when it writes the PDUs to a TAP
+
+  gse_deencap_t *decap;
+  struct reasm *reasm;
+  struct reorder *reorder;
+  struct fec_decoder *fec;
+  struct label_filter *filter;
+  struct perf_counters *perf; // NULL when not enabled
+
+  int recv_len;
+  int bb_header; // frames starting with a DVB-S2 baseband header
+  int in_place;  // complete PDUs handed in the received frame, no copy
+  // Frames parsed to their end despite the stop: while drained, or all along
+  // when the stop may come from the next process taking over
+  int draining;
+
+  // Settings changed by the control socket, NULL without it, read by the
+  // thread running the label filter
+  struct live_config *live;
+  int reader;
+};
+
+/**
+ * De-encapsulated PDU, held either by a libGSE virtual fragment, by a
+ * reassembly buffer or, when both are NULL, by the received frame
+ */
+struct decap_pdu {
+  unsigned char *data;
+  size_t len;
+  gse_vfrag_t *vfrag;
+  struct reasm_slot *slot;
+};
+
+/**
+ * Handler of a de-encapsulated PDU, it takes the ownership of the PDU. A PDU
+ * held by the received frame is only valid until the frame is released.
+ *
+ * Return 0 on success, -1 on error
+ */
+typedef int (*decap_pdu_handler_t)(struct decap_pdu *pdu, void *arg);
+
+/**
+ * Create the de-encapsulation context: UDP socket or shared memory ring,
+ * label filter, reorder window, FEC decoder, reassembly, either native or by
+ * libGSE, and hardware counters of the calling thread
+ *
+ * Return the context on success, NULL otherwise
+ */
+struct decap_ctxt *create_ctxt(struct process_decap_params *params);
+
+/**
+ * Delete a de-encapsulation context
+ */
+void delete_ctxt(struct decap_ctxt *ctxt);
+
+/**
+ * De-encapsulate a received UDP datagram, going through the tunnel header
+ * processing when enabled
+ *
+ * Return 0 on success, -1 if the handler failed
+ */
+int decap_datagram(struct decap_ctxt *ctxt, unsigned char *data, size_t len,
+                   decap_pdu_handler_t handler, void *arg);
+
+/**
+ * De-encapsulate a GSE frame
+ *
+ * Return 0 on success, -1 if the handler failed
+ */
+int decap_frame(struct decap_ctxt *ctxt, unsigned char *data, size_t len,
+                decap_pdu_handler_t handler, void *arg);
+
+/**
+ * De-encapsulate the frames held by the reorder window beyond its timeout
+ *
+ * Return 0 on success, -1 if the handler failed
+ */
+int flush_frames(struct decap_ctxt *ctxt, decap_pdu_handler_t handler,
+                 void *arg);
+
+/**
+ * De-encapsulate every frame held by the reorder window, giving its gaps up,
+ * to their end even once the loops are stopped
+ *
+ * Return 0 on success, -1 if the handler failed
+ */
+int drain_frames(struct decap_ctxt *ctxt, decap_pdu_handler_t handler,
+                 void *arg);
+
+/**
+ * Drop the reassemblies beyond their timeout
+ */
+void expire_pdus(struct decap_ctxt *ctxt);
+
+/**
+ * Release a de-encapsulated PDU
+ */
+void release_pdu(struct decap_ctxt *ctxt, struct decap_pdu *pdu);
+
+#endif
@@ -0,0 +1,909 @@
+// Copyright 2023, Viveris Technologies
+// Distributed under the terms of the MIT License
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "bb_header.h"
+#include "crc32.h"
+#include "encap_engine.h"
+#include "gf256.h"
+#include "gse_header.h"
+#include "pkt_header.h"
+#include "tap.h"
+#include "tunnel_log.h"
+#include "utils.h"
+
+#define MAX_FRAG 100 // Maximum fragmentation count for a packet
+#define PROTOCOL 9029
+#define MAX_FRAME_PACKETS 64 // Maximum count of GSE packets in a frame
+#define MIN_PACKET_SPACE (GSE_MAX_HEADER_LENGTH + GSE_MAX_TRAILER_LENGTH + 1)
+#define PROTOCOL_LEN 2
+#define FRAG_ID_LEN 1
+#define TOTAL_LENGTH_LEN 2
+// Header of a GSE packet holding a whole PDU with the longest label
+#define FAST_HEADROOM (GSE_FIXED_HEADER_LEN + PROTOCOL_LEN + FWD_LABEL_LEN)
+
+const char *encap_perf_names[ENCAP_PERF_COUNT] = {"TAP read", "GSE encap",
+                                                  "UDP send"};
+
+int encap_pdu(struct encap_send_ctxt *ctxt, gse_vfrag_t *vfrag_pdu,
+              uint8_t label_type, uint8_t *label, struct udp_addr *remote) {
+  int ret;
+  int frag_id;
+  size_t len_received = gse_get_vfrag_length(vfrag_pdu);
+
+  // Make room for the PDU by sending frames if all fragment IDs are busy
+  while ((frag_id = encap_sched_acquire(ctxt->sched, len_received, remote)) <
+         0) {
+    send_frame(ctxt);
+  }
+
+  // libGSE uses the QoS as fragment ID
+  perf_counters_start(ctxt->perf);
+  ret = gse_encap_receive_pdu(vfrag_pdu, ctxt->encap, label, label_type,
+                              PROTOCOL, ctxt->frag_base + frag_id);
+  perf_counters_stop(ctxt->perf, ENCAP_PERF_GSE_ENCAP, len_received);
+  if (ret > GSE_STATUS_OK) {
+    log_ring_write(log_encap_pdu_failed, LOG_INT(ret), LOG_INT(len_received),
+                   LOG_INT(GSE_MAX_PDU_LENGTH), LOG_INT(len_received));
+    encap_sched_release(ctxt->sched, frag_id);
+    gse_free_vfrag(&vfrag_pdu);
+    return -1;
+  }
+  return 0;
+}
+
+int forward_pdu(struct encap_send_ctxt *ctxt, gse_vfrag_t *vfrag_pdu,
+                uint8_t *label) {
+  int ret;
+  size_t i, count;
+  size_t len = gse_get_vfrag_length(vfrag_pdu);
+  struct pkt_header pkth;
+  struct fwd_table *fwd = ctxt->fwd;
+  struct fwd_entry *entry;
+  struct fwd_remote *remote;
+  gse_vfrag_t *copy;
+
+  if (parse_mac_header(gse_get_vfrag_start(vfrag_pdu), len, &pkth) != 0) {
+    log_ring_write(log_short_frame, LOG_INT(len));
+    gse_free_vfrag(&vfrag_pdu);
+    return -1;
+  }
+
+  // Replicate broadcast and multicast frames to every remote terminal, the
+  // default one included
+  if (fwd_is_group_address(pkth.dst)) {
+    count = fwd_group_count(fwd);
+    for (i = 0; i < count; i++) {
+      remote = fwd_group_remote(fwd, i);
+      if (i + 1 == count) {
+        copy = vfrag_pdu;
+      } else if ((ret = gse_create_vfrag_with_data(
+                      &copy, len, GSE_MAX_HEADER_LENGTH,
+                      GSE_MAX_TRAILER_LENGTH, gse_get_vfrag_start(vfrag_pdu),
+                      len)) > GSE_STATUS_OK) {
+        log_ring_write(log_replicate_failed, LOG_STR(gse_get_status(ret)));
+        continue;
+      }
+      if (encap_pdu(ctxt, copy, FWD_LABEL_BROADCAST, label, &(remote->addr)) ==
+          0) {
+        remote->pdus++;
+        remote->bytes += len;
+      }
+    }
+    if (count == 0) {
+      gse_free_vfrag(&vfrag_pdu);
+    }
+    return 0;
+  }
+
+  if ((entry = fwd_table_lookup(fwd, pkth.dst)) != NULL) {
+    if (encap_pdu(ctxt, vfrag_pdu, entry->label_type, entry->label,
+                  &(entry->remote->addr)) == 0) {
+      entry->pdus++;
+      entry->bytes += len;
+      entry->remote->pdus++;
+      entry->remote->bytes += len;
+    }
+    return 0;
+  }
+
+  // Unknown destination: use the default remote if any
+  if (fwd->fallback != NULL) {
+    if ((ret = encap_pdu(ctxt, vfrag_pdu, ctxt->label_type, label,
+                         &(fwd->fallback->addr))) == 0) {
+      fwd->fallback->pdus++;
+      fwd->fallback->bytes += len;
+    }
+    return ret;
+  }
+  fwd->unknown_pdus++;
+  gse_free_vfrag(&vfrag_pdu);
+  return 0;
+}
+
+int encap_tap_pdu(struct encap_send_ctxt *ctxt, int tap_fd, size_t buffer_len,
+                  gse_vfrag_t **spare, uint64_t *counter) {
+  int ret;
+  gse_vfrag_t *vfrag_pdu;
+
+  if (ctxt->fast_buf != NULL) {
+    return encap_tap_fast(ctxt, tap_fd, buffer_len, counter);
+  }
+  if ((ret = read_tap_pdu(tap_fd, buffer_len, spare, &vfrag_pdu,
+                          ctxt->perf)) != 0) {
+    return ret;
+  }
+  encap_new_pdu(ctxt, vfrag_pdu, counter);
+  return 0;
+}
+
+int encap_tap_fast(struct encap_send_ctxt *ctxt, int tap_fd, size_t buffer_len,
+                   uint64_t *counter) {
+  int ret;
+  size_t len;
+  uint8_t label[6];
+  unsigned char *pdu = ctxt->fast_buf + FAST_HEADROOM;
+  gse_vfrag_t *vfrag_pdu;
+
+  perf_counters_start(ctxt->perf);
+  ret = read_tap(tap_fd, buffer_len, pdu, &len);
+  perf_counters_stop(ctxt->perf, ENCAP_PERF_TAP_READ, ret < 0 ? 0 : len);
+  if (ret < 0) {
+    return -1;
+  } else if (len == 0) {
+    return 1;
+  }
+  counter_label(++(*counter), label);
+
+  // The PDUs wait behind a PDU whose fragments are still in flight
+  if (ctxt->sched->busy_count == 0) {
+    if (ctxt->fwd != NULL) {
+      ret = forward_fast_pdu(ctxt, len, label);
+    } else {
+      ret = encap_fast_pdu(ctxt, len, ctxt->label_type, label,
+                           &(ctxt->remote));
+    }
+    if (ret <= 0) {
+      return 0;
+    }
+  }
+
+  // Replicated to every remote, or queued behind the PDUs in flight, by libGSE
+  if ((ret = gse_create_vfrag_with_data(&vfrag_pdu, len, GSE_MAX_HEADER_LENGTH,
+                                        GSE_MAX_TRAILER_LENGTH, pdu, len)) >
+      GSE_STATUS_OK) {
+    log_ring_write(log_vfrag_create_failed, LOG_STR(gse_get_status(ret)));
+    return -1;
+  }
+  if (ctxt->fwd != NULL) {
+    forward_pdu(ctxt, vfrag_pdu, label);
+  } else {
+    encap_pdu(ctxt, vfrag_pdu, ctxt->label_type, label, &(ctxt->remote));
+  }
+  return 0;
+}
+
+int forward_fast_pdu(struct encap_send_ctxt *ctxt, size_t len, uint8_t *label) {
+  int ret;
+  struct pkt_header pkth;
+  struct fwd_table *fwd = ctxt->fwd;
+  struct fwd_entry *entry;
+
+  if (parse_mac_header(ctxt->fast_buf + FAST_HEADROOM, len, &pkth) != 0) {
+    log_ring_write(log_short_frame, LOG_INT(len));
+    return -1;
+  }
+  // Replicated through libGSE
+  if (fwd_is_group_address(pkth.dst)) {
+    return 1;
+  }
+  if ((entry = fwd_table_lookup(fwd, pkth.dst)) != NULL) {
+    if ((ret = encap_fast_pdu(ctxt, len, entry->label_type, entry->label,
+                              &(entry->remote->addr))) == 0) {
+      entry->pdus++;
+      entry->bytes += len;
+      entry->remote->pdus++;
+      entry->remote->bytes += len;
+    }
+    return ret;
+  }
+  if (fwd->fallback != NULL) {
+    if ((ret = encap_fast_pdu(ctxt, len, ctxt->label_type, label,
+                              &(fwd->fallback->addr))) == 0) {
+      fwd->fallback->pdus++;
+      fwd->fallback->bytes += len;
+    }
+    return ret;
+  }
+  fwd->unknown_pdus++;
+  return 0;
+}
+
+/**
+ * Write the header of a GSE packet holding a whole PDU, S = E = 1 without
+ * fragment ID nor CRC, in front of the PDU
+ *
+ * Inlined with a constant label type, each label type gets its own code.
+ *
+ * Return the header length
+ */
+static inline __attribute__((always_inline)) size_t
+write_complete_header(unsigned char *pdu, size_t len, uint8_t label_type,
+                      const uint8_t *label) {
+  size_t label_len = label_type == GSE_LT_6_BYTES   ? 6
+                     : label_type == GSE_LT_3_BYTES ? 3
+                                                    : 0;
+  size_t hdr_len = GSE_FIXED_HEADER_LEN + PROTOCOL_LEN + label_len;
+  size_t gse_len = hdr_len - GSE_FIXED_HEADER_LEN + len;
+  unsigned char *hdr = pdu - hdr_len;
+
+  hdr[0] = 0xc0 | (label_type << 4) | ((gse_len >> 8) & 0x0f);
+  hdr[1] = gse_len & 0xff;
+  hdr[2] = PROTOCOL >> 8;
+  hdr[3] = PROTOCOL & 0xff;
+  memcpy(hdr + GSE_FIXED_HEADER_LEN + PROTOCOL_LEN, label, label_len);
+  return hdr_len;
+}
+
+/**
+ * Send the PDU of the fast path buffer in a GSE packet of its own, alone in
+ * a frame of variable length, or padded up to the data field of a frame of
+ * constant length, in fragments when it does not fit
+ *
+ * Inlined with a constant label type and frame mode, each combination gets
+ * its own code.
+ *
+ * Return 0 on success, 1 when the PDU goes through libGSE, -1 on error
+ */
+static inline __attribute__((always_inline)) int
+send_complete_packet(struct encap_send_ctxt *ctxt, size_t len,
+                     uint8_t label_type, uint8_t *label,
+                     struct udp_addr *remote, int constant_len) {
+  unsigned char *pdu = ctxt->fast_buf + FAST_HEADROOM;
+  size_t hdr_len = GSE_FIXED_HEADER_LEN + PROTOCOL_LEN +
+                   (label_type == GSE_LT_6_BYTES   ? 6
+                    : label_type == GSE_LT_3_BYTES ? 3
+                                                   : 0);
+  size_t field_len = 0;
+  struct modcod_step *step = NULL;
+  // Tunnel header, baseband header, packet and padding
+  struct iovec iov[4];
+
+  if (constant_len) {
+    field_len = ctxt->payload_len;
+    if (ctxt->modcod != NULL) {
+      step = modcod_sched_get(ctxt->modcod, monotonic_ms());
+      field_len = step->frame_len - BB_HEADER_LEN;
+    }
+    if (hdr_len + len > field_len) {
+      return send_fast_fragments(ctxt, len, label_type, label, remote);
+    }
+  }
+  if (hdr_len + len > GSE_MAX_PACKET_LENGTH) {
+    return send_fast_fragments(ctxt, len, label_type, label, remote);
+  }
+
+  perf_counters_start(ctxt->perf);
+  hdr_len = write_complete_header(pdu, len, label_type, label);
+  perf_counters_stop(ctxt->perf, ENCAP_PERF_GSE_ENCAP, hdr_len + len);
+  iov[2].iov_base = pdu - hdr_len;
+  iov[2].iov_len = hdr_len + len;
+  return send_packets(ctxt, remote, iov + 2, 1, hdr_len + len, field_len,
+                      step) == 0
+             ? 0
+             : -1;
+}
+
+int send_fast_fragments(struct encap_send_ctxt *ctxt, size_t len,
+                        uint8_t label_type, uint8_t *label,
+                        struct udp_addr *remote) {
+  unsigned char *pdu = ctxt->fast_buf + FAST_HEADROOM;
+  size_t label_len = gse_label_len(label_type);
+  size_t total_len = PROTOCOL_LEN + label_len + len;
+  size_t field_len, room, hdr_len, packet_len, data_len, sent = 0;
+  uint8_t start, end;
+  uint32_t crc;
+  struct modcod_step *step;
+  // Fixed header, fragment ID, total length, protocol and label
+  unsigned char hdr[GSE_FIXED_HEADER_LEN + FRAG_ID_LEN + TOTAL_LENGTH_LEN +
+                    PROTOCOL_LEN + FWD_LABEL_LEN];
+  unsigned char trailer[GSE_CRC_LEN];
+  // Tunnel header, baseband header, packet header, data, CRC and padding
+  struct iovec iov[6];
+
+  if (total_len > 0xffff) {
+    return 1;
+  }
+
+  // No other PDU is in flight: the first fragment ID is free
+  hdr[2] = ctxt->frag_base;
+  hdr[3] = total_len >> 8;
+  hdr[4] = total_len & 0xff;
+  hdr[5] = PROTOCOL >> 8;
+  hdr[6] = PROTOCOL & 0xff;
+  memcpy(hdr + 7, label, label_len);
+
+  // The CRC covers the total length, the protocol, the label and the PDU
+  perf_counters_start(ctxt->perf);
+  crc = crc32_update(CRC32_INIT, hdr + 3,
+                     TOTAL_LENGTH_LEN + PROTOCOL_LEN + label_len);
+  crc = crc32_update(crc, pdu, len);
+  perf_counters_stop(ctxt->perf, ENCAP_PERF_GSE_ENCAP, len);
+  trailer[0] = crc >> 24;
+  trailer[1] = (crc >> 16) & 0xff;
+  trailer[2] = (crc >> 8) & 0xff;
+  trailer[3] = crc & 0xff;
+
+  // A fragment per frame, the last one holding at least a byte of the PDU
+  while (sent < len) {
+    step = NULL;
+    field_len = 0;
+    room = GSE_MAX_PACKET_LENGTH;
+    if (ctxt->payload_len != 0) {
+      field_len = ctxt->payload_len;
+      if (ctxt->modcod != NULL) {
+        step = modcod_sched_get(ctxt->modcod, monotonic_ms());
+        field_len = step->frame_len - BB_HEADER_LEN;
+      }
+      room = field_len < room ? field_len : room;
+    }
+    start = sent == 0;
+    hdr_len = start ? sizeof(hdr) - FWD_LABEL_LEN + label_len
+                    : GSE_FIXED_HEADER_LEN + FRAG_ID_LEN;
+    data_len = len - sent;
+    end = !start && data_len + GSE_CRC_LEN <= room - hdr_len;
+    if (!end && data_len - 1 > room - hdr_len) {
+      data_len = room - hdr_len;
+    } else if (!end) {
+      data_len--;
+    }
+    packet_len = hdr_len + data_len + (end ? GSE_CRC_LEN : 0);
+    hdr[0] = (start << 7) | (end << 6) |
+             ((start ? label_type : GSE_LT_REUSE) << 4) |
+             (((packet_len - GSE_FIXED_HEADER_LEN) >> 8) & 0x0f);
+    hdr[1] = (packet_len - GSE_FIXED_HEADER_LEN) & 0xff;
+
+    iov[2].iov_base = hdr;
+    iov[2].iov_len = hdr_len;
+    iov[3].iov_base = pdu + sent;
+    iov[3].iov_len = data_len;
+    iov[4].iov_base = trailer;
+    iov[4].iov_len = GSE_CRC_LEN;
+    if (send_packets(ctxt, remote, iov + 2, end ? 3 : 2, packet_len, field_len,
+                     step) != 0) {
+      return -1;
+    }
+    sent += data_len;
+  }
+  return 0;
+}
+
+int encap_fast_pdu(struct encap_send_ctxt *ctxt, size_t len, uint8_t label_type,
+                   uint8_t *label, struct udp_addr *remote) {
+  if (ctxt->payload_len == 0) {
+    switch (label_type) {
+    case GSE_LT_6_BYTES:
+      return send_complete_packet(ctxt, len, GSE_LT_6_BYTES, label, remote, 0);
+    case GSE_LT_3_BYTES:
+      return send_complete_packet(ctxt, len, GSE_LT_3_BYTES, label, remote, 0);
+    default:
+      return send_complete_packet(ctxt, len, GSE_LT_BROADCAST, label, remote,
+                                  0);
+    }
+  }
+  switch (label_type) {
+  case GSE_LT_6_BYTES:
+    return send_complete_packet(ctxt, len, GSE_LT_6_BYTES, label, remote, 1);
+  case GSE_LT_3_BYTES:
+    return send_complete_packet(ctxt, len, GSE_LT_3_BYTES, label, remote, 1);
+  default:
+    return send_complete_packet(ctxt, len, GSE_LT_BROADCAST, label, remote, 1);
+  }
+}
+
+int read_tap_pdu(int tap_fd, size_t buffer_len, gse_vfrag_t **spare,
+                 gse_vfrag_t **pdu, struct perf_counters *perf) {
+  int ret;
+  size_t len_received;
+  gse_vfrag_t *vfrag_pdu = *spare;
+
+  *spare = NULL;
+  if (vfrag_pdu == NULL &&
+      (ret = gse_create_vfrag(&vfrag_pdu, GSE_MAX_PDU_LENGTH,
+                              GSE_MAX_HEADER_LENGTH,
+                              GSE_MAX_TRAILER_LENGTH)) > GSE_STATUS_OK) {
+    log_ring_write(log_vfrag_create_failed, LOG_STR(gse_get_status(ret)));
+    return -1;
+  }
+
+  perf_counters_start(perf);
+  ret = read_tap(tap_fd, buffer_len, gse_get_vfrag_start(vfrag_pdu),
+                 &(len_received));
+  perf_counters_stop(perf, ENCAP_PERF_TAP_READ, ret < 0 ? 0 : len_received);
+  if (ret < 0) {
+#ifdef DEBUG
+    fprintf(stdout, "Receive nothing from TAP interface\n");
+#endif
+    gse_free_vfrag(&vfrag_pdu);
+    return -1; // Ignore
+  } else if (len_received == 0) {
+#ifdef DEBUG
+    fprintf(stdout, "Receive empty packet from TAP interface\n");
+#endif
+    // Kept for the next read, the non-blocking TAP is often empty
+    *spare = vfrag_pdu;
+    return 1; // Ignore
+  }
+#ifdef DEBUG
+  fprintf(stdout, "[Receiver] Receive packet (%zu bytes)\n", len_received);
+#endif
+
+  ret = gse_set_vfrag_length(vfrag_pdu, len_received);
+  if (ret > GSE_STATUS_OK) {
+    log_ring_write(log_vfrag_length_failed, LOG_STR(gse_get_status(ret)));
+  }
+  if (gse_get_vfrag_length(vfrag_pdu) == 0) {
+    log_ring_write(log_vfrag_empty);
+  }
+  *pdu = vfrag_pdu;
+  return 0;
+}
+
+void counter_label(uint64_t counter, uint8_t *label) {
+  label[5] = (counter >> 56) & 0xff;
+  label[4] = (counter >> 48) & 0xff;
+  label[3] = (counter >> 32) & 0xff;
+  label[2] = (counter >> 16) & 0xff;
+  label[1] = (counter >> 8) & 0xff;
+  label[0] = counter & 0xff;
+}
+
+void encap_new_pdu(struct encap_send_ctxt *ctxt, gse_vfrag_t *vfrag_pdu,
+                   uint64_t *counter) {
+  uint8_t label[6];
+
+  counter_label(++(*counter), label);
+  if (ctxt->fwd != NULL) {
+    forward_pdu(ctxt, vfrag_pdu, label);
+  } else {
+    encap_pdu(ctxt, vfrag_pdu, ctxt->label_type, label, &(ctxt->remote));
+  }
+}
+
+void encap_apply_settings(struct encap_send_ctxt *ctxt,
+                          const struct live_settings *settings) {
+  memcpy(&(ctxt->timeout), &(settings->read_timeout), sizeof(struct timespec));
+  if (ctxt->modcod == NULL) {
+    ctxt->payload_len = settings->payload_len;
+  }
+  ctxt->label_type = settings->label_type;
+  if (ctxt->chan != NULL) {
+    channel_set_rate(ctxt->chan, settings->rate_kbps);
+  }
+}
+
+int send_frame(struct encap_send_ctxt *ctxt) {
+  int ret;
+  int frag_id;
+  unsigned int count = 0, i;
+  size_t frame_len = 0, field_len = ctxt->payload_len;
+  long desired_len;
+  struct udp_addr remote;
+  struct gse_header hdr;
+  struct sched_frag *frag;
+  struct modcod_step *step = NULL;
+  gse_vfrag_t *vfrag_pkts[MAX_FRAME_PACKETS];
+  // Tunnel header, baseband header, packets and padding
+  struct iovec iov[MAX_FRAME_PACKETS + 3];
+  struct iovec *pkt_iov = iov + 2;
+
+  // The data field of the BBFrame of the current MODCOD
+  if (ctxt->modcod != NULL) {
+    step = modcod_sched_get(ctxt->modcod, monotonic_ms());
+    field_len = step->frame_len - BB_HEADER_LEN;
+  }
+
+  // Fill the frame with the packets chosen by the scheduler among the PDUs
+  // sent to the same remote, a single packet is sent per frame of variable
+  // length
+  perf_counters_start(ctxt->perf);
+  while (count < MAX_FRAME_PACKETS) {
+    if (field_len != 0 && field_len - frame_len < MIN_PACKET_SPACE) {
+      break;
+    }
+    if ((frag_id = encap_sched_pick(ctxt->sched, count > 0 ? &remote : NULL)) <
+        0) {
+      break;
+    }
+    frag = &(ctxt->sched->frags[frag_id]);
+    if (field_len == 0) {
+      desired_len = frag->remaining + GSE_MAX_HEADER_LENGTH;
+    } else {
+      desired_len = field_len - frame_len;
+    }
+    if (desired_len > GSE_MAX_PACKET_LENGTH) {
+      desired_len = GSE_MAX_PACKET_LENGTH;
+    }
+    ret = gse_encap_get_packet(&(vfrag_pkts[count]), ctxt->encap, desired_len,
+                               ctxt->frag_base + frag_id);
+    if (ret == GSE_STATUS_FIFO_EMPTY) {
+      encap_sched_release(ctxt->sched, frag_id);
+      continue;
+    } else if (ret > GSE_STATUS_OK) {
+      log_ring_write(log_get_packet_failed, LOG_STR(gse_get_status(ret)),
+                     LOG_INT(desired_len));
+      if (++frag->errors >= 5) {
+        encap_sched_release(ctxt->sched, frag_id);
+      }
+      break;
+    }
+
+    remote = frag->remote;
+    pkt_iov[count].iov_base = gse_get_vfrag_start(vfrag_pkts[count]);
+    pkt_iov[count].iov_len = gse_get_vfrag_length(vfrag_pkts[count]);
+    frame_len += pkt_iov[count].iov_len;
+    if (gse_parse_header(pkt_iov[count].iov_base, pkt_iov[count].iov_len,
+                         &hdr) == 0) {
+      encap_sched_sent(ctxt->sched, frag_id, hdr.packet_len - hdr.header_len,
+                       hdr.end);
+    } else {
+      encap_sched_release(ctxt->sched, frag_id);
+    }
+    count++;
+    if (field_len == 0) {
+      break;
+    }
+  }
+  perf_counters_stop(ctxt->perf, ENCAP_PERF_GSE_ENCAP, frame_len);
+  if (count == 0) {
+    return 0;
+  }
+
+  ret = send_packets(ctxt, &remote, pkt_iov, count, frame_len, field_len, step);
+  for (i = 0; i < count; i++) {
+    gse_free_vfrag(&(vfrag_pkts[i]));
+  }
+  return ret;
+}
+
+int send_packets(struct encap_send_ctxt *ctxt, struct udp_addr *remote,
+                 struct iovec *pkt_iov, unsigned int count, size_t frame_len,
+                 size_t field_len, struct modcod_step *step) {
+  int ret;
+  unsigned int i;
+  struct bb_header bb;
+  struct iovec *frame_iov = pkt_iov;
+  struct tunnel_header tunnel;
+  struct tunnel_seq *seq = NULL;
+
+  // Pad the frame up to the constant payload length, or to the data field
+  i = count;
+  if (field_len != 0 && frame_len < field_len) {
+    pkt_iov[i].iov_base = ctxt->padding;
+    pkt_iov[i].iov_len = field_len - frame_len;
+    i++;
+  }
+  if (step != NULL) {
+    modcod_sched_account(ctxt->modcod, step, frame_len, field_len);
+  }
+  if (step != NULL && ctxt->bb_header) {
+    memset(&bb, 0, sizeof(struct bb_header));
+    bb.matype1 = BB_MATYPE1_GSE_ACM;
+    bb.dfl = field_len * 8;
+    bb_header_write(&bb, ctxt->bb_hdr);
+    frame_iov--;
+    frame_iov[0].iov_base = ctxt->bb_hdr;
+    frame_iov[0].iov_len = BB_HEADER_LEN;
+    i++;
+  }
+  perf_counters_start(ctxt->perf);
+  if (ctxt->seqs != NULL) {
+    seq = get_tunnel_seq(ctxt, remote);
+    memset(&tunnel, 0, sizeof(struct tunnel_header));
+    tunnel.type = TUNNEL_TYPE_DATA;
+    tunnel.seq = seq->next++;
+    tunnel_header_write(&tunnel, ctxt->tunnel_hdr);
+    frame_iov[-1].iov_base = ctxt->tunnel_hdr;
+    frame_iov[-1].iov_len = TUNNEL_HEADER_LEN;
+    ret = write_frame(ctxt, remote, frame_iov - 1, i + 1);
+  } else {
+    ret = write_frame(ctxt, remote, frame_iov, i);
+  }
+  perf_counters_stop(ctxt->perf, ENCAP_PERF_UDP_SEND, frame_len);
+  if (ret != 0) {
+    log_ring_write(log_frame_send_failed);
+  }
+
+  // The parity covers the frame as sent, padding included
+  if (seq != NULL && seq->fec != NULL &&
+      fec_encoder_add(seq->fec, tunnel.seq, frame_iov, i)) {
+    send_parity(ctxt, seq);
+  }
+  return ret;
+}
+
+int output_frame(struct encap_send_ctxt *ctxt, struct udp_addr *remote,
+                 struct iovec *iov, int count) {
+  if (ctxt->shm != NULL) {
+    // A full ring drops the frame as a congested link would
+    return shm_ring_write_iov(ctxt->shm, iov, count) < 0 ? -1 : 0;
+  }
+  return write_udp_iov(ctxt->udp_fd, remote, iov, count);
+}
+
+int write_frame(struct encap_send_ctxt *ctxt, struct udp_addr *remote,
+                struct iovec *iov, int count) {
+  if (ctxt->chan != NULL) {
+    // The frames lost by the channel are not send errors
+    channel_push(ctxt->chan, remote, iov, count, monotonic_ns());
+    return 0;
+  }
+  return output_frame(ctxt, remote, iov, count);
+}
+
+/**
+ * Send a frame coming out of the channel emulation
+ *
+ * Return 0 on success, -1 otherwise
+ */
+int output_channel_frame(struct udp_addr *remote, unsigned char *data,
+                         size_t len, void *arg) {
+  struct iovec iov = {data, len};
+
+  if (output_frame((struct encap_send_ctxt *)arg, remote, &iov, 1) != 0) {
+    log_ring_write(log_frame_send_failed);
+    return -1;
+  }
+  return 0;
+}
+
+void emulate_channel(struct encap_send_ctxt *ctxt) {
+  channel_advance(ctxt->chan, monotonic_ns(), output_channel_frame, ctxt);
+}
+
+int send_parity(struct encap_send_ctxt *ctxt, struct tunnel_seq *seq) {
+  struct tunnel_header tunnel;
+  struct iovec iov[2];
+  unsigned char *data;
+  size_t len;
+  unsigned int i;
+  int ret = 0;
+
+  for (i = 0; i < seq->fec->m; i++) {
+    fec_encoder_parity(seq->fec, i, &tunnel, &data, &len);
+    tunnel_header_write(&tunnel, ctxt->tunnel_hdr);
+    iov[0].iov_base = ctxt->tunnel_hdr;
+    iov[0].iov_len = TUNNEL_HEADER_LEN;
+    iov[1].iov_base = data;
+    iov[1].iov_len = len;
+    if (write_frame(ctxt, &(seq->addr), iov, 2) != 0) {
+      log_ring_write(log_frame_send_failed);
+      ret = -1;
+    }
+  }
+  fec_encoder_reset(seq->fec);
+  return ret;
+}
+
+void flush_parity(struct encap_send_ctxt *ctxt) {
+  size_t i;
+
+  for (i = 0; i < ctxt->seq_count; i++) {
+    if (ctxt->seqs[i].fec != NULL && ctxt->seqs[i].fec->count > 0) {
+      send_parity(ctxt, &(ctxt->seqs[i]));
+    }
+  }
+}
+
+struct tunnel_seq *get_tunnel_seq(struct encap_send_ctxt *ctxt,
+                                  struct udp_addr *remote) {
+  size_t i;
+
+  // The remotes are few, their list is filled as frames are sent to them
+  for (i = 0; i < ctxt->seq_count; i++) {
+    if (ctxt->seqs[i].addr.addr == remote->addr &&
+        ctxt->seqs[i].addr.port == remote->port) {
+      break;
+    }
+  }
+  if (i == ctxt->seq_count) {
+    ctxt->seqs[i].addr = *remote;
+    ctxt->seqs[i].next = 0;
+    ctxt->seq_count++;
+  }
+  return &(ctxt->seqs[i]);
+}
+
+struct encap_send_ctxt *create_send_ctxt(struct process_encap_params *params) {
+  struct encap_send_ctxt *ctxt;
+
+  if ((ctxt = create_worker_ctxt(params, 0)) == NULL) {
+    return NULL;
+  }
+
+  // The PDUs are sent in GSE packets of their own as long as a frame holds
+  // a single PDU: frames of variable length, or a single fragment ID
+  if (ctxt->payload_len == 0 || params->frag_count == 1) {
+    if ((ctxt->fast_buf = (unsigned char *)malloc(
+             FAST_HEADROOM + encap_buffer_max(params))) == NULL) {
+      delete_send_ctxt(ctxt);
+      return NULL;
+    }
+    crc32_init();
+  }
+  return ctxt;
+}
+
+struct encap_send_ctxt *create_worker_ctxt(struct process_encap_params *params,
+                                           unsigned int worker) {
+  struct encap_send_ctxt *ctxt;
+  size_t i;
+  int ret;
+
+  if ((ctxt = (struct encap_send_ctxt *)malloc(
+           sizeof(struct encap_send_ctxt))) == NULL) {
+    return NULL;
+  }
+  memset(ctxt, 0, sizeof(struct encap_send_ctxt));
+  memcpy(&(ctxt->timeout), &(params->read_timeout), sizeof(struct timespec));
+  memcpy(&(ctxt->remote), &(params->remote), sizeof(struct udp_addr));
+  ctxt->label_type = GSE_LT_6_BYTES;
+  ctxt->frag_base = worker * params->frag_count;
+
+  // The frames are sized by the MODCOD schedule, up to the longest BBFrame
+  ctxt->payload_len = params->payload_len;
+  if (params->modcod_path[0] != '\0') {
+    if ((ctxt->modcod = modcod_sched_load(params->modcod_path,
+                                          monotonic_ms())) == NULL) {
+      fprintf(stderr, "MODCOD schedule %s loading failed\n",
+              params->modcod_path);
+      free(ctxt);
+      return NULL;
+    }
+    ctxt->payload_len = modcod_sched_max_len(ctxt->modcod);
+    ctxt->bb_header = params->bb_header;
+  }
+
+  if ((ctxt->evt_fd = eventfd(0, 0)) < 0) {
+    fprintf(stderr, "Function eventfd failed: %s (%d)\n", strerror(errno),
+            errno);
+    modcod_sched_delete(ctxt->modcod);
+    free(ctxt);
+    return NULL;
+  }
+  ctxt->udp_fd = -1;
+  if (params->shm_name[0] != '\0') {
+    // Room for the tunnel header and the length prefix of the parity frames
+    if ((ctxt->shm = shm_ring_open(
+             params->shm_name, SHM_RING_DEFAULT_SLOTS,
+             (ctxt->payload_len != 0 ? ctxt->payload_len
+                                     : GSE_MAX_PACKET_LENGTH) +
+                 TUNNEL_HEADER_LEN + FEC_LEN_PREFIX)) == NULL) {
+      fprintf(stderr, "Shared memory ring %s opening failed\n",
+              params->shm_name);
+      close(ctxt->evt_fd);
+      modcod_sched_delete(ctxt->modcod);
+      free(ctxt);
+      return NULL;
+    }
+  } else if ((ctxt->udp_fd = handoff_take_udp(params->handoff,
+                                               &(params->local))) < 0 &&
+             (ctxt->udp_fd = open_udp(&(params->local))) < 0) {
+    char l_addr[256];
+    ipv4_address_str(params->local.addr, l_addr);
+    fprintf(stderr, "UDP tunnel opening on %s:%u failed\n", l_addr,
+            params->local.port);
+    close(ctxt->evt_fd);
+    modcod_sched_delete(ctxt->modcod);
+    free(ctxt);
+    return NULL;
+  }
+  if (params->fwd_path[0] != '\0' &&
+      (ctxt->fwd = fwd_table_load(params->fwd_path)) == NULL) {
+    fprintf(stderr, "Forwarding table %s loading failed\n", params->fwd_path);
+    delete_send_ctxt(ctxt);
+    return NULL;
+  }
+  if (ctxt->fwd != NULL && ctxt->remote.port != 0) {
+    fwd_table_set_default(ctxt->fwd, &(ctxt->remote));
+  }
+  if ((ctxt->sched = encap_sched_create(params->frag_count,
+                                        params->sched_policy)) == NULL ||
+      (ctxt->padding = (unsigned char *)calloc(ctxt->payload_len + 1,
+                                               sizeof(unsigned char))) ==
+          NULL) {
+    delete_send_ctxt(ctxt);
+    return NULL;
+  }
+  // A sequence per remote: those of the forwarding table and the default one
+  ctxt->seq_capa = (ctxt->fwd != NULL ? ctxt->fwd->remote_count : 0) + 1;
+  if (params->seq_header &&
+      (ctxt->seqs = (struct tunnel_seq *)calloc(
+           ctxt->seq_capa, sizeof(struct tunnel_seq))) == NULL) {
+    delete_send_ctxt(ctxt);
+    return NULL;
+  }
+  if (params->seq_header && params->fec_k > 0) {
+    gf256_init();
+    for (i = 0; i < ctxt->seq_capa; i++) {
+      // A frame of variable length holds a single GSE packet
+      if ((ctxt->seqs[i].fec = fec_encoder_create(
+               params->fec_scheme, params->fec_k, params->fec_m,
+               ctxt->payload_len != 0 ? ctxt->payload_len
+                                      : GSE_MAX_PACKET_LENGTH)) == NULL) {
+        fprintf(stderr, "FEC encoder allocation failed\n");
+        delete_send_ctxt(ctxt);
+        return NULL;
+      }
+    }
+  }
+  if ((ret = gse_encap_init(ctxt->frag_base + params->frag_count, MAX_FRAG,
+                            &(ctxt->encap))) != GSE_STATUS_OK) {
+    fprintf(stderr, "Encapsulator initialization failed: %s (%d)\n",
+            gse_get_status(ret), ret);
+    ctxt->encap = NULL;
+    delete_send_ctxt(ctxt);
+    return NULL;
+  }
+  if (params->perf_period > 0 &&
+      (ctxt->perf = perf_counters_create(encap_perf_names, ENCAP_PERF_COUNT,
+                                         params->perf_period)) == NULL) {
+    delete_send_ctxt(ctxt);
+    return NULL;
+  }
+  if (params->chan.frames > 0 &&
+      (ctxt->chan = channel_create(
+           &(params->chan),
+           (ctxt->payload_len != 0 ? ctxt->payload_len
+                                   : GSE_MAX_PACKET_LENGTH) +
+               TUNNEL_HEADER_LEN + FEC_LEN_PREFIX,
+           monotonic_ns())) == NULL) {
+    fprintf(stderr, "Channel emulation buffers allocation failed\n");
+    delete_send_ctxt(ctxt);
+    return NULL;
+  }
+
+  return ctxt;
+}
+
+int encap_buffer_max(struct process_encap_params *params) {
+  // The buffer length changed live is bounded by the longest PDU only
+  if (params->ctrl_path[0] != '\0' && params->buffer_len < GSE_MAX_PDU_LENGTH) {
+    return GSE_MAX_PDU_LENGTH;
+  }
+  return params->buffer_len;
+}
+
+void delete_send_ctxt(struct encap_send_ctxt *ctxt) {
+  size_t i;
+
+  if (ctxt == NULL) {
+    return;
+  }
+  channel_delete(ctxt->chan);
+  modcod_sched_delete(ctxt->modcod);
+  perf_counters_delete(ctxt->perf);
+  if (ctxt->encap != NULL) {
+    gse_encap_release(ctxt->encap);
+  }
+  encap_sched_delete(ctxt->sched);
+  free(ctxt->padding);
+  free(ctxt->fast_buf);
+  for (i = 0; ctxt->seqs != NULL && i < ctxt->seq_capa; i++) {
+    fec_encoder_delete(ctxt->seqs[i].fec);
+  }
+  free(ctxt->seqs);
+  fwd_table_delete(ctxt->fwd);
+  shm_ring_close(ctxt->shm);
+  if (ctxt->udp_fd >= 0) {
+    close(ctxt->udp_fd);
+  }
+  close(ctxt->evt_fd);
+  free(ctxt);
+}
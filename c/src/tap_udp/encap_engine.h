@@ -0,0 +1,264 @@
+// Copyright 2023, Viveris Technologies
+// Distributed under the terms of the MIT License
+
+#ifndef __ENCAP_ENGINE_H__
+#define __ENCAP_ENGINE_H__
+
+#include <signal.h>
+#include <stdint.h>
+
+#include "bb_header.h"
+#include "channel.h"
+#include "fwd_table.h"
+#include "live_config.h"
+#include "modcod.h"
+#include "perf_counters.h"
+#include "process_encap.h"
+#include "shm_ring.h"
+#include "tunnel_header.h"
+
+/*
+ * Encapsulation engine: from the PDUs to the UDP frames, whatever the PDUs
+ * come from
+ */
+
+/**
+ * Next tunnel sequence number and FEC block of a remote
+ */
+struct tunnel_seq {
+  struct udp_addr addr;
+  uint32_t next;
+  struct fec_encoder *fec;
+};
+
+// Stages of the encapsulation accounted by the hardware counters
+enum encap_perf_stage {
+  ENCAP_PERF_TAP_READ = 0,
+  ENCAP_PERF_GSE_ENCAP,
+  ENCAP_PERF_UDP_SEND,
+  ENCAP_PERF_COUNT
+};
+
+struct encap_send_ctxt {
+  struct timespec timeout;
+  sigset_t sigmask;
+  struct udp_addr remote;
+  uint8_t label_type; // of the PDUs sent to the default remote
+
+  int evt_fd;
+  int udp_fd;           // -1 when the frames go to a shared memory ring
+  struct shm_ring *shm; // NULL when the frames go to UDP
+
+  struct queue *encap_q;
+  struct fwd_table *fwd;
+
+  gse_encap_t *encap;
+  struct encap_sched *sched;
+  // TAP read buffer behind the room of a GSE header, NULL when a frame mixes
+  // the packets of several PDUs
+  unsigned char *fast_buf;
+  int frag_base; // fragment IDs of the scheduler offset, one range per worker
+  int payload_len; // longest frame, the frames of a MODCOD schedule are shorter
+  unsigned char *padding;
+
+  struct modcod_sched *modcod; // NULL with frames of a constant length
+  int bb_header;
+  unsigned char bb_hdr[BB_HEADER_LEN];
+
+  // Tunnel header, when enabled, with one sequence per remote
+  struct tunnel_seq *seqs;
+  size_t seq_count;
+  size_t seq_capa;
+  unsigned char tunnel_hdr[TUNNEL_HEADER_LEN];
+
+  struct perf_counters *perf; // NULL when not enabled
+  struct channel *chan;       // NULL when not emulated
+
+  int code;
+};
+
+/**
+ * Create the encapsulation context: UDP socket or shared memory ring,
+ * forwarding table, fragment IDs scheduler, libGSE encapsulator, tunnel
+ * header state, MODCOD schedule, channel emulation and hardware counters of
+ * the calling thread
+ *
+ * Return the context on success, NULL otherwise
+ */
+struct encap_send_ctxt *create_send_ctxt(struct process_encap_params *params);
+
+/**
+ * Create the encapsulation context of a worker, which sends under its own
+ * range of fragment IDs from worker * frag_count, so that the PDUs of the
+ * workers never share a fragment ID on the tunnel
+ *
+ * Return the context on success, NULL otherwise
+ */
+struct encap_send_ctxt *create_worker_ctxt(struct process_encap_params *params,
+                                           unsigned int worker);
+
+/**
+ * Get the longest PDU read from the TAP interface: the buffer length, or
+ * the longest GSE PDU when the control socket may change it
+ */
+int encap_buffer_max(struct process_encap_params *params);
+
+/**
+ * Delete an encapsulation context
+ */
+void delete_send_ctxt(struct encap_send_ctxt *ctxt);
+
+/**
+ * Give a PDU to libGSE under a free fragment ID, frames are sent first when
+ * none is free. The context takes the ownership of the PDU.
+ *
+ * Return 0 on success, -1 otherwise
+ */
+int encap_pdu(struct encap_send_ctxt *ctxt, gse_vfrag_t *vfrag_pdu,
+              uint8_t label_type, uint8_t *label, struct udp_addr *remote);
+
+/**
+ * Encapsulate a PDU towards the remote given by the forwarding table of its
+ * destination MAC address, broadcast and multicast PDUs are replicated
+ *
+ * Return 0 on success, -1 otherwise
+ */
+int forward_pdu(struct encap_send_ctxt *ctxt, gse_vfrag_t *vfrag_pdu,
+                uint8_t *label);
+
+/**
+ * Read a PDU from a TAP interface and forward it, the PDU buffer of a read
+ * without data is kept in spare for the next read. The label of the PDU is
+ * made of the counter of the PDUs read.
+ *
+ * Return 0 when a PDU is read, 1 when nothing is read, -1 on error
+ */
+int encap_tap_pdu(struct encap_send_ctxt *ctxt, int tap_fd, size_t buffer_len,
+                  gse_vfrag_t **spare, uint64_t *counter);
+
+/**
+ * Read a PDU from a TAP interface behind the room of a GSE header, and send
+ * it in a GSE packet of its own written in place, without libGSE. The PDUs
+ * to fragment, or to replicate, are copied to libGSE.
+ *
+ * Return 0 when a PDU is read, 1 when nothing is read, -1 on error
+ */
+int encap_tap_fast(struct encap_send_ctxt *ctxt, int tap_fd, size_t buffer_len,
+                   uint64_t *counter);
+
+/**
+ * Send the PDU of the fast path buffer under the entry of its destination in
+ * the forwarding table
+ *
+ * Return 0 on success, 1 when the PDU goes through libGSE, -1 on error
+ */
+int forward_fast_pdu(struct encap_send_ctxt *ctxt, size_t len, uint8_t *label);
+
+/**
+ * Send the PDU of the fast path buffer in fragments, each one alone in a
+ * frame, with the CRC computed by crc32_update instead of libGSE
+ *
+ * Return 0 on success, 1 when the PDU is too long for GSE, -1 on error
+ */
+int send_fast_fragments(struct encap_send_ctxt *ctxt, size_t len,
+                        uint8_t label_type, uint8_t *label,
+                        struct udp_addr *remote);
+
+/**
+ * Send the PDU of the fast path buffer in a GSE packet of its own, or in
+ * fragments when it does not fit
+ *
+ * Return 0 on success, 1 when the PDU goes through libGSE, -1 on error
+ */
+int encap_fast_pdu(struct encap_send_ctxt *ctxt, size_t len, uint8_t label_type,
+                   uint8_t *label, struct udp_addr *remote);
+
+/**
+ * Read a PDU from a TAP interface, the PDU buffer of a read without data is
+ * kept in spare for the next read. The read is accounted in perf when not
+ * NULL.
+ *
+ * Return 0 when a PDU is read, 1 when nothing is read, -1 on error
+ */
+int read_tap_pdu(int tap_fd, size_t buffer_len, gse_vfrag_t **spare,
+                 gse_vfrag_t **pdu, struct perf_counters *perf);
+
+/**
+ * Write the label made of the counter of the PDUs read
+ */
+void counter_label(uint64_t counter, uint8_t *label);
+
+/**
+ * Forward a PDU read, under a label made of the counter of the PDUs read
+ */
+void encap_new_pdu(struct encap_send_ctxt *ctxt, gse_vfrag_t *vfrag_pdu,
+                   uint64_t *counter);
+
+/**
+ * Take the settings published by the control socket, between two frames:
+ * the reading timeout, the frame length, unless a MODCOD schedule sizes
+ * the frames, the label type of the default remote and the channel rate
+ */
+void encap_apply_settings(struct encap_send_ctxt *ctxt,
+                          const struct live_settings *settings);
+
+/**
+ * Send a frame of the GSE packets chosen by the scheduler
+ *
+ * Return 0 on success, -1 otherwise
+ */
+int send_frame(struct encap_send_ctxt *ctxt);
+
+/**
+ * Send a frame of GSE packets: pad them up to the data field, prepend the
+ * baseband and tunnel headers when enabled, then account the frame in the
+ * FEC block. The two iovec entries in front of pkt_iov and the one after
+ * the packets must be free.
+ *
+ * Return 0 on success, -1 otherwise
+ */
+int send_packets(struct encap_send_ctxt *ctxt, struct udp_addr *remote,
+                 struct iovec *pkt_iov, unsigned int count, size_t frame_len,
+                 size_t field_len, struct modcod_step *step);
+
+/**
+ * Get the tunnel header state of a remote
+ */
+struct tunnel_seq *get_tunnel_seq(struct encap_send_ctxt *ctxt,
+                                  struct udp_addr *remote);
+
+/**
+ * Write a frame to the remote, or to the shared memory ring when enabled
+ *
+ * Return 0 on success, -1 otherwise
+ */
+int output_frame(struct encap_send_ctxt *ctxt, struct udp_addr *remote,
+                 struct iovec *iov, int count);
+
+/**
+ * Write a frame through the channel emulation when enabled, straight to the
+ * output otherwise
+ *
+ * Return 0 on success, -1 otherwise
+ */
+int write_frame(struct encap_send_ctxt *ctxt, struct udp_addr *remote,
+                struct iovec *iov, int count);
+
+/**
+ * Send the frames arrived at the end of the emulated channel
+ */
+void emulate_channel(struct encap_send_ctxt *ctxt);
+
+/**
+ * Send the parity frames of the current FEC block of a remote
+ *
+ * Return 0 on success, -1 otherwise
+ */
+int send_parity(struct encap_send_ctxt *ctxt, struct tunnel_seq *seq);
+
+/**
+ * Send the parity frames of the incomplete FEC blocks
+ */
+void flush_parity(struct encap_send_ctxt *ctxt);
+
+#endif
@@ -0,0 +1,140 @@
+// Copyright 2023, Viveris Technologies
+// Distributed under the terms of the MIT License
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "encap_sched.h"
+
+struct encap_sched *encap_sched_create(unsigned int count, sched_policy_t policy)
+{
+	struct encap_sched *sched;
+
+	if((sched = (struct encap_sched *)malloc(sizeof(struct encap_sched))) == NULL)
+	{
+		return NULL;
+	}
+	memset(sched, 0, sizeof(struct encap_sched));
+	if((sched->frags = (struct sched_frag *)calloc(count, sizeof(struct sched_frag))) == NULL)
+	{
+		free(sched);
+		return NULL;
+	}
+	sched->count = count;
+	sched->policy = policy;
+	return sched;
+}
+
+void encap_sched_delete(struct encap_sched *sched)
+{
+	if(sched == NULL)
+	{
+		return;
+	}
+	free(sched->frags);
+	free(sched);
+}
+
+int encap_sched_parse_policy(const char *str, sched_policy_t *policy)
+{
+	if(strcmp(str, "rr") == 0)
+	{
+		*policy = sched_round_robin;
+		return 0;
+	}
+	if(strcmp(str, "shortest") == 0)
+	{
+		*policy = sched_shortest;
+		return 0;
+	}
+	return -1;
+}
+
+int encap_sched_acquire(struct encap_sched *sched, size_t len, struct udp_addr *remote)
+{
+	unsigned int i;
+
+	if(sched->busy_count == sched->count)
+	{
+		return -1;
+	}
+	for(i = 0; i < sched->count; i++)
+	{
+		if(!sched->frags[i].busy)
+		{
+			break;
+		}
+	}
+	sched->frags[i].busy = 1;
+	sched->frags[i].remaining = len;
+	sched->frags[i].errors = 0;
+	sched->frags[i].remote = *remote;
+	sched->busy_count++;
+	return i;
+}
+
+int encap_sched_match(struct sched_frag *frag, struct udp_addr *remote)
+{
+	return frag->busy &&
+		(remote == NULL || (frag->remote.addr == remote->addr && frag->remote.port == remote->port));
+}
+
+int encap_sched_pick(struct encap_sched *sched, struct udp_addr *remote)
+{
+	unsigned int i, idx;
+	int best = -1;
+
+	if(sched->busy_count == 0)
+	{
+		return -1;
+	}
+	switch(sched->policy)
+	{
+		case sched_shortest:
+		for(i = 0; i < sched->count; i++)
+		{
+			if(encap_sched_match(&(sched->frags[i]), remote) &&
+			   (best < 0 || sched->frags[i].remaining < sched->frags[best].remaining))
+			{
+				best = i;
+			}
+		}
+		break;
+
+		case sched_round_robin:
+		default:
+		for(i = 0; i < sched->count; i++)
+		{
+			idx = (sched->next + i) % sched->count;
+			if(encap_sched_match(&(sched->frags[idx]), remote))
+			{
+				best = idx;
+				sched->next = (idx + 1) % sched->count;
+				break;
+			}
+		}
+		break;
+	}
+	return best;
+}
+
+void encap_sched_sent(struct encap_sched *sched, int frag_id, size_t payload_len, int end)
+{
+	struct sched_frag *frag = &(sched->frags[frag_id]);
+
+	frag->errors = 0;
+	frag->remaining = payload_len < frag->remaining ? frag->remaining - payload_len : 0;
+	if(end)
+	{
+		encap_sched_release(sched, frag_id);
+	}
+}
+
+void encap_sched_release(struct encap_sched *sched, int frag_id)
+{
+	if(sched->frags[frag_id].busy)
+	{
+		sched->frags[frag_id].busy = 0;
+		sched->busy_count--;
+	}
+}
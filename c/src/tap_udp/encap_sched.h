@@ -0,0 +1,87 @@
+// Copyright 2023, Viveris Technologies
+// Distributed under the terms of the MIT License
+
+#ifndef __ENCAP_SCHED_H__
+#define __ENCAP_SCHED_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "udp.h"
+
+typedef enum {
+	sched_round_robin = 0,  // one GSE packet per PDU in flight in turn
+	sched_shortest = 1      // PDU with the fewest bytes left first
+} sched_policy_t;
+
+/**
+ * PDU in flight under a fragment ID
+ */
+struct sched_frag
+{
+	int busy;
+	size_t remaining;
+	unsigned int errors;
+	struct udp_addr remote;
+};
+
+/**
+ * Scheduler of the GSE packets among the fragment IDs
+ *
+ * Each fragment ID holds at most one PDU at a time, so that the fragments
+ * of a large PDU can be interleaved with the packets of the other PDUs.
+ */
+struct encap_sched
+{
+	sched_policy_t policy;
+	unsigned int count;
+	unsigned int busy_count;
+	unsigned int next;
+	struct sched_frag *frags;
+};
+
+/**
+ * Create a scheduler of count fragment IDs
+ *
+ * Return the scheduler on success, NULL otherwise
+ */
+struct encap_sched *encap_sched_create(unsigned int count, sched_policy_t policy);
+
+/**
+ * Delete a scheduler
+ */
+void encap_sched_delete(struct encap_sched *sched);
+
+/**
+ * Parse a scheduling policy name ("rr" or "shortest")
+ *
+ * Return 0 on success, -1 otherwise
+ */
+int encap_sched_parse_policy(const char *str, sched_policy_t *policy);
+
+/**
+ * Get a free fragment ID for a new PDU
+ *
+ * Return the fragment ID on success, -1 if all of them are busy
+ */
+int encap_sched_acquire(struct encap_sched *sched, size_t len, struct udp_addr *remote);
+
+/**
+ * Choose the fragment ID of the next GSE packet, among the ones sent to
+ * remote if it is not NULL
+ *
+ * Return the fragment ID on success, -1 if nothing is in flight
+ */
+int encap_sched_pick(struct encap_sched *sched, struct udp_addr *remote);
+
+/**
+ * Account a GSE packet sent, the fragment ID is released on the last one
+ */
+void encap_sched_sent(struct encap_sched *sched, int frag_id, size_t payload_len, int end);
+
+/**
+ * Release a fragment ID
+ */
+void encap_sched_release(struct encap_sched *sched, int frag_id);
+
+#endif
@@ -0,0 +1,448 @@
+// Copyright 2023, Viveris Technologies
+// Distributed under the terms of the MIT License
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fec.h"
+#include "gf256.h"
+#include "hugemem.h"
+#include "utils.h"
+
+/*
+ * Parity frame tunnel header:
+ *  - flags: scheme (4 bits), number of parity frames of the block (4 bits)
+ *  - type specific: number of data frames of the block (8 bits), index of
+ *    the parity frame (8 bits)
+ *  - sequence number: the one of the first data frame of the block
+ */
+
+uint8_t fec_coef(fec_scheme_t scheme, unsigned int parity, unsigned int data)
+{
+	if(scheme == fec_xor)
+	{
+		return 1;
+	}
+	// Cauchy matrix: any square sub-matrix is invertible, so any m frames
+	// missing from a block are rebuilt from its m parity frames
+	return gf256_inv((FEC_MAX_DATA + parity) ^ data);
+}
+
+int fec_parse(const char *str, fec_scheme_t *scheme, unsigned int *k, unsigned int *m)
+{
+	char buf[32];
+	char *name, *k_str, *m_str, *save;
+	unsigned long val;
+
+	if(strlen(str) >= sizeof(buf))
+	{
+		return -1;
+	}
+	strcpy(buf, str);
+	name = strtok_r(buf, ":", &save);
+	k_str = strtok_r(NULL, ":", &save);
+	m_str = strtok_r(NULL, ":", &save);
+	if(name == NULL || k_str == NULL || strtok_r(NULL, ":", &save) != NULL)
+	{
+		return -1;
+	}
+	if(parse_unsigned_long(k_str, &val) != 0 || val == 0 || val > FEC_MAX_DATA)
+	{
+		return -1;
+	}
+	*k = val;
+	if(strcmp(name, "xor") == 0 && m_str == NULL)
+	{
+		*scheme = fec_xor;
+		*m = 1;
+		return 0;
+	}
+	if(strcmp(name, "rs") == 0 && m_str != NULL &&
+	   parse_unsigned_long(m_str, &val) == 0 && val > 0 && val <= FEC_MAX_PARITY)
+	{
+		*scheme = fec_rs;
+		*m = val;
+		return 0;
+	}
+	return -1;
+}
+
+struct fec_encoder *fec_encoder_create(fec_scheme_t scheme, unsigned int k, unsigned int m, size_t capa)
+{
+	struct fec_encoder *enc;
+
+	if((enc = (struct fec_encoder *)malloc(sizeof(struct fec_encoder))) == NULL)
+	{
+		return NULL;
+	}
+	memset(enc, 0, sizeof(struct fec_encoder));
+	enc->scheme = scheme;
+	enc->k = k;
+	enc->m = m;
+	enc->capa = capa + FEC_LEN_PREFIX;
+	if((enc->parity = (unsigned char *)calloc(m, enc->capa)) == NULL)
+	{
+		free(enc);
+		return NULL;
+	}
+	return enc;
+}
+
+void fec_encoder_delete(struct fec_encoder *enc)
+{
+	if(enc == NULL)
+	{
+		return;
+	}
+	free(enc->parity);
+	free(enc);
+}
+
+int fec_encoder_add(struct fec_encoder *enc, uint32_t seq, const struct iovec *iov, int count)
+{
+	unsigned char prefix[FEC_LEN_PREFIX];
+	size_t len = 0, off;
+	unsigned int j;
+	int i;
+
+	for(i = 0; i < count; i++)
+	{
+		len += iov[i].iov_len;
+	}
+	if(len + FEC_LEN_PREFIX > enc->capa)
+	{
+		return 0;
+	}
+	if(enc->count == 0)
+	{
+		enc->base = seq;
+	}
+	prefix[0] = (len >> 8) & 0xff;
+	prefix[1] = len & 0xff;
+	for(j = 0; j < enc->m; j++)
+	{
+		uint8_t coef = fec_coef(enc->scheme, j, enc->count);
+		unsigned char *parity = enc->parity + j * enc->capa;
+
+		gf256_madd(parity, prefix, coef, FEC_LEN_PREFIX);
+		off = FEC_LEN_PREFIX;
+		for(i = 0; i < count; i++)
+		{
+			gf256_madd(parity + off, (const uint8_t *)iov[i].iov_base, coef, iov[i].iov_len);
+			off += iov[i].iov_len;
+		}
+	}
+	if(len + FEC_LEN_PREFIX > enc->max_len)
+	{
+		enc->max_len = len + FEC_LEN_PREFIX;
+	}
+	return ++enc->count == enc->k;
+}
+
+void fec_encoder_parity(struct fec_encoder *enc, unsigned int idx, struct tunnel_header *hdr,
+                        unsigned char **data, size_t *len)
+{
+	hdr->type = TUNNEL_TYPE_PARITY;
+	hdr->flags = (enc->scheme << 4) | enc->m;
+	hdr->aux = (enc->count << 8) | idx;
+	hdr->seq = enc->base;
+	*data = enc->parity + idx * enc->capa;
+	*len = enc->max_len;
+}
+
+void fec_encoder_reset(struct fec_encoder *enc)
+{
+	memset(enc->parity, 0, enc->m * enc->capa);
+	enc->count = 0;
+	enc->max_len = 0;
+}
+
+struct fec_decoder *fec_decoder_create(size_t history, size_t capa)
+{
+	struct fec_decoder *dec;
+	size_t count = 1;
+	size_t i;
+
+	// Every frame of a block needs its own slot
+	while(count < history || count < FEC_MAX_DATA)
+	{
+		count <<= 1;
+	}
+	if((dec = (struct fec_decoder *)malloc(sizeof(struct fec_decoder))) == NULL)
+	{
+		return NULL;
+	}
+	memset(dec, 0, sizeof(struct fec_decoder));
+	dec->capa = capa + FEC_LEN_PREFIX;
+	dec->mask = count - 1;
+	if((dec->frames = (struct fec_frame *)calloc(count, sizeof(struct fec_frame))) == NULL ||
+	   (dec->arena = (unsigned char *)hugemem_alloc(count * dec->capa)) == NULL ||
+	   (dec->parity = (unsigned char *)hugemem_alloc(FEC_MAX_PARITY * dec->capa)) == NULL)
+	{
+		fec_decoder_delete(dec);
+		return NULL;
+	}
+	for(i = 0; i < count; i++)
+	{
+		dec->frames[i].data = dec->arena + i * dec->capa;
+	}
+	return dec;
+}
+
+void fec_decoder_delete(struct fec_decoder *dec)
+{
+	if(dec == NULL)
+	{
+		return;
+	}
+	hugemem_free(dec->parity);
+	hugemem_free(dec->arena);
+	free(dec->frames);
+	free(dec);
+}
+
+void fec_decoder_data(struct fec_decoder *dec, uint32_t seq, const unsigned char *data, size_t len)
+{
+	struct fec_frame *frame = &(dec->frames[seq & dec->mask]);
+
+	if(len + FEC_LEN_PREFIX > dec->capa)
+	{
+		frame->valid = 0;
+		return;
+	}
+	frame->data[0] = (len >> 8) & 0xff;
+	frame->data[1] = len & 0xff;
+	memcpy(frame->data + FEC_LEN_PREFIX, data, len);
+	frame->len = len + FEC_LEN_PREFIX;
+	frame->seq = seq;
+	frame->valid = 1;
+}
+
+int fec_frame_received(struct fec_decoder *dec, unsigned int idx)
+{
+	struct fec_frame *frame = &(dec->frames[(dec->base + idx) & dec->mask]);
+
+	return frame->valid && frame->seq == dec->base + idx;
+}
+
+unsigned int fec_missing(struct fec_decoder *dec, unsigned int *missing)
+{
+	unsigned int i, count = 0;
+
+	for(i = 0; i < dec->k; i++)
+	{
+		if(!fec_frame_received(dec, i))
+		{
+			missing[count++] = i;
+		}
+	}
+	return count;
+}
+
+void fec_close_block(struct fec_decoder *dec)
+{
+	unsigned int missing[FEC_MAX_DATA];
+
+	if(dec->active && !dec->done && fec_missing(dec, missing) > 0)
+	{
+		dec->stats.lost_blocks++;
+	}
+	dec->active = 0;
+}
+
+int fec_invert(uint8_t mat[FEC_MAX_PARITY][FEC_MAX_PARITY], uint8_t inv[FEC_MAX_PARITY][FEC_MAX_PARITY],
+               unsigned int n)
+{
+	unsigned int i, j, r;
+	uint8_t tmp, f;
+
+	for(i = 0; i < n; i++)
+	{
+		for(j = 0; j < n; j++)
+		{
+			inv[i][j] = i == j;
+		}
+	}
+	// Gauss-Jordan elimination, additions are XORs
+	for(i = 0; i < n; i++)
+	{
+		for(r = i; r < n && mat[r][i] == 0; r++)
+		{
+		}
+		if(r == n)
+		{
+			return -1;
+		}
+		for(j = 0; j < n; j++)
+		{
+			tmp = mat[i][j]; mat[i][j] = mat[r][j]; mat[r][j] = tmp;
+			tmp = inv[i][j]; inv[i][j] = inv[r][j]; inv[r][j] = tmp;
+		}
+		f = gf256_inv(mat[i][i]);
+		for(j = 0; j < n; j++)
+		{
+			mat[i][j] = gf256_mul(mat[i][j], f);
+			inv[i][j] = gf256_mul(inv[i][j], f);
+		}
+		for(r = 0; r < n; r++)
+		{
+			if(r == i || mat[r][i] == 0)
+			{
+				continue;
+			}
+			f = mat[r][i];
+			for(j = 0; j < n; j++)
+			{
+				mat[r][j] ^= gf256_mul(f, mat[i][j]);
+				inv[r][j] ^= gf256_mul(f, inv[i][j]);
+			}
+		}
+	}
+	return 0;
+}
+
+int fec_recover(struct fec_decoder *dec, unsigned int *missing, unsigned int count, fec_recover_t recover,
+                void *arg)
+{
+	uint8_t mat[FEC_MAX_PARITY][FEC_MAX_PARITY];
+	uint8_t inv[FEC_MAX_PARITY][FEC_MAX_PARITY];
+	unsigned char *syndromes[FEC_MAX_PARITY];
+	unsigned int rows[FEC_MAX_PARITY];
+	struct fec_frame *frame;
+	unsigned int i, r, c, n = 0;
+	size_t len;
+	int ret = 0;
+
+	for(i = 0; i < dec->m && n < count; i++)
+	{
+		if(dec->received[i])
+		{
+			rows[n] = i;
+			syndromes[n] = dec->parity + i * dec->capa;
+			n++;
+		}
+	}
+
+	// Remove the received frames from the parity, only the missing ones stay
+	for(i = 0; i < dec->k; i++)
+	{
+		if(!fec_frame_received(dec, i))
+		{
+			continue;
+		}
+		frame = &(dec->frames[(dec->base + i) & dec->mask]);
+		len = frame->len < dec->parity_len ? frame->len : dec->parity_len;
+		for(r = 0; r < count; r++)
+		{
+			gf256_madd(syndromes[r], frame->data, fec_coef(dec->scheme, rows[r], i), len);
+		}
+	}
+	for(r = 0; r < count; r++)
+	{
+		for(c = 0; c < count; c++)
+		{
+			mat[r][c] = fec_coef(dec->scheme, rows[r], missing[c]);
+		}
+	}
+	if(fec_invert(mat, inv, count) != 0)
+	{
+		dec->stats.lost_blocks++;
+		return 0;
+	}
+
+	for(c = 0; c < count; c++)
+	{
+		frame = &(dec->frames[(dec->base + missing[c]) & dec->mask]);
+		memset(frame->data, 0, dec->parity_len);
+		for(r = 0; r < count; r++)
+		{
+			gf256_madd(frame->data, syndromes[r], inv[c][r], dec->parity_len);
+		}
+		len = (frame->data[0] << 8) | frame->data[1];
+		if(len + FEC_LEN_PREFIX > dec->parity_len)
+		{
+			dec->stats.invalid++;
+			frame->valid = 0;
+			continue;
+		}
+		frame->len = len + FEC_LEN_PREFIX;
+		frame->seq = dec->base + missing[c];
+		frame->valid = 1;
+		dec->stats.recovered_frames++;
+		if(recover(frame->seq, frame->data + FEC_LEN_PREFIX, len, arg) != 0)
+		{
+			ret = -1;
+		}
+	}
+	return ret;
+}
+
+int fec_decoder_parity(struct fec_decoder *dec, const struct tunnel_header *hdr, const unsigned char *data,
+                       size_t len, fec_recover_t recover, void *arg)
+{
+	fec_scheme_t scheme = hdr->flags >> 4;
+	unsigned int m = hdr->flags & 0x0f;
+	unsigned int k = hdr->aux >> 8;
+	unsigned int idx = hdr->aux & 0xff;
+	unsigned int missing[FEC_MAX_DATA];
+	unsigned int count, i, received = 0;
+
+	if((scheme != fec_xor && scheme != fec_rs) || k == 0 || k > FEC_MAX_DATA || m == 0 ||
+	   m > FEC_MAX_PARITY || (scheme == fec_xor && m != 1) || idx >= m || len < FEC_LEN_PREFIX ||
+	   len > dec->capa)
+	{
+		dec->stats.invalid++;
+		return 0;
+	}
+	dec->stats.parity_frames++;
+
+	// Parity frames are sent right after their block, a new block closes the
+	// previous one
+	if(!dec->active || dec->base != hdr->seq)
+	{
+		fec_close_block(dec);
+		dec->active = 1;
+		dec->done = 0;
+		dec->base = hdr->seq;
+		dec->scheme = scheme;
+		dec->k = k;
+		dec->m = m;
+		dec->parity_len = len;
+		memset(dec->received, 0, sizeof(dec->received));
+	}
+	if(dec->done || dec->received[idx] || len != dec->parity_len || k != dec->k || m != dec->m)
+	{
+		return 0;
+	}
+	memcpy(dec->parity + idx * dec->capa, data, len);
+	dec->received[idx] = 1;
+
+	if((count = fec_missing(dec, missing)) == 0)
+	{
+		dec->done = 1;
+		dec->stats.complete_blocks++;
+		return 0;
+	}
+	for(i = 0; i < m; i++)
+	{
+		received += dec->received[i];
+	}
+	if(count > received)
+	{
+		return 0;
+	}
+	dec->done = 1;
+	return fec_recover(dec, missing, count, recover, arg);
+}
+
+void fec_decoder_print_stats(struct fec_decoder *dec)
+{
+	struct fec_stats *stats = &(dec->stats);
+
+	fec_close_block(dec);
+	fprintf(stdout, "FEC statistics (%s)\n", gf256_impl());
+	fprintf(stdout, "  - parity frames:      %lu received, %lu invalid\n", stats->parity_frames, stats->invalid);
+	fprintf(stdout, "  - blocks:             %lu complete, %lu lost\n", stats->complete_blocks, stats->lost_blocks);
+	fprintf(stdout, "  - rebuilt frames:     %lu\n", stats->recovered_frames);
+}
@@ -0,0 +1,173 @@
+// Copyright 2023, Viveris Technologies
+// Distributed under the terms of the MIT License
+
+#ifndef __FEC_H__
+#define __FEC_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/uio.h>
+
+#include "tunnel_header.h"
+
+#define FEC_MAX_DATA 64    // Data frames per block
+#define FEC_MAX_PARITY 8   // Parity frames per block
+#define FEC_LEN_PREFIX 2   // Frame length protected along with the frame
+
+/**
+ * Parity schemes
+ */
+typedef enum
+{
+	fec_xor = 1,   // a single parity frame, the XOR of the data frames
+	fec_rs = 2,    // Reed-Solomon over GF(2^8) with a Cauchy matrix
+} fec_scheme_t;
+
+/**
+ * Parity frames of the block being sent to a remote
+ *
+ * The parity is accumulated as each data frame is sent, the data frames are
+ * not kept. A data frame is protected with its length, and the frames
+ * shorter than the longest of the block are taken as padded with zeros.
+ */
+struct fec_encoder
+{
+	fec_scheme_t scheme;
+	unsigned int k;
+	unsigned int m;
+	size_t capa;
+
+	unsigned int count;
+	uint32_t base;
+	size_t max_len;
+	unsigned char *parity;
+};
+
+/**
+ * Received frame kept to rebuild the missing ones
+ */
+struct fec_frame
+{
+	int valid;
+	uint32_t seq;
+	size_t len;            // length prefix included
+	unsigned char *data;
+};
+
+/**
+ * FEC counters
+ */
+struct fec_stats
+{
+	uint64_t parity_frames;
+	uint64_t complete_blocks;    // no frame missing
+	uint64_t recovered_frames;
+	uint64_t lost_blocks;        // too many frames missing
+	uint64_t invalid;
+};
+
+/**
+ * Rebuilder of the missing frames of the last block
+ */
+struct fec_decoder
+{
+	size_t capa;
+
+	// Last data frames received, indexed by sequence number
+	size_t mask;
+	struct fec_frame *frames;
+	unsigned char *arena;
+
+	// Parity frames of the current block
+	int active;
+	int done;
+	uint32_t base;
+	fec_scheme_t scheme;
+	unsigned int k;
+	unsigned int m;
+	size_t parity_len;
+	int received[FEC_MAX_PARITY];
+	unsigned char *parity;
+
+	struct fec_stats stats;
+};
+
+/**
+ * Handler of a rebuilt data frame
+ *
+ * Return 0 on success, -1 on error
+ */
+typedef int (*fec_recover_t)(uint32_t seq, unsigned char *data, size_t len, void *arg);
+
+/**
+ * Parse a FEC configuration ("xor:K" or "rs:K:M")
+ *
+ * Return 0 on success, -1 otherwise
+ */
+int fec_parse(const char *str, fec_scheme_t *scheme, unsigned int *k, unsigned int *m);
+
+/**
+ * Create an encoder of blocks of k data frames of up to capa bytes, protected
+ * by m parity frames
+ *
+ * Return the encoder on success, NULL otherwise
+ */
+struct fec_encoder *fec_encoder_create(fec_scheme_t scheme, unsigned int k, unsigned int m, size_t capa);
+
+/**
+ * Delete an encoder
+ */
+void fec_encoder_delete(struct fec_encoder *enc);
+
+/**
+ * Add a data frame, scattered over an I/O vector, to the current block
+ *
+ * Return 1 when the block is complete and its parity frames must be sent,
+ * 0 otherwise
+ */
+int fec_encoder_add(struct fec_encoder *enc, uint32_t seq, const struct iovec *iov, int count);
+
+/**
+ * Get a parity frame of the current block and its tunnel header, the block
+ * may hold less than k data frames when it is flushed
+ */
+void fec_encoder_parity(struct fec_encoder *enc, unsigned int idx, struct tunnel_header *hdr,
+                        unsigned char **data, size_t *len);
+
+/**
+ * Start a new block
+ */
+void fec_encoder_reset(struct fec_encoder *enc);
+
+/**
+ * Create a decoder keeping the last history data frames of up to capa bytes
+ *
+ * Return the decoder on success, NULL otherwise
+ */
+struct fec_decoder *fec_decoder_create(size_t history, size_t capa);
+
+/**
+ * Delete a decoder
+ */
+void fec_decoder_delete(struct fec_decoder *dec);
+
+/**
+ * Keep a received data frame
+ */
+void fec_decoder_data(struct fec_decoder *dec, uint32_t seq, const unsigned char *data, size_t len);
+
+/**
+ * Handle a parity frame and rebuild the missing data frames of its block when
+ * enough parity frames are received
+ *
+ * Return 0 on success, -1 if the handler failed
+ */
+int fec_decoder_parity(struct fec_decoder *dec, const struct tunnel_header *hdr, const unsigned char *data,
+                       size_t len, fec_recover_t recover, void *arg);
+
+/**
+ * Print the FEC counters
+ */
+void fec_decoder_print_stats(struct fec_decoder *dec);
+
+#endif
@@ -0,0 +1,561 @@
+// Copyright 2023, Viveris Technologies
+// Distributed under the terms of the MIT License
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <arpa/inet.h>
+
+#include "fq_codel.h"
+
+#define FQ_MAX_DROP_BATCH 64 // PDUs dropped at most from the longest queue at once
+
+/**
+ * Parse a duration in milliseconds
+ *
+ * Return 0 on success, -1 otherwise
+ */
+int fq_parse_ms(const char *str, uint64_t *ns)
+{
+	char *end;
+	double val;
+
+	val = strtod(str, &end);
+	if(end == str || *end != '\0' || val <= 0 || val > 60000)
+	{
+		return -1;
+	}
+	*ns = (uint64_t)(val * 1000000);
+	return 0;
+}
+
+void fq_default_params(struct fq_params *params)
+{
+	params->flows = FQ_DEFAULT_FLOWS;
+	params->memory = FQ_DEFAULT_MEMORY;
+	params->limit = FQ_DEFAULT_LIMIT;
+	params->quantum = FQ_DEFAULT_QUANTUM;
+	params->target_ns = FQ_DEFAULT_TARGET_US * 1000ULL;
+	params->interval_ns = FQ_DEFAULT_INTERVAL_US * 1000ULL;
+}
+
+int fq_parse(const char *str, struct fq_params *params)
+{
+	char buf[64];
+	char *fields[4], *item, *save, *end;
+	unsigned long val;
+	int count = 0;
+
+	if(strlen(str) >= sizeof(buf))
+	{
+		return -1;
+	}
+	strcpy(buf, str);
+	for(item = strtok_r(buf, ":", &save); item != NULL; item = strtok_r(NULL, ":", &save))
+	{
+		if(count == 4)
+		{
+			return -1;
+		}
+		fields[count++] = item;
+	}
+	if(count != 1 && count != 2 && count != 4)
+	{
+		return -1;
+	}
+
+	val = strtoul(fields[0], &end, 10);
+	if(end == fields[0] || *end != '\0' || val == 0 || val > FQ_MAX_FLOWS)
+	{
+		return -1;
+	}
+	params->flows = val;
+	if(count >= 2)
+	{
+		val = strtoul(fields[1], &end, 10);
+		if(end == fields[1] || *end != '\0' || val < 64 || val > (1UL << 22))
+		{
+			return -1;
+		}
+		params->memory = val * 1024;
+	}
+	if(count == 4 &&
+	   (fq_parse_ms(fields[2], &(params->target_ns)) != 0 ||
+	    fq_parse_ms(fields[3], &(params->interval_ns)) != 0 ||
+	    params->target_ns > params->interval_ns))
+	{
+		return -1;
+	}
+	return 0;
+}
+
+struct fq_codel *fq_create(struct fq_params *params, fq_drop_t drop, void *drop_arg)
+{
+	struct fq_codel *fq;
+	unsigned int i;
+
+	if((fq = (struct fq_codel *)malloc(sizeof(struct fq_codel))) == NULL)
+	{
+		return NULL;
+	}
+	memset(fq, 0, sizeof(struct fq_codel));
+	fq->params = *params;
+	fq->drop = drop;
+	fq->drop_arg = drop_arg;
+	flow_hasher_init(&(fq->hasher), flow_rss_key);
+
+	fq->flows = (struct fq_flow *)calloc(params->flows, sizeof(struct fq_flow));
+	fq->pdus = (struct fq_pdu *)calloc(params->limit, sizeof(struct fq_pdu));
+	if(fq->flows == NULL || fq->pdus == NULL)
+	{
+		free(fq->flows);
+		free(fq->pdus);
+		free(fq);
+		return NULL;
+	}
+	for(i = 0; i < params->limit; i++)
+	{
+		fq->pdus[i].next = i + 1 < params->limit ? &(fq->pdus[i + 1]) : NULL;
+	}
+	fq->free_pdus = fq->pdus;
+	return fq;
+}
+
+void fq_delete(struct fq_codel *fq)
+{
+	struct fq_pdu *pdu;
+	unsigned int i;
+
+	if(fq == NULL)
+	{
+		return;
+	}
+	for(i = 0; i < fq->params.flows; i++)
+	{
+		for(pdu = fq->flows[i].head; pdu != NULL; pdu = pdu->next)
+		{
+			fq->drop(pdu->data, fq->drop_arg);
+		}
+	}
+	free(fq->pdus);
+	free(fq->flows);
+	free(fq);
+}
+
+void fq_list_push(struct fq_list *list, struct fq_flow *flow)
+{
+	flow->next = NULL;
+	if(list->tail == NULL)
+	{
+		list->head = flow;
+	}
+	else
+	{
+		list->tail->next = flow;
+	}
+	list->tail = flow;
+}
+
+struct fq_flow *fq_list_pop(struct fq_list *list)
+{
+	struct fq_flow *flow = list->head;
+
+	list->head = flow->next;
+	if(list->head == NULL)
+	{
+		list->tail = NULL;
+	}
+	return flow;
+}
+
+/**
+ * Remove the PDU at the head of a queue
+ *
+ * Return the PDU, NULL when the queue is empty
+ */
+struct fq_pdu *fq_flow_pop(struct fq_codel *fq, struct fq_flow *flow)
+{
+	struct fq_pdu *pdu = flow->head;
+
+	if(pdu == NULL)
+	{
+		return NULL;
+	}
+	flow->head = pdu->next;
+	if(flow->head == NULL)
+	{
+		flow->tail = NULL;
+	}
+	flow->backlog -= pdu->len;
+	fq->backlog -= pdu->len;
+	fq->queued--;
+	return pdu;
+}
+
+/**
+ * Give a PDU removed from its queue to the drop handler
+ */
+void fq_flow_drop(struct fq_codel *fq, struct fq_pdu *pdu)
+{
+	fq->drop(pdu->data, fq->drop_arg);
+	pdu->next = fq->free_pdus;
+	fq->free_pdus = pdu;
+}
+
+/**
+ * Drop from the head of the longest queue, up to half of its bytes
+ */
+void fq_drop_longest(struct fq_codel *fq)
+{
+	struct fq_flow *flow = NULL;
+	struct fq_pdu *pdu;
+	size_t threshold;
+	unsigned int i;
+
+	for(i = 0; i < fq->params.flows; i++)
+	{
+		if(flow == NULL || fq->flows[i].backlog > flow->backlog)
+		{
+			flow = &(fq->flows[i]);
+		}
+	}
+	threshold = flow->backlog / 2;
+	for(i = 0; i < FQ_MAX_DROP_BATCH && flow->backlog > threshold; i++)
+	{
+		pdu = fq_flow_pop(fq, flow);
+		flow->stats.overflow_drops++;
+		fq->stats.overflow_drops++;
+		fq_flow_drop(fq, pdu);
+	}
+}
+
+void fq_enqueue(struct fq_codel *fq, void *data, const unsigned char *frame, size_t len, uint64_t now_ns)
+{
+	struct flow_key key;
+	struct fq_flow *flow;
+	struct fq_pdu *pdu;
+
+	flow_key_parse(frame, len, &key);
+	flow = &(fq->flows[((uint64_t)flow_hash(&(fq->hasher), &key) * fq->params.flows) >> 32]);
+	if(flow->stats.pdus == 0)
+	{
+		flow->key = key;
+	}
+	flow->stats.pdus++;
+	flow->stats.bytes += len;
+	fq->stats.pdus++;
+	fq->stats.bytes += len;
+
+	if(fq->free_pdus == NULL)
+	{
+		fq_drop_longest(fq);
+	}
+	pdu = fq->free_pdus;
+	fq->free_pdus = pdu->next;
+	pdu->next = NULL;
+	pdu->data = data;
+	pdu->len = len;
+	pdu->enqueue_ns = now_ns;
+	if(flow->tail == NULL)
+	{
+		flow->head = pdu;
+	}
+	else
+	{
+		flow->tail->next = pdu;
+	}
+	flow->tail = pdu;
+	flow->backlog += len;
+	fq->backlog += len;
+	fq->queued++;
+	if(flow->backlog > flow->stats.max_backlog)
+	{
+		flow->stats.max_backlog = flow->backlog;
+	}
+	if(fq->backlog > fq->stats.max_backlog)
+	{
+		fq->stats.max_backlog = fq->backlog;
+	}
+
+	// A flow without PDUs queued is new: served ahead of the old ones
+	if(!flow->listed)
+	{
+		flow->listed = 1;
+		flow->deficit = fq->params.quantum;
+		fq_list_push(&(fq->new_flows), flow);
+	}
+
+	while(fq->backlog > fq->params.memory)
+	{
+		fq_drop_longest(fq);
+	}
+}
+
+/**
+ * Compute the next drop time of CoDel: interval / sqrt(count) after t
+ */
+uint64_t fq_control_law(struct fq_codel *fq, uint64_t t_ns, uint32_t count)
+{
+	uint64_t scaled = (uint64_t)count << 32;
+	uint64_t root = 0, bit = 1ULL << 62;
+
+	// Integer square root of count << 32, that is sqrt(count) << 16
+	while(bit > scaled)
+	{
+		bit >>= 2;
+	}
+	while(bit != 0)
+	{
+		if(scaled >= root + bit)
+		{
+			scaled -= root + bit;
+			root = (root >> 1) + bit;
+		}
+		else
+		{
+			root >>= 1;
+		}
+		bit >>= 2;
+	}
+	return t_ns + (fq->params.interval_ns << 16) / root;
+}
+
+/**
+ * Remove the PDU at the head of a queue and tell whether CoDel may drop it:
+ * its sojourn time stayed above the target for an interval
+ *
+ * Return the PDU, NULL when the queue is empty
+ */
+struct fq_pdu *fq_codel_pop(struct fq_codel *fq, struct fq_flow *flow, uint64_t now_ns, int *ok_to_drop)
+{
+	struct fq_pdu *pdu;
+
+	*ok_to_drop = 0;
+	if((pdu = fq_flow_pop(fq, flow)) == NULL)
+	{
+		flow->first_above_ns = 0;
+		return NULL;
+	}
+
+	// Below the target, or too few bytes left to build a standing queue
+	if(now_ns - pdu->enqueue_ns < fq->params.target_ns || flow->backlog <= fq->params.quantum)
+	{
+		flow->first_above_ns = 0;
+	}
+	else if(flow->first_above_ns == 0)
+	{
+		flow->first_above_ns = now_ns + fq->params.interval_ns;
+	}
+	else if(now_ns >= flow->first_above_ns)
+	{
+		*ok_to_drop = 1;
+	}
+	return pdu;
+}
+
+/**
+ * Drop a PDU from its queue by CoDel
+ */
+void fq_codel_drop(struct fq_codel *fq, struct fq_flow *flow, struct fq_pdu *pdu)
+{
+	flow->stats.codel_drops++;
+	fq->stats.codel_drops++;
+	fq_flow_drop(fq, pdu);
+}
+
+/**
+ * Get the next PDU of a queue through CoDel
+ *
+ * Return the PDU, NULL when the queue is empty
+ */
+struct fq_pdu *fq_codel_dequeue(struct fq_codel *fq, struct fq_flow *flow, uint64_t now_ns)
+{
+	struct fq_pdu *pdu;
+	uint32_t delta;
+	int ok_to_drop;
+
+	pdu = fq_codel_pop(fq, flow, now_ns, &ok_to_drop);
+	if(pdu == NULL)
+	{
+		flow->dropping = 0;
+		return NULL;
+	}
+
+	if(flow->dropping)
+	{
+		if(!ok_to_drop)
+		{
+			flow->dropping = 0;
+		}
+		while(flow->dropping && now_ns >= flow->drop_next_ns)
+		{
+			fq_codel_drop(fq, flow, pdu);
+			flow->count++;
+			pdu = fq_codel_pop(fq, flow, now_ns, &ok_to_drop);
+			if(pdu == NULL || !ok_to_drop)
+			{
+				flow->dropping = 0;
+			}
+			else
+			{
+				flow->drop_next_ns = fq_control_law(fq, flow->drop_next_ns, flow->count);
+			}
+		}
+	}
+	else if(ok_to_drop)
+	{
+		fq_codel_drop(fq, flow, pdu);
+		pdu = fq_codel_pop(fq, flow, now_ns, &ok_to_drop);
+		flow->dropping = 1;
+
+		// Back to dropping soon after leaving it: resume near the last rate
+		delta = flow->count - flow->lastcount;
+		if(delta > 1 && now_ns - flow->drop_next_ns < 16 * fq->params.interval_ns)
+		{
+			flow->count = delta;
+		}
+		else
+		{
+			flow->count = 1;
+		}
+		flow->lastcount = flow->count;
+		flow->drop_next_ns = fq_control_law(fq, now_ns, flow->count);
+	}
+	return pdu;
+}
+
+void *fq_dequeue(struct fq_codel *fq, uint64_t now_ns)
+{
+	struct fq_list *list;
+	struct fq_flow *flow;
+	struct fq_pdu *pdu;
+	void *data;
+
+	for(;;)
+	{
+		list = fq->new_flows.head != NULL ? &(fq->new_flows) : &(fq->old_flows);
+		if(list->head == NULL)
+		{
+			return NULL;
+		}
+		flow = list->head;
+
+		// Quantum spent: next turn at the end of the old flows
+		if(flow->deficit <= 0)
+		{
+			flow->deficit += fq->params.quantum;
+			fq_list_pop(list);
+			fq_list_push(&(fq->old_flows), flow);
+			continue;
+		}
+
+		if((pdu = fq_codel_dequeue(fq, flow, now_ns)) == NULL)
+		{
+			// A new flow emptied goes through the old ones once, so that a
+			// flow cannot stay new by sending a PDU at a time
+			fq_list_pop(list);
+			if(list == &(fq->new_flows) && fq->old_flows.head != NULL)
+			{
+				fq_list_push(&(fq->old_flows), flow);
+			}
+			else
+			{
+				flow->listed = 0;
+			}
+			continue;
+		}
+
+		flow->deficit -= pdu->len;
+		flow->stats.sent++;
+		fq->stats.sent++;
+		data = pdu->data;
+		pdu->next = fq->free_pdus;
+		fq->free_pdus = pdu;
+		return data;
+	}
+}
+
+unsigned int fq_queued(struct fq_codel *fq)
+{
+	return fq->queued;
+}
+
+/**
+ * Print the flow of a queue
+ */
+void fq_print_key(struct flow_key *key)
+{
+	char src[INET6_ADDRSTRLEN], dst[INET6_ADDRSTRLEN];
+	int af = key->family == 4 ? AF_INET : AF_INET6;
+	size_t len = key->family == 4 ? 4 : 16;
+
+	if(key->family == 0)
+	{
+		fprintf(stdout, "%02x:%02x:%02x:%02x:%02x:%02x > %02x:%02x:%02x:%02x:%02x:%02x", key->tuple[0],
+		        key->tuple[1], key->tuple[2], key->tuple[3], key->tuple[4], key->tuple[5], key->tuple[6],
+		        key->tuple[7], key->tuple[8], key->tuple[9], key->tuple[10], key->tuple[11]);
+		return;
+	}
+	inet_ntop(af, key->tuple, src, sizeof(src));
+	inet_ntop(af, key->tuple + len, dst, sizeof(dst));
+	if(key->level == flow_l4)
+	{
+		fprintf(stdout, "%s.%u > %s.%u proto %u", src, key->sport, dst, key->dport, key->proto);
+	}
+	else
+	{
+		fprintf(stdout, "%s > %s proto %u", src, dst, key->proto);
+	}
+}
+
+void fq_print_stats(struct fq_codel *fq)
+{
+	struct fq_flow *printed[FQ_PRINTED_FLOWS];
+	struct fq_flow *flow;
+	unsigned int count = 0, active = 0;
+	unsigned int i, j;
+
+	// Busiest flows by bytes, sorted by insertion
+	for(i = 0; i < fq->params.flows; i++)
+	{
+		flow = &(fq->flows[i]);
+		if(flow->stats.pdus == 0)
+		{
+			continue;
+		}
+		active++;
+		for(j = count; j > 0 && printed[j - 1]->stats.bytes < flow->stats.bytes; j--)
+		{
+			if(j < FQ_PRINTED_FLOWS)
+			{
+				printed[j] = printed[j - 1];
+			}
+		}
+		if(j < FQ_PRINTED_FLOWS)
+		{
+			printed[j] = flow;
+			if(count < FQ_PRINTED_FLOWS)
+			{
+				count++;
+			}
+		}
+	}
+
+	fprintf(stdout, "Flow queueing\n");
+	fprintf(stdout, "  - %-20s%u of %u\n", "flow queues used:", active, fq->params.flows);
+	fprintf(stdout, "  - %-20s%lu (%lu bytes)\n", "PDUs queued:", fq->stats.pdus, fq->stats.bytes);
+	fprintf(stdout, "  - %-20s%lu\n", "PDUs sent:", fq->stats.sent);
+	fprintf(stdout, "  - %-20s%lu\n", "CoDel drops:", fq->stats.codel_drops);
+	fprintf(stdout, "  - %-20s%lu\n", "overflow drops:", fq->stats.overflow_drops);
+	fprintf(stdout, "  - %-20s%zu bytes\n", "max backlog:", fq->stats.max_backlog);
+	for(i = 0; i < count; i++)
+	{
+		flow = printed[i];
+		fprintf(stdout, "  - flow %-15ld", flow - fq->flows);
+		fq_print_key(&(flow->key));
+		fprintf(stdout, "\n      %lu PDUs, %lu bytes, %lu sent, %lu CoDel drops, %lu overflow drops, "
+		        "max backlog %zu bytes\n", flow->stats.pdus, flow->stats.bytes, flow->stats.sent,
+		        flow->stats.codel_drops, flow->stats.overflow_drops, flow->stats.max_backlog);
+	}
+}
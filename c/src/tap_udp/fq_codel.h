@@ -0,0 +1,173 @@
+// Copyright 2023, Viveris Technologies
+// Distributed under the terms of the MIT License
+
+#ifndef __FQ_CODEL_H__
+#define __FQ_CODEL_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "flow_hash.h"
+
+#define FQ_DEFAULT_FLOWS 1024
+#define FQ_MAX_FLOWS 65536
+#define FQ_DEFAULT_MEMORY (32 << 20)   // bytes of PDUs queued at most
+#define FQ_DEFAULT_LIMIT 10240         // PDUs queued at most
+#define FQ_DEFAULT_QUANTUM 1514        // bytes served per flow in turn
+#define FQ_DEFAULT_TARGET_US 5000      // acceptable standing queue delay
+#define FQ_DEFAULT_INTERVAL_US 100000  // about a worst case RTT
+#define FQ_PRINTED_FLOWS 16            // busiest flows printed in the stats
+
+/**
+ * Flow queueing settings
+ */
+struct fq_params
+{
+	unsigned int flows;   // queues, the flows hashed into the same one share it
+	size_t memory;        // bytes of PDUs queued at most
+	unsigned int limit;   // PDUs queued at most
+	unsigned int quantum;
+	uint64_t target_ns;
+	uint64_t interval_ns;
+};
+
+/**
+ * PDU queued, with its enqueue time for the sojourn time
+ */
+struct fq_pdu
+{
+	struct fq_pdu *next;
+	void *data;
+	size_t len;
+	uint64_t enqueue_ns;
+};
+
+/**
+ * Counters of a flow queue
+ */
+struct fq_flow_stats
+{
+	uint64_t pdus;
+	uint64_t bytes;
+	uint64_t sent;
+	uint64_t codel_drops;    // sojourn time above the target for an interval
+	uint64_t overflow_drops; // from the longest queue, over the memory or limit
+	size_t max_backlog;
+};
+
+/**
+ * Queue of the flows of a hash bucket, with its CoDel state
+ */
+struct fq_flow
+{
+	struct fq_pdu *head;
+	struct fq_pdu *tail;
+	size_t backlog; // bytes
+	int deficit;
+
+	struct fq_flow *next; // in the new or old flows list
+	int listed;
+
+	// CoDel (RFC 8289)
+	uint64_t first_above_ns; // when the sojourn time stayed above the target for an interval, 0 below
+	uint64_t drop_next_ns;
+	uint32_t count;
+	uint32_t lastcount;
+	int dropping;
+
+	struct flow_key key; // of the first PDU, for the stats
+	struct fq_flow_stats stats;
+};
+
+/**
+ * List of flows served in turn
+ */
+struct fq_list
+{
+	struct fq_flow *head;
+	struct fq_flow *tail;
+};
+
+/**
+ * Handler of a PDU dropped, which gets its ownership back
+ */
+typedef void (*fq_drop_t)(void *data, void *arg);
+
+/**
+ * Flow queueing with CoDel (FQ-CoDel, RFC 8290)
+ *
+ * The PDUs are hashed by their flow into queues served by a deficit round
+ * robin, the queues of new flows first so that sparse flows get through
+ * ahead of the bulk ones. CoDel drops at dequeue the PDUs of a queue whose
+ * delay stays above the target, and the PDUs over the memory or the limit
+ * are dropped from the longest queue. Not thread-safe.
+ */
+struct fq_codel
+{
+	struct fq_params params;
+	struct flow_hasher hasher;
+
+	struct fq_flow *flows;
+	struct fq_list new_flows;
+	struct fq_list old_flows;
+
+	struct fq_pdu *pdus;
+	struct fq_pdu *free_pdus;
+	unsigned int queued;
+	size_t backlog; // bytes
+
+	fq_drop_t drop;
+	void *drop_arg;
+
+	struct fq_flow_stats stats;
+};
+
+/**
+ * Parse flow queueing settings (format: "FLOWS[:MEMORY_KB[:TARGET_MS:INTERVAL_MS]]")
+ * over the defaults
+ *
+ * Return 0 on success, -1 otherwise
+ */
+int fq_parse(const char *str, struct fq_params *params);
+
+/**
+ * Set the default flow queueing settings
+ */
+void fq_default_params(struct fq_params *params);
+
+/**
+ * Create the flow queues, the PDUs dropped are given to the drop handler
+ *
+ * Return the flow queues on success, NULL otherwise
+ */
+struct fq_codel *fq_create(struct fq_params *params, fq_drop_t drop, void *drop_arg);
+
+/**
+ * Delete the flow queues, the PDUs queued are dropped
+ */
+void fq_delete(struct fq_codel *fq);
+
+/**
+ * Queue a PDU of an Ethernet frame at time now_ns, then drop from the longest
+ * queue while over the memory or the limit
+ */
+void fq_enqueue(struct fq_codel *fq, void *data, const unsigned char *frame, size_t len, uint64_t now_ns);
+
+/**
+ * Get the next PDU to send at time now_ns
+ *
+ * Return the PDU, NULL when every queue is empty
+ */
+void *fq_dequeue(struct fq_codel *fq, uint64_t now_ns);
+
+/**
+ * Get the number of PDUs queued
+ */
+unsigned int fq_queued(struct fq_codel *fq);
+
+/**
+ * Print the counters, in total and of the busiest flows
+ */
+void fq_print_stats(struct fq_codel *fq);
+
+#endif
@@ -0,0 +1,300 @@
+// Copyright 2023, Viveris Technologies
+// Distributed under the terms of the MIT License
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <ctype.h>
+
+#include "fwd_table.h"
+#include "pkt_header.h"
+#include "utils.h"
+
+#define FWD_LINE_LEN 256
+
+/**
+ * Entry read from the file, before the table is built
+ */
+struct fwd_line
+{
+	uint64_t mac;
+	size_t remote;
+	uint8_t label_type;
+	uint8_t label[FWD_LABEL_LEN];
+};
+
+size_t fwd_hash(uint64_t mac, size_t mask)
+{
+	return (size_t)((mac * 0x9E3779B97F4A7C15ULL) >> 32) & mask;
+}
+
+int fwd_parse_line(char *line, struct fwd_line *entry, struct udp_addr *addr)
+{
+	uint8_t bytes[FWD_LABEL_LEN];
+	char *mac, *remote, *label;
+	char *save;
+	int i, count;
+
+	mac = strtok_r(line, " \t\r\n", &save);
+	remote = strtok_r(NULL, " \t\r\n", &save);
+	label = strtok_r(NULL, " \t\r\n", &save);
+	if(mac == NULL || remote == NULL || strtok_r(NULL, " \t\r\n", &save) != NULL)
+	{
+		return -1;
+	}
+
+	if(parse_hex_bytes(mac, bytes, FWD_LABEL_LEN) != FWD_LABEL_LEN)
+	{
+		return -1;
+	}
+	entry->mac = 0;
+	for(i = 0; i < FWD_LABEL_LEN; i++)
+	{
+		entry->mac = (entry->mac << 8) + bytes[i];
+	}
+	if(parse_udp_arguments(remote, addr) != 0)
+	{
+		return -1;
+	}
+
+	// The MAC address is the default label
+	if(label == NULL)
+	{
+		count = FWD_LABEL_LEN;
+	}
+	else if((count = parse_hex_bytes(label, bytes, FWD_LABEL_LEN)) != 6 && count != 3)
+	{
+		return -1;
+	}
+	entry->label_type = count == 6 ? FWD_LABEL_6_BYTES : FWD_LABEL_3_BYTES;
+	memset(entry->label, 0, FWD_LABEL_LEN);
+	memcpy(entry->label, bytes, count);
+	return 0;
+}
+
+struct fwd_table *fwd_table_build(struct fwd_line *lines, size_t count, struct fwd_remote *remotes, size_t remote_count)
+{
+	struct fwd_table *table;
+	struct fwd_entry *entry;
+	size_t capa = 1;
+	size_t i, idx;
+
+	if((table = (struct fwd_table *)malloc(sizeof(struct fwd_table))) == NULL)
+	{
+		return NULL;
+	}
+	memset(table, 0, sizeof(struct fwd_table));
+
+	// Keep the load factor under 50%
+	while(capa < 2 * count)
+	{
+		capa <<= 1;
+	}
+	if((table->entries = (struct fwd_entry *)calloc(capa, sizeof(struct fwd_entry))) == NULL)
+	{
+		free(table);
+		return NULL;
+	}
+	table->mask = capa - 1;
+	table->remotes = remotes;
+	table->remote_count = remote_count;
+
+	for(i = 0; i < count; i++)
+	{
+		idx = fwd_hash(lines[i].mac, table->mask);
+		while(table->entries[idx].used && table->entries[idx].mac != lines[i].mac)
+		{
+			idx = (idx + 1) & table->mask;
+		}
+		entry = &(table->entries[idx]);
+		if(entry->used)
+		{
+			char str[32];
+			mac_address_str(lines[i].mac, str);
+			fprintf(stderr, "Duplicated forwarding entry for MAC address %s, the last one is kept\n", str);
+		}
+		else
+		{
+			table->count++;
+		}
+		entry->used = 1;
+		entry->mac = lines[i].mac;
+		entry->remote = &(remotes[lines[i].remote]);
+		entry->label_type = lines[i].label_type;
+		memcpy(entry->label, lines[i].label, FWD_LABEL_LEN);
+	}
+	return table;
+}
+
+struct fwd_table *fwd_table_load(const char *path)
+{
+	struct fwd_table *table = NULL;
+	struct fwd_line *lines = NULL, *tmp_lines;
+	struct fwd_remote *remotes = NULL, *tmp_remotes;
+	struct udp_addr addr;
+	size_t count = 0, remote_count = 0, capa = 0;
+	size_t i;
+	unsigned int line_nb = 0;
+	char line[FWD_LINE_LEN];
+	char *start;
+	FILE *file;
+
+	if((file = fopen(path, "r")) == NULL)
+	{
+		fprintf(stderr, "Function fopen failed (path: %s): %s (%d)\n", path, strerror(errno), errno);
+		return NULL;
+	}
+	while(fgets(line, sizeof(line), file) != NULL)
+	{
+		line_nb++;
+		start = line;
+		while(isspace((unsigned char)*start))
+		{
+			start++;
+		}
+		if(*start == '\0' || *start == '#')
+		{
+			continue;
+		}
+		if(count == capa)
+		{
+			capa = capa == 0 ? 64 : 2 * capa;
+			if((tmp_lines = (struct fwd_line *)realloc(lines, capa * sizeof(struct fwd_line))) == NULL ||
+			   (tmp_remotes = (struct fwd_remote *)realloc(remotes, capa * sizeof(struct fwd_remote))) == NULL)
+			{
+				lines = tmp_lines != NULL ? tmp_lines : lines;
+				goto error;
+			}
+			lines = tmp_lines;
+			remotes = tmp_remotes;
+		}
+		if(fwd_parse_line(start, &(lines[count]), &addr) != 0)
+		{
+			fprintf(stderr, "Invalid forwarding entry at %s:%u (format: \"MAC_ADDRESS ADDRESS:PORT [LABEL]\")\n", path, line_nb);
+			goto error;
+		}
+
+		// Share the remote between the entries of a same terminal
+		for(i = 0; i < remote_count; i++)
+		{
+			if(remotes[i].addr.addr == addr.addr && remotes[i].addr.port == addr.port)
+			{
+				break;
+			}
+		}
+		if(i == remote_count)
+		{
+			memset(&(remotes[i]), 0, sizeof(struct fwd_remote));
+			remotes[i].addr = addr;
+			remote_count++;
+		}
+		lines[count].remote = i;
+		count++;
+	}
+	if(count == 0)
+	{
+		fprintf(stderr, "Empty forwarding table %s\n", path);
+		goto error;
+	}
+	if((table = fwd_table_build(lines, count, remotes, remote_count)) == NULL)
+	{
+		goto error;
+	}
+	free(lines);
+	fclose(file);
+	return table;
+
+error:
+	free(remotes);
+	free(lines);
+	fclose(file);
+	return NULL;
+}
+
+void fwd_table_delete(struct fwd_table *table)
+{
+	if(table == NULL)
+	{
+		return;
+	}
+	free(table->remotes);
+	free(table->entries);
+	free(table);
+}
+
+void fwd_table_set_default(struct fwd_table *table, const struct udp_addr *addr)
+{
+	size_t i;
+
+	for(i = 0; i < table->remote_count; i++)
+	{
+		if(table->remotes[i].addr.addr == addr->addr && table->remotes[i].addr.port == addr->port)
+		{
+			table->fallback = &(table->remotes[i]);
+			return;
+		}
+	}
+	memset(&(table->extra), 0, sizeof(struct fwd_remote));
+	table->extra.addr = *addr;
+	table->fallback = &(table->extra);
+}
+
+size_t fwd_group_count(struct fwd_table *table)
+{
+	return table->remote_count + (table->fallback == &(table->extra) ? 1 : 0);
+}
+
+struct fwd_remote *fwd_group_remote(struct fwd_table *table, size_t index)
+{
+	return index < table->remote_count ? &(table->remotes[index]) : &(table->extra);
+}
+
+struct fwd_entry *fwd_table_lookup(struct fwd_table *table, uint64_t mac)
+{
+	size_t idx = fwd_hash(mac, table->mask);
+
+	while(table->entries[idx].used)
+	{
+		if(table->entries[idx].mac == mac)
+		{
+			return &(table->entries[idx]);
+		}
+		idx = (idx + 1) & table->mask;
+	}
+	return NULL;
+}
+
+int fwd_is_group_address(uint64_t mac)
+{
+	// I/G bit of the first byte
+	return (mac >> 40) & 0x1;
+}
+
+void fwd_table_print_stats(struct fwd_table *table)
+{
+	char mac[32], addr[32];
+	size_t i;
+
+	fprintf(stdout, "Forwarding statistics\n");
+	for(i = 0; i <= table->mask; i++)
+	{
+		if(!table->entries[i].used)
+		{
+			continue;
+		}
+		mac_address_str(table->entries[i].mac, mac);
+		fprintf(stdout, "  - %s: %lu PDUs, %lu bytes\n", mac, table->entries[i].pdus, table->entries[i].bytes);
+	}
+	for(i = 0; i < table->remote_count; i++)
+	{
+		ipv4_address_str(table->remotes[i].addr.addr, addr);
+		fprintf(stdout, "  - remote %s:%u: %lu PDUs, %lu bytes\n", addr, table->remotes[i].addr.port, table->remotes[i].pdus, table->remotes[i].bytes);
+	}
+	if(table->fallback == &(table->extra))
+	{
+		ipv4_address_str(table->extra.addr.addr, addr);
+		fprintf(stdout, "  - default remote %s:%u: %lu PDUs, %lu bytes\n", addr, table->extra.addr.port, table->extra.pdus, table->extra.bytes);
+	}
+	fprintf(stdout, "  - unknown destination: %lu PDUs dropped\n", table->unknown_pdus);
+}
@@ -0,0 +1,122 @@
+// Copyright 2023, Viveris Technologies
+// Distributed under the terms of the MIT License
+
+#ifndef __FWD_TABLE_H__
+#define __FWD_TABLE_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "udp.h"
+
+#define FWD_LABEL_LEN 6
+
+// GSE label types
+#define FWD_LABEL_6_BYTES 0
+#define FWD_LABEL_3_BYTES 1
+#define FWD_LABEL_BROADCAST 2
+
+/**
+ * Remote terminal reached through the tunnel
+ */
+struct fwd_remote
+{
+	struct udp_addr addr;
+
+	uint64_t pdus;
+	uint64_t bytes;
+};
+
+/**
+ * Forwarding entry of a destination MAC address
+ */
+struct fwd_entry
+{
+	uint64_t mac;
+	int used;
+
+	struct fwd_remote *remote;
+	uint8_t label_type;
+	uint8_t label[FWD_LABEL_LEN];
+
+	uint64_t pdus;
+	uint64_t bytes;
+};
+
+/**
+ * Forwarding table, an open addressing hash table indexed by MAC address
+ */
+struct fwd_table
+{
+	size_t mask;
+	size_t count;
+	struct fwd_entry *entries;
+
+	// Distinct remote terminals, broadcast and multicast frames are
+	// replicated to each of them
+	size_t remote_count;
+	struct fwd_remote *remotes;
+
+	// Default remote of the unknown destinations, NULL without: one of the
+	// remotes, or the extra one which also gets the group frames
+	struct fwd_remote *fallback;
+	struct fwd_remote extra;
+
+	uint64_t unknown_pdus;
+};
+
+/**
+ * Load a forwarding table from a file
+ *
+ * Each line holds "MAC_ADDRESS ADDRESS:PORT [LABEL]" where LABEL is a 6-byte
+ * or a 3-byte label written like a MAC address ("xx:xx:xx"), the MAC address
+ * itself is used as label when omitted. Empty lines and lines starting with
+ * '#' are ignored.
+ *
+ * Return the table on success, NULL otherwise
+ */
+struct fwd_table *fwd_table_load(const char *path);
+
+/**
+ * Delete a forwarding table
+ */
+void fwd_table_delete(struct fwd_table *table);
+
+/**
+ * Set the default remote of the unknown destinations, which also gets the
+ * broadcast and multicast frames when it is not one of the table
+ */
+void fwd_table_set_default(struct fwd_table *table, const struct udp_addr *addr);
+
+/**
+ * Get the remote terminals of the broadcast and multicast frames: those of
+ * the table, then the default one when it is not one of them
+ *
+ * Return their count
+ */
+size_t fwd_group_count(struct fwd_table *table);
+
+/**
+ * Get a remote terminal of the broadcast and multicast frames, index below
+ * fwd_group_count()
+ */
+struct fwd_remote *fwd_group_remote(struct fwd_table *table, size_t index);
+
+/**
+ * Get the forwarding entry of a MAC address
+ *
+ * Return the entry if found, NULL otherwise
+ */
+struct fwd_entry *fwd_table_lookup(struct fwd_table *table, uint64_t mac);
+
+/**
+ * Check if a MAC address is a broadcast or a multicast address
+ */
+int fwd_is_group_address(uint64_t mac);
+
+/**
+ * Print the forwarding table counters
+ */
+void fwd_table_print_stats(struct fwd_table *table);
+
+#endif
@@ -0,0 +1,478 @@
+// Copyright 2023, Viveris Technologies
+// Distributed under the terms of the MIT License
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+#include "handoff.h"
+#include "utils.h"
+
+#define HANDOFF_GO 'g' // sent by the next process once ready
+
+/**
+ * Ancillary data of the descriptors
+ */
+union handoff_control
+{
+	struct cmsghdr align;
+	char buf[CMSG_SPACE((1 + HANDOFF_MAX_UDP) * sizeof(int))];
+};
+
+int handoff_receive(struct handoff *handoff);
+int handoff_give(struct handoff *handoff, int fd);
+void *handoff_serve(void *arg);
+void handoff_unlink(struct handoff *handoff);
+void handoff_close_fds(struct handoff *handoff);
+
+struct handoff *handoff_create(const char *path, int program)
+{
+	struct handoff *handoff;
+	struct sockaddr_un addr;
+	unsigned int i;
+
+	if(strlen(path) >= sizeof(addr.sun_path))
+	{
+		fprintf(stderr, "Invalid handoff socket path \"%s\": too long\n", path);
+		return NULL;
+	}
+	if((handoff = (struct handoff *)calloc(1, sizeof(struct handoff))) == NULL)
+	{
+		return NULL;
+	}
+	handoff->program = program;
+	memcpy(handoff->path, path, strlen(path) + 1);
+	handoff->tap_fd = -1;
+	for(i = 0; i < HANDOFF_MAX_UDP; i++)
+	{
+		handoff->udp_fds[i] = -1;
+	}
+	handoff->listen_fd = -1;
+	atomic_init(&(handoff->running), 1);
+	atomic_init(&(handoff->requested), 0);
+
+	memset(&addr, 0, sizeof(struct sockaddr_un));
+	addr.sun_family = AF_UNIX;
+	memcpy(addr.sun_path, path, strlen(path) + 1);
+	if((handoff->conn_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0)
+	{
+		fprintf(stderr, "Function socket failed: %s (%d)\n", strerror(errno), errno);
+		free(handoff);
+		return NULL;
+	}
+	if(connect(handoff->conn_fd, (struct sockaddr *)&addr, sizeof(struct sockaddr_un)) != 0)
+	{
+		// No previous process, or a socket left by a crash: the descriptors
+		// are opened
+		if(errno == ENOENT || errno == ECONNREFUSED)
+		{
+			close(handoff->conn_fd);
+			handoff->conn_fd = -1;
+			return handoff;
+		}
+		fprintf(stderr, "Handoff socket %s connection failed: %s (%d)\n", path, strerror(errno), errno);
+		handoff_delete(handoff);
+		return NULL;
+	}
+	if(handoff_receive(handoff) != 0)
+	{
+		fprintf(stderr, "Descriptors handoff from %s failed\n", path);
+		handoff_delete(handoff);
+		return NULL;
+	}
+	return handoff;
+}
+
+void handoff_delete(struct handoff *handoff)
+{
+	if(handoff == NULL)
+	{
+		return;
+	}
+	atomic_store(&(handoff->running), 0);
+	if(handoff->serving)
+	{
+		pthread_join(handoff->thread, NULL);
+	}
+	handoff_unlink(handoff);
+	if(handoff->conn_fd >= 0)
+	{
+		close(handoff->conn_fd);
+	}
+	handoff_close_fds(handoff);
+	free(handoff);
+}
+
+/**
+ * Receive the descriptors of the previous process, sent as soon as it
+ * accepted the connection
+ *
+ * Return 0 on success, -1 otherwise
+ */
+int handoff_receive(struct handoff *handoff)
+{
+	struct handoff_header header;
+	struct iovec iov = {&header, sizeof(struct handoff_header)};
+	union handoff_control control;
+	struct pollfd pfd = {handoff->conn_fd, POLLIN, 0};
+	struct msghdr msg;
+	struct cmsghdr *cmsg;
+	int fds[1 + HANDOFF_MAX_UDP];
+	unsigned int count = 0, i;
+	ssize_t ret;
+
+	if(poll(&pfd, 1, HANDOFF_STATE_TIMEOUT_MS) <= 0)
+	{
+		return -1;
+	}
+	memset(&msg, 0, sizeof(struct msghdr));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control.buf;
+	msg.msg_controllen = sizeof(control.buf);
+	if((ret = recvmsg(handoff->conn_fd, &msg, 0)) < 0)
+	{
+		fprintf(stderr, "Function recvmsg failed: %s (%d)\n", strerror(errno), errno);
+		return -1;
+	}
+	for(cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg))
+	{
+		if(cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS && count == 0)
+		{
+			count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+			memcpy(fds, CMSG_DATA(cmsg), count * sizeof(int));
+		}
+	}
+
+	// The descriptors of another program or version are released
+	if(ret != sizeof(struct handoff_header) || (msg.msg_flags & MSG_CTRUNC) != 0 ||
+	   header.magic != HANDOFF_MAGIC || header.version != HANDOFF_VERSION || header.program != handoff->program ||
+	   header.udp_count > HANDOFF_MAX_UDP || count != 1 + header.udp_count)
+	{
+		fprintf(stderr, "Invalid descriptors handed over: the previous process must be the same program\n");
+		for(i = 0; i < count; i++)
+		{
+			close(fds[i]);
+		}
+		return -1;
+	}
+	handoff->tap_fd = fds[0];
+	memcpy(handoff->udp_fds, fds + 1, header.udp_count * sizeof(int));
+	handoff->udp_count = header.udp_count;
+	return 0;
+}
+
+int handoff_take_tap(struct handoff *handoff)
+{
+	int fd;
+
+	if(handoff == NULL)
+	{
+		return -1;
+	}
+	fd = handoff->tap_fd;
+	handoff->tap_fd = -1;
+	return fd;
+}
+
+int handoff_take_udp(struct handoff *handoff, struct udp_addr *local)
+{
+	struct sockaddr_in addr;
+	socklen_t len = sizeof(struct sockaddr_in);
+	int fd;
+
+	if(handoff == NULL || handoff->udp_taken >= handoff->udp_count)
+	{
+		return -1;
+	}
+	fd = handoff->udp_fds[handoff->udp_taken];
+	handoff->udp_fds[handoff->udp_taken++] = -1;
+	if(getsockname(fd, (struct sockaddr *)&addr, &len) != 0 || addr.sin_family != AF_INET ||
+	   addr.sin_addr.s_addr != local->addr || ntohs(addr.sin_port) != local->port)
+	{
+		fprintf(stderr, "UDP socket handed over bound to another address, a new one is opened\n");
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+int handoff_resume(struct handoff *handoff, struct handoff_state *state)
+{
+	struct pollfd pfd;
+	uint64_t start_ns;
+	size_t len = 0;
+	ssize_t ret;
+	char go = HANDOFF_GO;
+
+	memset(state, 0, sizeof(struct handoff_state));
+	if(handoff == NULL || handoff->conn_fd < 0)
+	{
+		return 1;
+	}
+	// Those of the senders the previous process had in excess
+	handoff_close_fds(handoff);
+
+	// The previous process stops reading as soon as it gets the go, the
+	// frames then wait in the queues of the descriptors
+	start_ns = monotonic_ns();
+	pfd.fd = handoff->conn_fd;
+	pfd.events = POLLIN;
+	if(send(handoff->conn_fd, &go, 1, MSG_NOSIGNAL) == 1)
+	{
+		while(len < sizeof(struct handoff_state) && poll(&pfd, 1, HANDOFF_STATE_TIMEOUT_MS) > 0 &&
+		      (ret = read(handoff->conn_fd, (char *)state + len, sizeof(struct handoff_state) - len)) > 0)
+		{
+			len += ret;
+		}
+	}
+	handoff->resume_us = (monotonic_ns() - start_ns) / 1000;
+	close(handoff->conn_fd);
+	handoff->conn_fd = -1;
+
+	if(len < sizeof(struct handoff_state) || state->counter_count > HANDOFF_MAX_UDP ||
+	   state->seq_count > HANDOFF_MAX_SEQS)
+	{
+		fprintf(stderr, "No state handed over by the previous process: the labels and the sequences start over\n");
+		memset(state, 0, sizeof(struct handoff_state));
+		return 1;
+	}
+	return 0;
+}
+
+int handoff_listen(struct handoff *handoff, int tap_fd, const int *udp_fds, unsigned int udp_count)
+{
+	struct sockaddr_un addr;
+	struct stat st;
+	sigset_t sigmask, oldmask;
+	int ret;
+
+	if(udp_count > HANDOFF_MAX_UDP)
+	{
+		return -1;
+	}
+	handoff->own_fds[0] = tap_fd;
+	memcpy(handoff->own_fds + 1, udp_fds, udp_count * sizeof(int));
+	handoff->own_count = 1 + udp_count;
+
+	// A socket left by a previous run is replaced, any other file is kept
+	memset(&addr, 0, sizeof(struct sockaddr_un));
+	addr.sun_family = AF_UNIX;
+	memcpy(addr.sun_path, handoff->path, strlen(handoff->path) + 1);
+	if(lstat(handoff->path, &st) == 0 && S_ISSOCK(st.st_mode))
+	{
+		unlink(handoff->path);
+	}
+	if((handoff->listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0)
+	{
+		fprintf(stderr, "Function socket failed: %s (%d)\n", strerror(errno), errno);
+		return -1;
+	}
+	if(bind(handoff->listen_fd, (struct sockaddr *)&addr, sizeof(struct sockaddr_un)) != 0)
+	{
+		fprintf(stderr, "Handoff socket %s binding failed: %s (%d)\n", handoff->path, strerror(errno), errno);
+		close(handoff->listen_fd);
+		handoff->listen_fd = -1;
+		return -1;
+	}
+	if(lstat(handoff->path, &st) == 0)
+	{
+		handoff->listen_ino = st.st_ino;
+	}
+	// Only the owner of the process may take its descriptors
+	if(chmod(handoff->path, S_IRUSR | S_IWUSR) != 0 || listen(handoff->listen_fd, 1) != 0)
+	{
+		fprintf(stderr, "Handoff socket %s setup failed: %s (%d)\n", handoff->path, strerror(errno), errno);
+		handoff_unlink(handoff);
+		return -1;
+	}
+
+	// The stop signals are left to the processing threads
+	sigemptyset(&sigmask);
+	sigaddset(&sigmask, SIGTERM);
+	sigaddset(&sigmask, SIGINT);
+	pthread_sigmask(SIG_BLOCK, &sigmask, &oldmask);
+	ret = pthread_create(&(handoff->thread), NULL, handoff_serve, handoff);
+	pthread_sigmask(SIG_SETMASK, &oldmask, NULL);
+	if(ret != 0)
+	{
+		fprintf(stderr, "Function pthread_create failed: %s (%d)\n", strerror(ret), ret);
+		handoff_unlink(handoff);
+		return -1;
+	}
+	handoff->serving = 1;
+	return 0;
+}
+
+/**
+ * Give the descriptors to the next process, then wait until it is ready
+ *
+ * Return 0 once the next process is ready, -1 otherwise
+ */
+int handoff_give(struct handoff *handoff, int fd)
+{
+	struct handoff_header header;
+	struct iovec iov = {&header, sizeof(struct handoff_header)};
+	union handoff_control control;
+	struct pollfd pfd = {fd, POLLIN, 0};
+	struct msghdr msg;
+	struct cmsghdr *cmsg;
+	char go;
+	int ret;
+
+	memset(&header, 0, sizeof(struct handoff_header));
+	header.magic = HANDOFF_MAGIC;
+	header.version = HANDOFF_VERSION;
+	header.program = handoff->program;
+	header.udp_count = handoff->own_count - 1;
+
+	memset(&control, 0, sizeof(union handoff_control));
+	memset(&msg, 0, sizeof(struct msghdr));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control.buf;
+	msg.msg_controllen = CMSG_SPACE(handoff->own_count * sizeof(int));
+	cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(handoff->own_count * sizeof(int));
+	memcpy(CMSG_DATA(cmsg), handoff->own_fds, handoff->own_count * sizeof(int));
+	if(sendmsg(fd, &msg, MSG_NOSIGNAL) != sizeof(struct handoff_header))
+	{
+		return -1;
+	}
+
+	// The next process gets ready on the descriptors while this one goes on
+	// forwarding, it closes the connection if it fails
+	while(atomic_load(&(handoff->running)))
+	{
+		if((ret = poll(&pfd, 1, HANDOFF_ACCEPT_TIMEOUT_MS)) == 0)
+		{
+			continue;
+		}
+		return ret > 0 && read(fd, &go, 1) == 1 && go == HANDOFF_GO ? 0 : -1;
+	}
+	return -1;
+}
+
+/**
+ * Wait for the next process until stopped
+ */
+void *handoff_serve(void *arg)
+{
+	struct handoff *handoff = (struct handoff *)arg;
+	struct pollfd pfd = {handoff->listen_fd, POLLIN, 0};
+	int fd;
+
+	while(atomic_load(&(handoff->running)))
+	{
+		if(poll(&pfd, 1, HANDOFF_ACCEPT_TIMEOUT_MS) <= 0)
+		{
+			continue;
+		}
+		if((fd = accept(handoff->listen_fd, NULL, NULL)) < 0)
+		{
+			continue;
+		}
+		if(handoff_give(handoff, fd) != 0)
+		{
+			close(fd);
+			continue;
+		}
+
+		// The socket path is left to the next process, which listens there
+		// once it has the state
+		handoff->conn_fd = fd;
+		handoff_unlink(handoff);
+		atomic_store(&(handoff->requested), 1);
+		kill(getpid(), SIGTERM);
+		break;
+	}
+	return NULL;
+}
+
+int handoff_requested(struct handoff *handoff)
+{
+	return handoff != NULL && atomic_load(&(handoff->requested));
+}
+
+int handoff_send_state(struct handoff *handoff, const struct handoff_state *state)
+{
+	int ret = 0;
+
+	if(handoff->conn_fd < 0)
+	{
+		return -1;
+	}
+	if(send(handoff->conn_fd, state, sizeof(struct handoff_state), MSG_NOSIGNAL) !=
+	   (ssize_t)sizeof(struct handoff_state))
+	{
+		fprintf(stderr, "State handoff failed: %s (%d)\n", strerror(errno), errno);
+		ret = -1;
+	}
+	close(handoff->conn_fd);
+	handoff->conn_fd = -1;
+	return ret;
+}
+
+/**
+ * Stop listening, and remove the socket unless another process replaced it
+ */
+void handoff_unlink(struct handoff *handoff)
+{
+	struct stat st;
+
+	if(handoff->listen_fd < 0)
+	{
+		return;
+	}
+	close(handoff->listen_fd);
+	handoff->listen_fd = -1;
+	if(lstat(handoff->path, &st) == 0 && st.st_ino == handoff->listen_ino)
+	{
+		unlink(handoff->path);
+	}
+}
+
+/**
+ * Close the descriptors received and not taken
+ */
+void handoff_close_fds(struct handoff *handoff)
+{
+	unsigned int i;
+
+	if(handoff->tap_fd >= 0)
+	{
+		close(handoff->tap_fd);
+		handoff->tap_fd = -1;
+	}
+	for(i = handoff->udp_taken; i < handoff->udp_count; i++)
+	{
+		if(handoff->udp_fds[i] >= 0)
+		{
+			close(handoff->udp_fds[i]);
+			handoff->udp_fds[i] = -1;
+		}
+	}
+	handoff->udp_taken = handoff->udp_count;
+}
+
+void handoff_print_stats(struct handoff *handoff)
+{
+	fprintf(stdout, "Handoff statistics\n");
+	if(handoff->resume_us > 0)
+	{
+		fprintf(stdout, "  - %-20s%lu us from the stop asked to the state received\n", "taken over in:",
+		        handoff->resume_us);
+	}
+	fprintf(stdout, "  - %-20s%s\n", "handed over:", handoff_requested(handoff) ? "yes" : "no");
+}
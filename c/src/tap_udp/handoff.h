@@ -0,0 +1,157 @@
+// Copyright 2023, Viveris Technologies
+// Distributed under the terms of the MIT License
+
+#ifndef __HANDOFF_H__
+#define __HANDOFF_H__
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/un.h>
+
+#include "udp.h"
+
+#define HANDOFF_MAGIC 0x47534548 // "GSEH"
+#define HANDOFF_VERSION 1
+#define HANDOFF_MAX_UDP 32 // UDP sockets handed over at most, one per sender
+#define HANDOFF_MAX_SEQS 64 // tunnel sequences handed over at most
+#define HANDOFF_ACCEPT_TIMEOUT_MS 100 // between two checks of the stop
+#define HANDOFF_STATE_TIMEOUT_MS 5000 // for the previous process to stop
+
+// Programs handing their descriptors over, only to the same program
+#define HANDOFF_ENCAP 1
+#define HANDOFF_DECAP 2
+
+/**
+ * Descriptors sent first, in the order of the header: the TAP interface,
+ * then the UDP sockets
+ */
+struct handoff_header
+{
+	uint32_t magic;
+	uint16_t version;
+	uint16_t program; // HANDOFF_ENCAP or HANDOFF_DECAP
+	uint32_t udp_count;
+};
+
+/**
+ * Next tunnel sequence number of a remote
+ */
+struct handoff_seq
+{
+	struct udp_addr addr;
+	uint32_t next;
+};
+
+/**
+ * State sent by the previous process once stopped, so that the new process
+ * goes on with its labels and its tunnel sequence numbers
+ */
+struct handoff_state
+{
+	uint32_t counter_count;
+	uint64_t counters[HANDOFF_MAX_UDP]; // PDUs encapsulated, as the labels, per sender
+	uint32_t seq_count;
+	struct handoff_seq seqs[HANDOFF_MAX_SEQS]; // sent, or expected by the reorder window
+};
+
+/**
+ * Restart without closing the TAP interface nor the UDP sockets
+ *
+ * A process started with a handoff socket connects to it: when a previous
+ * process listens there, it receives its descriptors at once, while the
+ * previous process keeps forwarding. Once ready, the new process asks the
+ * previous one to stop: it sends the frames of its PDUs in flight, then its
+ * state, and exits. In between, the frames wait in the queues of the
+ * descriptors, shared by both processes. The new process then listens on
+ * the socket for the next restart.
+ */
+struct handoff
+{
+	int program;
+	char path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+
+	// Descriptors received from the previous process, -1 once taken
+	int tap_fd;
+	int udp_fds[HANDOFF_MAX_UDP];
+	unsigned int udp_count;
+	unsigned int udp_taken;
+	int conn_fd; // to the other process, -1 without
+	uint64_t resume_us; // from the stop asked to the state received
+
+	// Descriptors given to the next process
+	int listen_fd;
+	ino_t listen_ino; // of the socket file, removed at exit unless replaced
+	int own_fds[1 + HANDOFF_MAX_UDP];
+	unsigned int own_count;
+	pthread_t thread;
+	int serving;
+	atomic_int running;   // cleared to stop
+	atomic_int requested; // by the next process, which took the descriptors
+};
+
+/**
+ * Connect to the handoff socket, and receive the descriptors of the previous
+ * process when one listens there
+ *
+ * Return the handoff on success, NULL otherwise
+ */
+struct handoff *handoff_create(const char *path, int program);
+
+/**
+ * Stop listening, and release the descriptors not taken
+ */
+void handoff_delete(struct handoff *handoff);
+
+/**
+ * Take the TAP interface of the previous process
+ *
+ * Return its descriptor, -1 when none was handed over
+ */
+int handoff_take_tap(struct handoff *handoff);
+
+/**
+ * Take the next UDP socket of the previous process, closed when it is not
+ * bound to local
+ *
+ * Return its descriptor, -1 when none was handed over
+ */
+int handoff_take_udp(struct handoff *handoff, struct udp_addr *local);
+
+/**
+ * Stop the previous process, and get its state once its frames are sent.
+ * The descriptors not taken are closed.
+ *
+ * Return 0 when the state is received, 1 without previous process or state
+ */
+int handoff_resume(struct handoff *handoff, struct handoff_state *state);
+
+/**
+ * Listen on the handoff socket for the next process, to which the
+ * descriptors are given, the TAP one first. The process is stopped as by
+ * SIGTERM once the next process is ready.
+ *
+ * Return 0 on success, -1 otherwise
+ */
+int handoff_listen(struct handoff *handoff, int tap_fd, const int *udp_fds, unsigned int udp_count);
+
+/**
+ * Tell whether the next process took the descriptors, its state is then
+ * expected
+ */
+int handoff_requested(struct handoff *handoff);
+
+/**
+ * Send the state to the next process
+ *
+ * Return 0 on success, -1 otherwise
+ */
+int handoff_send_state(struct handoff *handoff, const struct handoff_state *state);
+
+/**
+ * Print the restarts of the process
+ */
+void handoff_print_stats(struct handoff *handoff);
+
+#endif
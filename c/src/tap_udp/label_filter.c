@@ -0,0 +1,172 @@
+// Copyright 2023, Viveris Technologies
+// Distributed under the terms of the MIT License
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "label_filter.h"
+#include "utils.h"
+
+void label_filter_init(struct label_filter *filter)
+{
+	unsigned int i;
+
+	memset(filter, 0, sizeof(struct label_filter));
+	for(i = 0; i < 4; i++)
+	{
+		filter->types[i].label_type = i;
+	}
+}
+
+int label_filter_add_label(struct label_filter *filter, const char *str)
+{
+	struct label_rule *rule;
+	int count;
+
+	if(filter->rule_count >= LABEL_FILTER_MAX_RULES)
+	{
+		return -1;
+	}
+	rule = &(filter->rules[filter->rule_count]);
+	memset(rule, 0, sizeof(struct label_rule));
+	if((count = parse_hex_bytes(str, rule->label, 6)) == 6)
+	{
+		rule->label_type = GSE_LT_6_BYTES;
+	}
+	else if(count == 3)
+	{
+		rule->label_type = GSE_LT_3_BYTES;
+	}
+	else
+	{
+		return -1;
+	}
+	filter->rule_count++;
+	return 0;
+}
+
+int label_filter_add_types(struct label_filter *filter, const char *str)
+{
+	unsigned long val;
+	const char *pos = str;
+	char *end;
+
+	do
+	{
+		val = strtoul(pos, &end, 10);
+		if(end == pos || val > GSE_LT_REUSE || (*end != ':' && *end != '\0'))
+		{
+			return -1;
+		}
+		filter->type_mask |= 1 << val;
+		pos = end + 1;
+	}
+	while(*end != '\0');
+	return 0;
+}
+
+int label_filter_enabled(struct label_filter *filter)
+{
+	return filter->type_mask != 0 || filter->rule_count != 0;
+}
+
+void label_filter_new_frame(struct label_filter *filter)
+{
+	filter->last = NULL;
+}
+
+struct label_rule *label_filter_match(struct label_filter *filter, struct gse_header *hdr)
+{
+	unsigned int i;
+
+	if((filter->type_mask & (1 << hdr->label_type)) != 0)
+	{
+		return &(filter->types[hdr->label_type]);
+	}
+	for(i = 0; i < filter->rule_count; i++)
+	{
+		if(filter->rules[i].label_type == hdr->label_type &&
+		   memcmp(filter->rules[i].label, hdr->label, hdr->label_len) == 0)
+		{
+			return &(filter->rules[i]);
+		}
+	}
+	return NULL;
+}
+
+int label_filter_accept(struct label_filter *filter, struct gse_header *hdr)
+{
+	struct label_rule *rule;
+
+	if(hdr->start)
+	{
+		// A re-used label is the one of the previous start packet of the frame
+		if(hdr->label_type == GSE_LT_REUSE && (filter->type_mask & (1 << GSE_LT_REUSE)) == 0)
+		{
+			rule = filter->last;
+		}
+		else
+		{
+			rule = label_filter_match(filter, hdr);
+		}
+		filter->last = rule;
+		if(!hdr->end)
+		{
+			filter->frags[hdr->frag_id] = rule;
+		}
+	}
+	else
+	{
+		rule = filter->frags[hdr->frag_id];
+		if(hdr->end)
+		{
+			filter->frags[hdr->frag_id] = NULL;
+		}
+	}
+
+	if(rule == NULL)
+	{
+		filter->dropped_packets++;
+		filter->dropped_bytes += hdr->packet_len;
+		return 0;
+	}
+	rule->packets++;
+	rule->bytes += hdr->packet_len;
+	return 1;
+}
+
+void label_filter_print_rule(struct label_rule *rule, const char *name)
+{
+	fprintf(stdout, "  - %-24s %lu packets, %lu bytes\n", name, rule->packets, rule->bytes);
+}
+
+void label_filter_print_stats(struct label_filter *filter)
+{
+	const char *type_names[4] = {"6-byte labels:", "3-byte labels:", "broadcast:", "re-used labels:"};
+	char name[32];
+	unsigned int i;
+
+	fprintf(stdout, "Label filter statistics\n");
+	for(i = 0; i < 4; i++)
+	{
+		if((filter->type_mask & (1 << i)) != 0)
+		{
+			label_filter_print_rule(&(filter->types[i]), type_names[i]);
+		}
+	}
+	for(i = 0; i < filter->rule_count; i++)
+	{
+		uint8_t *label = filter->rules[i].label;
+		if(filter->rules[i].label_type == GSE_LT_6_BYTES)
+		{
+			sprintf(name, "label %02x:%02x:%02x:%02x:%02x:%02x:", label[0], label[1], label[2], label[3], label[4], label[5]);
+		}
+		else
+		{
+			sprintf(name, "label %02x:%02x:%02x:", label[0], label[1], label[2]);
+		}
+		label_filter_print_rule(&(filter->rules[i]), name);
+	}
+	fprintf(stdout, "  - %-24s %lu packets, %lu bytes\n", "dropped:", filter->dropped_packets, filter->dropped_bytes);
+}
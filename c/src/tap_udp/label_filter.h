@@ -0,0 +1,89 @@
+// Copyright 2023, Viveris Technologies
+// Distributed under the terms of the MIT License
+
+#ifndef __LABEL_FILTER_H__
+#define __LABEL_FILTER_H__
+
+#include <stdint.h>
+
+#include "gse_header.h"
+
+#define LABEL_FILTER_MAX_RULES 64
+
+/**
+ * Accepted label and its counters
+ */
+struct label_rule
+{
+	uint8_t label_type;
+	uint8_t label[6];
+
+	uint64_t packets;
+	uint64_t bytes;
+};
+
+/**
+ * Filter dropping the GSE packets not addressed to the terminal
+ *
+ * The decision taken on a first fragment is kept for the next fragments
+ * of the same fragment ID, which do not carry any label.
+ */
+struct label_filter
+{
+	unsigned int type_mask;   // label types accepted whatever the label
+	unsigned int rule_count;
+	struct label_rule rules[LABEL_FILTER_MAX_RULES];
+	struct label_rule types[4];
+
+	// Rule of the packet in progress per fragment ID, NULL if dropped
+	struct label_rule *frags[GSE_FRAG_COUNT];
+
+	// Rule of the last start packet of the frame, for label re-use
+	struct label_rule *last;
+
+	uint64_t dropped_packets;
+	uint64_t dropped_bytes;
+};
+
+/**
+ * Initialize a filter accepting nothing
+ */
+void label_filter_init(struct label_filter *filter);
+
+/**
+ * Accept a label ("xx:xx:xx:xx:xx:xx" or "xx:xx:xx")
+ *
+ * Return 0 on success, -1 otherwise
+ */
+int label_filter_add_label(struct label_filter *filter, const char *str);
+
+/**
+ * Accept label types ("LT:LT...", LT from 0 to 3)
+ *
+ * Return 0 on success, -1 otherwise
+ */
+int label_filter_add_types(struct label_filter *filter, const char *str);
+
+/**
+ * Check if the filter accepts something
+ */
+int label_filter_enabled(struct label_filter *filter);
+
+/**
+ * Notify the filter a new frame begins
+ */
+void label_filter_new_frame(struct label_filter *filter);
+
+/**
+ * Check if a GSE packet must be processed and update the counters
+ *
+ * Return 1 if accepted, 0 if dropped
+ */
+int label_filter_accept(struct label_filter *filter, struct gse_header *hdr);
+
+/**
+ * Print the filter counters
+ */
+void label_filter_print_stats(struct label_filter *filter);
+
+#endif
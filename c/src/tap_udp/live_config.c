@@ -0,0 +1,493 @@
+// Copyright 2023, Viveris Technologies
+// Distributed under the terms of the MIT License
+
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "live_config.h"
+#include "utils.h"
+
+void *live_config_serve(void *arg);
+void live_config_client(struct live_config *config, int fd);
+int live_config_set(struct live_config *config, struct live_settings *settings, const char *key, const char *value,
+                    char *reply, size_t reply_len);
+int live_config_parse_types(const char *str, unsigned int *types);
+
+struct live_config *live_config_create(const char *path, const struct live_settings *initial,
+                                       const struct live_limits *limits)
+{
+	struct live_config *config;
+	struct live_settings *settings;
+	struct sockaddr_un addr;
+	struct stat st;
+	int ret;
+
+	if(path != NULL && strlen(path) >= sizeof(addr.sun_path))
+	{
+		fprintf(stderr, "Invalid control socket path \"%s\": too long\n", path);
+		return NULL;
+	}
+	if((config = (struct live_config *)calloc(1, sizeof(struct live_config))) == NULL)
+	{
+		return NULL;
+	}
+	if((settings = (struct live_settings *)malloc(sizeof(struct live_settings))) == NULL)
+	{
+		free(config);
+		return NULL;
+	}
+	memcpy(settings, initial, sizeof(struct live_settings));
+	settings->version = 1;
+	atomic_init(&(config->current), settings);
+	atomic_init(&(config->version), 1);
+	memcpy(&(config->limits), limits, sizeof(struct live_limits));
+	atomic_init(&(config->running), 1);
+	config->listen_fd = -1;
+	if(path == NULL)
+	{
+		return config;
+	}
+
+	// A socket left by a previous run is replaced, any other file is kept
+	memset(&addr, 0, sizeof(struct sockaddr_un));
+	addr.sun_family = AF_UNIX;
+	memcpy(addr.sun_path, path, strlen(path) + 1);
+	memcpy(config->path, path, strlen(path) + 1);
+	if(lstat(path, &st) == 0 && S_ISSOCK(st.st_mode))
+	{
+		unlink(path);
+	}
+	if((config->listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0)
+	{
+		fprintf(stderr, "Function socket failed: %s (%d)\n", strerror(errno), errno);
+		live_config_delete(config);
+		return NULL;
+	}
+	if(bind(config->listen_fd, (struct sockaddr *)&addr, sizeof(struct sockaddr_un)) != 0)
+	{
+		fprintf(stderr, "Control socket %s binding failed: %s (%d)\n", path, strerror(errno), errno);
+		close(config->listen_fd);
+		config->listen_fd = -1;
+		live_config_delete(config);
+		return NULL;
+	}
+	if(lstat(path, &st) == 0)
+	{
+		config->listen_ino = st.st_ino;
+	}
+	// The settings of a privileged process are its owner's only
+	if(chmod(path, S_IRUSR | S_IWUSR) != 0 || listen(config->listen_fd, 4) != 0)
+	{
+		fprintf(stderr, "Control socket %s setup failed: %s (%d)\n", path, strerror(errno), errno);
+		live_config_delete(config);
+		return NULL;
+	}
+	if((ret = pthread_create(&(config->thread), NULL, live_config_serve, config)) != 0)
+	{
+		fprintf(stderr, "Function pthread_create failed: %s (%d)\n", strerror(ret), ret);
+		live_config_delete(config);
+		return NULL;
+	}
+	config->serving = 1;
+	return config;
+}
+
+void live_config_delete(struct live_config *config)
+{
+	struct stat st;
+
+	if(config == NULL)
+	{
+		return;
+	}
+	atomic_store(&(config->running), 0);
+	if(config->serving)
+	{
+		pthread_join(config->thread, NULL);
+	}
+	if(config->listen_fd >= 0)
+	{
+		close(config->listen_fd);
+		// Unless the process which took the descriptors over replaced it
+		if(lstat(config->path, &st) == 0 && st.st_ino == config->listen_ino)
+		{
+			unlink(config->path);
+		}
+	}
+	free(config->retired);
+	free(atomic_load(&(config->current)));
+	free(config);
+}
+
+int live_config_register(struct live_config *config)
+{
+	int expected;
+	unsigned int i;
+
+	for(i = 0; i < LIVE_MAX_READERS; i++)
+	{
+		// A free reader has seen no settings: its first poll gets them
+		expected = 0;
+		if(atomic_compare_exchange_strong(&(config->readers[i].active), &expected, 1))
+		{
+			return i;
+		}
+	}
+	fprintf(stderr, "Too many readers of the settings: at most %u\n", LIVE_MAX_READERS);
+	return -1;
+}
+
+void live_config_unregister(struct live_config *config, int reader)
+{
+	atomic_store(&(config->readers[reader].seen), 0);
+	atomic_store(&(config->readers[reader].active), 0);
+}
+
+const struct live_settings *live_config_poll(struct live_config *config, int reader)
+{
+	struct live_reader *r = &(config->readers[reader]);
+	struct live_settings *settings;
+
+	// The fast path of every frame: a load of the version, owned by the
+	// control thread, and of the reader's own one
+	if(atomic_load_explicit(&(config->version), memory_order_acquire) ==
+	   atomic_load_explicit(&(r->seen), memory_order_relaxed))
+	{
+		return NULL;
+	}
+	// Loaded after the registration, in the order of the publication: the
+	// control thread either waits for the reader or published before
+	settings = atomic_load(&(config->current));
+	atomic_store_explicit(&(r->seen), settings->version, memory_order_release);
+	return settings;
+}
+
+int live_config_publish(struct live_config *config, const struct live_settings *settings)
+{
+	struct live_settings *old = atomic_load(&(config->current));
+	struct live_settings *copy;
+	struct timespec pause = {0, LIVE_GRACE_POLL_NS};
+	uint64_t version = old->version + 1;
+	unsigned int i;
+
+	if((copy = (struct live_settings *)malloc(sizeof(struct live_settings))) == NULL)
+	{
+		return -1;
+	}
+	memcpy(copy, settings, sizeof(struct live_settings));
+	copy->version = version;
+	atomic_store(&(config->current), copy);
+	atomic_store(&(config->version), version);
+
+	// Grace period: the previous settings are released once every reader
+	// got the new ones, which they do between two frames
+	for(i = 0; i < LIVE_MAX_READERS; i++)
+	{
+		while(atomic_load(&(config->readers[i].active)) &&
+		      atomic_load_explicit(&(config->readers[i].seen), memory_order_acquire) < version)
+		{
+			if(!atomic_load(&(config->running)))
+			{
+				// Stopping: the readers may be gone without unregistering
+				config->retired = old;
+				return 0;
+			}
+			nanosleep(&pause, NULL);
+		}
+	}
+	free(old);
+	return 0;
+}
+
+/**
+ * Parse label types ("LT:LT...", LT from 0 to 3) into a mask
+ *
+ * Return 0 on success, -1 otherwise
+ */
+int live_config_parse_types(const char *str, unsigned int *types)
+{
+	*types = 0;
+	do
+	{
+		if(str[0] < '0' || str[0] > '3' || (str[1] != ':' && str[1] != '\0'))
+		{
+			return -1;
+		}
+		*types |= 1U << (str[0] - '0');
+		str += str[1] == ':' ? 2 : 1;
+	} while(*str != '\0');
+	return 0;
+}
+
+/**
+ * Change a setting in settings, when the process allows it
+ *
+ * Return 0 on success, -1 otherwise, with the reason written to reply
+ */
+int live_config_set(struct live_config *config, struct live_settings *settings, const char *key, const char *value,
+                    char *reply, size_t reply_len)
+{
+	struct live_limits *limits = &(config->limits);
+	unsigned long val = 0;
+	unsigned int key_flag;
+
+	key_flag = strcmp(key, "timeout") == 0       ? LIVE_KEY_TIMEOUT
+	           : strcmp(key, "buffer") == 0      ? LIVE_KEY_BUFFER
+	           : strcmp(key, "payload") == 0     ? LIVE_KEY_PAYLOAD
+	           : strcmp(key, "rate") == 0        ? LIVE_KEY_RATE
+	           : strcmp(key, "label") == 0       ? LIVE_KEY_LABEL
+	           : strcmp(key, "label-types") == 0 ? LIVE_KEY_LABEL_TYPES
+	                                             : 0;
+	if(key_flag == 0)
+	{
+		snprintf(reply, reply_len, "error: unknown setting \"%s\"\n", key);
+		return -1;
+	}
+	if((limits->keys & key_flag) == 0)
+	{
+		snprintf(reply, reply_len, "error: %s is fixed at startup in this configuration\n", key);
+		return -1;
+	}
+	if(key_flag == LIVE_KEY_LABEL_TYPES)
+	{
+		if(live_config_parse_types(value, &(settings->label_types)) != 0)
+		{
+			snprintf(reply, reply_len, "error: invalid label-types \"%s\" (format: \"LT:LT...\", LT from 0 to 3)\n",
+			         value);
+			return -1;
+		}
+		return 0;
+	}
+	if(parse_unsigned_long(value, &val) != 0)
+	{
+		snprintf(reply, reply_len, "error: invalid %s \"%s\": must be an unsigned long\n", key, value);
+		return -1;
+	}
+	switch(key_flag)
+	{
+		case LIVE_KEY_TIMEOUT:
+			if(val == 0)
+			{
+				snprintf(reply, reply_len, "error: invalid timeout: must be strictly positive\n");
+				return -1;
+			}
+			set_time(val, &(settings->read_timeout));
+			break;
+
+		case LIVE_KEY_BUFFER:
+			if(val == 0 || val > (unsigned long)limits->buffer_max)
+			{
+				snprintf(reply, reply_len, "error: invalid buffer: must be between 1 and %d\n", limits->buffer_max);
+				return -1;
+			}
+			settings->buffer_len = val;
+			break;
+
+		case LIVE_KEY_PAYLOAD:
+			if(val < (unsigned long)limits->payload_min || val > (unsigned long)limits->payload_max)
+			{
+				snprintf(reply, reply_len, "error: invalid payload: must be between %d and %d\n", limits->payload_min,
+				         limits->payload_max);
+				return -1;
+			}
+			settings->payload_len = val;
+			break;
+
+		case LIVE_KEY_RATE:
+			settings->rate_kbps = val;
+			break;
+
+		case LIVE_KEY_LABEL:
+			if(val > 2)
+			{
+				snprintf(reply, reply_len, "error: invalid label: must be 0 (6 bytes), 1 (3 bytes) or 2 (broadcast)\n");
+				return -1;
+			}
+			settings->label_type = val;
+			break;
+	}
+	return 0;
+}
+
+int live_config_command(struct live_config *config, char *line, char *reply, size_t reply_len)
+{
+	struct live_settings *current = atomic_load(&(config->current));
+	struct live_settings settings;
+	unsigned int keys = config->limits.keys;
+	const char *sep = " ";
+	char *save = NULL;
+	char *cmd, *key, *value;
+	size_t len = 0;
+	unsigned int i;
+
+	reply[0] = '\0';
+	if((cmd = strtok_r(line, " \t\r\n", &save)) == NULL)
+	{
+		return 0;
+	}
+	if(strcmp(cmd, "show") == 0)
+	{
+		len += snprintf(reply + len, reply_len - len, "version %lu\n", current->version);
+		if(keys & LIVE_KEY_TIMEOUT)
+		{
+			len += snprintf(reply + len, reply_len - len, "timeout %lu\n", time_to_long(current->read_timeout));
+		}
+		if(keys & LIVE_KEY_BUFFER)
+		{
+			len += snprintf(reply + len, reply_len - len, "buffer %d\n", current->buffer_len);
+		}
+		if(keys & LIVE_KEY_PAYLOAD)
+		{
+			len += snprintf(reply + len, reply_len - len, "payload %d\n", current->payload_len);
+		}
+		if(keys & LIVE_KEY_RATE)
+		{
+			len += snprintf(reply + len, reply_len - len, "rate %lu\n", current->rate_kbps);
+		}
+		if(keys & LIVE_KEY_LABEL)
+		{
+			len += snprintf(reply + len, reply_len - len, "label %u\n", current->label_type);
+		}
+		if(keys & LIVE_KEY_LABEL_TYPES)
+		{
+			len += snprintf(reply + len, reply_len - len, "label-types");
+			for(i = 0; i < 4; i++)
+			{
+				if(current->label_types & (1U << i))
+				{
+					len += snprintf(reply + len, reply_len - len, "%s%u", sep, i);
+					sep = ":";
+				}
+			}
+			len += snprintf(reply + len, reply_len - len, "\n");
+		}
+		snprintf(reply + len, reply_len - len, "ok\n");
+		return 0;
+	}
+	if(strcmp(cmd, "set") != 0)
+	{
+		snprintf(reply, reply_len, "error: unknown command \"%s\" (show or set)\n", cmd);
+		config->rejected++;
+		return -1;
+	}
+
+	// All the settings of the line are published at once, or none of them
+	memcpy(&settings, current, sizeof(struct live_settings));
+	if((key = strtok_r(NULL, " \t\r\n", &save)) == NULL)
+	{
+		snprintf(reply, reply_len, "error: nothing to set\n");
+		config->rejected++;
+		return -1;
+	}
+	while(key != NULL)
+	{
+		if((value = strtok_r(NULL, " \t\r\n", &save)) == NULL)
+		{
+			snprintf(reply, reply_len, "error: missing value of %s\n", key);
+			config->rejected++;
+			return -1;
+		}
+		if(live_config_set(config, &settings, key, value, reply, reply_len) != 0)
+		{
+			config->rejected++;
+			return -1;
+		}
+		key = strtok_r(NULL, " \t\r\n", &save);
+	}
+	if(live_config_publish(config, &settings) != 0)
+	{
+		snprintf(reply, reply_len, "error: settings allocation failed\n");
+		config->rejected++;
+		return -1;
+	}
+	config->changes++;
+	snprintf(reply, reply_len, "ok %lu\n", atomic_load(&(config->version)));
+	return 0;
+}
+
+/**
+ * Serve the clients of the control socket one after the other until stopped
+ */
+void *live_config_serve(void *arg)
+{
+	struct live_config *config = (struct live_config *)arg;
+	struct pollfd pfd = {config->listen_fd, POLLIN, 0};
+	int fd;
+
+	while(atomic_load(&(config->running)))
+	{
+		if(poll(&pfd, 1, LIVE_ACCEPT_TIMEOUT_MS) <= 0)
+		{
+			continue;
+		}
+		if((fd = accept(config->listen_fd, NULL, NULL)) < 0)
+		{
+			continue;
+		}
+		live_config_client(config, fd);
+		close(fd);
+	}
+	return NULL;
+}
+
+/**
+ * Reply to the command lines of a client until it closes the connection
+ */
+void live_config_client(struct live_config *config, int fd)
+{
+	struct pollfd pfd = {fd, POLLIN, 0};
+	char line[LIVE_LINE_LEN];
+	char reply[LIVE_LINE_LEN];
+	size_t len = 0, i;
+	ssize_t ret;
+	char *end;
+
+	while(atomic_load(&(config->running)))
+	{
+		if(poll(&pfd, 1, LIVE_ACCEPT_TIMEOUT_MS) <= 0)
+		{
+			continue;
+		}
+		if((ret = read(fd, line + len, sizeof(line) - 1 - len)) <= 0)
+		{
+			return;
+		}
+		len += ret;
+		line[len] = '\0';
+		while((end = strchr(line, '\n')) != NULL)
+		{
+			*end = '\0';
+			live_config_command(config, line, reply, sizeof(reply));
+			if(reply[0] != '\0' && write(fd, reply, strlen(reply)) < 0)
+			{
+				return;
+			}
+			i = end + 1 - line;
+			memmove(line, end + 1, len - i + 1);
+			len -= i;
+		}
+		if(len == sizeof(line) - 1)
+		{
+			snprintf(reply, sizeof(reply), "error: line longer than %u bytes\n", LIVE_LINE_LEN - 2);
+			if(write(fd, reply, strlen(reply)) < 0)
+			{
+				return;
+			}
+			return;
+		}
+	}
+}
+
+void live_config_print_stats(struct live_config *config)
+{
+	fprintf(stdout, "Control socket statistics\n");
+	fprintf(stdout, "  - %-20s%lu\n", "settings version:", atomic_load(&(config->version)));
+	fprintf(stdout, "  - %-20s%lu\n", "changes:", config->changes);
+	fprintf(stdout, "  - %-20s%lu\n", "rejected commands:", config->rejected);
+}
@@ -0,0 +1,156 @@
+// Copyright 2023, Viveris Technologies
+// Distributed under the terms of the MIT License
+
+#ifndef __LIVE_CONFIG_H__
+#define __LIVE_CONFIG_H__
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <time.h>
+
+#include "ring.h"
+
+#define LIVE_MAX_READERS 64         // threads reading the settings at most
+#define LIVE_GRACE_POLL_NS 100000   // between two checks of the readers
+#define LIVE_ACCEPT_TIMEOUT_MS 100  // between two checks of the stop
+#define LIVE_LINE_LEN 256           // longest command line
+
+// Settings the control socket may change, as the process allows
+#define LIVE_KEY_TIMEOUT (1U << 0)
+#define LIVE_KEY_BUFFER (1U << 1)
+#define LIVE_KEY_PAYLOAD (1U << 2)
+#define LIVE_KEY_RATE (1U << 3)
+#define LIVE_KEY_LABEL (1U << 4)
+#define LIVE_KEY_LABEL_TYPES (1U << 5)
+
+/**
+ * Settings of a running tunnel, never modified once published
+ */
+struct live_settings
+{
+	uint64_t version;
+	struct timespec read_timeout;
+	int buffer_len;           // longest PDU read from the TAP interface
+	int payload_len;          // frame length, variable when 0
+	unsigned long rate_kbps;  // of the emulated channel, unlimited when 0
+	uint8_t label_type;       // of the PDUs sent to the default remote
+	unsigned int label_types; // accepted by the label filter whatever the label
+};
+
+/**
+ * Settings the process allows to change, and their bounds, given by the
+ * buffers allocated at startup
+ */
+struct live_limits
+{
+	unsigned int keys; // LIVE_KEY_*
+	int buffer_max;
+	int payload_min;
+	int payload_max;
+};
+
+/**
+ * Version of the settings a reader thread got last, on a cache line of its
+ * own
+ */
+struct live_reader
+{
+	_Atomic uint64_t seen __attribute__((aligned(RING_CACHE_LINE)));
+	atomic_int active;
+};
+
+/**
+ * Settings published to the threads of the tunnel by the control socket
+ *
+ * The settings are read as RCU data: the readers never lock, they load the
+ * version of the settings between two frames, and only when it changed the
+ * pointer to the new settings, whose fields they copy. The control thread,
+ * the only writer, publishes a new copy of the settings, then waits for
+ * every reader to get it before releasing the previous one: a reader moves
+ * on at its next poll, within a reading timeout when idle.
+ *
+ * The control socket is a Unix stream socket taking a command per line:
+ *   show                       print the settings, "ok" at the end
+ *   set KEY VALUE [KEY VALUE]  change the settings at once, "ok VERSION" or
+ *                              "error: REASON" in reply
+ * with the keys timeout (ms), buffer (bytes), payload (bytes), rate (kbps),
+ * label (0: 6 bytes, 1: 3 bytes, 2: broadcast) and label-types ("LT:LT...").
+ */
+struct live_config
+{
+	_Atomic(struct live_settings *) current;
+	_Atomic uint64_t version;
+	struct live_reader readers[LIVE_MAX_READERS];
+	struct live_limits limits;
+	struct live_settings *retired; // left by a publication cut short
+
+	int listen_fd;
+	char path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+	ino_t listen_ino; // of the socket file, removed at exit unless replaced
+	pthread_t thread;
+	int serving;
+	atomic_int running; // cleared to stop
+
+	uint64_t changes;
+	uint64_t rejected;
+};
+
+/**
+ * Publish the initial settings and start the control thread listening on
+ * the Unix socket path, without control thread when path is NULL
+ *
+ * Return the configuration on success, NULL otherwise
+ */
+struct live_config *live_config_create(const char *path, const struct live_settings *initial,
+                                       const struct live_limits *limits);
+
+/**
+ * Stop the control thread, remove its socket and release the settings. The
+ * readers must be stopped.
+ */
+void live_config_delete(struct live_config *config);
+
+/**
+ * Register a reader thread, whose first poll gets the current settings
+ *
+ * Return the reader index on success, -1 otherwise
+ */
+int live_config_register(struct live_config *config);
+
+/**
+ * Unregister a reader thread, so that the publications no longer wait for it
+ */
+void live_config_unregister(struct live_config *config, int reader);
+
+/**
+ * Get the settings published since the last poll of the reader, the
+ * settings got before must not be read anymore
+ *
+ * Return the new settings, NULL when they did not change
+ */
+const struct live_settings *live_config_poll(struct live_config *config, int reader);
+
+/**
+ * Publish new settings, then wait for every reader to get them and release
+ * the previous ones, as the control thread does
+ *
+ * Return 0 on success, -1 otherwise
+ */
+int live_config_publish(struct live_config *config, const struct live_settings *settings);
+
+/**
+ * Apply a command line to the settings
+ *
+ * Return 0 on success, -1 otherwise, with the reply written to reply
+ */
+int live_config_command(struct live_config *config, char *line, char *reply, size_t reply_len);
+
+/**
+ * Print the changes of the settings
+ */
+void live_config_print_stats(struct live_config *config);
+
+#endif
@@ -0,0 +1,256 @@
+// Copyright 2023, Viveris Technologies
+// Distributed under the terms of the MIT License
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "modcod.h"
+#include "utils.h"
+
+#define MODCOD_LINE_LEN 256
+
+// Sorted by efficiency
+const struct modcod modcods[MODCOD_COUNT] = {
+	{"QPSK-1/4", 16008, 3072, -2.35, 0.490},
+	{"QPSK-1/3", 21408, 5232, -1.24, 0.656},
+	{"QPSK-2/5", 25728, 6312, -0.30, 0.789},
+	{"QPSK-1/2", 32208, 7032, 1.00, 0.988},
+	{"QPSK-3/5", 38688, 9552, 2.23, 1.188},
+	{"QPSK-2/3", 43040, 10632, 3.10, 1.322},
+	{"QPSK-3/4", 48408, 11712, 4.03, 1.487},
+	{"QPSK-4/5", 51648, 12432, 4.68, 1.587},
+	{"QPSK-5/6", 53840, 13152, 5.18, 1.655},
+	{"QPSK-8/9", 57472, 14232, 6.20, 1.766},
+	{"8PSK-3/5", 38688, 9552, 5.50, 1.779},
+	{"QPSK-9/10", 58192, 0, 6.42, 1.789},
+	{"8PSK-2/3", 43040, 10632, 6.62, 1.980},
+	{"8PSK-3/4", 48408, 11712, 7.91, 2.228},
+	{"8PSK-5/6", 53840, 13152, 9.35, 2.479},
+	{"16APSK-2/3", 43040, 10632, 8.97, 2.637},
+	{"8PSK-8/9", 57472, 14232, 10.69, 2.646},
+	{"8PSK-9/10", 58192, 0, 10.98, 2.679},
+	{"16APSK-3/4", 48408, 11712, 10.21, 2.967},
+	{"16APSK-4/5", 51648, 12432, 11.03, 3.166},
+	{"16APSK-5/6", 53840, 13152, 11.61, 3.300},
+	{"16APSK-8/9", 57472, 14232, 12.89, 3.523},
+	{"16APSK-9/10", 58192, 0, 13.13, 3.567},
+	{"32APSK-3/4", 48408, 11712, 12.73, 3.703},
+	{"32APSK-4/5", 51648, 12432, 13.64, 3.952},
+	{"32APSK-5/6", 53840, 13152, 14.28, 4.120},
+	{"32APSK-8/9", 57472, 14232, 15.69, 4.398},
+	{"32APSK-9/10", 58192, 0, 16.05, 4.453},
+};
+
+/**
+ * Find the most efficient MODCOD decoded under an SNR, with a margin
+ *
+ * Return the MODCOD index, the most robust one when none is decoded
+ */
+unsigned int modcod_from_snr(double snr, int short_frame)
+{
+	unsigned int i, best = 0;
+
+	for(i = 0; i < MODCOD_COUNT; i++)
+	{
+		if(modcods[i].esn0 + MODCOD_SNR_MARGIN <= snr && (!short_frame || modcods[i].kbch_short != 0))
+		{
+			best = i;
+		}
+	}
+	return best;
+}
+
+int modcod_parse_line(char *line, struct modcod_step *step)
+{
+	char *time, *name, *frame, *end;
+	char *save;
+	unsigned long val;
+	unsigned int i;
+	double snr;
+
+	time = strtok_r(line, " \t\r\n", &save);
+	name = strtok_r(NULL, " \t\r\n", &save);
+	frame = strtok_r(NULL, " \t\r\n", &save);
+	if(time == NULL || name == NULL || strtok_r(NULL, " \t\r\n", &save) != NULL)
+	{
+		return -1;
+	}
+	if(parse_unsigned_long(time, &val) != 0)
+	{
+		return -1;
+	}
+	step->time_ms = val;
+	if(frame != NULL && strcmp(frame, "short") != 0)
+	{
+		return -1;
+	}
+	step->short_frame = frame != NULL;
+
+	if(strncmp(name, "snr:", 4) == 0)
+	{
+		snr = strtod(name + 4, &end);
+		if(end == name + 4 || *end != '\0')
+		{
+			return -1;
+		}
+		step->modcod = modcod_from_snr(snr, step->short_frame);
+	}
+	else
+	{
+		for(i = 0; i < MODCOD_COUNT && strcasecmp(name, modcods[i].name) != 0; i++)
+		{
+		}
+		if(i == MODCOD_COUNT || (step->short_frame && modcods[i].kbch_short == 0))
+		{
+			return -1;
+		}
+		step->modcod = i;
+	}
+	step->frame_len = (step->short_frame ? modcods[step->modcod].kbch_short : modcods[step->modcod].kbch_normal) / 8;
+	return 0;
+}
+
+struct modcod_sched *modcod_sched_load(const char *path, uint64_t now_ms)
+{
+	struct modcod_sched *sched;
+	struct modcod_step *tmp_steps;
+	size_t capa = 0;
+	unsigned int line_nb = 0;
+	char line[MODCOD_LINE_LEN];
+	char *start;
+	FILE *file;
+
+	if((sched = (struct modcod_sched *)calloc(1, sizeof(struct modcod_sched))) == NULL)
+	{
+		return NULL;
+	}
+	sched->start_ms = now_ms;
+	if((file = fopen(path, "r")) == NULL)
+	{
+		fprintf(stderr, "Function fopen failed (path: %s): %s (%d)\n", path, strerror(errno), errno);
+		free(sched);
+		return NULL;
+	}
+	while(fgets(line, sizeof(line), file) != NULL)
+	{
+		line_nb++;
+		start = line;
+		while(isspace((unsigned char)*start))
+		{
+			start++;
+		}
+		if(*start == '\0' || *start == '#')
+		{
+			continue;
+		}
+		if(sched->count == capa)
+		{
+			capa = capa == 0 ? 64 : 2 * capa;
+			if((tmp_steps = (struct modcod_step *)realloc(sched->steps, capa * sizeof(struct modcod_step))) == NULL)
+			{
+				goto error;
+			}
+			sched->steps = tmp_steps;
+		}
+		if(modcod_parse_line(start, &(sched->steps[sched->count])) != 0 ||
+		   (sched->count > 0 && sched->steps[sched->count].time_ms < sched->steps[sched->count - 1].time_ms))
+		{
+			fprintf(stderr, "Invalid MODCOD step at %s:%u (format: \"TIME_MS MODCOD|snr:DB [short]\", "
+			        "times not going down)\n", path, line_nb);
+			goto error;
+		}
+		sched->count++;
+	}
+	if(sched->count == 0)
+	{
+		fprintf(stderr, "Empty MODCOD schedule %s\n", path);
+		goto error;
+	}
+	fclose(file);
+	return sched;
+
+error:
+	modcod_sched_delete(sched);
+	fclose(file);
+	return NULL;
+}
+
+void modcod_sched_delete(struct modcod_sched *sched)
+{
+	if(sched == NULL)
+	{
+		return;
+	}
+	free(sched->steps);
+	free(sched);
+}
+
+struct modcod_step *modcod_sched_get(struct modcod_sched *sched, uint64_t now_ms)
+{
+	uint64_t elapsed = now_ms - sched->start_ms;
+
+	// The time only goes on, the steps are walked once
+	while(sched->current + 1 < sched->count && sched->steps[sched->current + 1].time_ms <= elapsed)
+	{
+		sched->current++;
+	}
+	return &(sched->steps[sched->current]);
+}
+
+size_t modcod_sched_max_len(struct modcod_sched *sched)
+{
+	size_t i, len = 0;
+
+	for(i = 0; i < sched->count; i++)
+	{
+		if(sched->steps[i].frame_len > len)
+		{
+			len = sched->steps[i].frame_len;
+		}
+	}
+	return len;
+}
+
+void modcod_sched_account(struct modcod_sched *sched, struct modcod_step *step, size_t data_len,
+                          size_t field_len)
+{
+	struct modcod_usage *usage = &(sched->usage[step->modcod][step->short_frame]);
+
+	usage->frames++;
+	usage->data_bytes += data_len;
+	usage->padding_bytes += field_len - data_len;
+}
+
+void modcod_sched_print_stats(struct modcod_sched *sched)
+{
+	struct modcod_usage *usage;
+	uint64_t data = 0, padding = 0;
+	unsigned int i, j;
+
+	fprintf(stdout, "MODCOD statistics\n");
+	for(i = 0; i < MODCOD_COUNT; i++)
+	{
+		for(j = 0; j < 2; j++)
+		{
+			usage = &(sched->usage[i][j]);
+			if(usage->frames == 0)
+			{
+				continue;
+			}
+			fprintf(stdout, "  - %-11s %-6s %lu frames, %lu data bytes, %lu padding bytes, %.1f%% packed\n",
+			        modcods[i].name, j ? "short" : "normal", usage->frames, usage->data_bytes,
+			        usage->padding_bytes,
+			        100.0 * usage->data_bytes / (usage->data_bytes + usage->padding_bytes));
+			data += usage->data_bytes;
+			padding += usage->padding_bytes;
+		}
+	}
+	if(data + padding > 0)
+	{
+		fprintf(stdout, "  - packing efficiency: %.1f%% of the data fields\n", 100.0 * data / (data + padding));
+	}
+}
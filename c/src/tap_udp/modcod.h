@@ -0,0 +1,104 @@
+// Copyright 2023, Viveris Technologies
+// Distributed under the terms of the MIT License
+
+#ifndef __MODCOD_H__
+#define __MODCOD_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define MODCOD_COUNT 28 // DVB-S2 MODCODs, dummy frame excluded
+#define MODCOD_SNR_MARGIN 0.5 // dB kept above the threshold of the MODCOD chosen from an SNR
+
+/**
+ * DVB-S2 MODCOD (EN 302 307-1, tables 5a, 5b and 13)
+ */
+struct modcod
+{
+	const char *name;
+	unsigned int kbch_normal; // BBFrame length in bits, 64800-bit FEC frames
+	unsigned int kbch_short;  // same with 16200-bit FEC frames, 0 if not defined
+	double esn0;              // ideal Es/N0 threshold (dB)
+	double efficiency;        // bits per symbol
+};
+
+extern const struct modcod modcods[MODCOD_COUNT];
+
+/**
+ * Step of a MODCOD schedule
+ */
+struct modcod_step
+{
+	uint64_t time_ms; // from the start of the schedule
+	unsigned int modcod;
+	int short_frame;
+	size_t frame_len; // BBFrame length in bytes
+};
+
+/**
+ * Frames sent under a MODCOD and a FEC frame length
+ */
+struct modcod_usage
+{
+	uint64_t frames;
+	uint64_t data_bytes;    // GSE packets
+	uint64_t padding_bytes;
+};
+
+/**
+ * Schedule of the MODCODs of the frames, as an ACM link would change them
+ *
+ * Each step starts at its time from the creation of the schedule and lasts
+ * until the next one, the last step lasts until the end.
+ */
+struct modcod_sched
+{
+	struct modcod_step *steps;
+	size_t count;
+	size_t current;
+	uint64_t start_ms;
+
+	struct modcod_usage usage[MODCOD_COUNT][2];
+};
+
+/**
+ * Load a MODCOD schedule from a file, starting at time now_ms
+ *
+ * Each line holds "TIME_MS MODCOD [short]" where MODCOD is either a MODCOD
+ * name such as "QPSK-1/2" or "8PSK-3/4", or "snr:DB" for the most efficient
+ * MODCOD under a signal to noise ratio, which replays an SNR trace. The
+ * times do not go down. Empty lines and lines starting with '#' are
+ * ignored.
+ *
+ * Return the schedule on success, NULL otherwise
+ */
+struct modcod_sched *modcod_sched_load(const char *path, uint64_t now_ms);
+
+/**
+ * Delete a MODCOD schedule
+ */
+void modcod_sched_delete(struct modcod_sched *sched);
+
+/**
+ * Get the step of the schedule at time now_ms
+ */
+struct modcod_step *modcod_sched_get(struct modcod_sched *sched, uint64_t now_ms);
+
+/**
+ * Get the longest BBFrame of the schedule in bytes
+ */
+size_t modcod_sched_max_len(struct modcod_sched *sched);
+
+/**
+ * Account a frame of data_len bytes of GSE packets sent under a step, the
+ * rest of the data field being padding
+ */
+void modcod_sched_account(struct modcod_sched *sched, struct modcod_step *step, size_t data_len,
+                          size_t field_len);
+
+/**
+ * Print the frames sent under each MODCOD and their packing efficiency
+ */
+void modcod_sched_print_stats(struct modcod_sched *sched);
+
+#endif
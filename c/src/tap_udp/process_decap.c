@@ -3,7 +3,9 @@
 
 #include <errno.h>
 #include <gse/virtual_fragment.h>
+#include <pthread.h>
 #include <signal.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -14,53 +16,157 @@
 #ifdef DEBUG
 #include <arpa/inet.h>
 #include <net/if.h>
-
-#include "utils.h"
 #endif
 
+#include "alloc_count.h"
+#include "decap_engine.h"
+#include "hugemem.h"
+#include "live_config.h"
 #include "pkt_header.h"
 #include "process_decap.h"
+#include "ring.h"
 #include "tap.h"
+#include "tunnel_log.h"
 #include "udp.h"
+#include "utils.h"
 
 #define CEIL(x, y)                                                             \
   (x / y + (x % y != 0)) // (x, y: Integers) Only works for positive numbers
-#define QOS_COUNT 1      // No QoS management applied into libGSE
 
 int check_decap_params(struct process_decap_params *params);
+struct live_config *create_live_config(struct decap_ctxt *ctxt,
+                                       struct process_decap_params *params);
+int poll_settings(struct decap_ctxt *ctxt);
+int run_decap(struct process_decap_params *params);
+int resume_handoff(struct decap_ctxt *ctxt, struct handoff *handoff);
+int hand_over(struct decap_ctxt *ctxt, struct handoff *handoff);
+
+int write_pdu(struct decap_pdu *pdu, void *arg);
+int process_loop(struct decap_ctxt *ctxt);
+int process_busy_loop(struct decap_ctxt *ctxt);
+int process_shm_loop(struct decap_ctxt *ctxt, int busy_poll);
+
+struct rx_buf {
+  size_t len;
+  unsigned int refs; // the de-encapsulator and the PDUs handed in place
+  unsigned char data[];
+};
 
-struct decap_ctxt {
-  struct timespec timeout;
-  sigset_t sigmask;
-  struct udp_addr remote;
-
-  int udp_fd;
-  int tap_fd;
+struct pdu_desc {
+  struct decap_pdu pdu;
+  struct rx_buf *buf; // holding the PDU handed in place, NULL otherwise
 };
-struct decap_ctxt *create_ctxt(struct process_decap_params *params);
-void delete_ctxt(struct decap_ctxt *ctxt);
 
-int process_send(struct decap_ctxt *ctxt);
+struct decap_pipeline {
+  struct decap_ctxt *ctxt;
 
-int alive;
+  // Receive buffers go round receiver -> de-encapsulator -> receiver
+  struct ring *rx_free;
+  struct ring *rx_full;
+  struct rx_buf **rx_bufs;
+  unsigned char *rx_arena;
+  struct rx_buf *current; // being de-encapsulated
+
+  // PDU descriptors go round de-encapsulator -> writer -> de-encapsulator,
+  // the PDUs are always released by the de-encapsulator as libgse is not
+  // thread-safe
+  struct ring *pdu_full;
+  struct ring *pdu_done;
+  struct pdu_desc *descs;
+  struct pdu_desc **desc_stack;
+  size_t desc_avail;
+
+  size_t count;
+  pthread_t threads[DECAP_STAGE_COUNT];
+
+  uint64_t frames_received;
+  uint64_t bytes_received;
+  uint64_t frames_decapsulated;
+  uint64_t pdus_decapsulated;
+  uint64_t pdus_written;
+  uint64_t bytes_written;
+};
+struct decap_pipeline *create_pipeline(struct decap_ctxt *ctxt,
+                                       struct process_decap_params *params);
+void delete_pipeline(struct decap_pipeline *pipe);
+int process_pipeline(struct decap_ctxt *ctxt,
+                     struct process_decap_params *params);
+void *decap_stage(void *arg);
+void *write_stage(void *arg);
+int enqueue_pdu(struct decap_pdu *pdu, void *arg);
+void reclaim_pdus(struct decap_pipeline *pipe);
+void release_buf(struct decap_pipeline *pipe, struct rx_buf *buf);
+int drain_pipeline(struct decap_pipeline *pipe);
+int drain_pdu(struct decap_pdu *pdu, void *arg);
+void print_pipeline_stats(struct decap_pipeline *pipe);
+
+atomic_int alive;
 void sighandler(__attribute__((unused)) int sig) { alive = 1; }
 
 int process_decap(struct process_decap_params *params) {
   int ret;
 
-  int nfds;
-  fd_set fds, readfds;
+  if (check_decap_params(params) != 0) {
+    return -1;
+  }
+  // The descriptors of a previous process are taken as they are opened
+  params->handoff = NULL;
+  if (params->handoff_path[0] != '\0' &&
+      (params->handoff = handoff_create(params->handoff_path,
+                                        HANDOFF_DECAP)) == NULL) {
+    return -1;
+  }
+  ret = run_decap(params);
+  handoff_delete(params->handoff);
+  params->handoff = NULL;
+  return ret;
+}
+
+int run_decap(struct process_decap_params *params) {
+  int ret;
 
   sigset_t sigmask;
   struct decap_ctxt *ctxt;
 
   // Initialization
-  if (check_decap_params(params) != 0) {
-    return -1;
+  if (params->prealloc) {
+    hugemem_enable();
   }
   if ((ctxt = create_ctxt(params)) == NULL) {
     return -1;
   }
+  if ((ctxt->tap_fd = handoff_take_tap(params->handoff)) < 0 &&
+      (ctxt->tap_fd = open_tap((char *)(params->tap_iface), tap_writeonly)) <
+          0) {
+    fprintf(stderr, "TAP interface %s opening failed\n", params->tap_iface);
+    delete_ctxt(ctxt);
+    return -1;
+  }
+  if (params->busy_poll && ctxt->shm == NULL &&
+      set_udp_busy_poll(ctxt->udp_fd, BUSY_POLL_USECS) != 0) {
+    delete_ctxt(ctxt);
+    return -1;
+  }
+  if (tunnel_log_start() != 0) {
+    delete_ctxt(ctxt);
+    return -1;
+  }
+  if (params->ctrl_path[0] != '\0' &&
+      ((ctxt->live = create_live_config(ctxt, params)) == NULL ||
+       (ctxt->reader = live_config_register(ctxt->live)) < 0)) {
+    fprintf(stderr, "Control socket %s opening failed\n", params->ctrl_path);
+    live_config_delete(ctxt->live);
+    log_ring_stop();
+    delete_ctxt(ctxt);
+    return -1;
+  }
+  if ((params->prealloc && hugemem_lock() != 0) ||
+      resume_handoff(ctxt, params->handoff) != 0) {
+    live_config_delete(ctxt->live);
+    log_ring_stop();
+    delete_ctxt(ctxt);
+    return -1;
+  }
 
   // Add stop signals handler
   signal(SIGTERM, sighandler);
@@ -73,37 +179,135 @@ int process_decap(struct process_decap_params *params) {
 
   // Link contexts
   ctxt->sigmask = sigmask;
-
-  FD_ZERO(&fds);
-  FD_SET(ctxt->udp_fd, &fds);
-  nfds = ctxt->udp_fd + 1;
   alive = 0;
 
-  gse_deencap_t *decap;
-  if ((ret = gse_deencap_init(QOS_COUNT, &decap)) != GSE_STATUS_OK) {
-    fprintf(stderr, "Deencapsulator initialization failed: %s (%d)\n",
-            gse_get_status(ret), ret);
+  if (params->ring_len > 0) {
+    ret = process_pipeline(ctxt, params);
+  } else if (set_thread_cpu(pthread_self(), params->cpus[0]) != 0 ||
+             set_thread_fifo(pthread_self(), params->priority) != 0) {
+    ret = -1;
+  } else if (ctxt->shm != NULL) {
+    ret = process_shm_loop(ctxt, params->busy_poll);
+  } else if (params->busy_poll) {
+    ret = process_busy_loop(ctxt);
+  } else {
+    ret = process_loop(ctxt);
+  }
+  if (ret == 0 && handoff_requested(params->handoff) &&
+      hand_over(ctxt, params->handoff) != 0) {
+    ret = -2;
+  }
+#ifdef DEBUG
+  if (params->prealloc) {
+    fprintf(stdout, "Heap allocations in steady state: %lu\n",
+            alloc_count_since_mark());
+  }
+#endif
+  log_ring_stop();
+
+  if (params->handoff != NULL) {
+    handoff_print_stats(params->handoff);
+  }
+  if (ctxt->live != NULL) {
+    live_config_print_stats(ctxt->live);
+    live_config_delete(ctxt->live);
+  }
+  if (ctxt->shm != NULL) {
+    shm_ring_print_stats(ctxt->shm, "consumer");
+  }
+  if (ctxt->filter != NULL) {
+    label_filter_print_stats(ctxt->filter);
+  }
+  if (ctxt->reasm != NULL) {
+    reasm_print_stats(ctxt->reasm);
+  }
+  if (ctxt->reorder != NULL) {
+    reorder_print_stats(ctxt->reorder);
+  }
+  if (ctxt->fec != NULL) {
+    fec_decoder_print_stats(ctxt->fec);
+  }
+  if (ctxt->perf != NULL) {
+    perf_counters_print_stats(ctxt->perf);
+  }
+  hugemem_print_stats();
+
+  // Clean
+  delete_ctxt(ctxt);
+
+  return ret;
+}
+
+int resume_handoff(struct decap_ctxt *ctxt, struct handoff *handoff) {
+  struct handoff_state state;
+
+  if (handoff == NULL) {
+    return 0;
+  }
+  // The reorder window goes on from the frame the previous process expected
+  if (handoff_resume(handoff, &state) == 0 && ctxt->reorder != NULL &&
+      state.seq_count > 0) {
+    reorder_resume(ctxt->reorder, state.seqs[0].next);
+  }
+  if (handoff_listen(handoff, ctxt->tap_fd, &(ctxt->udp_fd),
+                     ctxt->udp_fd >= 0 ? 1 : 0) != 0) {
+    fprintf(stderr, "Handoff socket %s opening failed\n", handoff->path);
+    return -1;
+  }
+  // The frame under way when the next process stops this one is its last,
+  // its PDUs are not lost
+  ctxt->draining = 1;
+  return 0;
+}
+
+int hand_over(struct decap_ctxt *ctxt, struct handoff *handoff) {
+  struct handoff_state state;
+
+  // The frames held ahead of a gap are written, the PDUs whose fragments
+  // are still to come are lost with this process. Without them, the next
+  // process gets no state and starts its reorder window over.
+  if (drain_frames(ctxt, write_pdu, ctxt) != 0) {
+    fprintf(stderr, "Reorder window draining failed, no state handed over\n");
     return -1;
   }
+  memset(&state, 0, sizeof(struct handoff_state));
+  if (ctxt->reorder != NULL && ctxt->reorder->started) {
+    state.seqs[0].addr = ctxt->remote;
+    state.seqs[0].next = ctxt->reorder->next;
+    state.seq_count = 1;
+  }
+  return handoff_send_state(handoff, &state);
+}
+
+int process_loop(struct decap_ctxt *ctxt) {
+  int ret;
 
-  unsigned char *data_received = (unsigned char *)malloc(
-      sizeof(unsigned char) * (GSE_MAX_PACKET_LENGTH + 2));
+  int nfds;
+  fd_set fds, readfds;
+
+  FD_ZERO(&fds);
+  FD_SET(ctxt->udp_fd, &fds);
+  nfds = ctxt->udp_fd + 1;
+
+  unsigned char *data_received = (unsigned char *)hugemem_alloc(
+      sizeof(unsigned char) * ctxt->recv_len);
   size_t len_received;
-  size_t len_decapsulated;
 
-  uint8_t label_type;
-  uint8_t label[6];
-  uint16_t protocol;
-  uint16_t gse_length;
+  if (data_received == NULL) {
+    return -2;
+  }
+  alloc_count_mark();
 
   while (alive == 0) {
-    gse_vfrag_t *vfrag_pkt = NULL;
-    gse_vfrag_t *pdu = NULL;
-
+    poll_settings(ctxt);
     readfds = fds;
     ret =
         pselect(nfds, &readfds, NULL, NULL, &(ctxt->timeout), &(ctxt->sigmask));
     if (ret == 0) {
+      expire_pdus(ctxt);
+      if (flush_frames(ctxt, write_pdu, ctxt) != 0) {
+        alive = -1;
+      }
       continue;
     } else if (ret < 0) {
       fprintf(stderr, "[Receiver] Function pselect failed: %s (%d)\n",
@@ -114,13 +318,17 @@ int process_decap(struct process_decap_params *params) {
 
     if (FD_ISSET(ctxt->udp_fd, &readfds)) // Incoming packet on UDP socket
     {
-      if ((ret = read_udp(ctxt->udp_fd, &(ctxt->remote), params->payload_len,
-                          data_received, &(len_received))) < 0) {
+      perf_counters_start(ctxt->perf);
+      ret = read_udp(ctxt->udp_fd, &(ctxt->remote), ctxt->recv_len,
+                     data_received, &(len_received));
+      perf_counters_stop(ctxt->perf, DECAP_PERF_UDP_RECV,
+                         ret < 0 ? 0 : len_received);
+      if (ret < 0) {
         fprintf(stderr, "[Receiver] Packet reading from UDP socket failed\n");
         alive = -1;
         break;
       } else if (0 < ret || len_received == 0) {
-        fprintf(stderr, "Invalid destination or empty encapsulation packet\n");
+        log_ring_write(log_invalid_datagram);
         continue;
       }
 
@@ -132,125 +340,578 @@ int process_decap(struct process_decap_params *params) {
       // continue;
       /*End test tap*/
 
-      len_decapsulated = 0;
-      while (len_decapsulated < len_received && alive == 0) {
-        ret = gse_create_vfrag_with_data(
-            &vfrag_pkt, len_received - len_decapsulated, 0, 0,
-            data_received + len_decapsulated, len_received - len_decapsulated);
-        if (ret > GSE_STATUS_OK) {
-          fprintf(stderr,
-                  "Decapsulation fragment initialization failed: %s (%d)\n",
-                  gse_get_status(ret), ret);
-          fprintf(stderr, "Len decap: %ld, Len received: %ld, Buffer: %d\n",
-                  len_decapsulated, len_received, params->buffer_len);
+      // The TAP writes of the PDUs completed are left out of the
+      // de-encapsulation counts
+      perf_counters_start(ctxt->perf);
+      ret = decap_datagram(ctxt, data_received, len_received, write_pdu, ctxt);
+      perf_counters_stop(ctxt->perf, DECAP_PERF_DEENCAP, len_received);
+      if (ret != 0) {
+        alive = -1;
+      }
+    }
+  }
+  hugemem_free(data_received);
+
+  return alive >= 0 ? 0 : -2;
+}
+
+int process_busy_loop(struct decap_ctxt *ctxt) {
+  int ret;
+
+  unsigned char *data_received = (unsigned char *)hugemem_alloc(
+      sizeof(unsigned char) * ctxt->recv_len);
+  size_t len_received;
+
+  uint64_t timeout_ns = time_to_long(ctxt->timeout) * 1000000;
+  uint64_t last_ns = monotonic_ns(), now_ns;
+
+  if (data_received == NULL) {
+    return -2;
+  }
+  alloc_count_mark();
+
+  // Spin on the non-blocking UDP socket, neither sleeping nor waking up
+  while (alive == 0) {
+    if (poll_settings(ctxt)) {
+      timeout_ns = time_to_long(ctxt->timeout) * 1000000;
+    }
+    perf_counters_start(ctxt->perf);
+    ret = read_udp(ctxt->udp_fd, &(ctxt->remote), ctxt->recv_len,
+                   data_received, &(len_received));
+    perf_counters_stop(ctxt->perf, DECAP_PERF_UDP_RECV,
+                       ret < 0 ? 0 : len_received);
+    now_ns = monotonic_ns();
+    if (ret == 1) {
+      // Idle link: same handling as the reading timeout of the loop
+      if (now_ns - last_ns >= timeout_ns) {
+        expire_pdus(ctxt);
+        if (flush_frames(ctxt, write_pdu, ctxt) != 0) {
           alive = -1;
         }
+        last_ns = now_ns;
+      }
+      continue;
+    } else if (ret < 0) {
+      fprintf(stderr, "[Receiver] Packet reading from UDP socket failed\n");
+      alive = -1;
+      break;
+    } else if (0 < ret || len_received == 0) {
+      log_ring_write(log_invalid_datagram);
+      continue;
+    }
+    last_ns = now_ns;
 
-        ret = gse_deencap_packet(vfrag_pkt, decap, &label_type, label,
-                                 &protocol, &pdu, &gse_length);
+    perf_counters_start(ctxt->perf);
+    ret = decap_datagram(ctxt, data_received, len_received, write_pdu, ctxt);
+    perf_counters_stop(ctxt->perf, DECAP_PERF_DEENCAP, len_received);
+    if (ret != 0) {
+      alive = -1;
+    }
+  }
+  hugemem_free(data_received);
 
-        if ((ret > GSE_STATUS_OK) && (ret != GSE_STATUS_PDU_RECEIVED) &&
-            (ret != GSE_STATUS_DATA_OVERWRITTEN) &&
-            (ret != GSE_STATUS_PADDING_DETECTED)) {
-          fprintf(stderr, "Error when de-encapsulating GSE packet: %s (%d)\n",
-                  gse_get_status(ret), ret);
-        }
+  return alive >= 0 ? 0 : -2;
+}
 
-        if (ret == GSE_STATUS_INVALID_DATA_LENGTH) {
-          fprintf(stderr, "Error, invalid data length: %s (%d)\n",
-                  gse_get_status(ret), ret);
-        }
+int process_shm_loop(struct decap_ctxt *ctxt, int busy_poll) {
+  int ret;
 
-        len_decapsulated += gse_length;
-        if (ret == GSE_STATUS_DATA_OVERWRITTEN) {
-          fprintf(stderr, "PDU incomplete dropped\n");
-        }
+  unsigned char *data_received;
+  size_t len_received;
 
-        if (ret == GSE_STATUS_PADDING_DETECTED) {
-          // No more packets, only padding left
-          break;
-        }
+  uint64_t timeout_ns = time_to_long(ctxt->timeout) * 1000000;
+  uint64_t last_ns = monotonic_ns(), now_ns;
 
-        if (ret == GSE_STATUS_PDU_RECEIVED) {
-#ifdef NOPE
-          for (int i = 0;
-               i < CEIL(gse_get_vfrag_length(pdu), params->buffer_len); ++i) {
-            if ((ret = write_tap(ctxt->tap_fd,
-                                 gse_get_vfrag_start(pdu) +
-                                     (i * params->buffer_len),
-                                 params->buffer_len)) != 0) {
-              fprintf(stderr, "[Sender] TAP sending failed (%d)\n", ret);
-            }
-          }
-#endif
-          write_tap(ctxt->tap_fd, gse_get_vfrag_start(pdu),
-                    gse_get_vfrag_length(pdu));
-          if ((ret = gse_free_vfrag(&pdu)) != GSE_STATUS_OK) {
-            fprintf(stdout, "Decapsulation PDU cleaning failed: %s (%d)\n",
-                    gse_get_status(ret), ret);
-          }
+  alloc_count_mark();
+
+  // The frames are de-encapsulated in place, the ring slot is given back
+  // once done: nothing is copied from the producer to the reassembly
+  while (alive == 0) {
+    if (poll_settings(ctxt)) {
+      timeout_ns = time_to_long(ctxt->timeout) * 1000000;
+    }
+    perf_counters_start(ctxt->perf);
+    ret = shm_ring_peek(ctxt->shm, &data_received, &len_received);
+    perf_counters_stop(ctxt->perf, DECAP_PERF_UDP_RECV,
+                       ret != 0 ? 0 : len_received);
+    now_ns = monotonic_ns();
+    if (ret != 0) {
+      // Empty ring: same handling as the reading timeout of the UDP loops
+      if (now_ns - last_ns >= timeout_ns) {
+        expire_pdus(ctxt);
+        if (flush_frames(ctxt, write_pdu, ctxt) != 0) {
+          alive = -1;
         }
+        last_ns = now_ns;
+      }
+      if (!busy_poll) {
+        // A stop signal interrupts the wait, or is seen after the timeout
+        shm_ring_wait(ctxt->shm, &(ctxt->timeout));
       }
+      continue;
     }
+    last_ns = now_ns;
+
+    if (len_received == 0) {
+      log_ring_write(log_invalid_datagram);
+    } else {
+      perf_counters_start(ctxt->perf);
+      ret = decap_datagram(ctxt, data_received, len_received, write_pdu, ctxt);
+      perf_counters_stop(ctxt->perf, DECAP_PERF_DEENCAP, len_received);
+      if (ret != 0) {
+        alive = -1;
+      }
+    }
+    shm_ring_release(ctxt->shm);
   }
 
-  // Clean
-  delete_ctxt(ctxt);
-
   return alive >= 0 ? 0 : -2;
 }
 
-int check_decap_params(struct process_decap_params *params) {
-  if (params->read_timeout.tv_sec == 0 && params->read_timeout.tv_nsec == 0) {
-    fprintf(stderr,
-            "Invalid reading timeout value: must be strictly positive\n");
+int write_pdu(struct decap_pdu *pdu, void *arg) {
+  struct decap_ctxt *ctxt = (struct decap_ctxt *)arg;
+
+  perf_counters_start(ctxt->perf);
+  write_tap(ctxt->tap_fd, pdu->data, pdu->len);
+  perf_counters_stop(ctxt->perf, DECAP_PERF_TAP_WRITE, pdu->len);
+  release_pdu(ctxt, pdu);
+  return 0;
+}
+
+int process_pipeline(struct decap_ctxt *ctxt,
+                     struct process_decap_params *params) {
+  int ret;
+  int stage;
+  int expected;
+  void *(*stages[DECAP_STAGE_COUNT])(void *) = {NULL, decap_stage,
+                                               write_stage};
+
+  int nfds;
+  fd_set fds, readfds;
+  sigset_t oldmask;
+
+  struct decap_pipeline *pipe;
+  struct rx_buf *buf = NULL;
+  size_t len_received;
+
+  if ((pipe = create_pipeline(ctxt, params)) == NULL) {
     return -1;
   }
 
-  if (params->payload_len < MIN_ENCAP_FRAME_SIZE) {
-    fprintf(stderr,
-            "Invalid encapsulation frames dimension: at least one frame of %u "
-            "bytes must be sent\n",
-            MIN_ENCAP_FRAME_SIZE);
+  // The receiver runs in the calling thread, which alone handles the stop
+  // signals: the other stages inherit a mask blocking them
+  pipe->threads[0] = pthread_self();
+  if (set_thread_cpu(pipe->threads[0], params->cpus[0]) != 0 ||
+      set_thread_fifo(pipe->threads[0], params->priority) != 0) {
+    delete_pipeline(pipe);
     return -1;
   }
+  pthread_sigmask(SIG_BLOCK, &(ctxt->sigmask), &oldmask);
+  for (stage = 1; stage < DECAP_STAGE_COUNT; stage++) {
+    if ((ret = pthread_create(&(pipe->threads[stage]), NULL, stages[stage],
+                              pipe)) != 0) {
+      fprintf(stderr, "Function pthread_create failed: %s (%d)\n",
+              strerror(ret), ret);
+      alive = -1;
+      break;
+    }
+    if (set_thread_cpu(pipe->threads[stage], params->cpus[stage]) != 0 ||
+        set_thread_fifo(pipe->threads[stage], params->priority) != 0) {
+      alive = -1;
+      stage++;
+      break;
+    }
+  }
+  pthread_sigmask(SIG_SETMASK, &oldmask, NULL);
+  alloc_count_mark();
+
+  FD_ZERO(&fds);
+  FD_SET(ctxt->udp_fd, &fds);
+  nfds = ctxt->udp_fd + 1;
+
+  while (alive == 0) {
+    // Get an empty buffer back from the de-encapsulator
+    if (buf == NULL && ring_pop(pipe->rx_free, (void **)&buf) != 0) {
+      if (ring_wait_data(pipe->rx_free, &(ctxt->timeout)) < 0) {
+        alive = -1;
+      }
+      continue;
+    }
+
+    readfds = fds;
+    ret =
+        pselect(nfds, &readfds, NULL, NULL, &(ctxt->timeout), &(ctxt->sigmask));
+    if (ret == 0) {
+      continue;
+    } else if (ret < 0) {
+      fprintf(stderr, "[Receiver] Function pselect failed: %s (%d)\n",
+              strerror(errno), errno);
+      alive = -1;
+      break;
+    }
+
+    if ((ret = read_udp(ctxt->udp_fd, &(ctxt->remote), ctxt->recv_len,
+                        buf->data, &(len_received))) < 0) {
+      fprintf(stderr, "[Receiver] Packet reading from UDP socket failed\n");
+      alive = -1;
+      break;
+    } else if (0 < ret || len_received == 0) {
+      log_ring_write(log_invalid_datagram);
+      continue;
+    }
+    buf->len = len_received;
+    pipe->frames_received++;
+    pipe->bytes_received += len_received;
+
+    // Cannot fail: the ring is able to hold every buffer
+    ring_push(pipe->rx_full, buf);
+    buf = NULL;
+  }
+
+  // Stop the other stages, unless one already failed, without waiting for
+  // the timeout of the idle ones
+  expected = 0;
+  atomic_compare_exchange_strong(&alive, &expected, 1);
+  ring_wake(pipe->rx_full);
+  ring_wake(pipe->pdu_full);
+  while (--stage > 0) {
+    pthread_join(pipe->threads[stage], NULL);
+  }
+  if (alive > 0 && handoff_requested(params->handoff) &&
+      drain_pipeline(pipe) != 0) {
+    fprintf(stderr, "Pipeline draining failed, no state handed over\n");
+    alive = -1;
+  }
+  print_pipeline_stats(pipe);
+  delete_pipeline(pipe);
+
+  return alive >= 0 ? 0 : -2;
+}
+
+void *decap_stage(void *arg) {
+  struct decap_pipeline *pipe = (struct decap_pipeline *)arg;
+  struct decap_ctxt *ctxt = pipe->ctxt;
+  struct rx_buf *buf;
+  int ret;
+
+  while (alive == 0) {
+    poll_settings(ctxt);
+    if (ring_pop(pipe->rx_full, (void **)&buf) != 0) {
+      if ((ret = ring_wait_data(pipe->rx_full, &(ctxt->timeout))) < 0) {
+        alive = -1;
+      } else if (ret > 0) {
+        reclaim_pdus(pipe);
+        expire_pdus(ctxt);
+        if (flush_frames(ctxt, enqueue_pdu, pipe) != 0) {
+          alive = -1;
+        }
+      }
+      continue;
+    }
+    pipe->frames_decapsulated++;
+    reclaim_pdus(pipe);
+    buf->refs = 1;
+    pipe->current = buf;
+    if (decap_datagram(ctxt, buf->data, buf->len, enqueue_pdu, pipe) != 0) {
+      alive = -1;
+    }
+    pipe->current = NULL;
+    release_buf(pipe, buf);
+  }
+  return NULL;
+}
+
+void *write_stage(void *arg) {
+  struct decap_pipeline *pipe = (struct decap_pipeline *)arg;
+  struct decap_ctxt *ctxt = pipe->ctxt;
+  struct pdu_desc *desc;
+
+  while (alive == 0) {
+    if (ring_pop(pipe->pdu_full, (void **)&desc) != 0) {
+      if (ring_wait_data(pipe->pdu_full, &(ctxt->timeout)) < 0) {
+        alive = -1;
+      }
+      continue;
+    }
+    write_tap(ctxt->tap_fd, desc->pdu.data, desc->pdu.len);
+    pipe->pdus_written++;
+    pipe->bytes_written += desc->pdu.len;
+    ring_push(pipe->pdu_done, desc);
+  }
+  return NULL;
+}
+
+int enqueue_pdu(struct decap_pdu *pdu, void *arg) {
+  struct decap_pipeline *pipe = (struct decap_pipeline *)arg;
+  struct pdu_desc *desc;
+
+  // Wait for the writer to give a descriptor back
+  while (pipe->desc_avail == 0) {
+    reclaim_pdus(pipe);
+    if (pipe->desc_avail != 0) {
+      break;
+    }
+    if (alive != 0) {
+      release_pdu(pipe->ctxt, pdu);
+      return 0;
+    }
+    if (ring_wait_data(pipe->pdu_done, &(pipe->ctxt->timeout)) < 0) {
+      release_pdu(pipe->ctxt, pdu);
+      return -1;
+    }
+  }
+  desc = pipe->desc_stack[--pipe->desc_avail];
+  desc->pdu = *pdu;
+  desc->buf = NULL;
+  if (pdu->vfrag == NULL && pdu->slot == NULL) {
+    // Handed in place: the frame stays until the writer is done with it
+    desc->buf = pipe->current;
+    desc->buf->refs++;
+  }
+  pipe->pdus_decapsulated++;
+  ring_push(pipe->pdu_full, desc);
   return 0;
 }
 
-struct decap_ctxt *create_ctxt(struct process_decap_params *params) {
-  struct decap_ctxt *ctxt;
+void reclaim_pdus(struct decap_pipeline *pipe) {
+  struct pdu_desc *desc;
 
-  if ((ctxt = (struct decap_ctxt *)malloc(sizeof(struct decap_ctxt))) == NULL) {
-    return NULL;
+  while (ring_pop(pipe->pdu_done, (void **)&desc) == 0) {
+    release_pdu(pipe->ctxt, &(desc->pdu));
+    if (desc->buf != NULL) {
+      release_buf(pipe, desc->buf);
+      desc->buf = NULL;
+    }
+    pipe->desc_stack[pipe->desc_avail++] = desc;
+  }
+}
+
+void release_buf(struct decap_pipeline *pipe, struct rx_buf *buf) {
+  if (--buf->refs == 0) {
+    ring_push(pipe->rx_free, buf);
+  }
+}
+
+int drain_pipeline(struct decap_pipeline *pipe) {
+  struct decap_ctxt *ctxt = pipe->ctxt;
+  struct pdu_desc *desc;
+  struct rx_buf *buf;
+  int draining = ctxt->draining;
+  int ret = 0;
+
+  // The stages are stopped: the PDUs, then the frames left in the rings are
+  // handled by the calling thread, in their order of arrival, and to their
+  // end despite the stop
+  while (ring_pop(pipe->pdu_full, (void **)&desc) == 0) {
+    write_tap(ctxt->tap_fd, desc->pdu.data, desc->pdu.len);
+    pipe->pdus_written++;
+    pipe->bytes_written += desc->pdu.len;
+    ring_push(pipe->pdu_done, desc);
   }
-  memset(ctxt, 0, sizeof(struct decap_ctxt));
-  memcpy(&(ctxt->timeout), &(params->read_timeout), sizeof(struct timespec));
-  memcpy(&(ctxt->remote), &(params->remote), sizeof(struct udp_addr));
+  reclaim_pdus(pipe);
+  ctxt->draining = 1;
+  while (ret == 0 && ring_pop(pipe->rx_full, (void **)&buf) == 0) {
+    pipe->frames_decapsulated++;
+    ret = decap_datagram(ctxt, buf->data, buf->len, drain_pdu, pipe);
+    ring_push(pipe->rx_free, buf);
+  }
+  ctxt->draining = draining;
+  return ret;
+}
+
+int drain_pdu(struct decap_pdu *pdu, void *arg) {
+  struct decap_pipeline *pipe = (struct decap_pipeline *)arg;
+
+  pipe->pdus_decapsulated++;
+  pipe->pdus_written++;
+  pipe->bytes_written += pdu->len;
+  return write_pdu(pdu, pipe->ctxt);
+}
+
+void print_pipeline_stats(struct decap_pipeline *pipe) {
+  // A stage waiting for room downstream points to the next stage as the
+  // bottleneck, a stage waiting for input is faster than the previous one
+  fprintf(stdout, "Pipeline statistics\n");
+  fprintf(stdout,
+          "  - UDP receiver:       %lu frames, %lu bytes, stalled %lu times "
+          "(no free buffer)\n",
+          pipe->frames_received, pipe->bytes_received,
+          pipe->rx_free->empty_count);
+  fprintf(stdout,
+          "  - de-encapsulator:    %lu frames, %lu PDUs, starved %lu times, "
+          "stalled %lu times (no free descriptor)\n",
+          pipe->frames_decapsulated, pipe->pdus_decapsulated,
+          pipe->rx_full->empty_count, pipe->pdu_done->empty_count);
+  fprintf(stdout,
+          "  - TAP writer:         %lu PDUs, %lu bytes, starved %lu times\n",
+          pipe->pdus_written, pipe->bytes_written,
+          pipe->pdu_full->empty_count);
+  fprintf(stdout,
+          "  - rings high-water:   frames %zu/%zu, PDUs %zu/%zu\n",
+          pipe->rx_full->max_used, pipe->count, pipe->pdu_full->max_used,
+          pipe->count);
+}
 
-  if ((ctxt->udp_fd = open_udp(&(params->local))) < 0) {
-    char l_addr[256];
-    ipv4_address_str(params->local.addr, l_addr);
-    fprintf(stderr, "UDP tunnel opening on %s:%u failed\n", l_addr,
-            params->local.port);
-    free(ctxt);
+struct decap_pipeline *create_pipeline(struct decap_ctxt *ctxt,
+                                       struct process_decap_params *params) {
+  struct decap_pipeline *pipe;
+  size_t buf_len, i;
+
+  if ((pipe = (struct decap_pipeline *)malloc(sizeof(struct decap_pipeline))) ==
+      NULL) {
     return NULL;
   }
-  if ((ctxt->tap_fd = open_tap((char *)(params->tap_iface), tap_writeonly)) <
-      0) {
-    fprintf(stderr, "TAP interface %s opening failed\n", params->tap_iface);
-    close(ctxt->udp_fd);
-    free(ctxt);
+  memset(pipe, 0, sizeof(struct decap_pipeline));
+  pipe->ctxt = ctxt;
+  // The frames held by the reorder window are overwritten as it slides, the
+  // receive buffers are only given back once their PDUs are written
+  ctxt->in_place = ctxt->reorder == NULL;
+  pipe->count = params->ring_len;
+
+  if ((pipe->rx_free = ring_create(pipe->count)) == NULL ||
+      (pipe->rx_full = ring_create(pipe->count)) == NULL ||
+      (pipe->pdu_full = ring_create(pipe->count)) == NULL ||
+      (pipe->pdu_done = ring_create(pipe->count)) == NULL) {
+    fprintf(stderr, "Pipeline rings creation failed\n");
+    delete_pipeline(pipe);
     return NULL;
   }
+  // All the receive buffers in a single arena, cache line aligned
+  buf_len = (sizeof(struct rx_buf) + ctxt->recv_len + RING_CACHE_LINE - 1) &
+            ~((size_t)RING_CACHE_LINE - 1);
+  if ((pipe->rx_arena = (unsigned char *)hugemem_alloc(pipe->count *
+                                                       buf_len)) == NULL ||
+      (pipe->rx_bufs = (struct rx_buf **)calloc(
+           pipe->count, sizeof(struct rx_buf *))) == NULL ||
+      (pipe->descs = (struct pdu_desc *)calloc(
+           pipe->count, sizeof(struct pdu_desc))) == NULL ||
+      (pipe->desc_stack = (struct pdu_desc **)calloc(
+           pipe->count, sizeof(struct pdu_desc *))) == NULL) {
+    delete_pipeline(pipe);
+    return NULL;
+  }
+  for (i = 0; i < pipe->count; i++) {
+    pipe->rx_bufs[i] = (struct rx_buf *)(pipe->rx_arena + i * buf_len);
+    ring_push(pipe->rx_free, pipe->rx_bufs[i]);
+    pipe->desc_stack[i] = &(pipe->descs[i]);
+  }
+  pipe->desc_avail = pipe->count;
+  pipe->rx_free->max_used = 0;
 
-  return ctxt;
+  return pipe;
 }
 
-void delete_ctxt(struct decap_ctxt *ctxt) {
-  if (ctxt == NULL) {
+void delete_pipeline(struct decap_pipeline *pipe) {
+  size_t i;
+
+  if (pipe == NULL) {
     return;
   }
-  close(ctxt->udp_fd);
-  close(ctxt->tap_fd);
-  free(ctxt);
+  for (i = 0; pipe->descs != NULL && i < pipe->count; i++) {
+    release_pdu(pipe->ctxt, &(pipe->descs[i].pdu));
+  }
+  free(pipe->desc_stack);
+  free(pipe->descs);
+  free(pipe->rx_bufs);
+  hugemem_free(pipe->rx_arena);
+  ring_delete(pipe->pdu_done);
+  ring_delete(pipe->pdu_full);
+  ring_delete(pipe->rx_full);
+  ring_delete(pipe->rx_free);
+  free(pipe);
+}
+
+struct live_config *create_live_config(struct decap_ctxt *ctxt,
+                                       struct process_decap_params *params) {
+  struct live_settings settings;
+  struct live_limits limits;
+
+  memset(&settings, 0, sizeof(struct live_settings));
+  memcpy(&(settings.read_timeout), &(params->read_timeout),
+         sizeof(struct timespec));
+  settings.buffer_len = params->buffer_len;
+  settings.payload_len = params->payload_len;
+  settings.label_types = ctxt->filter != NULL ? ctxt->filter->type_mask : 0;
+
+  // The receive buffers and the reassembly arena are sized at startup, the
+  // stages of a pipeline share the reading timeout
+  memset(&limits, 0, sizeof(struct live_limits));
+  if (params->ring_len == 0) {
+    limits.keys |= LIVE_KEY_TIMEOUT;
+  }
+  if (ctxt->filter != NULL) {
+    limits.keys |= LIVE_KEY_LABEL_TYPES;
+  }
+  return live_config_create(params->ctrl_path, &settings, &limits);
+}
+
+int poll_settings(struct decap_ctxt *ctxt) {
+  const struct live_settings *settings;
+
+  if (ctxt->live == NULL ||
+      (settings = live_config_poll(ctxt->live, ctxt->reader)) == NULL) {
+    return 0;
+  }
+  if ((ctxt->live->limits.keys & LIVE_KEY_TIMEOUT) != 0) {
+    memcpy(&(ctxt->timeout), &(settings->read_timeout),
+           sizeof(struct timespec));
+  }
+  if (ctxt->filter != NULL) {
+    ctxt->filter->type_mask = settings->label_types;
+  }
+  return 1;
+}
+
+int check_decap_params(struct process_decap_params *params) {
+  if (params->read_timeout.tv_sec == 0 && params->read_timeout.tv_nsec == 0) {
+    fprintf(stderr,
+            "Invalid reading timeout value: must be strictly positive\n");
+    return -1;
+  }
+
+  if (params->fec_history > 0 && params->reorder_window == 0) {
+    fprintf(stderr, "Invalid FEC history: the reorder window must be set\n");
+    return -1;
+  }
+  if (params->reorder_window > 0 && params->reorder_timeout.tv_sec == 0 &&
+      params->reorder_timeout.tv_nsec == 0) {
+    fprintf(stderr,
+            "Invalid reordering timeout value: must be strictly positive\n");
+    return -1;
+  }
+  if (params->reasm_slots > 0 && params->reasm_timeout.tv_sec == 0 &&
+      params->reasm_timeout.tv_nsec == 0) {
+    fprintf(stderr,
+            "Invalid reassembly timeout value: must be strictly positive\n");
+    return -1;
+  }
+  if (params->perf_period > 0 && params->ring_len > 0) {
+    fprintf(stderr, "Invalid hardware counters period: the counters follow "
+                    "a single thread, the pipeline must be disabled\n");
+    return -1;
+  }
+  if (params->busy_poll && params->ring_len > 0) {
+    fprintf(stderr, "Invalid busy polling: the UDP socket is spun by the "
+                    "single thread loop, the pipeline must be disabled\n");
+    return -1;
+  }
+  if (params->shm_name[0] != '\0' && params->ring_len > 0) {
+    fprintf(stderr, "Invalid shared memory ring: the frames are read in "
+                    "place by the single thread loop, the pipeline must be "
+                    "disabled\n");
+    return -1;
+  }
+  if (params->prealloc && params->reasm_slots == 0) {
+    fprintf(stderr, "Invalid memory preallocation: libGSE allocates the PDUs "
+                    "on demand, the native reassembly must be enabled\n");
+    return -1;
+  }
+  if (params->payload_len < MIN_ENCAP_FRAME_SIZE) {
+    fprintf(stderr,
+            "Invalid encapsulation frames dimension: at least one frame of %u "
+            "bytes must be sent\n",
+            MIN_ENCAP_FRAME_SIZE);
+    return -1;
+  }
+  return 0;
 }
@@ -14,21 +14,61 @@
 #include <gse/refrag.h>
 #include <gse/header_fields.h>
 
+#include "handoff.h"
+#include "label_filter.h"
 #include "udp.h"
 
 #define MIN_ENCAP_FRAME_SIZE (2 * GSE_MAX_HEADER_LENGTH + 2 * GSE_MAX_TRAILER_LENGTH)
 
+// Stages of the decapsulation pipeline: UDP receiver, de-encapsulator, TAP writer
+#define DECAP_STAGE_COUNT 3
+
+#define BUSY_POLL_USECS 50 // device queue polling of each read, when busy polling
+
 struct process_decap_params
 {
 	char tap_iface[256];
 
 	struct udp_addr local;
 	struct udp_addr remote;
+	char shm_name[256]; // frames read from this shared memory ring instead of UDP when set
 
 	struct timespec read_timeout;
 
 	int buffer_len;
 	int payload_len;
+	int bb_header; // frames starting with a DVB-S2 baseband header, as sent by satencap -H
+
+	int ring_len;
+	int cpus[DECAP_STAGE_COUNT];
+	int priority; // SCHED_FIFO priority of the threads, 0 to leave it
+	int busy_poll; // spin on the non-blocking UDP socket instead of sleeping
+
+	// Tunnel header with a sequence number, and reordering, when not 0
+	int reorder_window;
+	struct timespec reorder_timeout;
+	int fec_history; // frames kept to rebuild the lost ones, 0 without FEC
+
+	// Native reassembly into a bounded arena, libGSE is used when 0
+	int reasm_slots;
+	struct timespec reasm_timeout;
+
+	struct label_filter filter;
+
+	// One datagram in perf_period measured, none when 0, without pipeline only
+	unsigned int perf_period;
+
+	// Packet and reassembly memory mapped up front and locked, with no heap
+	// allocation in steady state, native reassembly only
+	int prealloc;
+
+	// Unix socket changing the settings while running, none when empty
+	char ctrl_path[256];
+
+	// Unix socket handing the descriptors over to the next process, none when
+	// empty, and the descriptors of the previous process, set by the process
+	char handoff_path[256];
+	struct handoff *handoff;
 };
 
 /**
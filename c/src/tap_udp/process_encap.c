@@ -4,6 +4,7 @@
 #include <errno.h>
 #include <pthread.h>
 #include <signal.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -16,19 +17,20 @@
 #ifdef DEBUG
 #include <arpa/inet.h>
 #include <net/if.h>
-
-#include "utils.h"
 #endif
 
-#include "pkt_header.h"
+#include "encap_engine.h"
+#include "flow_batch.h"
+#include "flow_hash.h"
+#include "fq_codel.h"
+#include "gse_header.h"
+#include "live_config.h"
 #include "process_encap.h"
+#include "ring.h"
 #include "tap.h"
+#include "tunnel_log.h"
 #include "udp.h"
-
-#define MAX_FRAG 100 // Maximum fragmentation count for a packet
-#define QOS_COUNT 1  // No QoS management applied into libGSE
-#define QOS 0
-#define PROTOCOL 9029
+#include "utils.h"
 
 int check_encap_params(struct process_encap_params *params);
 
@@ -37,33 +39,105 @@ struct encap_recv_ctxt {
   sigset_t sigmask;
 
   int tap_fd;
+  size_t buffer_len;
+  gse_vfrag_t *spare; // PDU buffer left by a read without data
+  struct fq_codel *fq; // NULL when the PDUs are not queued per flow
+
+  // Settings changed by the control socket, NULL without it
+  struct live_config *live;
+  int reader;
 
   struct queue *pkt_q;
 };
 struct encap_recv_ctxt *create_recv_ctxt(struct process_encap_params *params);
 void delete_recv_ctxt(struct encap_recv_ctxt *ctxt);
-
-struct encap_send_ctxt {
-  struct timespec timeout;
-  sigset_t sigmask;
-  struct udp_addr remote;
-
-  int evt_fd;
-  int udp_fd;
-
-  struct queue *encap_q;
-
-  int code;
+struct live_config *create_live_config(struct process_encap_params *params);
+int poll_settings(struct encap_recv_ctxt *ctxt,
+                  struct encap_send_ctxt *send_ctxt);
+
+int read_pdu(struct encap_recv_ctxt *ctxt, struct encap_send_ctxt *send_ctxt,
+             uint64_t *counter);
+
+int run_encap(struct process_encap_params *params);
+int resume_handoff(struct encap_recv_ctxt *ctxt,
+                   struct encap_send_ctxt **senders, uint64_t **counters,
+                   unsigned int count, struct handoff *handoff);
+void hand_over(struct encap_send_ctxt **senders, uint64_t **counters,
+               unsigned int count, struct handoff *handoff);
+
+// Time to serialize the frames ahead on the emulated link at most: the
+// queue builds up in the flow queues instead, as with a NIC under BQL
+#define FQ_LINK_BACKLOG_NS 2000000
+
+void process_fq(struct encap_recv_ctxt *ctxt,
+                struct encap_send_ctxt *send_ctxt,
+                struct process_encap_params *params, uint64_t *counter);
+int fq_read_pdu(struct encap_recv_ctxt *ctxt, struct encap_send_ctxt *send_ctxt,
+                uint64_t now_ns);
+void fq_drop_pdu(void *data, void *arg);
+
+#define ENCAP_WORKER_RING 1024 // PDUs queued to a worker at most
+
+struct encap_worker {
+  struct encap_send_ctxt *ctxt;
+  struct ring *pdus; // from the reader, which gives their ownership
+  pthread_t thread;
+  int busy_poll;
+  struct live_config *live; // NULL without control socket
+  int reader;
+
+  uint64_t counter; // PDUs encapsulated, as the labels
+  uint64_t steered; // PDUs pushed by the reader
 };
-struct encap_send_ctxt *create_send_ctxt(struct process_encap_params *params);
-void delete_send_ctxt(struct encap_send_ctxt *ctxt);
 
-int alive;
+/**
+ * Reader steering the PDUs of each flow to a single worker, so that the PDUs
+ * of a flow keep their order while the flows spread over the workers
+ */
+struct encap_steering {
+  struct flow_hasher hasher;
+  struct flow_steer steer;
+  struct flow_batch batch; // of the PDUs read at once
+  struct encap_worker *workers;
+  unsigned int count;
+  unsigned int started;
+
+  uint64_t levels[flow_l4 + 1]; // PDUs per layer hashed
+};
+struct encap_steering *create_steering(struct process_encap_params *params);
+void delete_steering(struct encap_steering *steering);
+int process_steering(struct encap_recv_ctxt *ctxt,
+                     struct process_encap_params *params);
+int steer_pdus(struct encap_recv_ctxt *ctxt, struct encap_steering *steering);
+void *encap_worker(void *arg);
+void print_steering_stats(struct encap_steering *steering);
+
+// Stop flag: set by the signal handler and by the threads stopping the
+// others, hence atomic, and lock-free so that the handler may write it
+atomic_int alive;
 void sighandler(__attribute__((unused)) int sig) { alive = 1; }
 
 int process_encap(struct process_encap_params *params) {
   int ret;
 
+  if (check_encap_params(params) != 0) {
+    return -1;
+  }
+  // The descriptors of a previous process are taken as they are opened
+  if (params->handoff_path[0] != '\0' &&
+      (params->handoff = handoff_create(params->handoff_path,
+                                        HANDOFF_ENCAP)) == NULL) {
+    return -1;
+  }
+  ret = run_encap(params);
+  handoff_delete(params->handoff);
+  params->handoff = NULL;
+  return ret;
+}
+
+int run_encap(struct process_encap_params *params) {
+  int ret;
+
   void *res;
   (void)res;
   int nfds;
@@ -74,16 +148,31 @@ int process_encap(struct process_encap_params *params) {
   struct encap_send_ctxt *send_ctxt;
 
   // Initialization
-  if (check_encap_params(params) != 0) {
-    return -1;
-  }
   if ((ctxt = create_recv_ctxt(params)) == NULL) {
     return -1;
   }
+  if (params->workers > 0) {
+    ret = process_steering(ctxt, params);
+    delete_recv_ctxt(ctxt);
+    return ret;
+  }
   if ((send_ctxt = create_send_ctxt(params)) == NULL) {
     delete_recv_ctxt(ctxt);
     return -1;
   }
+  if (tunnel_log_start() != 0) {
+    delete_send_ctxt(send_ctxt);
+    delete_recv_ctxt(ctxt);
+    return -1;
+  }
+
+  if (set_thread_cpu(pthread_self(), params->cpu) != 0 ||
+      set_thread_fifo(pthread_self(), params->priority) != 0 ||
+      (params->busy_poll && set_nonblocking(ctxt->tap_fd) != 0)) {
+    delete_send_ctxt(send_ctxt);
+    delete_recv_ctxt(ctxt);
+    return -1;
+  }
 
   // Add stop signals handler
   signal(SIGTERM, sighandler);
@@ -102,140 +191,629 @@ int process_encap(struct process_encap_params *params) {
   FD_SET(ctxt->tap_fd, &fds);
   nfds = ctxt->tap_fd + 1;
   alive = 0;
+  if (ctxt->live != NULL &&
+      (ctxt->reader = live_config_register(ctxt->live)) < 0) {
+    alive = -1;
+  }
+
+  struct timespec no_wait = {0, 0};
+  struct timespec chan_tick = {0, CHANNEL_TICK_NS};
+  struct encap_sched *sched = send_ctxt->sched;
+  struct channel *chan = send_ctxt->chan;
+  gse_vfrag_t *vfrag_pdu;
+
+  uint64_t counter = 0;
+  uint64_t *counters[1] = {&counter};
+  if (alive == 0 &&
+      resume_handoff(ctxt, &send_ctxt, counters, 1, params->handoff) != 0) {
+    alive = -1;
+  }
+
+  uint64_t timeout_ns = time_to_long(ctxt->timeout) * 1000000;
+  uint64_t last_ns = monotonic_ns(), now_ns;
+  if (ctxt->fq != NULL) {
+    // Runs until stopped
+    process_fq(ctxt, send_ctxt, params, &counter);
+  }
+  while (alive == 0) {
+    if (poll_settings(ctxt, send_ctxt)) {
+      timeout_ns = time_to_long(ctxt->timeout) * 1000000;
+    }
+
+    // Read a new PDU as long as a fragment ID is free, without waiting if
+    // some PDUs are still in flight
+    if (sched->busy_count < sched->count && params->busy_poll) {
+      // Spin on the non-blocking TAP, neither sleeping nor waking up
+      now_ns = monotonic_ns();
+      if (read_pdu(ctxt, send_ctxt, &counter) == 0) {
+        last_ns = now_ns;
+      } else if (sched->busy_count == 0 && now_ns - last_ns >= timeout_ns) {
+        flush_parity(send_ctxt);
+        last_ns = now_ns;
+      }
+    } else if (sched->busy_count < sched->count) {
+      // Wake up for the frames coming out of the emulated channel
+      readfds = fds;
+      ret = pselect(nfds, &readfds, NULL, NULL,
+                    sched->busy_count > 0 ? &no_wait
+                    : chan != NULL && channel_in_flight(chan) > 0
+                        ? &chan_tick
+                        : &(ctxt->timeout),
+                    &(ctxt->sigmask));
+      if (ret < 0) {
+        fprintf(stderr, "[Receiver] Function pselect failed: %s (%d)\n",
+                strerror(errno), errno);
+        alive = -1;
+        break;
+      }
+      now_ns = monotonic_ns();
+      // Idle link: do not hold back the parity of the last frames
+      if (ret == 0 && sched->busy_count == 0 &&
+          now_ns - last_ns >= timeout_ns) {
+        flush_parity(send_ctxt);
+        last_ns = now_ns;
+      }
+      if (ret > 0 && FD_ISSET(ctxt->tap_fd, &readfds) &&
+          read_pdu(ctxt, send_ctxt, &counter) == 0) {
+        last_ns = now_ns;
+      }
+    }
+
+    // Send one frame, mixing the packets of the PDUs in flight
+    if (sched->busy_count > 0) {
+      send_frame(send_ctxt);
+    }
+    if (chan != NULL) {
+      emulate_channel(send_ctxt);
+    }
+  }
+
+  // The next process took the descriptors: the PDUs read go out before the
+  // state is handed over, the frames numbered on the emulated channel after
+  if (alive > 0 && handoff_requested(params->handoff)) {
+    while (ctxt->fq != NULL &&
+           (vfrag_pdu = fq_dequeue(ctxt->fq, monotonic_ns())) != NULL) {
+      encap_new_pdu(send_ctxt, vfrag_pdu, &counter);
+    }
+    hand_over(&send_ctxt, counters, 1, params->handoff);
+    while (chan != NULL && channel_in_flight(chan) > 0) {
+      nanosleep(&chan_tick, NULL);
+      emulate_channel(send_ctxt);
+    }
+  }
+  log_ring_stop();
+
+  if (params->handoff != NULL) {
+    handoff_print_stats(params->handoff);
+  }
+  if (ctxt->live != NULL) {
+    live_config_print_stats(ctxt->live);
+  }
+  if (ctxt->fq != NULL) {
+    fq_print_stats(ctxt->fq);
+  }
+  if (send_ctxt->modcod != NULL) {
+    modcod_sched_print_stats(send_ctxt->modcod);
+  }
+  if (send_ctxt->chan != NULL) {
+    channel_print_stats(send_ctxt->chan);
+  }
+  if (send_ctxt->shm != NULL) {
+    shm_ring_print_stats(send_ctxt->shm, "producer");
+  }
+  if (send_ctxt->fwd != NULL) {
+    fwd_table_print_stats(send_ctxt->fwd);
+  }
+  if (send_ctxt->perf != NULL) {
+    perf_counters_print_stats(send_ctxt->perf);
+  }
+
+  // Clean
+  delete_send_ctxt(send_ctxt);
+  delete_recv_ctxt(ctxt);
+
+  return alive >= 0 ? 0 : -2;
+}
+
+int read_pdu(struct encap_recv_ctxt *ctxt, struct encap_send_ctxt *send_ctxt,
+             uint64_t *counter) {
+  return encap_tap_pdu(send_ctxt, ctxt->tap_fd, ctxt->buffer_len,
+                       &(ctxt->spare), counter);
+}
+
+int resume_handoff(struct encap_recv_ctxt *ctxt,
+                   struct encap_send_ctxt **senders, uint64_t **counters,
+                   unsigned int count, struct handoff *handoff) {
+  struct handoff_state state;
+  struct tunnel_seq *seq;
+  int udp_fds[MAX_ENCAP_WORKERS];
+  unsigned int i, udp_count = 0;
 
-  size_t len_received;
-  gse_encap_t *encap;
-  if ((ret = gse_encap_init(QOS_COUNT, MAX_FRAG, &encap)) != GSE_STATUS_OK) {
-    fprintf(stderr, "Encapsulator initialization failed: %s (%d)\n",
-            gse_get_status(ret), ret);
+  if (handoff == NULL) {
+    return 0;
+  }
+
+  // The labels go on per sender, the tunnel sequences of the single sender
+  // which has a tunnel header per remote, as far as it has room
+  if (handoff_resume(handoff, &state) == 0) {
+    for (i = 0; i < count && i < state.counter_count; i++) {
+      *(counters[i]) = state.counters[i];
+    }
+    for (i = 0; senders[0]->seqs != NULL && i < state.seq_count; i++) {
+      if (senders[0]->seq_count < senders[0]->seq_capa) {
+        seq = get_tunnel_seq(senders[0], &(state.seqs[i].addr));
+        seq->next = state.seqs[i].next;
+      }
+    }
+  }
+  for (i = 0; i < count; i++) {
+    if (senders[i]->udp_fd >= 0) {
+      udp_fds[udp_count++] = senders[i]->udp_fd;
+    }
+  }
+  if (handoff_listen(handoff, ctxt->tap_fd, udp_fds, udp_count) != 0) {
+    fprintf(stderr, "Handoff socket %s opening failed\n", handoff->path);
     return -1;
   }
+  return 0;
+}
 
-  gse_vfrag_t *vfrag_pdu = NULL;
-  gse_vfrag_t *vfrag_pkt = NULL;
-  uint8_t label[6];
+void hand_over(struct encap_send_ctxt **senders, uint64_t **counters,
+               unsigned int count, struct handoff *handoff) {
+  struct handoff_state state;
+  unsigned int i;
+  size_t j;
+
+  memset(&state, 0, sizeof(struct handoff_state));
+  for (i = 0; i < count; i++) {
+    // The fragments of the PDUs in flight would be lost with this process
+    while (senders[i]->sched->busy_count > 0) {
+      send_frame(senders[i]);
+    }
+    flush_parity(senders[i]);
+    state.counters[i] = *(counters[i]);
+  }
+  state.counter_count = count;
+  for (j = 0; j < senders[0]->seq_count && j < HANDOFF_MAX_SEQS; j++) {
+    state.seqs[j].addr = senders[0]->seqs[j].addr;
+    state.seqs[j].next = senders[0]->seqs[j].next;
+  }
+  state.seq_count = j;
+  handoff_send_state(handoff, &state);
+}
+
+int poll_settings(struct encap_recv_ctxt *ctxt,
+                  struct encap_send_ctxt *send_ctxt) {
+  const struct live_settings *settings;
 
-  uint64_t counter = 0, err;
+  if (ctxt->live == NULL ||
+      (settings = live_config_poll(ctxt->live, ctxt->reader)) == NULL) {
+    return 0;
+  }
+  memcpy(&(ctxt->timeout), &(settings->read_timeout), sizeof(struct timespec));
+  ctxt->buffer_len = settings->buffer_len;
+  if (send_ctxt != NULL) {
+    encap_apply_settings(send_ctxt, settings);
+  }
+  return 1;
+}
+
+void process_fq(struct encap_recv_ctxt *ctxt,
+                struct encap_send_ctxt *send_ctxt,
+                struct process_encap_params *params, uint64_t *counter) {
+  int ret, link_ready;
+
+  int nfds;
+  fd_set fds, readfds;
+
+  struct timespec no_wait = {0, 0};
+  struct timespec chan_tick = {0, CHANNEL_TICK_NS};
+  struct timespec *timeout;
+  struct encap_sched *sched = send_ctxt->sched;
+  struct channel *chan = send_ctxt->chan;
+  gse_vfrag_t *vfrag_pdu;
+
+  FD_ZERO(&fds);
+  FD_SET(ctxt->tap_fd, &fds);
+  nfds = ctxt->tap_fd + 1;
+
+  uint64_t timeout_ns = time_to_long(ctxt->timeout) * 1000000;
+  uint64_t last_ns = monotonic_ns(), now_ns;
   while (alive == 0) {
-    readfds = fds;
-    ret =
-        pselect(nfds, &readfds, NULL, NULL, &(ctxt->timeout), &(ctxt->sigmask));
+    if (poll_settings(ctxt, send_ctxt)) {
+      timeout_ns = time_to_long(ctxt->timeout) * 1000000;
+    }
+    now_ns = monotonic_ns();
+
+    // Fill the free fragment IDs from the flow queues, and send one frame,
+    // as long as the link is not backlogged
+    link_ready = chan == NULL ||
+                 channel_backlog_ns(chan, now_ns) < FQ_LINK_BACKLOG_NS;
+    if (link_ready) {
+      while (sched->busy_count < sched->count &&
+             (vfrag_pdu = fq_dequeue(ctxt->fq, now_ns)) != NULL) {
+        encap_new_pdu(send_ctxt, vfrag_pdu, counter);
+      }
+      if (sched->busy_count > 0) {
+        send_frame(send_ctxt);
+      }
+    }
+    if (chan != NULL) {
+      emulate_channel(send_ctxt);
+    }
+
+    // Read the TAP interface whatever the fragment IDs in flight, the PDUs
+    // wait in the flow queues
+    if (params->busy_poll) {
+      ret = fq_read_pdu(ctxt, send_ctxt, now_ns);
+    } else {
+      if (link_ready && (sched->busy_count > 0 || fq_queued(ctxt->fq) > 0)) {
+        timeout = &no_wait;
+      } else if (chan != NULL &&
+                 (!link_ready || channel_in_flight(chan) > 0)) {
+        timeout = &chan_tick;
+      } else {
+        timeout = &(ctxt->timeout);
+      }
+      readfds = fds;
+      ret = pselect(nfds, &readfds, NULL, NULL, timeout, &(ctxt->sigmask));
+      if (ret < 0) {
+        fprintf(stderr, "[Receiver] Function pselect failed: %s (%d)\n",
+                strerror(errno), errno);
+        alive = -1;
+        break;
+      }
+      ret = ret > 0 && FD_ISSET(ctxt->tap_fd, &readfds)
+                ? fq_read_pdu(ctxt, send_ctxt, monotonic_ns())
+                : 1;
+    }
+
+    // Idle link: do not hold back the parity of the last frames
     if (ret == 0) {
+      last_ns = now_ns;
+    } else if (sched->busy_count == 0 && fq_queued(ctxt->fq) == 0 &&
+               now_ns - last_ns >= timeout_ns) {
+      flush_parity(send_ctxt);
+      last_ns = now_ns;
+    }
+  }
+}
+
+int fq_read_pdu(struct encap_recv_ctxt *ctxt, struct encap_send_ctxt *send_ctxt,
+                uint64_t now_ns) {
+  int ret;
+  size_t len;
+  gse_vfrag_t *vfrag_pdu, *copy;
+
+  if ((ret = read_tap_pdu(ctxt->tap_fd, ctxt->buffer_len, &(ctxt->spare),
+                          &vfrag_pdu, send_ctxt->perf)) != 0) {
+    return ret;
+  }
+
+  // Queued in a buffer of its own length, so that the memory limit of the
+  // flow queues holds, the read buffer is kept for the next read
+  len = gse_get_vfrag_length(vfrag_pdu);
+  if (len == 0) {
+    ctxt->spare = vfrag_pdu;
+    return 1;
+  }
+  if ((ret = gse_create_vfrag_with_data(
+           &copy, len, GSE_MAX_HEADER_LENGTH, GSE_MAX_TRAILER_LENGTH,
+           gse_get_vfrag_start(vfrag_pdu), len)) > GSE_STATUS_OK) {
+    log_ring_write(log_vfrag_create_failed, LOG_STR(gse_get_status(ret)));
+    gse_free_vfrag(&vfrag_pdu);
+    return -1;
+  }
+  ctxt->spare = vfrag_pdu;
+  fq_enqueue(ctxt->fq, copy, gse_get_vfrag_start(copy), len, now_ns);
+  return 0;
+}
+
+void fq_drop_pdu(void *data, __attribute__((unused)) void *arg) {
+  gse_vfrag_t *vfrag_pdu = (gse_vfrag_t *)data;
+
+  gse_free_vfrag(&vfrag_pdu);
+}
+
+int process_steering(struct encap_recv_ctxt *ctxt,
+                     struct process_encap_params *params) {
+  int ret;
+  unsigned int i;
+  int expected;
+
+  int nfds;
+  fd_set fds, readfds;
+  sigset_t sigmask, oldmask;
+
+  struct encap_steering *steering;
+  struct encap_worker *worker;
+  struct encap_send_ctxt *senders[MAX_ENCAP_WORKERS];
+  uint64_t *counters[MAX_ENCAP_WORKERS];
+  gse_vfrag_t *vfrag_pdu;
+
+  if ((steering = create_steering(params)) == NULL) {
+    return -1;
+  }
+  for (i = 0; i < steering->count; i++) {
+    senders[i] = steering->workers[i].ctxt;
+    counters[i] = &(steering->workers[i].counter);
+  }
+  if (tunnel_log_start() != 0) {
+    delete_steering(steering);
+    return -1;
+  }
+
+  // Add stop signals handler
+  signal(SIGTERM, sighandler);
+  signal(SIGINT, sighandler);
+
+  // Mask signals during interface polling
+  sigemptyset(&sigmask);
+  sigaddset(&sigmask, SIGTERM);
+  sigaddset(&sigmask, SIGINT);
+  ctxt->sigmask = sigmask;
+  alive = 0;
+
+  // The reader runs in the calling thread, which alone handles the stop
+  // signals: the workers inherit a mask blocking them. It reads the TAP
+  // until it is empty, or a batch is full, once it is readable.
+  if (set_thread_cpu(pthread_self(), params->cpu) != 0 ||
+      set_thread_fifo(pthread_self(), params->priority) != 0 ||
+      set_nonblocking(ctxt->tap_fd) != 0) {
+    alive = -1;
+  }
+  if (ctxt->live != NULL &&
+      (ctxt->reader = live_config_register(ctxt->live)) < 0) {
+    alive = -1;
+  }
+  if (alive == 0 && resume_handoff(ctxt, senders, counters, steering->count,
+                                   params->handoff) != 0) {
+    alive = -1;
+  }
+  pthread_sigmask(SIG_BLOCK, &sigmask, &oldmask);
+  for (i = 0; alive == 0 && i < steering->count; i++) {
+    worker = &(steering->workers[i]);
+    if ((worker->live = ctxt->live) != NULL &&
+        (worker->reader = live_config_register(ctxt->live)) < 0) {
+      alive = -1;
+      break;
+    }
+    if ((ret = pthread_create(&(worker->thread), NULL, encap_worker,
+                              worker)) != 0) {
+      fprintf(stderr, "Function pthread_create failed: %s (%d)\n",
+              strerror(ret), ret);
+      alive = -1;
+      break;
+    }
+    steering->started++;
+    if (set_thread_cpu(worker->thread, params->worker_cpus[i]) != 0 ||
+        set_thread_fifo(worker->thread, params->priority) != 0) {
+      alive = -1;
+    }
+  }
+  pthread_sigmask(SIG_SETMASK, &oldmask, NULL);
+
+  FD_ZERO(&fds);
+  FD_SET(ctxt->tap_fd, &fds);
+  nfds = ctxt->tap_fd + 1;
+
+  while (alive == 0) {
+    poll_settings(ctxt, NULL);
+    if (params->busy_poll) {
+      steer_pdus(ctxt, steering);
       continue;
-    } else if (ret < 0) {
+    }
+    readfds = fds;
+    ret = pselect(nfds, &readfds, NULL, NULL, &(ctxt->timeout),
+                  &(ctxt->sigmask));
+    if (ret < 0) {
       fprintf(stderr, "[Receiver] Function pselect failed: %s (%d)\n",
               strerror(errno), errno);
       alive = -1;
       break;
     }
-
-    ret = gse_create_vfrag(&vfrag_pdu, GSE_MAX_PDU_LENGTH,
-                           GSE_MAX_HEADER_LENGTH, GSE_MAX_TRAILER_LENGTH);
-    if (ret > GSE_STATUS_OK) {
-      fprintf(stderr, "Error when creating PDU virtual fragment (%s)\n",
-              gse_get_status(ret));
+    if (ret > 0 && FD_ISSET(ctxt->tap_fd, &readfds)) {
+      steer_pdus(ctxt, steering);
     }
+  }
 
-    if (FD_ISSET(ctxt->tap_fd, &readfds)) // Incoming packet on TAP interface
-    {
-      // if((ret = read_tap(ctxt->tap_fd, params->buffer_len, data_received,
-      // &(len_received)))
-      // != 0)
-      if ((ret = read_tap(ctxt->tap_fd, params->buffer_len,
-                          gse_get_vfrag_start(vfrag_pdu), &(len_received))) <
-          0) {
-#ifdef DEBUG
-        fprintf(stdout,
-                "Receive nothing from TAP interface\n");
-#endif
-        gse_free_vfrag(&vfrag_pdu);
-        continue; // Ignore
-      } else if (len_received == 0) {
-#ifdef DEBUG
-        fprintf(stdout,
-                "Receive empty packet from TAP interface\n");
-#endif
-        gse_free_vfrag(&vfrag_pdu);
-        continue; // Ignore
-      }
-#ifdef DEBUG
-      fprintf(stdout, "[Receiver] Receive packet (%zu bytes)\n", len_received);
-#endif
+  // Stop the workers, unless one already failed, without waiting for the
+  // timeout of the idle ones
+  expected = 0;
+  atomic_compare_exchange_strong(&alive, &expected, 1);
+  for (i = 0; i < steering->started; i++) {
+    ring_wake(steering->workers[i].pdus);
+    pthread_join(steering->workers[i].thread, NULL);
+  }
 
-      /* Test TAP */
-      // if((ret = write_udp(send_ctxt->udp_fd, &(send_ctxt->remote),
-      // data_received, len_received)) != 0) { 	fprintf(stderr, "[Send] Write
-      // udp failed\n");
-      // }
-      // continue;
-      /* End test TAP*/
-
-      ret = gse_set_vfrag_length(vfrag_pdu, len_received);
-      if (ret > GSE_STATUS_OK) {
-        fprintf(stderr, "error when setting fragment length: %s\n",
-                gse_get_status(ret));
-      }
-      if (gse_get_vfrag_length(vfrag_pdu) == 0) {
-        fprintf(stderr, "VFRAG empty\n");
-      }
-      ++counter;
-      label[5] = (counter >> 56) & 0xff;
-      label[4] = (counter >> 48) & 0xff;
-      label[3] = (counter >> 32) & 0xff;
-      label[2] = (counter >> 16) & 0xff;
-      label[1] = (counter >> 8) & 0xff;
-      label[0] = counter & 0xff;
-      ret = gse_encap_receive_pdu(vfrag_pdu, encap, label, 0, PROTOCOL, QOS);
-      if (ret > GSE_STATUS_OK) {
-        fprintf(stderr,
-                "VFRAG failed encap: %.2x, vfrag_length: %ld, max_length: %d, "
-                "len_received: "
-                "%ld\n",
-                ret, gse_get_vfrag_length(vfrag_pdu), GSE_MAX_PDU_LENGTH,
-                len_received);
-        gse_free_vfrag(&vfrag_pdu);
-        continue;
+  // The next process took the descriptors: the PDUs steered go out before
+  // the state is handed over
+  if (alive > 0 && handoff_requested(params->handoff)) {
+    for (i = 0; i < steering->count; i++) {
+      worker = &(steering->workers[i]);
+      while (ring_pop(worker->pdus, (void **)&vfrag_pdu) == 0) {
+        encap_new_pdu(worker->ctxt, vfrag_pdu, &(worker->counter));
       }
-      err = 0;
-      long desired_len = params->payload_len;
-      while (ret != GSE_STATUS_FIFO_EMPTY && err < 5) {
-        if (params->payload_len == 0) {
-          desired_len = gse_get_vfrag_length(vfrag_pdu) + GSE_MAX_HEADER_LENGTH;
-        }
-        ret = gse_encap_get_packet(&vfrag_pkt, encap, desired_len, QOS);
-        if ((ret > GSE_STATUS_OK) && (ret != GSE_STATUS_FIFO_EMPTY)) {
-          fprintf(
-              stderr,
-              "Error when getting packet from PDU: %s | Demanded length: %ld\n",
-              gse_get_status(ret), desired_len);
-          err++;
-        } else if (ret != GSE_STATUS_FIFO_EMPTY) {
-          if (params->payload_len != 0) {
-            memset(&gse_get_vfrag_start(
-                       vfrag_pkt)[gse_get_vfrag_length(vfrag_pkt)],
-                   0, params->payload_len - gse_get_vfrag_length(vfrag_pkt));
-            ret = gse_set_vfrag_length(vfrag_pkt, params->payload_len);
-            if (ret > GSE_STATUS_OK) {
-              fprintf(stderr, "error when setting fragment length: %s\n",
-                      gse_get_status(ret));
-            }
-          }
-          if ((ret = write_udp(send_ctxt->udp_fd, &(send_ctxt->remote),
-                               gse_get_vfrag_start(vfrag_pkt),
-                               gse_get_vfrag_length(vfrag_pkt))) != 0) {
-            fprintf(stderr, "[Send] Write udp failed\n");
-          }
+    }
+    hand_over(senders, counters, steering->count, params->handoff);
+  }
+  log_ring_stop();
+
+  if (params->handoff != NULL) {
+    handoff_print_stats(params->handoff);
+  }
+  if (ctxt->live != NULL) {
+    live_config_print_stats(ctxt->live);
+  }
+  print_steering_stats(steering);
+  for (i = 0; i < steering->count; i++) {
+    worker = &(steering->workers[i]);
+    if (worker->ctxt->modcod != NULL) {
+      fprintf(stdout, "Worker %u: ", i);
+      modcod_sched_print_stats(worker->ctxt->modcod);
+    }
+    if (worker->ctxt->fwd != NULL) {
+      fprintf(stdout, "Worker %u: ", i);
+      fwd_table_print_stats(worker->ctxt->fwd);
+    }
+    // The PDUs left in the ring still belong to the reader side
+    while (ring_pop(worker->pdus, (void **)&vfrag_pdu) == 0) {
+      gse_free_vfrag(&vfrag_pdu);
+    }
+  }
+  delete_steering(steering);
+
+  return alive >= 0 ? 0 : -2;
+}
+
+int steer_pdus(struct encap_recv_ctxt *ctxt, struct encap_steering *steering) {
+  int ret = 0;
+  unsigned int i, count;
+  struct flow_batch *batch = &(steering->batch);
+  struct encap_worker *worker;
+  gse_vfrag_t *vfrag_pdus[FLOW_BATCH_MAX];
+  const unsigned char *frames[FLOW_BATCH_MAX];
+  size_t lens[FLOW_BATCH_MAX];
+
+  // The PDUs queued on the non-blocking TAP, classified together
+  for (count = 0; count < FLOW_BATCH_MAX; count++) {
+    if ((ret = read_tap_pdu(ctxt->tap_fd, ctxt->buffer_len, &(ctxt->spare),
+                            &(vfrag_pdus[count]), NULL)) != 0) {
+      break;
+    }
+    frames[count] = gse_get_vfrag_start(vfrag_pdus[count]);
+    lens[count] = gse_get_vfrag_length(vfrag_pdus[count]);
+  }
+  if (count == 0) {
+    return ret;
+  }
+  flow_batch_classify(&(steering->hasher), frames, lens, count, batch);
+
+  for (i = 0; i < count; i++) {
+    steering->levels[batch->level[i]]++;
+    worker = &(steering->workers[flow_steer_worker(&(steering->steer),
+                                                   batch->hash[i])]);
+
+    // Wait for the worker rather than drop: the TAP queue holds the next PDUs
+    while (ring_push(worker->pdus, vfrag_pdus[i]) != 0) {
+      if (alive != 0 ||
+          ring_wait_space(worker->pdus, &(ctxt->timeout)) < 0) {
+        for (; i < count; i++) {
+          gse_free_vfrag(&(vfrag_pdus[i]));
         }
-        gse_free_vfrag(&vfrag_pkt);
+        return -1;
       }
     }
+    worker->steered++;
   }
+  return 0;
+}
 
-  // Clean
-  delete_send_ctxt(send_ctxt);
-  delete_recv_ctxt(ctxt);
+void *encap_worker(void *arg) {
+  struct encap_worker *worker = (struct encap_worker *)arg;
+  struct encap_send_ctxt *ctxt = worker->ctxt;
+  struct encap_sched *sched = ctxt->sched;
+  const struct live_settings *settings;
+  gse_vfrag_t *vfrag_pdu;
 
-  return alive >= 0 ? 0 : -2;
+  while (alive == 0) {
+    if (worker->live != NULL &&
+        (settings = live_config_poll(worker->live, worker->reader)) != NULL) {
+      encap_apply_settings(ctxt, settings);
+    }
+
+    // Take a new PDU as long as a fragment ID is free, without waiting if
+    // some PDUs are still in flight
+    if (sched->busy_count < sched->count) {
+      if (ring_pop(worker->pdus, (void **)&vfrag_pdu) == 0) {
+        encap_new_pdu(ctxt, vfrag_pdu, &(worker->counter));
+      } else if (sched->busy_count == 0 && !worker->busy_poll &&
+                 ring_wait_data(worker->pdus, &(ctxt->timeout)) < 0) {
+        alive = -1;
+      }
+    }
+
+    // Send one frame, mixing the packets of the PDUs in flight
+    if (sched->busy_count > 0) {
+      send_frame(ctxt);
+    }
+  }
+  return NULL;
+}
+
+void print_steering_stats(struct encap_steering *steering) {
+  struct encap_worker *worker;
+  unsigned int i;
+  char name[32];
+
+  // A worker stalling the reader is the bottleneck, a starved one waits for
+  // its flows
+  fprintf(stdout, "Steering statistics\n");
+  fprintf(stdout,
+          "  - flows hashed on:    %lu ports, %lu IP addresses, %lu MAC "
+          "addresses\n",
+          steering->levels[flow_l4], steering->levels[flow_l3],
+          steering->levels[flow_l2]);
+  for (i = 0; i < steering->count; i++) {
+    worker = &(steering->workers[i]);
+    snprintf(name, sizeof(name), "worker %u:", i);
+    fprintf(stdout,
+            "  - %-20s%lu PDUs, fragment IDs %d-%d, stalled the reader %lu "
+            "times, starved %lu times, ring high-water %zu/%zu\n",
+            name, worker->steered, worker->ctxt->frag_base,
+            worker->ctxt->frag_base + worker->ctxt->sched->count - 1,
+            worker->pdus->full_count, worker->pdus->empty_count,
+            worker->pdus->max_used, ring_capacity(worker->pdus));
+  }
+}
+
+struct encap_steering *create_steering(struct process_encap_params *params) {
+  struct encap_steering *steering;
+  struct encap_worker *worker;
+  unsigned int i;
+
+  if ((steering = (struct encap_steering *)malloc(
+           sizeof(struct encap_steering))) == NULL) {
+    return NULL;
+  }
+  memset(steering, 0, sizeof(struct encap_steering));
+  flow_hasher_init(&(steering->hasher), flow_rss_key);
+  flow_batch_init();
+  flow_steer_init(&(steering->steer), params->workers);
+
+  if ((steering->workers = (struct encap_worker *)calloc(
+           params->workers, sizeof(struct encap_worker))) == NULL) {
+    free(steering);
+    return NULL;
+  }
+  for (i = 0; i < (unsigned int)params->workers; i++) {
+    worker = &(steering->workers[i]);
+    worker->busy_poll = params->busy_poll;
+    if ((worker->ctxt = create_worker_ctxt(params, i)) == NULL ||
+        (worker->pdus = ring_create(ENCAP_WORKER_RING)) == NULL) {
+      fprintf(stderr, "Worker %u creation failed\n", i);
+      delete_send_ctxt(worker->ctxt);
+      delete_steering(steering);
+      return NULL;
+    }
+    steering->count++;
+  }
+
+  return steering;
+}
+
+void delete_steering(struct encap_steering *steering) {
+  unsigned int i;
+
+  if (steering == NULL) {
+    return;
+  }
+  for (i = 0; i < steering->count; i++) {
+    ring_delete(steering->workers[i].pdus);
+    delete_send_ctxt(steering->workers[i].ctxt);
+  }
+  free(steering->workers);
+  free(steering);
 }
 
 int check_encap_params(struct process_encap_params *params) {
@@ -245,9 +823,41 @@ int check_encap_params(struct process_encap_params *params) {
     return -1;
   }
 
-  if (params->sched_period.tv_sec == 0 && params->sched_period.tv_nsec == 0) {
+  if (params->frag_count < 1 || params->frag_count > MAX_FRAG_ID_COUNT) {
+    fprintf(stderr,
+            "Invalid fragment IDs count: must be between 1 and %u\n",
+            MAX_FRAG_ID_COUNT);
+    return -1;
+  }
+  if (params->shm_name[0] != '\0' && params->fwd_path[0] != '\0') {
+    fprintf(stderr, "Invalid shared memory ring: a single consumer reads it, "
+                    "the forwarding table must be disabled\n");
+    return -1;
+  }
+  if (params->workers > 0 &&
+      params->workers * params->frag_count > MAX_FRAG_ID_COUNT) {
     fprintf(stderr,
-            "Invalid scheduler period value: must be strictly positive\n");
+            "Invalid workers count: each worker has its own fragment IDs, "
+            "WORKERS * FRAG_IDS must be at most %u\n",
+            MAX_FRAG_ID_COUNT);
+    return -1;
+  }
+  if (params->workers > 0 &&
+      (params->seq_header || params->shm_name[0] != '\0' ||
+       params->chan.frames > 0 || params->perf_period > 0)) {
+    fprintf(stderr, "Invalid workers: the tunnel header, the FEC, the shared "
+                    "memory ring, the channel emulation and the hardware "
+                    "counters need a single sender\n");
+    return -1;
+  }
+  if (params->workers > 0 && params->fq.flows > 0) {
+    fprintf(stderr, "Invalid workers: the flow queues feed a single "
+                    "encapsulator\n");
+    return -1;
+  }
+  if (params->bb_header && params->modcod_path[0] == '\0') {
+    fprintf(stderr, "Invalid baseband header: the frames are BBFrames of a "
+                    "MODCOD schedule only\n");
     return -1;
   }
   if (params->payload_len != 0 && params->payload_len < MIN_ENCAP_FRAME_SIZE) {
@@ -269,60 +879,70 @@ struct encap_recv_ctxt *create_recv_ctxt(struct process_encap_params *params) {
   }
   memset(ctxt, 0, sizeof(struct encap_recv_ctxt));
   memcpy(&(ctxt->timeout), &(params->read_timeout), sizeof(struct timespec));
+  ctxt->buffer_len = params->buffer_len;
 
-  if ((ctxt->tap_fd = open_tap((char *)(params->tap_iface), tap_readonly)) <
-      0) {
+  if ((ctxt->tap_fd = handoff_take_tap(params->handoff)) < 0 &&
+      (ctxt->tap_fd = open_tap((char *)(params->tap_iface), tap_readonly)) <
+          0) {
     fprintf(stderr, "TAP interface %s opening failed\n", params->tap_iface);
     free(ctxt);
     return NULL;
   }
-
-  return ctxt;
-}
-
-void delete_recv_ctxt(struct encap_recv_ctxt *ctxt) {
-  if (ctxt == NULL) {
-    return;
-  }
-  close(ctxt->tap_fd);
-  free(ctxt);
-}
-
-struct encap_send_ctxt *create_send_ctxt(struct process_encap_params *params) {
-  struct encap_send_ctxt *ctxt;
-
-  if ((ctxt = (struct encap_send_ctxt *)malloc(
-           sizeof(struct encap_send_ctxt))) == NULL) {
-    return NULL;
-  }
-  memset(ctxt, 0, sizeof(struct encap_send_ctxt));
-  memcpy(&(ctxt->timeout), &(params->read_timeout), sizeof(struct timespec));
-  memcpy(&(ctxt->remote), &(params->remote), sizeof(struct udp_addr));
-
-  if ((ctxt->evt_fd = eventfd(0, 0)) < 0) {
-    fprintf(stderr, "Function eventfd failed: %s (%d)\n", strerror(errno),
-            errno);
+  if (params->fq.flows > 0 &&
+      (ctxt->fq = fq_create(&(params->fq), fq_drop_pdu, NULL)) == NULL) {
+    fprintf(stderr, "Flow queues creation failed\n");
+    close(ctxt->tap_fd);
     free(ctxt);
     return NULL;
   }
-  if ((ctxt->udp_fd = open_udp(&(params->local))) < 0) {
-    char l_addr[256];
-    ipv4_address_str(params->local.addr, l_addr);
-    fprintf(stderr, "UDP tunnel opening on %s:%u failed\n", l_addr,
-            params->local.port);
-    close(ctxt->evt_fd);
-    free(ctxt);
+  if (params->ctrl_path[0] != '\0' &&
+      (ctxt->live = create_live_config(params)) == NULL) {
+    fprintf(stderr, "Control socket %s opening failed\n", params->ctrl_path);
+    delete_recv_ctxt(ctxt);
     return NULL;
   }
 
   return ctxt;
 }
 
-void delete_send_ctxt(struct encap_send_ctxt *ctxt) {
+struct live_config *create_live_config(struct process_encap_params *params) {
+  struct live_settings settings;
+  struct live_limits limits;
+
+  memset(&settings, 0, sizeof(struct live_settings));
+  memcpy(&(settings.read_timeout), &(params->read_timeout),
+         sizeof(struct timespec));
+  settings.buffer_len = params->buffer_len;
+  settings.payload_len = params->payload_len;
+  settings.rate_kbps = params->chan.rate_kbps;
+  settings.label_type = GSE_LT_6_BYTES;
+
+  // The lengths are bounded by the buffers allocated at startup: the frame
+  // length given sizes the padding, the channel, the ring and FEC buffers
+  memset(&limits, 0, sizeof(struct live_limits));
+  limits.keys = LIVE_KEY_TIMEOUT | LIVE_KEY_BUFFER | LIVE_KEY_LABEL;
+  limits.buffer_max = encap_buffer_max(params);
+  if (params->payload_len != 0 && params->modcod_path[0] == '\0') {
+    limits.keys |= LIVE_KEY_PAYLOAD;
+    limits.payload_min = MIN_ENCAP_FRAME_SIZE;
+    limits.payload_max = params->payload_len;
+  }
+  if (params->chan.frames > 0) {
+    limits.keys |= LIVE_KEY_RATE;
+  }
+  return live_config_create(params->ctrl_path, &settings, &limits);
+}
+
+void delete_recv_ctxt(struct encap_recv_ctxt *ctxt) {
   if (ctxt == NULL) {
     return;
   }
-  close(ctxt->udp_fd);
-  close(ctxt->evt_fd);
+  // The readers are stopped
+  live_config_delete(ctxt->live);
+  fq_delete(ctxt->fq);
+  if (ctxt->spare != NULL) {
+    gse_free_vfrag(&(ctxt->spare));
+  }
+  close(ctxt->tap_fd);
   free(ctxt);
 }
@@ -15,22 +15,71 @@
 #include <gse/refrag.h>
 #include <gse/header_fields.h>
 
+#include "channel.h"
+#include "encap_sched.h"
+#include "fec.h"
+#include "fq_codel.h"
+#include "handoff.h"
 #include "udp.h"
 
 #define MIN_ENCAP_FRAME_SIZE (2 * GSE_MAX_HEADER_LENGTH + 2 * GSE_MAX_TRAILER_LENGTH)
+#define MAX_FRAG_ID_COUNT 255 // libGSE counts its QoS, used as fragment IDs, on a byte
+#define MAX_ENCAP_WORKERS 32
 
 struct process_encap_params
 {
 	char tap_iface[256];
 
 	struct udp_addr local;
-	struct udp_addr remote;
+	struct udp_addr remote; // port 0 when only the forwarding table is used
+	char fwd_path[256];
+	char shm_name[256]; // frames written to this shared memory ring instead of UDP when set
 
 	struct timespec read_timeout;
 	struct timespec sched_period;
 
 	int buffer_len;
 	int payload_len;
+
+	// Frames sized from the MODCOD schedule of this file instead of
+	// payload_len when set, with a DVB-S2 baseband header when bb_header
+	char modcod_path[256];
+	int bb_header;
+
+	int frag_count;
+	sched_policy_t sched_policy;
+
+	int seq_header; // prepend the tunnel header with a sequence number
+
+	// Parity frames every fec_k frames, none when 0 (tunnel header only)
+	fec_scheme_t fec_scheme;
+	unsigned int fec_k;
+	unsigned int fec_m;
+
+	unsigned int perf_period; // one packet in perf_period measured, none when 0
+
+	struct channel_params chan; // satellite channel emulated before the send
+
+	// PDUs queued per flow in front of the encapsulator, none when flows is 0
+	struct fq_params fq;
+
+	// Processing thread CPU and SCHED_FIFO priority, -1 and 0 to leave them
+	int cpu;
+	int priority;
+	int busy_poll; // spin on the non-blocking TAP instead of sleeping
+
+	// PDUs steered by the hash of their flow to worker threads, each one with
+	// its own encapsulator, none when 0 (single thread)
+	int workers;
+	int worker_cpus[MAX_ENCAP_WORKERS];
+
+	// Unix socket changing the settings while running, none when empty
+	char ctrl_path[256];
+
+	// Unix socket handing the descriptors over to the next process, none when
+	// empty, and the descriptors of the previous process, set by the process
+	char handoff_path[256];
+	struct handoff *handoff;
 };
 
 /**
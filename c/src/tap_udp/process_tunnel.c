@@ -0,0 +1,235 @@
+// Copyright 2023, Viveris Technologies
+// Distributed under the terms of the MIT License
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/select.h>
+#include <unistd.h>
+
+#include "decap_engine.h"
+#include "encap_engine.h"
+#include "process_tunnel.h"
+#include "tap.h"
+#include "tunnel_log.h"
+#include "udp.h"
+#include "utils.h"
+
+/**
+ * State of the two ways sharing the loop
+ */
+struct tunnel_ctxt {
+  struct encap_send_ctxt *encap;
+  struct decap_ctxt *decap;
+
+  int tap_fd;
+  gse_vfrag_t *spare; // PDU buffer left by a read without data
+  unsigned char *data_received;
+};
+struct tunnel_ctxt *create_tunnel_ctxt(struct process_tunnel_params *params);
+void delete_tunnel_ctxt(struct tunnel_ctxt *ctxt);
+
+int write_pdu(struct decap_pdu *pdu, void *arg);
+int process_loop(struct tunnel_ctxt *ctxt,
+                 struct process_tunnel_params *params);
+
+atomic_int alive;
+void sighandler(__attribute__((unused)) int sig) { alive = 1; }
+
+int process_tunnel(struct process_tunnel_params *params) {
+  int ret;
+
+  sigset_t sigmask;
+  struct tunnel_ctxt *ctxt;
+
+  // Initialization
+  if ((ctxt = create_tunnel_ctxt(params)) == NULL) {
+    return -1;
+  }
+  if (tunnel_log_start() != 0) {
+    delete_tunnel_ctxt(ctxt);
+    return -1;
+  }
+  if (set_thread_cpu(pthread_self(), params->encap.cpu) != 0 ||
+      set_thread_fifo(pthread_self(), params->encap.priority) != 0) {
+    log_ring_stop();
+    delete_tunnel_ctxt(ctxt);
+    return -1;
+  }
+
+  // Add stop signals handler
+  signal(SIGTERM, sighandler);
+  signal(SIGINT, sighandler);
+
+  // Mask signals during interfaces polling
+  sigemptyset(&sigmask);
+  sigaddset(&sigmask, SIGTERM);
+  sigaddset(&sigmask, SIGINT);
+
+  // Link contexts
+  ctxt->encap->sigmask = sigmask;
+  ctxt->decap->sigmask = sigmask;
+  alive = 0;
+
+  ret = process_loop(ctxt, params);
+  log_ring_stop();
+
+  if (ctxt->decap->reasm != NULL) {
+    reasm_print_stats(ctxt->decap->reasm);
+  }
+  if (ctxt->decap->reorder != NULL) {
+    reorder_print_stats(ctxt->decap->reorder);
+  }
+  if (ctxt->decap->fec != NULL) {
+    fec_decoder_print_stats(ctxt->decap->fec);
+  }
+
+  // Clean
+  delete_tunnel_ctxt(ctxt);
+
+  return ret;
+}
+
+int process_loop(struct tunnel_ctxt *ctxt,
+                 struct process_tunnel_params *params) {
+  int ret;
+
+  int nfds;
+  fd_set fds, readfds;
+  struct timespec no_wait = {0, 0};
+
+  struct encap_send_ctxt *encap = ctxt->encap;
+  struct decap_ctxt *decap = ctxt->decap;
+  struct encap_sched *sched = encap->sched;
+
+  size_t len_received;
+  uint64_t counter = 0;
+
+  FD_ZERO(&fds);
+  FD_SET(ctxt->tap_fd, &fds);
+  FD_SET(decap->udp_fd, &fds);
+  nfds = (ctxt->tap_fd > decap->udp_fd ? ctxt->tap_fd : decap->udp_fd) + 1;
+
+  while (alive == 0) {
+    // The TAP is left aside while every fragment ID is busy, the frames of
+    // the PDUs in flight are sent without waiting
+    readfds = fds;
+    if (sched->busy_count >= sched->count) {
+      FD_CLR(ctxt->tap_fd, &readfds);
+    }
+    ret = pselect(nfds, &readfds, NULL, NULL,
+                  sched->busy_count > 0 ? &no_wait : &(decap->timeout),
+                  &(decap->sigmask));
+    if (ret < 0) {
+      fprintf(stderr, "[Tunnel] Function pselect failed: %s (%d)\n",
+              strerror(errno), errno);
+      alive = -1;
+      break;
+    } else if (ret == 0) {
+      // Nothing received: give up the late frames and PDUs, and do not
+      // hold back the parity of the last frames sent on an idle link
+      expire_pdus(decap);
+      if (flush_frames(decap, write_pdu, ctxt) != 0) {
+        alive = -1;
+      }
+      if (sched->busy_count == 0) {
+        flush_parity(encap);
+      }
+    }
+
+    // Return way first: writing the PDUs frees the TAP queue
+    if (ret > 0 && FD_ISSET(decap->udp_fd, &readfds)) {
+      ret = read_udp(decap->udp_fd, &(decap->remote), decap->recv_len,
+                     ctxt->data_received, &(len_received));
+      if (ret < 0) {
+        fprintf(stderr, "[Tunnel] Packet reading from UDP socket failed\n");
+        alive = -1;
+        break;
+      } else if (ret > 0 || len_received == 0) {
+        log_ring_write(log_invalid_datagram);
+      } else if (decap_datagram(decap, ctxt->data_received, len_received,
+                                write_pdu, ctxt) != 0) {
+        alive = -1;
+      }
+    }
+    if (FD_ISSET(ctxt->tap_fd, &readfds)) {
+      encap_tap_pdu(encap, ctxt->tap_fd, params->encap.buffer_len,
+                    &(ctxt->spare), &counter);
+    }
+
+    // Send one frame, mixing the packets of the PDUs in flight
+    if (sched->busy_count > 0) {
+      send_frame(encap);
+    }
+  }
+
+  return alive >= 0 ? 0 : -2;
+}
+
+int write_pdu(struct decap_pdu *pdu, void *arg) {
+  struct tunnel_ctxt *ctxt = (struct tunnel_ctxt *)arg;
+
+  write_tap(ctxt->tap_fd, pdu->data, pdu->len);
+  release_pdu(ctxt->decap, pdu);
+  return 0;
+}
+
+struct tunnel_ctxt *create_tunnel_ctxt(struct process_tunnel_params *params) {
+  struct tunnel_ctxt *ctxt;
+
+  if ((ctxt = (struct tunnel_ctxt *)malloc(sizeof(struct tunnel_ctxt))) ==
+      NULL) {
+    return NULL;
+  }
+  memset(ctxt, 0, sizeof(struct tunnel_ctxt));
+  ctxt->tap_fd = -1;
+
+  if ((ctxt->encap = create_send_ctxt(&(params->encap))) == NULL ||
+      (ctxt->decap = create_ctxt(&(params->decap))) == NULL) {
+    delete_tunnel_ctxt(ctxt);
+    return NULL;
+  }
+
+  // A single UDP socket both ways: the de-encapsulation gives its own up
+  close(ctxt->decap->udp_fd);
+  ctxt->decap->udp_fd = ctxt->encap->udp_fd;
+
+  if ((ctxt->data_received = (unsigned char *)malloc(
+           sizeof(unsigned char) * ctxt->decap->recv_len)) == NULL) {
+    delete_tunnel_ctxt(ctxt);
+    return NULL;
+  }
+  if ((ctxt->tap_fd = open_tap((char *)(params->encap.tap_iface),
+                               tap_readwrite)) < 0) {
+    fprintf(stderr, "TAP interface %s opening failed\n",
+            params->encap.tap_iface);
+    delete_tunnel_ctxt(ctxt);
+    return NULL;
+  }
+
+  return ctxt;
+}
+
+void delete_tunnel_ctxt(struct tunnel_ctxt *ctxt) {
+  if (ctxt == NULL) {
+    return;
+  }
+  if (ctxt->spare != NULL) {
+    gse_free_vfrag(&(ctxt->spare));
+  }
+  if (ctxt->tap_fd >= 0) {
+    close(ctxt->tap_fd);
+  }
+  free(ctxt->data_received);
+  if (ctxt->decap != NULL) {
+    // The UDP socket is closed along the encapsulation context
+    ctxt->decap->udp_fd = -1;
+    delete_ctxt(ctxt->decap);
+  }
+  delete_send_ctxt(ctxt->encap);
+  free(ctxt);
+}
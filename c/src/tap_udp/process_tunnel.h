@@ -0,0 +1,29 @@
+// Copyright 2023, Viveris Technologies
+// Distributed under the terms of the MIT License
+
+#ifndef __PROCESS_TUNNEL_H__
+#define __PROCESS_TUNNEL_H__
+
+#include "process_decap.h"
+#include "process_encap.h"
+
+/**
+ * Both ways of a terminal: the encapsulation parameters hold the TAP
+ * interface, the UDP addresses and the processing thread settings shared
+ * by the two ways
+ */
+struct process_tunnel_params
+{
+	struct process_encap_params encap;
+	struct process_decap_params decap;
+};
+
+/**
+ * Run the encapsulation and the de-encapsulation in a single loop, through
+ * a single TAP file descriptor and a single UDP socket
+ *
+ * Return 0 on success, -1 on init error, -2 on loop error
+ */
+int process_tunnel(struct process_tunnel_params *params);
+
+#endif
@@ -0,0 +1,281 @@
+// Copyright 2023, Viveris Technologies
+// Distributed under the terms of the MIT License
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "crc32.h"
+#include "hugemem.h"
+#include "reasm.h"
+
+#define GSE_FRAG_ID_LEN 1
+#define GSE_PROTOCOL_LEN 2
+
+struct reasm_slot *reasm_get_slot(struct reasm *reasm)
+{
+	struct reasm_slot *slot;
+	size_t used;
+
+	if(reasm->free_count == 0)
+	{
+		if(reasm->oldest == NULL)
+		{
+			// Every buffer holds a complete PDU not released yet
+			return NULL;
+		}
+		reasm->stats.evictions++;
+		reasm_release(reasm, reasm->oldest);
+	}
+	slot = reasm->free_stack[--reasm->free_count];
+	slot->len = 0;
+	used = reasm->slot_count - reasm->free_count;
+	if(used > reasm->stats.max_used)
+	{
+		reasm->stats.max_used = used;
+	}
+	return slot;
+}
+
+void reasm_link(struct reasm *reasm, struct reasm_slot *slot)
+{
+	slot->pending = 1;
+	slot->older = reasm->newest;
+	slot->newer = NULL;
+	if(reasm->newest != NULL)
+	{
+		reasm->newest->newer = slot;
+	}
+	else
+	{
+		reasm->oldest = slot;
+	}
+	reasm->newest = slot;
+	reasm->frags[slot->frag_id] = slot;
+	timer_wheel_add(reasm->wheel, &(slot->timer), reasm->wheel->now + reasm->timeout);
+}
+
+void reasm_unlink(struct reasm *reasm, struct reasm_slot *slot)
+{
+	if(slot->older != NULL)
+	{
+		slot->older->newer = slot->newer;
+	}
+	else
+	{
+		reasm->oldest = slot->newer;
+	}
+	if(slot->newer != NULL)
+	{
+		slot->newer->older = slot->older;
+	}
+	else
+	{
+		reasm->newest = slot->older;
+	}
+	slot->older = NULL;
+	slot->newer = NULL;
+	slot->pending = 0;
+	reasm->frags[slot->frag_id] = NULL;
+	timer_wheel_cancel(&(slot->timer));
+}
+
+void reasm_timeout(struct tw_timer *timer, void *arg)
+{
+	struct reasm *reasm = (struct reasm *)arg;
+
+	reasm->stats.timeouts++;
+	reasm_release(reasm, (struct reasm_slot *)timer);
+}
+
+int reasm_append(struct reasm *reasm, struct reasm_slot *slot, const unsigned char *data, size_t len)
+{
+	if(slot->len + len > slot->expected)
+	{
+		reasm->stats.length_errors++;
+		reasm_release(reasm, slot);
+		return -1;
+	}
+	memcpy(slot->data + slot->len, data, len);
+	slot->len += len;
+	return 0;
+}
+
+struct reasm *reasm_create(size_t slot_count, size_t slot_len, unsigned long timeout_ms, uint64_t now_ms)
+{
+	struct reasm *reasm;
+	size_t i;
+
+	if((reasm = (struct reasm *)malloc(sizeof(struct reasm))) == NULL)
+	{
+		return NULL;
+	}
+	memset(reasm, 0, sizeof(struct reasm));
+	reasm->slot_count = slot_count;
+	reasm->slot_len = slot_len;
+	reasm->timeout = (timeout_ms + REASM_TICK_MS - 1) / REASM_TICK_MS;
+
+	if((reasm->arena = (unsigned char *)hugemem_alloc(slot_count * slot_len)) == NULL ||
+	   (reasm->slots = (struct reasm_slot *)calloc(slot_count, sizeof(struct reasm_slot))) == NULL ||
+	   (reasm->free_stack = (struct reasm_slot **)calloc(slot_count, sizeof(struct reasm_slot *))) == NULL ||
+	   (reasm->wheel = timer_wheel_create(reasm->timeout + 1, now_ms / REASM_TICK_MS)) == NULL)
+	{
+		reasm_delete(reasm);
+		return NULL;
+	}
+	for(i = 0; i < slot_count; i++)
+	{
+		reasm->slots[i].data = reasm->arena + i * slot_len;
+		reasm->free_stack[i] = &(reasm->slots[i]);
+	}
+	reasm->free_count = slot_count;
+	return reasm;
+}
+
+void reasm_delete(struct reasm *reasm)
+{
+	if(reasm == NULL)
+	{
+		return;
+	}
+	timer_wheel_delete(reasm->wheel);
+	free(reasm->free_stack);
+	free(reasm->slots);
+	hugemem_free(reasm->arena);
+	free(reasm);
+}
+
+int reasm_packet(struct reasm *reasm, const unsigned char *packet, const struct gse_header *hdr, struct reasm_slot **pdu)
+{
+	struct reasm_slot *slot;
+	const unsigned char *data = packet + hdr->header_len;
+	size_t len = hdr->packet_len - hdr->header_len;
+	uint32_t crc;
+
+	if(hdr->start && hdr->protocol < GSE_PROTOCOL_MIN)
+	{
+		reasm->stats.unsupported++;
+		return -1;
+	}
+
+	// Complete PDU: no CRC, the buffer is only needed to outlive the frame
+	if(hdr->start && hdr->end)
+	{
+		if(len > reasm->slot_len)
+		{
+			reasm->stats.length_errors++;
+			return -1;
+		}
+		if((slot = reasm_get_slot(reasm)) == NULL)
+		{
+			reasm->stats.no_buffer++;
+			return -1;
+		}
+		slot->protocol = hdr->protocol;
+		memcpy(slot->data, data, len);
+		slot->len = len;
+		reasm->stats.pdus++;
+		*pdu = slot;
+		return 1;
+	}
+
+	reasm->stats.fragments++;
+	slot = reasm->frags[hdr->frag_id];
+
+	// First fragment: the total length counts the protocol, the label and the
+	// PDU, the CRC covers them along with the total length field
+	if(hdr->start)
+	{
+		if(slot != NULL)
+		{
+			reasm->stats.overwritten++;
+			reasm_release(reasm, slot);
+		}
+		if(hdr->total_length < GSE_PROTOCOL_LEN + hdr->label_len ||
+		   (size_t)(hdr->total_length - GSE_PROTOCOL_LEN - hdr->label_len) > reasm->slot_len)
+		{
+			reasm->stats.length_errors++;
+			return -1;
+		}
+		if((slot = reasm_get_slot(reasm)) == NULL)
+		{
+			reasm->stats.no_buffer++;
+			return -1;
+		}
+		slot->frag_id = hdr->frag_id;
+		slot->protocol = hdr->protocol;
+		slot->expected = hdr->total_length - GSE_PROTOCOL_LEN - hdr->label_len;
+		slot->crc = crc32_update(CRC32_INIT, packet + GSE_FIXED_HEADER_LEN + GSE_FRAG_ID_LEN,
+		                         hdr->packet_len - GSE_FIXED_HEADER_LEN - GSE_FRAG_ID_LEN);
+		reasm_link(reasm, slot);
+		return reasm_append(reasm, slot, data, len);
+	}
+
+	if(slot == NULL)
+	{
+		reasm->stats.orphans++;
+		return -1;
+	}
+
+	// Intermediate fragment
+	if(!hdr->end)
+	{
+		slot->crc = crc32_update(slot->crc, data, len);
+		return reasm_append(reasm, slot, data, len);
+	}
+
+	// Last fragment, ended by the CRC
+	len -= GSE_CRC_LEN;
+	slot->crc = crc32_update(slot->crc, data, len);
+	if(reasm_append(reasm, slot, data, len) != 0)
+	{
+		return -1;
+	}
+	crc = ((uint32_t)data[len] << 24) | ((uint32_t)data[len + 1] << 16) |
+	      ((uint32_t)data[len + 2] << 8) | data[len + 3];
+	if(slot->len != slot->expected)
+	{
+		reasm->stats.length_errors++;
+		reasm_release(reasm, slot);
+		return -1;
+	}
+	if(crc != slot->crc)
+	{
+		reasm->stats.crc_errors++;
+		reasm_release(reasm, slot);
+		return -1;
+	}
+	reasm_unlink(reasm, slot);
+	reasm->stats.pdus++;
+	*pdu = slot;
+	return 1;
+}
+
+void reasm_release(struct reasm *reasm, struct reasm_slot *slot)
+{
+	if(slot->pending)
+	{
+		reasm_unlink(reasm, slot);
+	}
+	reasm->free_stack[reasm->free_count++] = slot;
+}
+
+void reasm_expire(struct reasm *reasm, uint64_t now_ms)
+{
+	timer_wheel_advance(reasm->wheel, now_ms / REASM_TICK_MS, reasm_timeout, reasm);
+}
+
+void reasm_print_stats(struct reasm *reasm)
+{
+	struct reasm_stats *stats = &(reasm->stats);
+
+	fprintf(stdout, "Reassembly statistics\n");
+	fprintf(stdout, "  - memory:             %zu buffers of %zu bytes, %zu used at most\n",
+	        reasm->slot_count, reasm->slot_len, stats->max_used);
+	fprintf(stdout, "  - PDUs:               %lu complete, %lu fragments\n", stats->pdus, stats->fragments);
+	fprintf(stdout, "  - incomplete dropped: %lu timeouts, %lu evictions, %lu overwritten\n",
+	        stats->timeouts, stats->evictions, stats->overwritten);
+	fprintf(stdout, "  - errors:             %lu orphan fragments, %lu CRC, %lu length, %lu unsupported\n",
+	        stats->orphans, stats->crc_errors, stats->length_errors, stats->unsupported);
+	fprintf(stdout, "  - no free buffer:     %lu PDUs dropped\n", stats->no_buffer);
+}
@@ -0,0 +1,118 @@
+// Copyright 2023, Viveris Technologies
+// Distributed under the terms of the MIT License
+
+#ifndef __REASM_H__
+#define __REASM_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "gse_header.h"
+#include "timer_wheel.h"
+
+#define REASM_TICK_MS 10 // Granularity of the reassembly timeouts
+
+/**
+ * Reassembly buffer taken from the arena
+ */
+struct reasm_slot
+{
+	// First member, the expiry handler gets the slot back from the timer
+	struct tw_timer timer;
+
+	// Age list of the reassemblies in progress, the oldest is evicted first
+	struct reasm_slot *older;
+	struct reasm_slot *newer;
+
+	int pending;
+	uint8_t frag_id;
+	uint16_t protocol;
+	size_t expected;
+	uint32_t crc;
+
+	size_t len;
+	unsigned char *data;
+};
+
+/**
+ * Reassembly counters
+ */
+struct reasm_stats
+{
+	uint64_t pdus;
+	uint64_t fragments;
+	uint64_t timeouts;      // incomplete PDUs dropped after the timeout
+	uint64_t evictions;     // incomplete PDUs dropped to free a buffer
+	uint64_t overwritten;   // incomplete PDUs dropped by a new first fragment
+	uint64_t orphans;       // fragments without a reassembly in progress
+	uint64_t crc_errors;
+	uint64_t length_errors;
+	uint64_t unsupported;   // extension headers
+	uint64_t no_buffer;     // PDUs dropped, every buffer being in use
+	size_t max_used;
+};
+
+/**
+ * Reassembly manager of the GSE fragments
+ *
+ * The memory is bounded: the buffers are carved once from an arena and the
+ * reassembly of a PDU only takes a buffer. When none is left, the oldest
+ * reassembly in progress is evicted, and each reassembly is dropped if not
+ * completed before the timeout. A completed PDU keeps its buffer until it is
+ * released. Not thread-safe.
+ */
+struct reasm
+{
+	size_t slot_count;
+	size_t slot_len;
+	uint64_t timeout;  // ticks
+
+	unsigned char *arena;
+	struct reasm_slot *slots;
+	struct reasm_slot **free_stack;
+	size_t free_count;
+
+	struct reasm_slot *frags[GSE_FRAG_COUNT];
+	struct reasm_slot *oldest;
+	struct reasm_slot *newest;
+	struct timer_wheel *wheel;
+
+	struct reasm_stats stats;
+};
+
+/**
+ * Create a reassembly manager of slot_count buffers of slot_len bytes
+ *
+ * Return the manager on success, NULL otherwise
+ */
+struct reasm *reasm_create(size_t slot_count, size_t slot_len, unsigned long timeout_ms, uint64_t now_ms);
+
+/**
+ * Delete a reassembly manager and its arena
+ */
+void reasm_delete(struct reasm *reasm);
+
+/**
+ * Handle a GSE packet, the header being already parsed
+ *
+ * Return 1 and set pdu when a PDU is complete, 0 when the packet is kept,
+ * -1 when it is dropped
+ */
+int reasm_packet(struct reasm *reasm, const unsigned char *packet, const struct gse_header *hdr, struct reasm_slot **pdu);
+
+/**
+ * Give the buffer of a complete PDU back to the arena
+ */
+void reasm_release(struct reasm *reasm, struct reasm_slot *slot);
+
+/**
+ * Drop the reassemblies whose timeout is elapsed
+ */
+void reasm_expire(struct reasm *reasm, uint64_t now_ms);
+
+/**
+ * Print the reassembly counters
+ */
+void reasm_print_stats(struct reasm *reasm);
+
+#endif
@@ -0,0 +1,225 @@
+// Copyright 2023, Viveris Technologies
+// Distributed under the terms of the MIT License
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hugemem.h"
+#include "reorder.h"
+
+// A frame further behind is taken for a restart of the remote counter
+#define REORDER_RESYNC_DISTANCE 65536
+
+void reorder_update_gap(struct reorder *reorder)
+{
+	size_t i;
+
+	// The gap is as old as the oldest frame waiting for it
+	reorder->gap_start = UINT64_MAX;
+	for(i = 0; reorder->depth > 0 && i <= reorder->mask; i++)
+	{
+		if(reorder->slots[i].used && reorder->slots[i].arrival < reorder->gap_start)
+		{
+			reorder->gap_start = reorder->slots[i].arrival;
+		}
+	}
+}
+
+int reorder_drain(struct reorder *reorder, reorder_deliver_t deliver, void *arg)
+{
+	struct reorder_slot *slot = &(reorder->slots[reorder->next & reorder->mask]);
+	int ret = 0;
+	int drained = 0;
+
+	while(slot->used && slot->seq == reorder->next)
+	{
+		slot->used = 0;
+		reorder->depth--;
+		reorder->next++;
+		reorder->stats.reordered++;
+		drained = 1;
+		if(deliver(slot->data, slot->len, arg) != 0)
+		{
+			ret = -1;
+		}
+		slot = &(reorder->slots[reorder->next & reorder->mask]);
+	}
+	if(drained)
+	{
+		reorder_update_gap(reorder);
+	}
+	return ret;
+}
+
+int reorder_skip(struct reorder *reorder, reorder_deliver_t deliver, void *arg)
+{
+	// Give up the missing frames up to the next buffered one
+	while(reorder->depth > 0 && !reorder->slots[reorder->next & reorder->mask].used)
+	{
+		reorder->stats.lost++;
+		reorder->next++;
+	}
+	return reorder_drain(reorder, deliver, arg);
+}
+
+struct reorder *reorder_create(size_t window, size_t frame_len, unsigned long timeout_ms)
+{
+	struct reorder *reorder;
+	size_t capa = 1;
+	size_t i;
+
+	while(capa < window)
+	{
+		capa <<= 1;
+	}
+	if((reorder = (struct reorder *)malloc(sizeof(struct reorder))) == NULL)
+	{
+		return NULL;
+	}
+	memset(reorder, 0, sizeof(struct reorder));
+	reorder->mask = capa - 1;
+	reorder->frame_len = frame_len;
+	reorder->timeout = timeout_ms;
+	reorder->gap_start = UINT64_MAX;
+
+	if((reorder->arena = (unsigned char *)hugemem_alloc(capa * frame_len)) == NULL ||
+	   (reorder->slots = (struct reorder_slot *)calloc(capa, sizeof(struct reorder_slot))) == NULL)
+	{
+		reorder_delete(reorder);
+		return NULL;
+	}
+	for(i = 0; i < capa; i++)
+	{
+		reorder->slots[i].data = reorder->arena + i * frame_len;
+	}
+	return reorder;
+}
+
+void reorder_delete(struct reorder *reorder)
+{
+	if(reorder == NULL)
+	{
+		return;
+	}
+	free(reorder->slots);
+	hugemem_free(reorder->arena);
+	free(reorder);
+}
+
+int reorder_frame(struct reorder *reorder, uint32_t seq, unsigned char *data, size_t len, uint64_t now_ms,
+                  reorder_deliver_t deliver, void *arg)
+{
+	struct reorder_slot *slot;
+	int32_t dist;
+	int ret;
+
+	if(!reorder->started)
+	{
+		reorder->started = 1;
+		reorder->next = seq;
+	}
+	ret = reorder_flush(reorder, now_ms, deliver, arg);
+
+	dist = (int32_t)(seq - reorder->next);
+	if(dist < 0 && dist > -REORDER_RESYNC_DISTANCE)
+	{
+		reorder->stats.late++;
+		return ret;
+	}
+
+	// Too far ahead for the window, or the remote restarted: give the gaps up
+	// until the frame fits
+	while(dist < 0 || (size_t)dist > reorder->mask)
+	{
+		if(reorder->depth == 0)
+		{
+			if(dist > 0)
+			{
+				reorder->stats.lost += dist;
+			}
+			reorder->next = seq;
+			dist = 0;
+			break;
+		}
+		if(reorder_skip(reorder, deliver, arg) != 0)
+		{
+			ret = -1;
+		}
+		dist = (int32_t)(seq - reorder->next);
+	}
+
+	if(dist == 0)
+	{
+		reorder->next++;
+		reorder->stats.in_order++;
+		if(deliver(data, len, arg) != 0)
+		{
+			ret = -1;
+		}
+		if(reorder_drain(reorder, deliver, arg) != 0)
+		{
+			ret = -1;
+		}
+		return ret;
+	}
+
+	slot = &(reorder->slots[seq & reorder->mask]);
+	if(slot->used)
+	{
+		reorder->stats.duplicates++;
+		return ret;
+	}
+	if(len > reorder->frame_len)
+	{
+		reorder->stats.invalid++;
+		return ret;
+	}
+	memcpy(slot->data, data, len);
+	slot->len = len;
+	slot->seq = seq;
+	slot->arrival = now_ms;
+	slot->used = 1;
+	if(++reorder->depth > reorder->stats.max_depth)
+	{
+		reorder->stats.max_depth = reorder->depth;
+	}
+	if(now_ms < reorder->gap_start)
+	{
+		reorder->gap_start = now_ms;
+	}
+	return ret;
+}
+
+int reorder_flush(struct reorder *reorder, uint64_t now_ms, reorder_deliver_t deliver, void *arg)
+{
+	int ret = 0;
+
+	while(reorder->depth > 0 && reorder->gap_start + reorder->timeout <= now_ms)
+	{
+		reorder->stats.timeouts++;
+		if(reorder_skip(reorder, deliver, arg) != 0)
+		{
+			ret = -1;
+		}
+	}
+	return ret;
+}
+
+void reorder_resume(struct reorder *reorder, uint32_t next)
+{
+	reorder->started = 1;
+	reorder->next = next;
+}
+
+void reorder_print_stats(struct reorder *reorder)
+{
+	struct reorder_stats *stats = &(reorder->stats);
+
+	fprintf(stdout, "Reordering statistics\n");
+	fprintf(stdout, "  - frames:             %lu in order, %lu reordered, %zu waiting at most\n",
+	        stats->in_order, stats->reordered, stats->max_depth);
+	fprintf(stdout, "  - sequence gaps:      %lu frames lost, %lu gaps timed out\n", stats->lost, stats->timeouts);
+	fprintf(stdout, "  - frames dropped:     %lu late, %lu duplicated, %lu invalid\n",
+	        stats->late, stats->duplicates, stats->invalid);
+}
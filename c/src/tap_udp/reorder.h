@@ -0,0 +1,107 @@
+// Copyright 2023, Viveris Technologies
+// Distributed under the terms of the MIT License
+
+#ifndef __REORDER_H__
+#define __REORDER_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Handler of a frame delivered in order
+ *
+ * Return 0 on success, -1 on error
+ */
+typedef int (*reorder_deliver_t)(unsigned char *data, size_t len, void *arg);
+
+/**
+ * Frame received ahead of the expected one
+ */
+struct reorder_slot
+{
+	int used;
+	uint32_t seq;
+	uint64_t arrival;
+	size_t len;
+	unsigned char *data;
+};
+
+/**
+ * Reordering counters
+ */
+struct reorder_stats
+{
+	uint64_t in_order;     // delivered on arrival
+	uint64_t reordered;    // delivered from the window
+	uint64_t lost;         // sequence numbers skipped
+	uint64_t late;         // received after their turn, dropped
+	uint64_t duplicates;
+	uint64_t timeouts;     // gaps given up after the timeout
+	uint64_t invalid;      // datagrams without a valid tunnel header
+	size_t max_depth;
+};
+
+/**
+ * Reorder window of the tunnel frames, based on their sequence number
+ *
+ * A frame arriving in order is delivered straight from the caller buffer,
+ * only the frames arriving ahead of a gap are copied into the window. A gap
+ * is given up, and the frames after it delivered, when the window is full or
+ * when the oldest frame waiting for it exceeds the timeout. Not thread-safe.
+ */
+struct reorder
+{
+	size_t mask;
+	size_t frame_len;
+	uint64_t timeout;  // ms
+
+	unsigned char *arena;
+	struct reorder_slot *slots;
+
+	int started;
+	uint32_t next;
+	size_t depth;
+	uint64_t gap_start;
+
+	struct reorder_stats stats;
+};
+
+/**
+ * Create a reorder window of at least window frames of frame_len bytes
+ *
+ * Return the window on success, NULL otherwise
+ */
+struct reorder *reorder_create(size_t window, size_t frame_len, unsigned long timeout_ms);
+
+/**
+ * Delete a reorder window, the frames still buffered are dropped
+ */
+void reorder_delete(struct reorder *reorder);
+
+/**
+ * Handle a received frame and deliver the frames which are now in order
+ *
+ * Return 0 on success, -1 if the delivery failed
+ */
+int reorder_frame(struct reorder *reorder, uint32_t seq, unsigned char *data, size_t len, uint64_t now_ms,
+                  reorder_deliver_t deliver, void *arg);
+
+/**
+ * Give up the gaps older than the timeout and deliver the frames after them
+ *
+ * Return 0 on success, -1 if the delivery failed
+ */
+int reorder_flush(struct reorder *reorder, uint64_t now_ms, reorder_deliver_t deliver, void *arg);
+
+/**
+ * Start the window at the sequence number expected next, as a previous
+ * process left it
+ */
+void reorder_resume(struct reorder *reorder, uint32_t next);
+
+/**
+ * Print the reordering counters
+ */
+void reorder_print_stats(struct reorder *reorder);
+
+#endif
@@ -0,0 +1,1323 @@
+// Copyright 2023, Viveris Technologies
+// Distributed under the terms of the MIT License
+
+#include <errno.h>
+#include <getopt.h>
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_TSC
+#endif
+
+#include "bench_traffic.h"
+#include "crc32.h"
+#include "decap_engine.h"
+#include "encap_engine.h"
+#include "flow_batch.h"
+#include "flow_hash.h"
+#include "gse_header.h"
+#include "tunnel_log.h"
+#include "utils.h"
+
+// Default values
+#define DEFAULT_MODE                "both"
+#define DEFAULT_GEN_ADDR            "127.0.0.1:40000"
+#define DEFAULT_SINK_ADDR           "127.0.0.1:40001"
+#define DEFAULT_PAYLOAD_LENGTH      1500   // bytes
+#define DEFAULT_READ_TIMEOUT        100    // ms
+#define DEFAULT_FRAG_COUNT          1      // fragment IDs
+#define DEFAULT_SCHED_POLICY        "shortest"
+#define DEFAULT_SIZES               "imix"
+#define DEFAULT_DSCP                "0"
+#define DEFAULT_RATE                0      // frames per second
+#define DEFAULT_COUNT               0      // frames
+#define DEFAULT_DURATION            10000  // ms
+#define DEFAULT_REORDER_WINDOW      0      // frames
+#define DEFAULT_REORDER_TIMEOUT     50     // ms
+#define DEFAULT_REASM_SLOTS         0      // buffers
+#define DEFAULT_REASM_TIMEOUT       1000   // ms
+#define DEFAULT_FLOWS               1000000
+#define DEFAULT_WORKERS             4
+#define SINK_IDLE_STOP              2000   // ms of silence which ends a lone sink
+#define CLASSIFY_POOL               4096   // frames generated between two timed classifications
+#define CLASSIFY_DAMAGED            80     // first bytes of the frames damaged to check the classifiers
+#define CLASSIFY_DAMAGES            3      // bytes overwritten per damaged frame
+#define FUZZ_FRAG_COUNT             255    // libGSE reassembles one PDU per QoS, used as fragment ID
+#define FUZZ_PRINTED                8      // disagreements printed
+#define CRC_MAX_LEN                 65536  // bytes of the buffers checked
+#define CRC_ALIGN                   64     // offsets the buffers checked start at
+#define CRC_VOLUME                  (1 << 28) // bytes timed per length
+
+#define BENCH_GEN  0x1
+#define BENCH_SINK 0x2
+#define BENCH_CLASSIFY 0x4
+#define BENCH_FUZZ 0x8
+#define BENCH_CRC 0x10
+
+struct bench_params
+{
+	int mode;
+
+	// The generator sends from encap.local to encap.remote, the sink receives
+	// on decap.local from decap.remote
+	struct process_encap_params encap;
+	struct process_decap_params decap;
+
+	struct bench_sizes sizes;
+	struct bench_dscp dscp;
+	unsigned long rate;
+	unsigned long count;
+	unsigned long duration;
+
+	// Flow classifier alone
+	unsigned long flows;
+	unsigned int workers;
+};
+
+/**
+ * Measure of a side of the benchmark
+ */
+struct bench_run
+{
+	uint64_t frames;
+	uint64_t bytes;
+	uint64_t wall_ns; // from the first to the last frame
+	uint64_t cpu_ns;
+	double cycles_per_ns;
+};
+
+/**
+ * Clocks read at the start of a side
+ */
+struct bench_clock
+{
+	uint64_t wall_ns;
+	uint64_t cpu_ns;
+	uint64_t tsc;
+};
+
+struct bench_ctxt
+{
+	struct bench_params *params;
+
+	struct encap_send_ctxt *encap;
+	struct bench_gen gen;
+	struct bench_run gen_run;
+	atomic_int gen_done;
+
+	struct decap_ctxt *decap;
+	struct bench_sink sink;
+	struct bench_run sink_run;
+	uint64_t first_ns;
+	uint64_t last_ns;
+};
+
+atomic_int alive;
+void sighandler(__attribute__((unused)) int sig) { alive = 1; }
+
+/**
+ * Print help message
+ */
+void usage()
+{
+	fprintf(stdout, "Usage: satbench [-m MODE] [-l GEN_ADDR_PORT] [-r SINK_ADDR_PORT]\n");
+	fprintf(stdout, "                [-s SIZES] [-d DSCP_MIX] [-g RATE] [-n COUNT] [-T DURATION]\n");
+	fprintf(stdout, "                [-p PAYLOAD_LEN] [-F FRAG_IDS] [-O SCHED_POLICY]\n");
+	fprintf(stdout, "                [-S REORDER_WINDOW] [-E FEC]\n");
+	fprintf(stdout, "                [-R REASM_BUFFERS] [-t READ_TIMEOUT]\n");
+	fprintf(stdout, "                [-f FLOWS] [-w WORKERS]\n");
+	fprintf(stdout, "                [-h]\n");
+	fprintf(stdout, "\n    Generate synthetic Ethernet/IPv4/UDP frames into the encapsulation engine and check them out of the\n");
+	fprintf(stdout, "    de-encapsulation engine, through an UDP tunnel which needs neither a TAP interface nor privileges\n");
+	fprintf(stdout, "\n    Optional arguments\n");
+	fprintf(stdout, "        MODE              \"gen\" to only send, \"sink\" to only receive, \"both\" to run the generator and the sink on two threads, \"classify\" to only measure the flow classifier steering the PDUs of \"satencap -w\" and check its batches against the frame at a time parser, \"fuzz\" to check the decoder of the complete GSE packets of satdecap against libGSE on random frames of PAYLOAD_LEN bytes, \"crc\" to check the CRC-32 of the fragmented PDUs against the table and measure it (default: %s)\n", DEFAULT_MODE);
+	fprintf(stdout, "        GEN_ADDR_PORT     the address and port the generator sends from (format: \"ADDRESS:PORT\", default: %s)\n", DEFAULT_GEN_ADDR);
+	fprintf(stdout, "        SINK_ADDR_PORT    the address and port the sink receives on (format: \"ADDRESS:PORT\", default: %s)\n", DEFAULT_SINK_ADDR);
+	fprintf(stdout, "        SIZES             the Ethernet frame lengths, from %u to %u bytes (format: \"LEN\", \"MIN-MAX\", \"LEN:WEIGHT,...\" or \"imix\", default: %s)\n", BENCH_MIN_FRAME_LEN, BENCH_MAX_FRAME_LEN, DEFAULT_SIZES);
+	fprintf(stdout, "        DSCP_MIX          the DSCP values of the frames (format: \"DSCP:WEIGHT,...\", default: %s)\n", DEFAULT_DSCP);
+	fprintf(stdout, "        RATE              the frames generated per second. Set 0 to generate as fast as possible (default: %u)\n", DEFAULT_RATE);
+	fprintf(stdout, "        COUNT             the frames to generate. Set 0 to only stop after DURATION (default: %u)\n", DEFAULT_COUNT);
+	fprintf(stdout, "        DURATION          the generation duration (ms) (default: %u)\n", DEFAULT_DURATION);
+	fprintf(stdout, "        PAYLOAD_LEN       the size (bytes) of the UDP tunnel payload. Set 0 to send a single GSE packet per frame (default: %u)\n", DEFAULT_PAYLOAD_LENGTH);
+	fprintf(stdout, "        FRAG_IDS          the number of fragment IDs used to interleave the PDUs, from 1 to %u (default: %u)\n", MAX_FRAG_ID_COUNT, DEFAULT_FRAG_COUNT);
+	fprintf(stdout, "        SCHED_POLICY      the order the packets of the interleaved PDUs are sent in (format: \"rr\" or \"shortest\", default: %s)\n", DEFAULT_SCHED_POLICY);
+	fprintf(stdout, "        REORDER_WINDOW    the number of frames the sink buffers to put the frames back in sequence, it sends the tunnel header when not 0 (default: %u)\n", DEFAULT_REORDER_WINDOW);
+	fprintf(stdout, "        FEC               the parity frames sent after each block of K frames (format: \"xor:K\" or \"rs:K:M\"), implies REORDER_WINDOW\n");
+	fprintf(stdout, "        REASM_BUFFERS     the number of buffers the sink reassembles the fragmented PDUs in. Set 0 to let libGSE reassemble the PDUs (default: %u)\n", DEFAULT_REASM_SLOTS);
+	fprintf(stdout, "        READ_TIMEOUT      the timeout (ms) of the sink waiting for frames (default: %u)\n", DEFAULT_READ_TIMEOUT);
+	fprintf(stdout, "        FLOWS             the flows the frames are drawn among, with MODE \"classify\" (default: %u)\n", DEFAULT_FLOWS);
+	fprintf(stdout, "        WORKERS           the workers the flows are steered to, with MODE \"classify\", up to %u (default: %u)\n", MAX_ENCAP_WORKERS, DEFAULT_WORKERS);
+}
+
+/**
+ * Parse benchmark parameters
+ *
+ * Return 0 on success, 1 when help is required, -1 on error
+ */
+int parse_arguments(int argc, char** argv, struct bench_params* params)
+{
+	unsigned int shift = 0;
+	const unsigned int error_flag = 1 << ++shift;
+	const unsigned int help_flag = 1 << ++shift;
+
+	const unsigned int mode_flag = 1 << ++shift;
+	const unsigned int gen_addr_flag = 1 << ++shift;
+	const unsigned int sink_addr_flag = 1 << ++shift;
+
+	const unsigned int sizes_flag = 1 << ++shift;
+	const unsigned int dscp_flag = 1 << ++shift;
+	const unsigned int rate_flag = 1 << ++shift;
+	const unsigned int count_flag = 1 << ++shift;
+	const unsigned int duration_flag = 1 << ++shift;
+
+	const unsigned int payload_len_flag = 1 << ++shift;
+	const unsigned int frag_count_flag = 1 << ++shift;
+	const unsigned int sched_policy_flag = 1 << ++shift;
+
+	const unsigned int reorder_window_flag = 1 << ++shift;
+	const unsigned int fec_flag = 1 << ++shift;
+
+	const unsigned int reasm_slots_flag = 1 << ++shift;
+	const unsigned int read_timeout_flag = 1 << ++shift;
+
+	const unsigned int flows_flag = 1 << ++shift;
+	const unsigned int workers_flag = 1 << ++shift;
+
+	unsigned int flags = 0;
+	int c;
+	unsigned long val;
+
+	memset(params, 0, sizeof(struct bench_params));
+	label_filter_init(&(params->decap.filter));
+	while((flags & error_flag) == 0 && (flags & help_flag) == 0 && (c = getopt(argc, argv, "hm:l:r:s:d:g:n:T:p:F:O:S:E:R:t:f:w:")) != -1)
+	{
+		switch(c)
+		{
+			case 'h':
+			flags |= help_flag;
+			break;
+
+			case 'm':
+			if(strcmp(optarg, "gen") == 0)
+			{
+				params->mode = BENCH_GEN;
+			}
+			else if(strcmp(optarg, "sink") == 0)
+			{
+				params->mode = BENCH_SINK;
+			}
+			else if(strcmp(optarg, "both") == 0)
+			{
+				params->mode = BENCH_GEN | BENCH_SINK;
+			}
+			else if(strcmp(optarg, "classify") == 0)
+			{
+				params->mode = BENCH_CLASSIFY;
+			}
+			else if(strcmp(optarg, "fuzz") == 0)
+			{
+				params->mode = BENCH_FUZZ;
+			}
+			else if(strcmp(optarg, "crc") == 0)
+			{
+				params->mode = BENCH_CRC;
+			}
+			else
+			{
+				fprintf(stderr, "Invalid mode \"%s\": must be \"gen\", \"sink\", \"both\", \"classify\", \"fuzz\" or \"crc\"\n", optarg);
+				flags |= error_flag;
+				break;
+			}
+			flags |= mode_flag;
+			break;
+
+			case 'l':
+			if(parse_udp_arguments(optarg, &(params->encap.local)) != 0)
+			{
+				fprintf(stderr, "Invalid generator address and port \"%s\" (format: \"ADDRESS:PORT\")\n", optarg);
+				flags |= error_flag;
+				break;
+			}
+			flags |= gen_addr_flag;
+			break;
+
+			case 'r':
+			if(parse_udp_arguments(optarg, &(params->encap.remote)) != 0)
+			{
+				fprintf(stderr, "Invalid sink address and port \"%s\" (format: \"ADDRESS:PORT\")\n", optarg);
+				flags |= error_flag;
+				break;
+			}
+			flags |= sink_addr_flag;
+			break;
+
+			case 's':
+			if(bench_parse_sizes(optarg, &(params->sizes)) != 0)
+			{
+				fprintf(stderr, "Invalid frame lengths \"%s\" (format: \"LEN\", \"MIN-MAX\", \"LEN:WEIGHT,...\" or \"imix\", LEN from %u to %u)\n", optarg, BENCH_MIN_FRAME_LEN, BENCH_MAX_FRAME_LEN);
+				flags |= error_flag;
+				break;
+			}
+			flags |= sizes_flag;
+			break;
+
+			case 'd':
+			if(bench_parse_dscp(optarg, &(params->dscp)) != 0)
+			{
+				fprintf(stderr, "Invalid DSCP mix \"%s\" (format: \"DSCP:WEIGHT,...\", DSCP from 0 to 63, at most %u values)\n", optarg, BENCH_MAX_DSCPS);
+				flags |= error_flag;
+				break;
+			}
+			flags |= dscp_flag;
+			break;
+
+			case 'g':
+			if(parse_unsigned_long(optarg, &val) != 0)
+			{
+				fprintf(stderr, "Invalid rate \"%s\": the value must be an unsigned long in frames per second\n", optarg);
+				flags |= error_flag;
+				break;
+			}
+			params->rate = val;
+			flags |= rate_flag;
+			break;
+
+			case 'n':
+			if(parse_unsigned_long(optarg, &val) != 0)
+			{
+				fprintf(stderr, "Invalid frame count \"%s\": the value must be an unsigned long\n", optarg);
+				flags |= error_flag;
+				break;
+			}
+			params->count = val;
+			flags |= count_flag;
+			break;
+
+			case 'T':
+			if(parse_unsigned_long(optarg, &val) != 0)
+			{
+				fprintf(stderr, "Invalid duration \"%s\": the value must be an unsigned long in milliseconds\n", optarg);
+				flags |= error_flag;
+				break;
+			}
+			params->duration = val;
+			flags |= duration_flag;
+			break;
+
+			case 'p':
+			if(parse_unsigned_long(optarg, &val) != 0 || val > UINT_MAX)
+			{
+				fprintf(stderr, "Invalid payload length \"%s\": the value must be an unsigned int in bytes\n", optarg);
+				flags |= error_flag;
+				break;
+			}
+			params->encap.payload_len = val;
+			flags |= payload_len_flag;
+			break;
+
+			case 'F':
+			if(parse_unsigned_long(optarg, &val) != 0 || val == 0 || val > MAX_FRAG_ID_COUNT)
+			{
+				fprintf(stderr, "Invalid fragment IDs count \"%s\": the value must be between 1 and %u\n", optarg, MAX_FRAG_ID_COUNT);
+				flags |= error_flag;
+				break;
+			}
+			params->encap.frag_count = val;
+			flags |= frag_count_flag;
+			break;
+
+			case 'O':
+			if(encap_sched_parse_policy(optarg, &(params->encap.sched_policy)) != 0)
+			{
+				fprintf(stderr, "Invalid scheduler policy \"%s\": must be \"rr\" or \"shortest\"\n", optarg);
+				flags |= error_flag;
+				break;
+			}
+			flags |= sched_policy_flag;
+			break;
+
+			case 'S':
+			if(parse_unsigned_long(optarg, &val) != 0 || val > INT_MAX)
+			{
+				fprintf(stderr, "Invalid reorder window \"%s\": the value must be an unsigned int in frames\n", optarg);
+				flags |= error_flag;
+				break;
+			}
+			params->decap.reorder_window = val;
+			flags |= reorder_window_flag;
+			break;
+
+			case 'E':
+			if(fec_parse(optarg, &(params->encap.fec_scheme), &(params->encap.fec_k), &(params->encap.fec_m)) != 0)
+			{
+				fprintf(stderr, "Invalid FEC \"%s\" (format: \"xor:K\" or \"rs:K:M\", K up to %u, M up to %u)\n", optarg, FEC_MAX_DATA, FEC_MAX_PARITY);
+				flags |= error_flag;
+				break;
+			}
+			flags |= fec_flag;
+			break;
+
+			case 'R':
+			if(parse_unsigned_long(optarg, &val) != 0 || val > INT_MAX)
+			{
+				fprintf(stderr, "Invalid reassembly buffers count \"%s\": the value must be an unsigned int\n", optarg);
+				flags |= error_flag;
+				break;
+			}
+			params->decap.reasm_slots = val;
+			flags |= reasm_slots_flag;
+			break;
+
+			case 't':
+			if(parse_unsigned_long(optarg, &val) != 0 || val == 0)
+			{
+				fprintf(stderr, "Invalid reading timeout \"%s\": the value must be a strictly positive unsigned long in milliseconds\n", optarg);
+				flags |= error_flag;
+				break;
+			}
+			set_time(val, &(params->decap.read_timeout));
+			flags |= read_timeout_flag;
+			break;
+
+			case 'f':
+			if(parse_unsigned_long(optarg, &val) != 0 || val == 0)
+			{
+				fprintf(stderr, "Invalid flows count \"%s\": the value must be a strictly positive unsigned long\n", optarg);
+				flags |= error_flag;
+				break;
+			}
+			params->flows = val;
+			flags |= flows_flag;
+			break;
+
+			case 'w':
+			if(parse_unsigned_long(optarg, &val) != 0 || val == 0 || val > MAX_ENCAP_WORKERS)
+			{
+				fprintf(stderr, "Invalid workers count \"%s\": the value must be between 1 and %u\n", optarg, MAX_ENCAP_WORKERS);
+				flags |= error_flag;
+				break;
+			}
+			params->workers = val;
+			flags |= workers_flag;
+			break;
+
+			case '?':
+			fprintf(stderr, "Invalid argument option \"%c\"\n", c);
+			flags |= error_flag;
+			break;
+
+			default:
+			fprintf(stderr, "Invalid arguments\n");
+			flags |= error_flag;
+			break;
+		}
+	}
+	if((flags & help_flag) != 0)
+	{
+		return 1;
+	}
+	if((flags & error_flag) != 0)
+	{
+		return -1;
+	}
+
+	// Check optional arguments
+	if((flags & mode_flag) == 0)
+	{
+		params->mode = BENCH_GEN | BENCH_SINK;
+	}
+	if((flags & gen_addr_flag) == 0)
+	{
+		parse_udp_arguments(DEFAULT_GEN_ADDR, &(params->encap.local));
+	}
+	if((flags & sink_addr_flag) == 0)
+	{
+		parse_udp_arguments(DEFAULT_SINK_ADDR, &(params->encap.remote));
+	}
+	if((flags & sizes_flag) == 0)
+	{
+		bench_parse_sizes(DEFAULT_SIZES, &(params->sizes));
+	}
+	if((flags & dscp_flag) == 0)
+	{
+		bench_parse_dscp(DEFAULT_DSCP, &(params->dscp));
+	}
+	if((flags & rate_flag) == 0)
+	{
+		params->rate = DEFAULT_RATE;
+	}
+	if((flags & count_flag) == 0)
+	{
+		params->count = DEFAULT_COUNT;
+	}
+	if((flags & duration_flag) == 0)
+	{
+		params->duration = DEFAULT_DURATION;
+	}
+	if((flags & payload_len_flag) == 0)
+	{
+		params->encap.payload_len = DEFAULT_PAYLOAD_LENGTH;
+	}
+	if(params->encap.payload_len != 0 && params->encap.payload_len < MIN_ENCAP_FRAME_SIZE)
+	{
+		fprintf(stderr, "Invalid payload length: at least %u bytes\n", MIN_ENCAP_FRAME_SIZE);
+		return -1;
+	}
+	if((flags & frag_count_flag) == 0)
+	{
+		params->encap.frag_count = DEFAULT_FRAG_COUNT;
+	}
+	if((flags & sched_policy_flag) == 0)
+	{
+		encap_sched_parse_policy(DEFAULT_SCHED_POLICY, &(params->encap.sched_policy));
+	}
+	if((flags & reorder_window_flag) == 0)
+	{
+		params->decap.reorder_window = DEFAULT_REORDER_WINDOW;
+	}
+	if((flags & fec_flag) != 0)
+	{
+		// Keep the frames of two blocks to rebuild the lost ones
+		params->decap.fec_history = 2 * (params->encap.fec_k + params->encap.fec_m);
+		if(params->decap.reorder_window < params->decap.fec_history)
+		{
+			params->decap.reorder_window = params->decap.fec_history;
+		}
+	}
+	if((flags & reasm_slots_flag) == 0)
+	{
+		params->decap.reasm_slots = DEFAULT_REASM_SLOTS;
+	}
+	if((flags & read_timeout_flag) == 0)
+	{
+		set_time(DEFAULT_READ_TIMEOUT, &(params->decap.read_timeout));
+	}
+	if((flags & flows_flag) == 0)
+	{
+		params->flows = DEFAULT_FLOWS;
+	}
+	if((flags & workers_flag) == 0)
+	{
+		params->workers = DEFAULT_WORKERS;
+	}
+
+	// Both sides of the tunnel
+	params->encap.read_timeout = params->decap.read_timeout;
+	params->encap.seq_header = params->decap.reorder_window > 0;
+	params->decap.local = params->encap.remote;
+	params->decap.remote = params->encap.local;
+	params->decap.payload_len = params->encap.payload_len != 0 ? params->encap.payload_len : GSE_MAX_PACKET_LENGTH;
+	params->decap.buffer_len = BENCH_MAX_FRAME_LEN;
+	set_time(DEFAULT_REORDER_TIMEOUT, &(params->decap.reorder_timeout));
+	set_time(DEFAULT_REASM_TIMEOUT, &(params->decap.reasm_timeout));
+
+	return 0;
+}
+
+void clock_start(struct bench_clock *clock)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+	clock->cpu_ns = (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+	clock->wall_ns = monotonic_ns();
+#ifdef BENCH_TSC
+	clock->tsc = __rdtsc();
+#endif
+}
+
+void clock_stop(struct bench_clock *clock, struct bench_run *run)
+{
+	struct timespec now;
+	uint64_t wall_ns;
+
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+	run->cpu_ns = (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec - clock->cpu_ns;
+	wall_ns = monotonic_ns() - clock->wall_ns;
+	run->cycles_per_ns = 0;
+#ifdef BENCH_TSC
+	// The TSC ticks at the nominal frequency of the CPU
+	if(wall_ns > 0)
+	{
+		run->cycles_per_ns = (double)(__rdtsc() - clock->tsc) / wall_ns;
+	}
+#else
+	(void)wall_ns;
+#endif
+}
+
+void print_run(const char *name, struct bench_run *run)
+{
+	double secs = run->wall_ns / 1e9;
+
+	fprintf(stdout, "%s\n", name);
+	fprintf(stdout, "  - frames:     %lu frames, %lu bytes in %.3f s\n", run->frames, run->bytes, secs);
+	if(run->frames == 0 || secs <= 0)
+	{
+		return;
+	}
+	fprintf(stdout, "  - throughput: %.0f pps, %.3f Gbit/s\n", run->frames / secs, run->bytes * 8 / secs / 1e9);
+	fprintf(stdout, "  - CPU:        %.1f%% of a core, %.0f ns/frame", 100.0 * run->cpu_ns / run->wall_ns,
+	        (double)run->cpu_ns / run->frames);
+	if(run->cycles_per_ns > 0)
+	{
+		fprintf(stdout, ", %.0f cycles/frame", run->cycles_per_ns * run->cpu_ns / run->frames);
+	}
+	fprintf(stdout, "\n");
+}
+
+/**
+ * Give a new frame to the encapsulation engine
+ *
+ * Return 0 on success, -1 otherwise
+ */
+int generate_frame(struct bench_ctxt *bench)
+{
+	static uint8_t label[6] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x02};
+	gse_vfrag_t *vfrag_pdu = NULL;
+	size_t len;
+	int ret;
+
+	ret = gse_create_vfrag(&vfrag_pdu, BENCH_MAX_FRAME_LEN, GSE_MAX_HEADER_LENGTH, GSE_MAX_TRAILER_LENGTH);
+	if(ret > GSE_STATUS_OK)
+	{
+		fprintf(stderr, "Error when creating PDU virtual fragment (%s)\n", gse_get_status(ret));
+		return -1;
+	}
+	len = bench_gen_frame(&(bench->gen), gse_get_vfrag_start(vfrag_pdu), monotonic_ns());
+	ret = gse_set_vfrag_length(vfrag_pdu, len);
+	if(ret > GSE_STATUS_OK)
+	{
+		fprintf(stderr, "Error when setting fragment length: %s\n", gse_get_status(ret));
+		gse_free_vfrag(&vfrag_pdu);
+		return -1;
+	}
+	return encap_pdu(bench->encap, vfrag_pdu, 0, label, &(bench->params->encap.remote));
+}
+
+/**
+ * Generate the frames at the requested rate, the same way process_encap
+ * reads them from the TAP interface
+ */
+void *generate(void *arg)
+{
+	struct bench_ctxt *bench = (struct bench_ctxt *)arg;
+	struct bench_params *params = bench->params;
+	struct encap_sched *sched = bench->encap->sched;
+	struct bench_clock clock;
+	struct timespec wait;
+	uint64_t start, end, now, due;
+
+	clock_start(&clock);
+	start = clock.wall_ns;
+	end = start + params->duration * 1000000;
+	now = start;
+	while(alive == 0 && now < end && (params->count == 0 || bench->gen.seq < params->count))
+	{
+		// Hold the next frame back until it is due, sleeping when no frame
+		// is left to send
+		due = params->rate == 0 ? now : start + (uint64_t)(bench->gen.seq * (1e9 / params->rate));
+		if(sched->busy_count < sched->count && due <= now)
+		{
+			if(generate_frame(bench) != 0)
+			{
+				alive = -1;
+				break;
+			}
+		}
+		else if(sched->busy_count == 0)
+		{
+			wait.tv_sec = (due - now) / 1000000000;
+			wait.tv_nsec = (due - now) % 1000000000;
+			nanosleep(&wait, NULL);
+		}
+		if(sched->busy_count > 0)
+		{
+			send_frame(bench->encap);
+		}
+		now = monotonic_ns();
+	}
+
+	// Send the last PDUs in flight and their parity
+	while(alive >= 0 && sched->busy_count > 0)
+	{
+		send_frame(bench->encap);
+	}
+	flush_parity(bench->encap);
+
+	clock_stop(&clock, &(bench->gen_run));
+	bench->gen_run.wall_ns = monotonic_ns() - start;
+	bench->gen_run.frames = bench->gen.seq;
+	bench->gen_run.bytes = bench->gen.bytes;
+	atomic_store(&(bench->gen_done), 1);
+	return NULL;
+}
+
+int sink_pdu(struct decap_pdu *pdu, void *arg)
+{
+	struct bench_ctxt *bench = (struct bench_ctxt *)arg;
+	uint64_t now = monotonic_ns();
+
+	bench_sink_frame(&(bench->sink), pdu->data, pdu->len, now);
+	release_pdu(bench->decap, pdu);
+	if(bench->first_ns == 0)
+	{
+		bench->first_ns = now;
+	}
+	bench->last_ns = now;
+	return 0;
+}
+
+/**
+ * Receive the frames until the generator is done and the tunnel is idle, the
+ * same way process_decap writes them to the TAP interface
+ */
+int sink(struct bench_ctxt *bench)
+{
+	struct decap_ctxt *ctxt = bench->decap;
+	struct bench_clock clock;
+	unsigned char *data_received;
+	size_t len_received;
+	uint64_t idle_ms = 0;
+	fd_set fds, readfds;
+	int nfds;
+	int ret;
+
+	if((data_received = (unsigned char *)malloc(ctxt->recv_len)) == NULL)
+	{
+		return -1;
+	}
+	FD_ZERO(&fds);
+	FD_SET(ctxt->udp_fd, &fds);
+	nfds = ctxt->udp_fd + 1;
+
+	clock_start(&clock);
+	while(alive == 0)
+	{
+		readfds = fds;
+		ret = pselect(nfds, &readfds, NULL, NULL, &(ctxt->timeout), &(ctxt->sigmask));
+		if(ret == 0)
+		{
+			expire_pdus(ctxt);
+			if(flush_frames(ctxt, sink_pdu, bench) != 0)
+			{
+				alive = -1;
+			}
+			// A lone sink stops a while after the traffic ended
+			idle_ms += time_to_long(ctxt->timeout);
+			if((bench->params->mode & BENCH_GEN) != 0 ? atomic_load(&(bench->gen_done)) != 0 :
+			   bench->sink.received > 0 && idle_ms >= SINK_IDLE_STOP)
+			{
+				break;
+			}
+			continue;
+		}
+		else if(ret < 0)
+		{
+			fprintf(stderr, "[Sink] Function pselect failed: %s (%d)\n", strerror(errno), errno);
+			alive = -1;
+			break;
+		}
+		idle_ms = 0;
+
+		if((ret = read_udp(ctxt->udp_fd, &(ctxt->remote), ctxt->recv_len, data_received, &len_received)) < 0)
+		{
+			alive = -1;
+			break;
+		}
+		else if(ret > 0 || len_received == 0)
+		{
+			continue;
+		}
+		if(decap_datagram(ctxt, data_received, len_received, sink_pdu, bench) != 0)
+		{
+			alive = -1;
+		}
+	}
+	clock_stop(&clock, &(bench->sink_run));
+	free(data_received);
+
+	bench->sink_run.wall_ns = bench->last_ns - bench->first_ns;
+	bench->sink_run.frames = bench->sink.received;
+	bench->sink_run.bytes = bench->sink.bytes;
+	return alive >= 0 ? 0 : -1;
+}
+
+/**
+ * Damage a copy of a frame to check the classifiers on: truncate it, and
+ * overwrite some bytes of its headers, often with the values their parsers
+ * branch on
+ *
+ * Return the length of the copy
+ */
+size_t damage_frame(struct bench_gen *gen, const unsigned char *frame, size_t len, unsigned char *copy)
+{
+	static const uint8_t values[] = {0x00, 0x05, 0x06, 0x08, 0x11, 0x2b, 0x2c, 0x33, 0x3c, 0x45,
+	                                 0x4f, 0x60, 0x81, 0x84, 0x86, 0x88, 0x91, 0xa8, 0xdd, 0xff};
+	uint64_t r = bench_rand(&(gen->rand));
+	unsigned int i;
+
+	memcpy(copy, frame, len);
+	for(i = 0; i < CLASSIFY_DAMAGES; i++, r >>= 16)
+	{
+		copy[(r & 0xff) % CLASSIFY_DAMAGED] =
+		    (r & 0x100) != 0 ? values[((r >> 9) & 0x7f) % sizeof(values)] : (r >> 8) & 0xff;
+	}
+	if(r % 4 == 0)
+	{
+		len = (r >> 2) % (len + 1);
+	}
+	return len;
+}
+
+/**
+ * Count the frames two classifications of the same batch disagree on, and
+ * print the first ones
+ */
+unsigned int classify_disagreements(const struct flow_batch *batch, const struct flow_batch *reference,
+                                    uint64_t errors)
+{
+	unsigned int i, count = 0;
+
+	for(i = 0; i < reference->count; i++)
+	{
+		if(batch->level[i] == reference->level[i] && batch->version[i] == reference->version[i] &&
+		   batch->proto[i] == reference->proto[i] && batch->dscp[i] == reference->dscp[i] &&
+		   batch->pcp[i] == reference->pcp[i] && batch->vlan_count[i] == reference->vlan_count[i] &&
+		   batch->tuple_len[i] == reference->tuple_len[i] && batch->ether_type[i] == reference->ether_type[i] &&
+		   batch->sport[i] == reference->sport[i] && batch->dport[i] == reference->dport[i] &&
+		   batch->hash[i] == reference->hash[i] &&
+		   memcmp(batch->tuple[i], reference->tuple[i], FLOW_TUPLE_MAX) == 0)
+		{
+			continue;
+		}
+		if(errors + count++ < FUZZ_PRINTED)
+		{
+			fprintf(stdout, "Frame %u: level %u, type %04x, proto %u, ports %u-%u, hash %08x, reference level %u, type "
+			        "%04x, proto %u, ports %u-%u, hash %08x\n", i, batch->level[i], batch->ether_type[i],
+			        batch->proto[i], batch->sport[i], batch->dport[i], batch->hash[i], reference->level[i],
+			        reference->ether_type[i], reference->proto[i], reference->sport[i], reference->dport[i],
+			        reference->hash[i]);
+		}
+	}
+	return count;
+}
+
+/**
+ * Classify frames drawn among many flows and steer them to workers, the way
+ * the reader of process_encap does, and report the cost per frame and the
+ * spread of the load. The batch classifier is timed against flow_key_parse,
+ * and checked against it on the frames drawn and on damaged copies.
+ *
+ * Return 0 on success, -1 on init error, -2 on disagreement
+ */
+int run_classify(struct bench_params *params)
+{
+	struct flow_hasher *hasher;
+	struct flow_steer steer;
+	struct flow_key key;
+	struct flow_batch batch, reference;
+	struct bench_gen gen;
+	unsigned char *pool, *damaged;
+	const unsigned char *frames[CLASSIFY_POOL];
+	const unsigned char *copies[FLOW_BATCH_MAX];
+	size_t lens[CLASSIFY_POOL];
+	size_t copy_lens[FLOW_BATCH_MAX];
+	uint64_t loads[MAX_ENCAP_WORKERS];
+	uint64_t scalar_loads[MAX_ENCAP_WORKERS];
+	uint64_t levels[flow_l4 + 1];
+	uint64_t start, end, t0, classify_ns = 0, scalar_ns = 0, min, max, checks = 0, errors = 0;
+	unsigned int i, j;
+#ifdef BENCH_TSC
+	uint64_t tsc, cycles = 0;
+#endif
+
+	hasher = (struct flow_hasher *)malloc(sizeof(struct flow_hasher));
+	pool = (unsigned char *)malloc(CLASSIFY_POOL * BENCH_FLOW_FRAME_LEN);
+	damaged = (unsigned char *)malloc(FLOW_BATCH_MAX * BENCH_FLOW_FRAME_LEN);
+	if(hasher == NULL || pool == NULL || damaged == NULL)
+	{
+		free(damaged);
+		free(pool);
+		free(hasher);
+		return -1;
+	}
+	flow_hasher_init(hasher, flow_rss_key);
+	flow_steer_init(&steer, params->workers);
+	flow_batch_init();
+	bench_gen_init(&gen, &(params->sizes), &(params->dscp));
+	memset(loads, 0, sizeof(loads));
+	memset(scalar_loads, 0, sizeof(scalar_loads));
+	memset(levels, 0, sizeof(levels));
+	for(i = 0; i < CLASSIFY_POOL; i++)
+	{
+		frames[i] = pool + i * BENCH_FLOW_FRAME_LEN;
+	}
+	for(i = 0; i < FLOW_BATCH_MAX; i++)
+	{
+		copies[i] = damaged + i * BENCH_FLOW_FRAME_LEN;
+	}
+
+	signal(SIGTERM, sighandler);
+	signal(SIGINT, sighandler);
+	alive = 0;
+
+	// Only the classification is timed, not the generation of the frames
+	start = monotonic_ns();
+	end = start + params->duration * 1000000;
+	while(alive == 0 && monotonic_ns() < end && (params->count == 0 || gen.seq < params->count))
+	{
+		for(i = 0; i < CLASSIFY_POOL; i++)
+		{
+			lens[i] = bench_flow_frame(&gen, params->flows, pool + i * BENCH_FLOW_FRAME_LEN);
+		}
+
+		// A frame at a time, as the reference
+		t0 = monotonic_ns();
+		for(i = 0; i < CLASSIFY_POOL; i++)
+		{
+			flow_key_parse(frames[i], lens[i], &key);
+			scalar_loads[flow_steer_worker(&steer, flow_hash(hasher, &key))]++;
+		}
+		scalar_ns += monotonic_ns() - t0;
+
+		t0 = monotonic_ns();
+#ifdef BENCH_TSC
+		tsc = __rdtsc();
+#endif
+		for(i = 0; i < CLASSIFY_POOL; i += FLOW_BATCH_MAX)
+		{
+			flow_batch_classify(hasher, frames + i, lens + i, FLOW_BATCH_MAX, &batch);
+			for(j = 0; j < batch.count; j++)
+			{
+				levels[batch.level[j]]++;
+				loads[flow_steer_worker(&steer, batch.hash[j])]++;
+			}
+		}
+#ifdef BENCH_TSC
+		cycles += __rdtsc() - tsc;
+#endif
+		classify_ns += monotonic_ns() - t0;
+
+		// Batches of every size, of the frames drawn then of damaged copies
+		for(i = 0; i < CLASSIFY_POOL; i += FLOW_BATCH_MAX)
+		{
+			j = i / FLOW_BATCH_MAX % FLOW_BATCH_MAX + 1;
+			flow_batch_classify(hasher, frames + i, lens + i, j, &batch);
+			flow_batch_classify_scalar(hasher, frames + i, lens + i, j, &reference);
+			errors += classify_disagreements(&batch, &reference, errors);
+			for(j = 0; j < FLOW_BATCH_MAX; j++)
+			{
+				copy_lens[j] = damage_frame(&gen, frames[i + j], lens[i + j], damaged + j * BENCH_FLOW_FRAME_LEN);
+			}
+			flow_batch_classify(hasher, copies, copy_lens, FLOW_BATCH_MAX, &batch);
+			flow_batch_classify_scalar(hasher, copies, copy_lens, FLOW_BATCH_MAX, &reference);
+			errors += classify_disagreements(&batch, &reference, errors);
+			checks += reference.count + FLOW_BATCH_MAX;
+		}
+	}
+	// Both steered the frames alike
+	if(memcmp(loads, scalar_loads, sizeof(loads)) != 0)
+	{
+		errors++;
+	}
+
+	min = UINT64_MAX;
+	max = 0;
+	for(i = 0; i < params->workers; i++)
+	{
+		min = loads[i] < min ? loads[i] : min;
+		max = loads[i] > max ? loads[i] : max;
+	}
+	fprintf(stdout, "Classifier\n");
+	fprintf(stdout, "  - batches:    %s, %u frames each\n", flow_batch_impl_name(), FLOW_BATCH_MAX);
+	fprintf(stdout, "  - frames:     %lu frames drawn among %lu flows, classified in %.3f s\n", gen.seq,
+	        params->flows, classify_ns / 1e9);
+	if(gen.seq > 0 && classify_ns > 0)
+	{
+		fprintf(stdout, "  - throughput: %.0f pps, %.1f ns/frame", gen.seq / (classify_ns / 1e9),
+		        (double)classify_ns / gen.seq);
+#ifdef BENCH_TSC
+		fprintf(stdout, ", %.0f cycles/frame", (double)cycles / gen.seq);
+#endif
+		fprintf(stdout, ", %.1f ns/frame a frame at a time\n", (double)scalar_ns / gen.seq);
+		fprintf(stdout, "  - checks:     %lu frames, %lu disagreements with flow_key_parse\n", checks, errors);
+		fprintf(stdout, "  - hashed on:  %lu ports, %lu IP addresses, %lu MAC addresses\n", levels[flow_l4],
+		        levels[flow_l3], levels[flow_l2]);
+		fprintf(stdout, "  - steering:   %u workers, %.1f%% to %.1f%% of the frames each (%.1f%% even)\n",
+		        params->workers, 100.0 * min / gen.seq, 100.0 * max / gen.seq, 100.0 / params->workers);
+	}
+
+	free(damaged);
+	free(pool);
+	free(hasher);
+	return alive >= 0 && errors == 0 ? 0 : -2;
+}
+
+/**
+ * Walk random GSE frames, some of them corrupted, with both the decoder of the
+ * complete packets of decap_frame and libGSE, and check they agree on every
+ * PDU handed in place and on the padding
+ *
+ * Return 0 on agreement, -1 on init error, -2 on disagreement
+ */
+int run_fuzz(struct bench_params *params)
+{
+	gse_deencap_t *decap;
+	gse_vfrag_t *vfrag, *pdu;
+	struct gse_header hdr;
+	struct bench_gen gen;
+	unsigned char *frame;
+	size_t len, off;
+	uint64_t end, complete = 0, fallback = 0, padding = 0, disagreements = 0;
+	uint8_t label_type, label[6];
+	uint16_t protocol, gse_length;
+	const char *error;
+	int native, ret;
+
+	len = params->encap.payload_len != 0 ? params->encap.payload_len : DEFAULT_PAYLOAD_LENGTH;
+	if((frame = (unsigned char *)malloc(len)) == NULL)
+	{
+		return -1;
+	}
+	if((ret = gse_deencap_init(FUZZ_FRAG_COUNT, &decap)) != GSE_STATUS_OK)
+	{
+		fprintf(stderr, "Deencapsulator initialization failed: %s (%d)\n", gse_get_status(ret), ret);
+		free(frame);
+		return -1;
+	}
+	bench_gen_init(&gen, &(params->sizes), &(params->dscp));
+
+	signal(SIGTERM, sighandler);
+	signal(SIGINT, sighandler);
+	alive = 0;
+
+	end = monotonic_ns() + params->duration * 1000000;
+	while(alive == 0 && monotonic_ns() < end && (params->count == 0 || gen.seq < params->count))
+	{
+		bench_gse_frame(&gen, frame, len);
+		off = 0;
+		while(off < len)
+		{
+			// Sorted as decap_frame does: padding, complete packet or libGSE
+			native = gse_parse_header(frame + off, len - off, &hdr);
+			if(native == 0 && !gse_complete_packet(&hdr))
+			{
+				native = -1;
+			}
+
+			pdu = NULL;
+			gse_length = 0;
+			if((ret = gse_create_vfrag_with_data(&vfrag, len - off, 0, 0, frame + off, len - off)) > GSE_STATUS_OK)
+			{
+				fprintf(stderr, "Virtual fragment creation failed: %s (%d)\n", gse_get_status(ret), ret);
+				alive = -1;
+				break;
+			}
+			ret = gse_deencap_packet(vfrag, decap, &label_type, label, &protocol, &pdu, &gse_length);
+
+			error = NULL;
+			if(native > 0 && ret != GSE_STATUS_PADDING_DETECTED)
+			{
+				error = "padding not detected by libGSE";
+			}
+			else if(native == 0 && ret != GSE_STATUS_PDU_RECEIVED)
+			{
+				error = "complete packet not received by libGSE";
+			}
+			else if(native == 0 && (gse_length != hdr.packet_len ||
+			                        gse_get_vfrag_length(pdu) != (size_t)(hdr.packet_len - hdr.header_len) ||
+			                        memcmp(gse_get_vfrag_start(pdu), frame + off + hdr.header_len,
+			                               hdr.packet_len - hdr.header_len) != 0))
+			{
+				error = "PDU differs";
+			}
+			else if(native == 0 && (protocol != hdr.protocol || label_type != hdr.label_type ||
+			                        memcmp(label, hdr.label, hdr.label_len) != 0))
+			{
+				error = "protocol or label differs";
+			}
+			if(error != NULL && disagreements++ < FUZZ_PRINTED)
+			{
+				fprintf(stdout, "Frame %lu at %zu: %s (libGSE: %s (%d))\n", gen.seq, off, error,
+				        gse_get_status(ret), ret);
+			}
+			if(pdu != NULL)
+			{
+				gse_free_vfrag(&pdu);
+			}
+
+			if(native > 0)
+			{
+				padding++;
+				break;
+			}
+			if(native == 0)
+			{
+				complete++;
+			}
+			else
+			{
+				fallback++;
+			}
+			// Past the packet both decoders parsed, or libGSE alone
+			if(gse_length == 0)
+			{
+				break;
+			}
+			off += gse_length;
+		}
+	}
+
+	fprintf(stdout, "GSE decoders\n");
+	fprintf(stdout, "  - frames:        %lu frames of %zu bytes\n", gen.seq, len);
+	fprintf(stdout, "  - packets:       %lu complete packets handed in place, %lu left to libGSE, %lu paddings\n",
+	        complete, fallback, padding);
+	fprintf(stdout, "  - disagreements: %lu\n", disagreements);
+
+	gse_deencap_release(decap);
+	free(frame);
+	return alive >= 0 && disagreements == 0 ? 0 : -2;
+}
+
+/**
+ * Check the CRC-32 implementation picked for the CPU against the table on
+ * random buffers, lengths, alignments and splits, then measure both
+ *
+ * Return 0 on agreement, -1 on init error, -2 on disagreement
+ */
+int run_crc(struct bench_params *params)
+{
+	static const size_t lens[] = {64, 1500, 9000, CRC_MAX_LEN};
+	struct bench_gen gen;
+	unsigned char *buffer, *data;
+	uint64_t end, r, checks = 0, errors = 0, t0, fast_ns, table_ns;
+	uint32_t crc, fast, table, sum = 0;
+	size_t len, split, i, n;
+
+	if((buffer = (unsigned char *)malloc(CRC_MAX_LEN + CRC_ALIGN)) == NULL)
+	{
+		return -1;
+	}
+	bench_gen_init(&gen, &(params->sizes), &(params->dscp));
+	for(i = 0; i < CRC_MAX_LEN + CRC_ALIGN; i++)
+	{
+		buffer[i] = bench_rand(&(gen.rand)) & 0xff;
+	}
+	crc32_init();
+
+	signal(SIGTERM, sighandler);
+	signal(SIGINT, sighandler);
+	alive = 0;
+
+	// Short buffers around the folding thresholds as often as long ones
+	end = monotonic_ns() + params->duration * 1000000;
+	while(alive == 0 && monotonic_ns() < end && (params->count == 0 || checks < params->count))
+	{
+		r = bench_rand(&(gen.rand));
+		data = buffer + r % CRC_ALIGN;
+		len = (r >> 8) % ((r >> 40) % 2 == 0 ? 256 : CRC_MAX_LEN);
+		split = len > 0 ? (r >> 24) % len : 0;
+		crc = r >> 32;
+
+		table = crc32_update_table(crc, data, len);
+		fast = crc32_update(crc, data, len);
+		if(fast != table || crc32_update(crc32_update(crc, data, split), data + split, len - split) != table)
+		{
+			if(errors++ < FUZZ_PRINTED)
+			{
+				fprintf(stdout, "CRC of %zu bytes at offset %zu split at %zu from %08x: %08x, table %08x\n",
+				        len, (size_t)(data - buffer), split, crc, fast, table);
+			}
+		}
+		checks++;
+	}
+
+	fprintf(stdout, "CRC-32\n");
+	fprintf(stdout, "  - implementation: %s\n", crc32_impl_name());
+	fprintf(stdout, "  - checks:         %lu buffers, %lu disagreements with the table\n", checks, errors);
+	for(i = 0; alive == 0 && i < sizeof(lens) / sizeof(lens[0]); i++)
+	{
+		t0 = monotonic_ns();
+		for(n = 0; n < CRC_VOLUME / lens[i]; n++)
+		{
+			sum ^= crc32_update(CRC32_INIT, buffer, lens[i]);
+		}
+		fast_ns = monotonic_ns() - t0;
+		t0 = monotonic_ns();
+		for(n = 0; n < CRC_VOLUME / lens[i]; n++)
+		{
+			sum ^= crc32_update_table(CRC32_INIT, buffer, lens[i]);
+		}
+		table_ns = monotonic_ns() - t0;
+		fprintf(stdout, "  - %5zu bytes:    %.2f GB/s, table %.2f GB/s\n", lens[i],
+		        (double)n * lens[i] / fast_ns, (double)n * lens[i] / table_ns);
+	}
+	// Both implementations gave each buffer the same CRC, the sum keeps the loops
+	if(sum != 0)
+	{
+		errors++;
+	}
+
+	free(buffer);
+	return alive >= 0 && errors == 0 ? 0 : -2;
+}
+
+/**
+ * Run the benchmark
+ *
+ * Return 0 on success, -1 on init error, -2 on run error
+ */
+int run_bench(struct bench_params *params)
+{
+	struct bench_ctxt bench;
+	sigset_t sigmask, oldmask;
+	pthread_t thread;
+	int ret = 0;
+
+	if(params->mode == BENCH_CLASSIFY)
+	{
+		return run_classify(params);
+	}
+	if(params->mode == BENCH_FUZZ)
+	{
+		return run_fuzz(params);
+	}
+	if(params->mode == BENCH_CRC)
+	{
+		return run_crc(params);
+	}
+	memset(&bench, 0, sizeof(struct bench_ctxt));
+	bench.params = params;
+	bench_gen_init(&(bench.gen), &(params->sizes), &(params->dscp));
+	if(bench_sink_init(&(bench.sink)) != 0)
+	{
+		return -1;
+	}
+	if((params->mode & BENCH_GEN) != 0 && (bench.encap = create_send_ctxt(&(params->encap))) == NULL)
+	{
+		bench_sink_release(&(bench.sink));
+		return -1;
+	}
+	if((params->mode & BENCH_SINK) != 0 && (bench.decap = create_ctxt(&(params->decap))) == NULL)
+	{
+		delete_send_ctxt(bench.encap);
+		bench_sink_release(&(bench.sink));
+		return -1;
+	}
+	if(tunnel_log_start() != 0)
+	{
+		delete_ctxt(bench.decap);
+		delete_send_ctxt(bench.encap);
+		bench_sink_release(&(bench.sink));
+		return -1;
+	}
+
+	// Add stop signals handler
+	signal(SIGTERM, sighandler);
+	signal(SIGINT, sighandler);
+
+	// Mask signals during interface polling
+	sigemptyset(&sigmask);
+	sigaddset(&sigmask, SIGTERM);
+	sigaddset(&sigmask, SIGINT);
+	if(bench.decap != NULL)
+	{
+		bench.decap->sigmask = sigmask;
+	}
+	alive = 0;
+
+	if(params->mode == BENCH_GEN)
+	{
+		generate(&bench);
+	}
+	else if(params->mode == BENCH_SINK)
+	{
+		ret = sink(&bench);
+	}
+	else
+	{
+		// The sink, in the calling thread, alone handles the stop signals
+		pthread_sigmask(SIG_BLOCK, &sigmask, &oldmask);
+		ret = pthread_create(&thread, NULL, generate, &bench);
+		pthread_sigmask(SIG_SETMASK, &oldmask, NULL);
+		if(ret != 0)
+		{
+			fprintf(stderr, "Function pthread_create failed: %s (%d)\n", strerror(ret), ret);
+			alive = -1;
+		}
+		else
+		{
+			ret = sink(&bench);
+			pthread_join(thread, NULL);
+			// The sink only sees the gaps before the last frame received
+			if(bench.gen.seq > bench.sink.next)
+			{
+				bench.sink.lost += bench.gen.seq - bench.sink.next;
+			}
+		}
+	}
+	log_ring_stop();
+
+	if((params->mode & BENCH_GEN) != 0)
+	{
+		print_run("Generator", &(bench.gen_run));
+	}
+	if((params->mode & BENCH_SINK) != 0)
+	{
+		print_run("Sink", &(bench.sink_run));
+		bench_sink_print_stats(&(bench.sink));
+		if(bench.decap->reasm != NULL)
+		{
+			reasm_print_stats(bench.decap->reasm);
+		}
+		if(bench.decap->reorder != NULL)
+		{
+			reorder_print_stats(bench.decap->reorder);
+		}
+		if(bench.decap->fec != NULL)
+		{
+			fec_decoder_print_stats(bench.decap->fec);
+		}
+	}
+
+	// Clean
+	delete_ctxt(bench.decap);
+	delete_send_ctxt(bench.encap);
+	bench_sink_release(&(bench.sink));
+
+	return ret == 0 && alive >= 0 ? 0 : -2;
+}
+
+/**
+ * Main function
+ *
+ * Return 0 on success, -1 on arguments error, -2 on run error
+ */
+int main(int argc, char** argv)
+{
+	struct bench_params params;
+	int ret;
+
+	// Parse arguments
+	if((ret = parse_arguments(argc, argv, &params)) != 0)
+	{
+		usage();
+		return ret > 0 ? 0 : -1;
+	}
+
+	// Run benchmark
+	if(run_bench(&params) != 0)
+	{
+		return -2;
+	}
+	return 0;
+}
@@ -18,6 +18,12 @@
 #define DEFAULT_PAYLOAD_LENGTH      1500   // bytes
 #define DEFAULT_BUFFER_LENGTH       8192   // bytes
 #define DEFAULT_READ_TIMEOUT        100    // ms
+#define DEFAULT_RING_LENGTH         0      // frames
+#define DEFAULT_REORDER_WINDOW      0      // frames
+#define DEFAULT_REORDER_TIMEOUT     50     // ms
+#define DEFAULT_FEC_HISTORY         0      // frames
+#define DEFAULT_REASM_SLOTS         0      // buffers
+#define DEFAULT_REASM_TIMEOUT       1000   // ms
 
 /**
  * Print help message
@@ -25,18 +31,44 @@
 void usage()
 {
 	fprintf(stdout, "Usage: satdecap -i TAP_IFACE -l LOCAL_ADDR_PORT -r REMOTE_ADDR_PORT\n");
-	fprintf(stdout, "                [-p PAYLOAD_LEN]\n");
+	fprintf(stdout, "       satdecap -i TAP_IFACE -m SHM_RING\n");
+	fprintf(stdout, "                [-p PAYLOAD_LEN] [-H]\n");
 	fprintf(stdout, "                [-b BUFFER_LEN]\n");
 	fprintf(stdout, "                [-t READ_TIMEOUT]\n");
+	fprintf(stdout, "                [-P RING_LEN]\n");
+	fprintf(stdout, "                [-a CPUS] [-Q PRIORITY] [-B]\n");
+	fprintf(stdout, "                [-L LABEL]... [-y LABEL_TYPES]\n");
+	fprintf(stdout, "                [-S REORDER_WINDOW] [-D REORDER_TIMEOUT] [-E FEC_HISTORY]\n");
+	fprintf(stdout, "                [-R REASM_BUFFERS] [-T REASM_TIMEOUT]\n");
+	fprintf(stdout, "                [-C PERF_PERIOD] [-M]\n");
+	fprintf(stdout, "                [-U CONTROL_SOCKET] [-X HANDOFF_SOCKET]\n");
 	fprintf(stdout, "                [-h]\n");
 	fprintf(stdout, "\n    Required arguments\n");
 	fprintf(stdout, "        TAP_IFACE         the TAP interface which forwards outcoming IP packets\n");
 	fprintf(stdout, "        LOCAL_ADDR_PORT   the address and port to use as source of UDP tunnel (format: \"ADDRESS:PORT\")\n");
 	fprintf(stdout, "        REMOTE_ADDR_PORT  the address and port to use as destination of UDP tunnel (format: \"ADDRESS:PORT\")\n");
+	fprintf(stdout, "        SHM_RING          the name of the shared memory ring (/dev/shm/SHM_RING) to read the frames from instead of the UDP tunnel, written by \"satencap -m\" or a channel emulator, without RING_LEN only. The first side started creates it\n");
 	fprintf(stdout, "\n    Optional arguments\n");
 	fprintf(stdout, "        PAYLOAD_LEN       the max size (bytes) of incoming payload from the UDP tunnel (default: %u)\n", DEFAULT_PAYLOAD_LENGTH);
+	fprintf(stdout, "        -H                check and remove the DVB-S2 baseband header of each frame, sent by \"satencap -M -H\". Only the data field of the BBFrame is de-encapsulated, PAYLOAD_LEN must cover the longest BBFrame\n");
 	fprintf(stdout, "        BUFFER_LEN        the max size (bytes) of outcoming IP packet (default: %u))\n", DEFAULT_BUFFER_LENGTH);
 	fprintf(stdout, "        READ_TIMEOUT      the timeout (ms) to read incoming payload from the UDP tunnel (default: %u)\n", DEFAULT_READ_TIMEOUT);
+	fprintf(stdout, "        RING_LEN          the number of frames in flight between the UDP receiver, the de-encapsulator and the TAP writer running on separate threads. Set 0 to run all of them in a single thread (default: %u)\n", DEFAULT_RING_LENGTH);
+	fprintf(stdout, "        LABEL             a label of the GSE packets to forward to the TAP interface (format: \"xx:xx:xx:xx:xx:xx\" or \"xx:xx:xx\"), may be repeated\n");
+	fprintf(stdout, "        LABEL_TYPES       the label types of the GSE packets to forward whatever their label (format: \"LT:LT...\", 0: 6 bytes, 1: 3 bytes, 2: broadcast, 3: re-use)\n");
+	fprintf(stdout, "                          when LABEL or LABEL_TYPES is set, the other GSE packets are dropped before being de-encapsulated\n");
+	fprintf(stdout, "        REORDER_WINDOW    the number of frames buffered to put the frames back in sequence. Setting it expects the tunnel header with sequence numbers sent by \"satencap -S\" (default: %u)\n", DEFAULT_REORDER_WINDOW);
+	fprintf(stdout, "        REORDER_TIMEOUT   the timeout (ms) after which a missing frame is given up, with REORDER_WINDOW only (default: %u)\n", DEFAULT_REORDER_TIMEOUT);
+	fprintf(stdout, "        FEC_HISTORY       the number of frames kept to rebuild the lost ones from the parity frames sent by \"satencap -E\", at least the FEC block length, with REORDER_WINDOW only. Set 0 to ignore the parity frames (default: %u)\n", DEFAULT_FEC_HISTORY);
+	fprintf(stdout, "        REASM_BUFFERS     the number of BUFFER_LEN buffers to reassemble the fragmented PDUs in, which bounds the reassembly memory. The oldest incomplete PDU is dropped when none is left. Set 0 to let libGSE reassemble the PDUs (default: %u)\n", DEFAULT_REASM_SLOTS);
+	fprintf(stdout, "        REASM_TIMEOUT     the timeout (ms) after which an incomplete PDU is dropped, with REASM_BUFFERS only (default: %u)\n", DEFAULT_REASM_TIMEOUT);
+	fprintf(stdout, "        PERF_PERIOD       count the cycles, instructions, cache misses and branch misses of the UDP receive, GSE de-encap and TAP write of one frame in PERF_PERIOD, reported per packet size at exit, without RING_LEN only. Set 0 to disable (default: 0)\n");
+	fprintf(stdout, "        CPUS              the CPUs to pin the UDP receiver, the de-encapsulator and the TAP writer on (format: \"CPU:CPU:CPU\", \"-\" to not pin a stage)\n");
+	fprintf(stdout, "        PRIORITY          the SCHED_FIFO real-time priority of the threads, from 1 to 99, the default policy is kept when unset\n");
+	fprintf(stdout, "        -B                spin on the non-blocking UDP socket, busy polling the device queue, instead of sleeping until a frame comes, without RING_LEN only. The thread takes a whole CPU: pin it on an isolated one\n");
+	fprintf(stdout, "        -M                map the frame and reassembly buffers up front, on 2 MiB hugepages when some are reserved, and lock the process memory, with REASM_BUFFERS only: no heap allocation is left in steady state\n");
+	fprintf(stdout, "        CONTROL_SOCKET    the Unix socket changing the settings without restarting, between two frames: \"show\" prints them, \"set KEY VALUE...\" changes them at once, with the keys timeout (READ_TIMEOUT, without RING_LEN) and label-types (LABEL_TYPES, with LABEL or LABEL_TYPES)\n");
+	fprintf(stdout, "        HANDOFF_SOCKET    the Unix socket handing the TAP interface and the UDP socket over to the next satdecap started with it, which takes them over from the running one, with its reordering sequence, instead of opening them\n");
 }
 
 /**
@@ -55,16 +87,36 @@ int parse_arguments(int argc, char** argv, struct process_decap_params* params)
 
 	const unsigned int local_flag = 1 << ++shift;
 	const unsigned int remote_flag = 1 << ++shift;
+	const unsigned int shm_ring_flag = 1 << ++shift;
 
 	const unsigned int payload_len_flag = 1 << ++shift;
+	const unsigned int bb_header_flag = 1 << ++shift;
 
 	const unsigned int buffer_len_flag = 1 <<++shift;
 
+	const unsigned int ring_len_flag = 1 << ++shift;
+	const unsigned int cpus_flag = 1 << ++shift;
+	const unsigned int priority_flag = 1 << ++shift;
+	const unsigned int busy_poll_flag = 1 << ++shift;
+
+	const unsigned int reorder_window_flag = 1 << ++shift;
+	const unsigned int reorder_timeout_flag = 1 << ++shift;
+	const unsigned int fec_history_flag = 1 << ++shift;
+
+	const unsigned int reasm_slots_flag = 1 << ++shift;
+	const unsigned int reasm_timeout_flag = 1 << ++shift;
+
+	const unsigned int perf_period_flag = 1 << ++shift;
+	const unsigned int prealloc_flag = 1 << ++shift;
+	const unsigned int ctrl_path_flag = 1 << ++shift;
+	const unsigned int handoff_path_flag = 1 << ++shift;
+
 	unsigned int flags = 0;
 	int c;
 	unsigned long val;
 
-	while((flags & error_flag) == 0 && (flags & help_flag) == 0 && (c = getopt(argc, argv, "hi:l:r:p:b:q:t:")) != -1)
+	label_filter_init(&(params->filter));
+	while((flags & error_flag) == 0 && (flags & help_flag) == 0 && (c = getopt(argc, argv, "hi:l:r:m:p:Hb:q:t:P:a:Q:BL:y:S:D:E:R:T:C:MU:X:")) != -1)
 	{
 		switch(c)
 		{
@@ -104,6 +156,17 @@ int parse_arguments(int argc, char** argv, struct process_decap_params* params)
 			flags |= remote_flag;
 			break;
 
+			case 'm':
+			if(strlen(optarg) == 0 || strlen(optarg) >= sizeof(params->shm_name) || strchr(optarg, '/') != NULL)
+			{
+				fprintf(stderr, "Invalid shared memory ring \"%s\": must be a file name without '/'\n", optarg);
+				flags |= error_flag;
+				break;
+			}
+			memcpy(params->shm_name, optarg, strlen(optarg) + 1);
+			flags |= shm_ring_flag;
+			break;
+
 			case 'p':
 			if(parse_unsigned_long(optarg, &val) != 0 || val > UINT_MAX)
 			{
@@ -137,6 +200,156 @@ int parse_arguments(int argc, char** argv, struct process_decap_params* params)
 			flags |= read_timeout_flag;
 			break;
 
+			case 'P':
+			if(parse_unsigned_long(optarg, &val) != 0 || val > INT_MAX)
+			{
+				fprintf(stderr, "Invalid ring length \"%s\": the value must be an unsigned int in frames\n", optarg);
+				flags |= error_flag;
+				break;
+			}
+			params->ring_len = val;
+			flags |= ring_len_flag;
+			break;
+
+			case 'a':
+			if(parse_cpu_list(optarg, params->cpus, DECAP_STAGE_COUNT) != 0)
+			{
+				fprintf(stderr, "Invalid CPUs \"%s\" (format: \"CPU:CPU:CPU\")\n", optarg);
+				flags |= error_flag;
+				break;
+			}
+			flags |= cpus_flag;
+			break;
+
+			case 'Q':
+			if(parse_unsigned_long(optarg, &val) != 0 || val < 1 || val > 99)
+			{
+				fprintf(stderr, "Invalid real-time priority \"%s\": the value must be between 1 and 99\n", optarg);
+				flags |= error_flag;
+				break;
+			}
+			params->priority = val;
+			flags |= priority_flag;
+			break;
+
+			case 'B':
+			flags |= busy_poll_flag;
+			break;
+
+			case 'L':
+			if(label_filter_add_label(&(params->filter), optarg) != 0)
+			{
+				fprintf(stderr, "Invalid label \"%s\" (format: \"xx:xx:xx:xx:xx:xx\" or \"xx:xx:xx\", at most %u labels)\n", optarg, LABEL_FILTER_MAX_RULES);
+				flags |= error_flag;
+				break;
+			}
+			break;
+
+			case 'y':
+			if(label_filter_add_types(&(params->filter), optarg) != 0)
+			{
+				fprintf(stderr, "Invalid label types \"%s\" (format: \"LT:LT...\", LT from 0 to 3)\n", optarg);
+				flags |= error_flag;
+				break;
+			}
+			break;
+
+			case 'S':
+			if(parse_unsigned_long(optarg, &val) != 0 || val > INT_MAX)
+			{
+				fprintf(stderr, "Invalid reorder window \"%s\": the value must be an unsigned int in frames\n", optarg);
+				flags |= error_flag;
+				break;
+			}
+			params->reorder_window = val;
+			flags |= reorder_window_flag;
+			break;
+
+			case 'D':
+			if(parse_unsigned_long(optarg, &val) != 0)
+			{
+				fprintf(stderr, "Invalid reordering timeout \"%s\": the value must be an unsigned long in milliseconds\n", optarg);
+				flags |= error_flag;
+				break;
+			}
+			set_time(val, &(params->reorder_timeout));
+			flags |= reorder_timeout_flag;
+			break;
+
+			case 'E':
+			if(parse_unsigned_long(optarg, &val) != 0 || val > INT_MAX)
+			{
+				fprintf(stderr, "Invalid FEC history \"%s\": the value must be an unsigned int in frames\n", optarg);
+				flags |= error_flag;
+				break;
+			}
+			params->fec_history = val;
+			flags |= fec_history_flag;
+			break;
+
+			case 'R':
+			if(parse_unsigned_long(optarg, &val) != 0 || val > INT_MAX)
+			{
+				fprintf(stderr, "Invalid reassembly buffers count \"%s\": the value must be an unsigned int\n", optarg);
+				flags |= error_flag;
+				break;
+			}
+			params->reasm_slots = val;
+			flags |= reasm_slots_flag;
+			break;
+
+			case 'T':
+			if(parse_unsigned_long(optarg, &val) != 0)
+			{
+				fprintf(stderr, "Invalid reassembly timeout \"%s\": the value must be an unsigned long in milliseconds\n", optarg);
+				flags |= error_flag;
+				break;
+			}
+			set_time(val, &(params->reasm_timeout));
+			flags |= reasm_timeout_flag;
+			break;
+
+			case 'C':
+			if(parse_unsigned_long(optarg, &val) != 0 || val > UINT_MAX)
+			{
+				fprintf(stderr, "Invalid hardware counters period \"%s\": the value must be an unsigned int in frames\n", optarg);
+				flags |= error_flag;
+				break;
+			}
+			params->perf_period = val;
+			flags |= perf_period_flag;
+			break;
+
+			case 'M':
+			flags |= prealloc_flag;
+			break;
+
+			case 'U':
+			if(strlen(optarg) >= sizeof(params->ctrl_path))
+			{
+				fprintf(stderr, "Invalid control socket path \"%s\": too long\n", optarg);
+				flags |= error_flag;
+				break;
+			}
+			memcpy(params->ctrl_path, optarg, strlen(optarg) + 1);
+			flags |= ctrl_path_flag;
+			break;
+
+			case 'X':
+			if(strlen(optarg) >= sizeof(params->handoff_path))
+			{
+				fprintf(stderr, "Invalid handoff socket path \"%s\": too long\n", optarg);
+				flags |= error_flag;
+				break;
+			}
+			memcpy(params->handoff_path, optarg, strlen(optarg) + 1);
+			flags |= handoff_path_flag;
+			break;
+
+			case 'H':
+			flags |= bb_header_flag;
+			break;
+
 			case '?':
 			fprintf(stderr, "Invalid argument option \"%c\"\n", c);
 			flags |= error_flag;
@@ -163,18 +376,22 @@ int parse_arguments(int argc, char** argv, struct process_decap_params* params)
 		fprintf(stderr, "Missing TAP interface argument\n");
 		return -1;
 	}
-	if((flags & local_flag) == 0)
+	if((flags & local_flag) == 0 && (flags & shm_ring_flag) == 0)
 	{
 		fprintf(stderr, "Missing local address and port argument\n");
 		return -1;
 	}
-	if((flags & remote_flag) == 0)
+	if((flags & remote_flag) == 0 && (flags & shm_ring_flag) == 0)
 	{
 		fprintf(stderr, "Missing remote address and port argument\n");
 		return -1;
 	}
 
 	// Check optional arguments
+	if((flags & shm_ring_flag) == 0)
+	{
+		params->shm_name[0] = '\0';
+	}
 	if((flags & read_timeout_flag) == 0)
 	{
 		set_time(DEFAULT_READ_TIMEOUT, &(params->read_timeout));
@@ -183,10 +400,61 @@ int parse_arguments(int argc, char** argv, struct process_decap_params* params)
 	{
 		params->payload_len = DEFAULT_PAYLOAD_LENGTH;
 	}
+	params->bb_header = (flags & bb_header_flag) != 0;
 	if((flags & buffer_len_flag) == 0)
 	{
 		params->buffer_len = DEFAULT_BUFFER_LENGTH;
 	}
+	if((flags & ring_len_flag) == 0)
+	{
+		params->ring_len = DEFAULT_RING_LENGTH;
+	}
+	if((flags & reorder_window_flag) == 0)
+	{
+		params->reorder_window = DEFAULT_REORDER_WINDOW;
+	}
+	if((flags & reorder_timeout_flag) == 0)
+	{
+		set_time(DEFAULT_REORDER_TIMEOUT, &(params->reorder_timeout));
+	}
+	if((flags & fec_history_flag) == 0)
+	{
+		params->fec_history = DEFAULT_FEC_HISTORY;
+	}
+	if((flags & reasm_slots_flag) == 0)
+	{
+		params->reasm_slots = DEFAULT_REASM_SLOTS;
+	}
+	if((flags & reasm_timeout_flag) == 0)
+	{
+		set_time(DEFAULT_REASM_TIMEOUT, &(params->reasm_timeout));
+	}
+	if((flags & perf_period_flag) == 0)
+	{
+		params->perf_period = 0;
+	}
+	if((flags & priority_flag) == 0)
+	{
+		params->priority = 0;
+	}
+	params->busy_poll = (flags & busy_poll_flag) != 0;
+	params->prealloc = (flags & prealloc_flag) != 0;
+	if((flags & ctrl_path_flag) == 0)
+	{
+		params->ctrl_path[0] = '\0';
+	}
+	if((flags & handoff_path_flag) == 0)
+	{
+		params->handoff_path[0] = '\0';
+	}
+	if((flags & cpus_flag) == 0)
+	{
+		unsigned int i;
+		for(i = 0; i < DECAP_STAGE_COUNT; i++)
+		{
+			params->cpus[i] = -1;
+		}
+	}
 
 	return 0;
 }
@@ -219,9 +487,17 @@ int main(int argc, char** argv)
 		in.s_addr = params.remote.addr;
 		fprintf(stdout, "  - remote address:     \"%s:%u\"\n", inet_ntoa(in), params.remote.port);
 	}
+	fprintf(stdout, "  - shared memory ring: \"%s\"\n", params.shm_name);
 	fprintf(stdout, "  - reading timeout:    %lu ms\n", time_to_long(params.read_timeout));
 	fprintf(stdout, "  - payload length:     %d bytes\n", params.payload_len);
 	fprintf(stdout, "  - buffer length:      %d bytes\n", params.buffer_len);
+	fprintf(stdout, "  - ring length:        %d frames\n", params.ring_len);
+	fprintf(stdout, "  - reorder window:     %d frames\n", params.reorder_window);
+	fprintf(stdout, "  - reassembly buffers: %d\n", params.reasm_slots);
+	fprintf(stdout, "  - CPUs:               %d:%d:%d\n", params.cpus[0], params.cpus[1], params.cpus[2]);
+	fprintf(stdout, "  - priority:           %d\n", params.priority);
+	fprintf(stdout, "  - busy polling:       %d\n", params.busy_poll);
+	fprintf(stdout, "  - preallocation:      %d\n", params.prealloc);
 	fprintf(stdout, "\n");
 #endif
 	// Process decapsulation
@@ -11,6 +11,8 @@
 #include <arpa/inet.h>
 #include <net/if.h>
 
+#include "fq_codel.h"
+#include "modcod.h"
 #include "process_encap.h"
 #include "utils.h"
 
@@ -18,6 +20,10 @@
 #define DEFAULT_PAYLOAD_LENGTH 1500  // bytes
 #define DEFAULT_BUFFER_LENGTH 8192   // bytes
 #define DEFAULT_READ_TIMEOUT 100     // ms
+#define DEFAULT_FRAG_COUNT 1         // fragment IDs
+#define DEFAULT_SCHED_POLICY "shortest"
+#define DEFAULT_CHANNEL_FRAMES 16384 // frames
+#define DEFAULT_CHANNEL_SEED 1
 
 /**
  * Print help message
@@ -26,9 +32,22 @@ void usage() {
   fprintf(
       stdout,
       "Usage: satencap -i TAP_IFACE -l LOCAL_ADDR_PORT -r REMOTE_ADDR_PORT\n");
-  fprintf(stdout, "                [-p PAYLOAD_LEN]\n");
+  fprintf(stdout, "       satencap -i TAP_IFACE -l LOCAL_ADDR_PORT -f FWD_TABLE "
+                  "[-r REMOTE_ADDR_PORT]\n");
+  fprintf(stdout, "       satencap -i TAP_IFACE -m SHM_RING\n");
+  fprintf(stdout, "                [-p PAYLOAD_LEN | -M MODCOD_SCHEDULE [-H]]\n");
   fprintf(stdout, "                [-b BUFFER_LEN]\n");
   fprintf(stdout, "                [-t READ_TIMEOUT]\n");
+  fprintf(stdout, "                [-F FRAG_IDS]\n");
+  fprintf(stdout, "                [-O SCHED_POLICY]\n");
+  fprintf(stdout, "                [-S] [-E FEC]\n");
+  fprintf(stdout, "                [-C PERF_PERIOD]\n");
+  fprintf(stdout, "                [-d DELAY] [-j JITTER] [-L LOSS] [-R RATE] "
+                  "[-e SEED] [-n CHANNEL_FRAMES]\n");
+  fprintf(stdout, "                [-Z FQ]\n");
+  fprintf(stdout, "                [-a CPU] [-Q PRIORITY] [-B]\n");
+  fprintf(stdout, "                [-w WORKERS [-W WORKER_CPUS]]\n");
+  fprintf(stdout, "                [-U CONTROL_SOCKET] [-X HANDOFF_SOCKET]\n");
   fprintf(stdout, "                [-h]\n");
   fprintf(stdout, "\n    Required arguments\n");
   fprintf(stdout, "        TAP_IFACE         the TAP interface which receives "
@@ -36,13 +55,36 @@ void usage() {
   fprintf(stdout, "        LOCAL_ADDR_PORT   the address and port to use as "
                   "source of UDP tunnel (format: \"ADDRESS:PORT\")\n");
   fprintf(stdout, "        REMOTE_ADDR_PORT  the address and port to use as "
-                  "destination of UDP tunnel (format: \"ADDRESS:PORT\")\n");
+                  "destination of UDP tunnel (format: \"ADDRESS:PORT\"), "
+                  "used for unknown destinations with a forwarding table\n");
+  fprintf(stdout, "        FWD_TABLE         the file mapping destination MAC "
+                  "addresses to remote terminals (format of each line: "
+                  "\"MAC_ADDRESS ADDRESS:PORT [LABEL]\"), broadcast and "
+                  "multicast frames are sent to every terminal, the default "
+                  "one included\n");
+  fprintf(stdout, "        SHM_RING          the name of the shared memory ring "
+                  "(/dev/shm/SHM_RING) to write the frames to instead of the "
+                  "UDP tunnel, read by \"satdecap -m\" or a channel emulator. "
+                  "The first side started creates it\n");
   fprintf(stdout, "\n    Optional arguments\n");
   fprintf(stdout,
           "        PAYLOAD_LEN       the constant size (bytes) of outcoming "
           "payload to the UDP tunnel. Set 0 to send packets of variable "
           "payload length (default: %u)\n",
           DEFAULT_PAYLOAD_LENGTH);
+  fprintf(stdout,
+          "        MODCOD_SCHEDULE   the file of the MODCODs of the frames "
+          "over time (format of each line: \"TIME_MS MODCOD [short]\" where "
+          "MODCOD is a DVB-S2 MODCOD such as \"8PSK-3/4\" or \"snr:DB\" "
+          "for the most efficient one under an SNR), each frame is as long "
+          "as the BBFrame of its MODCOD instead of PAYLOAD_LEN. The "
+          "PAYLOAD_LEN of satdecap must be at least the longest BBFrame, %u "
+          "bytes at most\n",
+          modcods[MODCOD_COUNT - 1].kbch_normal / 8);
+  fprintf(stdout,
+          "        -H                prepend a DVB-S2 baseband header to each "
+          "BBFrame of the MODCOD schedule, to be checked and removed by "
+          "\"satdecap -H\"\n");
   fprintf(stdout,
           "        BUFFER_LEN        the max size (bytes) of incoming IP "
           "packet (default: %u))\n",
@@ -51,6 +93,100 @@ void usage() {
           "        READ_TIMEOUT      the timeout (ms) to read incoming IP "
           "packets (default: %u)\n",
           DEFAULT_READ_TIMEOUT);
+  fprintf(stdout,
+          "        FRAG_IDS          the number of PDUs in flight, each one "
+          "under its own GSE fragment ID, from 1 to %u (default: %u)\n",
+          MAX_FRAG_ID_COUNT, DEFAULT_FRAG_COUNT);
+  fprintf(stdout,
+          "        SCHED_POLICY      the order of the GSE packets of the PDUs "
+          "in flight: \"rr\" for one packet of each PDU in turn, "
+          "\"shortest\" for the PDU with the fewest bytes left first "
+          "(default: %s)\n",
+          DEFAULT_SCHED_POLICY);
+  fprintf(stdout,
+          "        -S                prepend a tunnel header with a sequence "
+          "number to each frame, to be reordered by \"satdecap -S\"\n");
+  fprintf(stdout,
+          "        FEC               send parity frames after each block of K "
+          "frames, \"xor:K\" for a single XOR parity frame or \"rs:K:M\" "
+          "for M Reed-Solomon parity frames (K up to %u, M up to %u), "
+          "implies -S. The parity of an incomplete block is sent after "
+          "READ_TIMEOUT without traffic\n",
+          FEC_MAX_DATA, FEC_MAX_PARITY);
+  fprintf(stdout,
+          "        PERF_PERIOD       count the cycles, instructions, cache "
+          "misses and branch misses of the TAP read, GSE encap and UDP send "
+          "of one packet in PERF_PERIOD, reported per packet size at exit. "
+          "Set 0 to disable (default: 0)\n");
+  fprintf(stdout,
+          "        DELAY             emulate a satellite channel before the "
+          "send, with a propagation delay (ms), e.g. 270 for a GEO hop. "
+          "Any of DELAY, JITTER, LOSS and RATE enables the emulation\n");
+  fprintf(stdout,
+          "        JITTER            the delay variation (ms) of the emulated "
+          "channel, drawn uniformly on both sides of DELAY, which may "
+          "reorder the frames\n");
+  fprintf(stdout,
+          "        LOSS              the frame losses of the emulated channel "
+          "in percents, \"LOSS\" for independent losses or "
+          "\"P_BAD:P_GOOD[:LOSS_GOOD:LOSS_BAD]\" for a Gilbert-Elliott "
+          "model (default LOSS_GOOD 0, LOSS_BAD 100)\n");
+  fprintf(stdout,
+          "        RATE              the serialization rate (kbit/s) of the "
+          "emulated channel, the frames queue up behind the previous ones\n");
+  fprintf(stdout,
+          "        SEED              the seed of the losses and jitter draws, "
+          "a run is reproduced with the same seed (default: %u)\n",
+          DEFAULT_CHANNEL_SEED);
+  fprintf(stdout,
+          "        CHANNEL_FRAMES    the frames in flight on the emulated "
+          "channel at most, the next ones are dropped (default: %u)\n",
+          DEFAULT_CHANNEL_FRAMES);
+  fprintf(stdout,
+          "        FQ                queue the PDUs per flow in front of the "
+          "encapsulator (format: \"FLOWS[:MEMORY_KB[:TARGET_MS:INTERVAL_MS]]"
+          "\"): the flows hashed into FLOWS queues are served in turn, the "
+          "new ones first, CoDel drops from a queue whose delay stays above "
+          "TARGET_MS for INTERVAL_MS, and the longest queue is cut over "
+          "MEMORY_KB. With RATE, the link holds only the next frames so that "
+          "the PDUs wait in the flow queues (default: %u:%u:%g:%g)\n",
+          FQ_DEFAULT_FLOWS, FQ_DEFAULT_MEMORY / 1024,
+          FQ_DEFAULT_TARGET_US / 1000.0, FQ_DEFAULT_INTERVAL_US / 1000.0);
+  fprintf(stdout, "        CPU               the CPU to pin the processing thread "
+                  "on\n");
+  fprintf(stdout,
+          "        PRIORITY          the SCHED_FIFO real-time priority of the "
+          "processing thread, from 1 to 99, the default policy is kept when "
+          "unset\n");
+  fprintf(stdout,
+          "        -B                spin on the non-blocking TAP interface "
+          "instead of sleeping until a packet comes. The thread takes a whole "
+          "CPU: pin it on an isolated one\n");
+  fprintf(stdout,
+          "        WORKERS           the worker threads encapsulating the PDUs, "
+          "up to %u, the TAP reader steers the PDUs of each flow to a single "
+          "worker by a hash of its addresses and ports (VLAN and Q in Q, "
+          "IPv4 and IPv6, TCP, UDP and SCTP). Each worker sends under its "
+          "own FRAG_IDS fragment IDs, without -S, -E, -m, channel emulation "
+          "nor PERF_PERIOD. Set 0 to run in a single thread (default: 0)\n",
+          MAX_ENCAP_WORKERS);
+  fprintf(stdout,
+          "        WORKER_CPUS       the CPUs to pin the workers on (format: "
+          "\"CPU:CPU...\", one per worker, \"-\" to not pin a worker), "
+          "CPU pins the TAP reader\n");
+  fprintf(stdout,
+          "        CONTROL_SOCKET    the Unix socket changing the settings "
+          "without restarting, between two frames: \"show\" prints them, "
+          "\"set KEY VALUE...\" changes them at once, with the keys timeout "
+          "(READ_TIMEOUT), buffer (BUFFER_LEN), payload (PAYLOAD_LEN, up to "
+          "the one given, without MODCOD_SCHEDULE), rate (RATE, with "
+          "channel emulation) and label (type of the labels: 0 for 6 bytes, "
+          "1 for 3 bytes, 2 for broadcast)\n");
+  fprintf(stdout,
+          "        HANDOFF_SOCKET    the Unix socket handing the TAP interface "
+          "and the UDP sockets over to the next satencap started with it, "
+          "which takes them over from the running one, with its labels and "
+          "tunnel sequences, instead of opening them\n");
 }
 
 /**
@@ -74,17 +210,41 @@ int parse_arguments(int argc, char **argv,
   (void)sched_period_flag;
 
   const unsigned int payload_len_flag = 1 << ++shift;
+  const unsigned int modcod_flag = 1 << ++shift;
+  const unsigned int bb_header_flag = 1 << ++shift;
   const unsigned int frames_count_flag = 1 << ++shift;
   (void)frames_count_flag;
 
   const unsigned int buffer_len_flag = 1 << ++shift;
 
+  const unsigned int fwd_table_flag = 1 << ++shift;
+  const unsigned int shm_ring_flag = 1 << ++shift;
+  const unsigned int frag_count_flag = 1 << ++shift;
+  const unsigned int sched_policy_flag = 1 << ++shift;
+  const unsigned int seq_header_flag = 1 << ++shift;
+  const unsigned int fec_flag = 1 << ++shift;
+  const unsigned int perf_period_flag = 1 << ++shift;
+  const unsigned int chan_delay_flag = 1 << ++shift;
+  const unsigned int chan_jitter_flag = 1 << ++shift;
+  const unsigned int chan_loss_flag = 1 << ++shift;
+  const unsigned int chan_rate_flag = 1 << ++shift;
+  const unsigned int chan_seed_flag = 1 << ++shift;
+  const unsigned int chan_frames_flag = 1 << ++shift;
+  const unsigned int cpu_flag = 1 << ++shift;
+  const unsigned int priority_flag = 1 << ++shift;
+  const unsigned int busy_poll_flag = 1 << ++shift;
+  const unsigned int workers_flag = 1 << ++shift;
+  const unsigned int fq_flag = 1 << ++shift;
+
   unsigned int flags = 0;
+  const char *worker_cpus = NULL;
+  unsigned int i;
   int c;
   unsigned long val;
 
+  memset(params, 0, sizeof(struct process_encap_params));
   while ((flags & error_flag) == 0 && (flags & help_flag) == 0 &&
-         (c = getopt(argc, argv, "hi:l:r:p:c:b:q:s:t:")) != -1) {
+         (c = getopt(argc, argv, "hi:l:r:p:M:Hc:b:q:s:t:f:m:F:O:SE:C:d:j:L:R:e:n:Z:a:Q:Bw:W:U:X:")) != -1) {
     switch (c) {
     case 'h':
       flags |= help_flag;
@@ -141,6 +301,21 @@ int parse_arguments(int argc, char **argv,
       flags |= payload_len_flag;
       break;
 
+    case 'M':
+      if (strlen(optarg) >= sizeof(params->modcod_path)) {
+        fprintf(stderr, "Invalid MODCOD schedule path \"%s\": too long\n",
+                optarg);
+        flags |= error_flag;
+        break;
+      }
+      memcpy(params->modcod_path, optarg, strlen(optarg) + 1);
+      flags |= modcod_flag;
+      break;
+
+    case 'H':
+      flags |= bb_header_flag;
+      break;
+
     case 'b':
       if (parse_unsigned_long(optarg, &val) != 0 || val > UINT_MAX) {
         fprintf(stderr,
@@ -167,6 +342,243 @@ int parse_arguments(int argc, char **argv,
       flags |= read_timeout_flag;
       break;
 
+    case 'f':
+      if (strlen(optarg) >= sizeof(params->fwd_path)) {
+        fprintf(stderr, "Invalid forwarding table path \"%s\": too long\n",
+                optarg);
+        flags |= error_flag;
+        break;
+      }
+      memcpy(params->fwd_path, optarg, strlen(optarg) + 1);
+      flags |= fwd_table_flag;
+      break;
+
+    case 'm':
+      if (strlen(optarg) == 0 || strlen(optarg) >= sizeof(params->shm_name) ||
+          strchr(optarg, '/') != NULL) {
+        fprintf(stderr,
+                "Invalid shared memory ring \"%s\": must be a file name "
+                "without '/'\n",
+                optarg);
+        flags |= error_flag;
+        break;
+      }
+      memcpy(params->shm_name, optarg, strlen(optarg) + 1);
+      flags |= shm_ring_flag;
+      break;
+
+    case 'F':
+      if (parse_unsigned_long(optarg, &val) != 0 || val == 0 ||
+          val > MAX_FRAG_ID_COUNT) {
+        fprintf(stderr,
+                "Invalid fragment IDs count \"%s\": the value must be "
+                "between 1 and %u\n",
+                optarg, MAX_FRAG_ID_COUNT);
+        flags |= error_flag;
+        break;
+      }
+      params->frag_count = val;
+      flags |= frag_count_flag;
+      break;
+
+    case 'O':
+      if (encap_sched_parse_policy(optarg, &(params->sched_policy)) != 0) {
+        fprintf(stderr,
+                "Invalid scheduling policy \"%s\": the value must be "
+                "\"rr\" or \"shortest\"\n",
+                optarg);
+        flags |= error_flag;
+        break;
+      }
+      flags |= sched_policy_flag;
+      break;
+
+    case 'S':
+      flags |= seq_header_flag;
+      break;
+
+    case 'E':
+      if (fec_parse(optarg, &(params->fec_scheme), &(params->fec_k),
+                    &(params->fec_m)) != 0) {
+        fprintf(stderr,
+                "Invalid FEC \"%s\" (format: \"xor:K\" or \"rs:K:M\", K "
+                "up to %u, M up to %u)\n",
+                optarg, FEC_MAX_DATA, FEC_MAX_PARITY);
+        flags |= error_flag;
+        break;
+      }
+      flags |= fec_flag | seq_header_flag;
+      break;
+
+    case 'C':
+      if (parse_unsigned_long(optarg, &val) != 0 || val > UINT_MAX) {
+        fprintf(stderr,
+                "Invalid hardware counters period \"%s\": the value must be "
+                "an unsigned long in packets\n",
+                optarg);
+        flags |= error_flag;
+        break;
+      }
+      params->perf_period = val;
+      flags |= perf_period_flag;
+      break;
+
+    case 'd':
+      if (parse_unsigned_long(optarg, &val) != 0 || val > ULONG_MAX / 1000) {
+        fprintf(stderr,
+                "Invalid channel delay \"%s\": the value must be an "
+                "unsigned long in milliseconds\n",
+                optarg);
+        flags |= error_flag;
+        break;
+      }
+      params->chan.delay_us = val * 1000;
+      flags |= chan_delay_flag;
+      break;
+
+    case 'j':
+      if (parse_unsigned_long(optarg, &val) != 0 || val > ULONG_MAX / 1000) {
+        fprintf(stderr,
+                "Invalid channel jitter \"%s\": the value must be an "
+                "unsigned long in milliseconds\n",
+                optarg);
+        flags |= error_flag;
+        break;
+      }
+      params->chan.jitter_us = val * 1000;
+      flags |= chan_jitter_flag;
+      break;
+
+    case 'L':
+      if (channel_parse_loss(optarg, &(params->chan)) != 0) {
+        fprintf(stderr,
+                "Invalid channel losses \"%s\" (format: \"LOSS\" or "
+                "\"P_BAD:P_GOOD[:LOSS_GOOD:LOSS_BAD]\", in percents)\n",
+                optarg);
+        flags |= error_flag;
+        break;
+      }
+      flags |= chan_loss_flag;
+      break;
+
+    case 'R':
+      if (parse_unsigned_long(optarg, &val) != 0 || val == 0) {
+        fprintf(stderr,
+                "Invalid channel rate \"%s\": the value must be a strictly "
+                "positive unsigned long in kbit/s\n",
+                optarg);
+        flags |= error_flag;
+        break;
+      }
+      params->chan.rate_kbps = val;
+      flags |= chan_rate_flag;
+      break;
+
+    case 'e':
+      if (parse_unsigned_long(optarg, &val) != 0) {
+        fprintf(stderr,
+                "Invalid channel seed \"%s\": the value must be an unsigned "
+                "long\n",
+                optarg);
+        flags |= error_flag;
+        break;
+      }
+      params->chan.seed = val;
+      flags |= chan_seed_flag;
+      break;
+
+    case 'n':
+      if (parse_unsigned_long(optarg, &val) != 0 || val == 0) {
+        fprintf(stderr,
+                "Invalid channel frames count \"%s\": the value must be a "
+                "strictly positive unsigned long\n",
+                optarg);
+        flags |= error_flag;
+        break;
+      }
+      params->chan.frames = val;
+      flags |= chan_frames_flag;
+      break;
+
+    case 'Z':
+      fq_default_params(&(params->fq));
+      if (fq_parse(optarg, &(params->fq)) != 0) {
+        fprintf(stderr,
+                "Invalid flow queueing \"%s\" (format: \"FLOWS[:MEMORY_KB"
+                "[:TARGET_MS:INTERVAL_MS]]\", FLOWS up to %u, MEMORY_KB from "
+                "64, TARGET_MS up to INTERVAL_MS)\n",
+                optarg, FQ_MAX_FLOWS);
+        flags |= error_flag;
+        break;
+      }
+      flags |= fq_flag;
+      break;
+
+    case 'a':
+      if (parse_cpu_list(optarg, &(params->cpu), 1) != 0) {
+        fprintf(stderr, "Invalid CPU \"%s\": the value must be a CPU index\n",
+                optarg);
+        flags |= error_flag;
+        break;
+      }
+      flags |= cpu_flag;
+      break;
+
+    case 'Q':
+      if (parse_unsigned_long(optarg, &val) != 0 || val < 1 || val > 99) {
+        fprintf(stderr,
+                "Invalid real-time priority \"%s\": the value must be "
+                "between 1 and 99\n",
+                optarg);
+        flags |= error_flag;
+        break;
+      }
+      params->priority = val;
+      flags |= priority_flag;
+      break;
+
+    case 'B':
+      flags |= busy_poll_flag;
+      break;
+
+    case 'w':
+      if (parse_unsigned_long(optarg, &val) != 0 || val > MAX_ENCAP_WORKERS) {
+        fprintf(stderr,
+                "Invalid workers count \"%s\": the value must be between 0 "
+                "and %u\n",
+                optarg, MAX_ENCAP_WORKERS);
+        flags |= error_flag;
+        break;
+      }
+      params->workers = val;
+      flags |= workers_flag;
+      break;
+
+    case 'W':
+      // Parsed once the workers count is known
+      worker_cpus = optarg;
+      break;
+
+    case 'U':
+      if (strlen(optarg) >= sizeof(params->ctrl_path)) {
+        fprintf(stderr, "Invalid control socket path \"%s\": too long\n",
+                optarg);
+        flags |= error_flag;
+        break;
+      }
+      memcpy(params->ctrl_path, optarg, strlen(optarg) + 1);
+      break;
+
+    case 'X':
+      if (strlen(optarg) >= sizeof(params->handoff_path)) {
+        fprintf(stderr, "Invalid handoff socket path \"%s\": too long\n",
+                optarg);
+        flags |= error_flag;
+        break;
+      }
+      memcpy(params->handoff_path, optarg, strlen(optarg) + 1);
+      break;
+
     case '?':
       fprintf(stderr, "Invalid argument option \"%c\"\n", c);
       flags |= error_flag;
@@ -190,11 +602,12 @@ int parse_arguments(int argc, char **argv,
     fprintf(stderr, "Missing TAP interface argument\n");
     return -1;
   }
-  if ((flags & local_flag) == 0) {
+  if ((flags & local_flag) == 0 && (flags & shm_ring_flag) == 0) {
     fprintf(stderr, "Missing local address and port argument\n");
     return -1;
   }
-  if ((flags & remote_flag) == 0) {
+  if ((flags & remote_flag) == 0 && (flags & fwd_table_flag) == 0 &&
+      (flags & shm_ring_flag) == 0) {
     fprintf(stderr, "Missing remote address and port argument\n");
     return -1;
   }
@@ -210,6 +623,74 @@ int parse_arguments(int argc, char **argv,
 	{
 		params->buffer_len = DEFAULT_BUFFER_LENGTH;
 	}
+  if ((flags & remote_flag) == 0) {
+    params->remote.addr = 0;
+    params->remote.port = 0;
+  }
+  if ((flags & modcod_flag) == 0) {
+    params->modcod_path[0] = '\0';
+  }
+  params->bb_header = (flags & bb_header_flag) != 0;
+  if ((flags & fwd_table_flag) == 0) {
+    params->fwd_path[0] = '\0';
+  }
+  if ((flags & shm_ring_flag) == 0) {
+    params->shm_name[0] = '\0';
+  }
+  if ((flags & frag_count_flag) == 0) {
+    params->frag_count = DEFAULT_FRAG_COUNT;
+  }
+  params->seq_header = (flags & seq_header_flag) != 0;
+  if ((flags & fec_flag) == 0) {
+    params->fec_k = 0;
+    params->fec_m = 0;
+  }
+  if ((flags & sched_policy_flag) == 0) {
+    encap_sched_parse_policy(DEFAULT_SCHED_POLICY, &(params->sched_policy));
+  }
+  if ((flags & perf_period_flag) == 0) {
+    params->perf_period = 0;
+  }
+  if ((flags & (chan_delay_flag | chan_jitter_flag | chan_loss_flag |
+                chan_rate_flag)) == 0) {
+    // No channel emulation
+    params->chan.frames = 0;
+  } else {
+    if ((flags & chan_seed_flag) == 0) {
+      params->chan.seed = DEFAULT_CHANNEL_SEED;
+    }
+    if ((flags & chan_frames_flag) == 0) {
+      params->chan.frames = DEFAULT_CHANNEL_FRAMES;
+    }
+  }
+  if ((flags & fq_flag) == 0) {
+    params->fq.flows = 0;
+  }
+  if ((flags & cpu_flag) == 0) {
+    params->cpu = -1;
+  }
+  if ((flags & priority_flag) == 0) {
+    params->priority = 0;
+  }
+  params->busy_poll = (flags & busy_poll_flag) != 0;
+  if ((flags & workers_flag) == 0) {
+    params->workers = 0;
+  }
+  if (worker_cpus != NULL &&
+      (params->workers == 0 ||
+       parse_cpu_list(worker_cpus, params->worker_cpus, params->workers) !=
+           0)) {
+    fprintf(stderr,
+            "Invalid worker CPUs \"%s\": one CPU index or \"-\" per "
+            "worker\n",
+            worker_cpus);
+    return -1;
+  }
+  if (worker_cpus == NULL) {
+    for (i = 0; i < MAX_ENCAP_WORKERS; i++) {
+      params->worker_cpus[i] = -1;
+    }
+  }
 
   return 0;
 }
@@ -247,6 +728,9 @@ int main(int argc, char **argv) {
           time_to_long(params.read_timeout));
   fprintf(stdout, "  - payload length:     %d bytes\n", params.payload_len);
   fprintf(stdout, "  - buffer length:      %d bytes\n", params.buffer_len);
+  fprintf(stdout, "  - forwarding table:   \"%s\"\n", params.fwd_path);
+  fprintf(stdout, "  - shared memory ring: \"%s\"\n", params.shm_name);
+  fprintf(stdout, "  - fragment IDs:       %d\n", params.frag_count);
   fprintf(stdout, "\n");
 #endif
 
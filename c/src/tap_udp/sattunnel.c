@@ -0,0 +1,450 @@
+// Copyright 2023, Viveris Technologies
+// Distributed under the terms of the MIT License
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+
+#include <net/if.h>
+#include <arpa/inet.h>
+
+#include "utils.h"
+#include "process_tunnel.h"
+
+// Default values
+#define DEFAULT_PAYLOAD_LENGTH      1500   // bytes
+#define DEFAULT_BUFFER_LENGTH       8192   // bytes
+#define DEFAULT_READ_TIMEOUT        100    // ms
+#define DEFAULT_FRAG_COUNT          1      // fragment IDs
+#define DEFAULT_SCHED_POLICY        "shortest"
+#define DEFAULT_REORDER_WINDOW      0      // frames
+#define DEFAULT_REORDER_TIMEOUT     50     // ms
+#define DEFAULT_REASM_SLOTS         0      // buffers
+#define DEFAULT_REASM_TIMEOUT       1000   // ms
+
+/**
+ * Print help message
+ */
+void usage()
+{
+	fprintf(stdout, "Usage: sattunnel -i TAP_IFACE -l LOCAL_ADDR_PORT -r REMOTE_ADDR_PORT\n");
+	fprintf(stdout, "                 [-p PAYLOAD_LEN] [-q RECV_LEN]\n");
+	fprintf(stdout, "                 [-b BUFFER_LEN]\n");
+	fprintf(stdout, "                 [-t READ_TIMEOUT]\n");
+	fprintf(stdout, "                 [-F FRAG_IDS] [-O SCHED_POLICY]\n");
+	fprintf(stdout, "                 [-S REORDER_WINDOW] [-D REORDER_TIMEOUT] [-E FEC]\n");
+	fprintf(stdout, "                 [-R REASM_BUFFERS] [-T REASM_TIMEOUT]\n");
+	fprintf(stdout, "                 [-a CPU] [-Q PRIORITY]\n");
+	fprintf(stdout, "                 [-h]\n");
+	fprintf(stdout, "\n    Encapsulate the packets of the TAP interface to the remote terminal and write the packets of the remote\n");
+	fprintf(stdout, "    terminal to the TAP interface, both ways in a single loop over a single UDP socket\n");
+	fprintf(stdout, "\n    Required arguments\n");
+	fprintf(stdout, "        TAP_IFACE         the TAP interface of the terminal\n");
+	fprintf(stdout, "        LOCAL_ADDR_PORT   the address and port of the UDP tunnel on this side (format: \"ADDRESS:PORT\")\n");
+	fprintf(stdout, "        REMOTE_ADDR_PORT  the address and port of the UDP tunnel on the remote side, the only one frames are accepted from (format: \"ADDRESS:PORT\")\n");
+	fprintf(stdout, "\n    Optional arguments\n");
+	fprintf(stdout, "        PAYLOAD_LEN       the constant size (bytes) of the payload sent to the UDP tunnel. Set 0 to send packets of variable payload length (default: %u)\n", DEFAULT_PAYLOAD_LENGTH);
+	fprintf(stdout, "        RECV_LEN          the max size (bytes) of the payload received from the UDP tunnel (default: PAYLOAD_LEN, or %u when it is 0)\n", GSE_MAX_PACKET_LENGTH);
+	fprintf(stdout, "        BUFFER_LEN        the max size (bytes) of the IP packets (default: %u)\n", DEFAULT_BUFFER_LENGTH);
+	fprintf(stdout, "        READ_TIMEOUT      the timeout (ms) after which an idle tunnel flushes the late frames and the parity (default: %u)\n", DEFAULT_READ_TIMEOUT);
+	fprintf(stdout, "        FRAG_IDS          the number of PDUs in flight, each one under its own GSE fragment ID, from 1 to %u (default: %u)\n", MAX_FRAG_ID_COUNT, DEFAULT_FRAG_COUNT);
+	fprintf(stdout, "        SCHED_POLICY      the order of the GSE packets of the PDUs in flight: \"rr\" or \"shortest\" (default: %s)\n", DEFAULT_SCHED_POLICY);
+	fprintf(stdout, "        REORDER_WINDOW    the number of frames buffered to put the received frames back in sequence, the frames are sent with the tunnel header when not 0: both sides must set it (default: %u)\n", DEFAULT_REORDER_WINDOW);
+	fprintf(stdout, "        REORDER_TIMEOUT   the timeout (ms) after which a missing frame is given up, with REORDER_WINDOW only (default: %u)\n", DEFAULT_REORDER_TIMEOUT);
+	fprintf(stdout, "        FEC               the parity frames sent after each block of K frames (format: \"xor:K\" or \"rs:K:M\"), the received ones rebuild the lost frames, with REORDER_WINDOW only: both sides must set it\n");
+	fprintf(stdout, "        REASM_BUFFERS     the number of BUFFER_LEN buffers to reassemble the fragmented PDUs in. Set 0 to let libGSE reassemble the PDUs (default: %u)\n", DEFAULT_REASM_SLOTS);
+	fprintf(stdout, "        REASM_TIMEOUT     the timeout (ms) after which an incomplete PDU is dropped, with REASM_BUFFERS only (default: %u)\n", DEFAULT_REASM_TIMEOUT);
+	fprintf(stdout, "        CPU               the CPU to pin the processing thread on\n");
+	fprintf(stdout, "        PRIORITY          the SCHED_FIFO real-time priority of the processing thread, from 1 to 99, the default policy is kept when unset\n");
+}
+
+/**
+ * Parse tunnel parameters
+ *
+ * Return 0 on success, 1 when help is required, -1 on error
+ */
+int parse_arguments(int argc, char** argv, struct process_tunnel_params* params)
+{
+	struct process_encap_params *encap = &(params->encap);
+	struct process_decap_params *decap = &(params->decap);
+
+	unsigned int shift = 0;
+	const unsigned int error_flag = 1 << ++shift;
+	const unsigned int help_flag = 1 << ++shift;
+
+	const unsigned int tap_iface_flag = 1 << ++shift;
+	const unsigned int read_timeout_flag = 1 << ++shift;
+
+	const unsigned int local_flag = 1 << ++shift;
+	const unsigned int remote_flag = 1 << ++shift;
+
+	const unsigned int payload_len_flag = 1 << ++shift;
+	const unsigned int recv_len_flag = 1 << ++shift;
+	const unsigned int buffer_len_flag = 1 << ++shift;
+
+	const unsigned int frag_count_flag = 1 << ++shift;
+	const unsigned int sched_policy_flag = 1 << ++shift;
+
+	const unsigned int reorder_window_flag = 1 << ++shift;
+	const unsigned int reorder_timeout_flag = 1 << ++shift;
+	const unsigned int fec_flag = 1 << ++shift;
+
+	const unsigned int reasm_slots_flag = 1 << ++shift;
+	const unsigned int reasm_timeout_flag = 1 << ++shift;
+
+	const unsigned int cpu_flag = 1 << ++shift;
+	const unsigned int priority_flag = 1 << ++shift;
+
+	unsigned int flags = 0;
+	int c;
+	unsigned long val;
+
+	memset(params, 0, sizeof(struct process_tunnel_params));
+	label_filter_init(&(decap->filter));
+	while((flags & error_flag) == 0 && (flags & help_flag) == 0 && (c = getopt(argc, argv, "hi:l:r:p:q:b:t:F:O:S:D:E:R:T:a:Q:")) != -1)
+	{
+		switch(c)
+		{
+			case 'h':
+			flags |= help_flag;
+			break;
+
+			case 'i':
+			if(if_nametoindex(optarg) == 0 || strlen(optarg) >= sizeof(encap->tap_iface))
+			{
+				fprintf(stderr, "Invalid TAP interface \"%s\": must be an existing TAP interface\n", optarg);
+				flags |= error_flag;
+				break;
+			}
+			flags |= tap_iface_flag;
+			memcpy(encap->tap_iface, optarg, strlen(optarg) + 1);
+			break;
+
+			case 'l':
+			if(parse_udp_arguments(optarg, &(encap->local)) != 0)
+			{
+				fprintf(stderr, "Invalid local address and port \"%s\" (format: \"ADDRESS:PORT\")\n", optarg);
+				flags |= error_flag;
+				break;
+			}
+			flags |= local_flag;
+			break;
+
+			case 'r':
+			if(parse_udp_arguments(optarg, &(encap->remote)) != 0)
+			{
+				fprintf(stderr, "Invalid remote address and port \"%s\" (format: \"ADDRESS:PORT\")\n", optarg);
+				flags |= error_flag;
+				break;
+			}
+			flags |= remote_flag;
+			break;
+
+			case 'p':
+			if(parse_unsigned_long(optarg, &val) != 0 || val > UINT_MAX)
+			{
+				fprintf(stderr, "Invalid payload length \"%s\": the value must be an unsigned int in bytes\n", optarg);
+				flags |= error_flag;
+				break;
+			}
+			encap->payload_len = val;
+			flags |= payload_len_flag;
+			break;
+
+			case 'q':
+			if(parse_unsigned_long(optarg, &val) != 0 || val > UINT_MAX)
+			{
+				fprintf(stderr, "Invalid received payload length \"%s\": the value must be an unsigned int in bytes\n", optarg);
+				flags |= error_flag;
+				break;
+			}
+			decap->payload_len = val;
+			flags |= recv_len_flag;
+			break;
+
+			case 'b':
+			if(parse_unsigned_long(optarg, &val) != 0 || val > UINT_MAX)
+			{
+				fprintf(stderr, "Invalid buffer length \"%s\": the value must be an unsigned long in bytes\n", optarg);
+				flags |= error_flag;
+				break;
+			}
+			encap->buffer_len = val;
+			flags |= buffer_len_flag;
+			break;
+
+			case 't':
+			if(parse_unsigned_long(optarg, &val) != 0 || val == 0)
+			{
+				fprintf(stderr, "Invalid reading timeout \"%s\": the value must be a strictly positive unsigned long in milliseconds\n", optarg);
+				flags |= error_flag;
+				break;
+			}
+			set_time(val, &(encap->read_timeout));
+			flags |= read_timeout_flag;
+			break;
+
+			case 'F':
+			if(parse_unsigned_long(optarg, &val) != 0 || val == 0 || val > MAX_FRAG_ID_COUNT)
+			{
+				fprintf(stderr, "Invalid fragment IDs count \"%s\": the value must be between 1 and %u\n", optarg, MAX_FRAG_ID_COUNT);
+				flags |= error_flag;
+				break;
+			}
+			encap->frag_count = val;
+			flags |= frag_count_flag;
+			break;
+
+			case 'O':
+			if(encap_sched_parse_policy(optarg, &(encap->sched_policy)) != 0)
+			{
+				fprintf(stderr, "Invalid scheduler policy \"%s\": must be \"rr\" or \"shortest\"\n", optarg);
+				flags |= error_flag;
+				break;
+			}
+			flags |= sched_policy_flag;
+			break;
+
+			case 'S':
+			if(parse_unsigned_long(optarg, &val) != 0 || val > INT_MAX)
+			{
+				fprintf(stderr, "Invalid reorder window \"%s\": the value must be an unsigned int in frames\n", optarg);
+				flags |= error_flag;
+				break;
+			}
+			decap->reorder_window = val;
+			flags |= reorder_window_flag;
+			break;
+
+			case 'D':
+			if(parse_unsigned_long(optarg, &val) != 0 || val == 0)
+			{
+				fprintf(stderr, "Invalid reordering timeout \"%s\": the value must be a strictly positive unsigned long in milliseconds\n", optarg);
+				flags |= error_flag;
+				break;
+			}
+			set_time(val, &(decap->reorder_timeout));
+			flags |= reorder_timeout_flag;
+			break;
+
+			case 'E':
+			if(fec_parse(optarg, &(encap->fec_scheme), &(encap->fec_k), &(encap->fec_m)) != 0)
+			{
+				fprintf(stderr, "Invalid FEC \"%s\" (format: \"xor:K\" or \"rs:K:M\", K up to %u, M up to %u)\n", optarg, FEC_MAX_DATA, FEC_MAX_PARITY);
+				flags |= error_flag;
+				break;
+			}
+			flags |= fec_flag;
+			break;
+
+			case 'R':
+			if(parse_unsigned_long(optarg, &val) != 0 || val > INT_MAX)
+			{
+				fprintf(stderr, "Invalid reassembly buffers count \"%s\": the value must be an unsigned int\n", optarg);
+				flags |= error_flag;
+				break;
+			}
+			decap->reasm_slots = val;
+			flags |= reasm_slots_flag;
+			break;
+
+			case 'T':
+			if(parse_unsigned_long(optarg, &val) != 0 || val == 0)
+			{
+				fprintf(stderr, "Invalid reassembly timeout \"%s\": the value must be a strictly positive unsigned long in milliseconds\n", optarg);
+				flags |= error_flag;
+				break;
+			}
+			set_time(val, &(decap->reasm_timeout));
+			flags |= reasm_timeout_flag;
+			break;
+
+			case 'a':
+			if(parse_cpu_list(optarg, &(encap->cpu), 1) != 0)
+			{
+				fprintf(stderr, "Invalid CPU \"%s\": the value must be a CPU index\n", optarg);
+				flags |= error_flag;
+				break;
+			}
+			flags |= cpu_flag;
+			break;
+
+			case 'Q':
+			if(parse_unsigned_long(optarg, &val) != 0 || val < 1 || val > 99)
+			{
+				fprintf(stderr, "Invalid real-time priority \"%s\": the value must be between 1 and 99\n", optarg);
+				flags |= error_flag;
+				break;
+			}
+			encap->priority = val;
+			flags |= priority_flag;
+			break;
+
+			case '?':
+			fprintf(stderr, "Invalid argument option \"%c\"\n", c);
+			flags |= error_flag;
+			break;
+
+			default:
+			fprintf(stderr, "Invalid arguments\n");
+			flags |= error_flag;
+			break;
+		}
+	}
+	if((flags & help_flag) != 0)
+	{
+		return 1;
+	}
+	if((flags & error_flag) != 0)
+	{
+		return -1;
+	}
+
+	// Check required arguments
+	if((flags & tap_iface_flag) == 0)
+	{
+		fprintf(stderr, "Missing TAP interface argument\n");
+		return -1;
+	}
+	if((flags & local_flag) == 0)
+	{
+		fprintf(stderr, "Missing local address and port argument\n");
+		return -1;
+	}
+	if((flags & remote_flag) == 0)
+	{
+		fprintf(stderr, "Missing remote address and port argument\n");
+		return -1;
+	}
+
+	// Check optional arguments
+	if((flags & read_timeout_flag) == 0)
+	{
+		set_time(DEFAULT_READ_TIMEOUT, &(encap->read_timeout));
+	}
+	if((flags & payload_len_flag) == 0)
+	{
+		encap->payload_len = DEFAULT_PAYLOAD_LENGTH;
+	}
+	if(encap->payload_len != 0 && encap->payload_len < MIN_ENCAP_FRAME_SIZE)
+	{
+		fprintf(stderr, "Invalid payload length: at least %u bytes\n", MIN_ENCAP_FRAME_SIZE);
+		return -1;
+	}
+	if((flags & recv_len_flag) == 0)
+	{
+		decap->payload_len = encap->payload_len != 0 ? encap->payload_len : GSE_MAX_PACKET_LENGTH;
+	}
+	if(decap->payload_len < MIN_ENCAP_FRAME_SIZE)
+	{
+		fprintf(stderr, "Invalid received payload length: at least %u bytes\n", MIN_ENCAP_FRAME_SIZE);
+		return -1;
+	}
+	if((flags & buffer_len_flag) == 0)
+	{
+		encap->buffer_len = DEFAULT_BUFFER_LENGTH;
+	}
+	if((flags & frag_count_flag) == 0)
+	{
+		encap->frag_count = DEFAULT_FRAG_COUNT;
+	}
+	if((flags & sched_policy_flag) == 0)
+	{
+		encap_sched_parse_policy(DEFAULT_SCHED_POLICY, &(encap->sched_policy));
+	}
+	if((flags & reorder_window_flag) == 0)
+	{
+		decap->reorder_window = DEFAULT_REORDER_WINDOW;
+	}
+	if((flags & reorder_timeout_flag) == 0)
+	{
+		set_time(DEFAULT_REORDER_TIMEOUT, &(decap->reorder_timeout));
+	}
+	if((flags & fec_flag) != 0)
+	{
+		if(decap->reorder_window == 0)
+		{
+			fprintf(stderr, "Invalid FEC: the reorder window must be set\n");
+			return -1;
+		}
+		// Keep the frames of two blocks to rebuild the lost ones
+		decap->fec_history = 2 * (encap->fec_k + encap->fec_m);
+		if(decap->reorder_window < decap->fec_history)
+		{
+			decap->reorder_window = decap->fec_history;
+		}
+	}
+	if((flags & reasm_slots_flag) == 0)
+	{
+		decap->reasm_slots = DEFAULT_REASM_SLOTS;
+	}
+	if((flags & reasm_timeout_flag) == 0)
+	{
+		set_time(DEFAULT_REASM_TIMEOUT, &(decap->reasm_timeout));
+	}
+	if((flags & cpu_flag) == 0)
+	{
+		encap->cpu = -1;
+	}
+
+	// Both ways of the tunnel
+	encap->seq_header = decap->reorder_window > 0;
+	memcpy(decap->tap_iface, encap->tap_iface, sizeof(decap->tap_iface));
+	decap->local = encap->local;
+	decap->remote = encap->remote;
+	decap->read_timeout = encap->read_timeout;
+	decap->buffer_len = encap->buffer_len;
+	decap->cpus[0] = encap->cpu;
+	decap->priority = encap->priority;
+
+	return 0;
+}
+
+/**
+ * Main function
+ *
+ * Return 0 on success, -1 on arguments error, -2 on initialization error, -3 otherwise
+ */
+int main(int argc, char** argv)
+{
+	struct process_tunnel_params params;
+	int ret;
+
+	// Parse arguments
+	if((ret = parse_arguments(argc, argv, &params)) != 0)
+	{
+		usage();
+		return ret > 0 ? 0 : -1;
+	}
+
+#ifdef DEBUG
+	// Print arguments
+	fprintf(stdout, "Configuration\n");
+	fprintf(stdout, "  - TAP interface:      \"%s\"\n", params.encap.tap_iface);
+	{
+		struct in_addr in;
+		in.s_addr = params.encap.local.addr;
+		fprintf(stdout, "  - local address:      \"%s:%u\"\n", inet_ntoa(in), params.encap.local.port);
+		in.s_addr = params.encap.remote.addr;
+		fprintf(stdout, "  - remote address:     \"%s:%u\"\n", inet_ntoa(in), params.encap.remote.port);
+	}
+	fprintf(stdout, "  - reading timeout:    %lu ms\n", time_to_long(params.encap.read_timeout));
+	fprintf(stdout, "  - payload length:     %d bytes sent, %d bytes received\n", params.encap.payload_len, params.decap.payload_len);
+	fprintf(stdout, "  - buffer length:      %d bytes\n", params.encap.buffer_len);
+	fprintf(stdout, "  - fragment IDs:       %d\n", params.encap.frag_count);
+	fprintf(stdout, "  - reorder window:     %d frames\n", params.decap.reorder_window);
+	fprintf(stdout, "  - reassembly buffers: %d\n", params.decap.reasm_slots);
+	fprintf(stdout, "  - CPU:                %d\n", params.encap.cpu);
+	fprintf(stdout, "  - priority:           %d\n", params.encap.priority);
+	fprintf(stdout, "\n");
+#endif
+	// Process both ways
+	if((ret = process_tunnel(&params)) != 0)
+	{
+		return -2;
+	}
+	return 0;
+}
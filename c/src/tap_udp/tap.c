@@ -16,6 +16,7 @@
 #include <signal.h>
 
 #include "tap.h"
+#include "tunnel_log.h"
 
 int open_tap(char* tap_iface, tap_mode_t mode)
 {
@@ -32,6 +33,10 @@ int open_tap(char* tap_iface, tap_mode_t mode)
 		flags = O_WRONLY;
 		break;
 
+		case tap_readwrite:
+		flags = O_RDWR;
+		break;
+
 		default:
 		return -1;
 	}
@@ -73,7 +78,12 @@ int read_tap(int tap_fd, size_t capa, unsigned char* buffer, size_t *len)
 	//memset(buffer, 0, capa);
 	if((ret = read(tap_fd, buffer, capa)) < 0)
 	{
-		fprintf(stderr, "Function read failed: %s (%d)\n", strerror(errno), errno);
+		if(errno == EAGAIN || errno == EWOULDBLOCK)
+		{
+			*len = 0;
+			return 1;
+		}
+		log_ring_write(log_tap_read_failed, LOG_STR(strerror(errno)), LOG_INT(errno));
 		*len = 0;
 		return -1;
 	}
@@ -86,12 +96,12 @@ int write_tap(int tap_fd, unsigned char* buffer, size_t len)
 	int ret;
 	if((ret = write(tap_fd, buffer, len)) < 0)
 	{
-		fprintf(stderr, "Function write failed: %s (%d)\n", strerror(errno), errno);
+		log_ring_write(log_tap_write_failed, LOG_STR(strerror(errno)), LOG_INT(errno));
 		return -1;
 	}
 	else if(ret != (int)len)
 	{
-		fprintf(stderr, "Partial bufffer written (%d / %zu bytes)\n", ret, len);
+		log_ring_write(log_tap_partial_write, LOG_INT(ret), LOG_INT(len));
 		return -1;
 	}
 	return 0;
@@ -8,7 +8,8 @@
 
 typedef enum {
 	tap_readonly = 0,
-	tap_writeonly = 1
+	tap_writeonly = 1,
+	tap_readwrite = 2
 } tap_mode_t;
 
 /**
@@ -19,7 +20,7 @@ int open_tap(char* tap_iface, tap_mode_t mode);
 /**
  * Read data from a TAP interface
  *
- * Return 0 on success, 1 on timeout, -1 on error
+ * Return 0 on success, 1 when nothing is read, -1 on error
  */
 int read_tap(int tap_fd, size_t capa, unsigned char* buffer, size_t* len);
 
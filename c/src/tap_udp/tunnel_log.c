@@ -0,0 +1,36 @@
+// Copyright 2023, Viveris Technologies
+// Distributed under the terms of the MIT License
+
+#include "tunnel_log.h"
+
+static const struct log_type tunnel_log_types[log_type_count] = {
+	[log_udp_recv_failed] = {"Function recvfrom failed: %s (%d)\n", 2, TUNNEL_LOG_LIMIT},
+	[log_udp_send_failed] = {"Function sendto failed: %s (%d)\n", 2, TUNNEL_LOG_LIMIT},
+	[log_udp_sendmsg_failed] = {"Function sendmsg failed: %s (%d)\n", 2, TUNNEL_LOG_LIMIT},
+	[log_udp_partial_send] = {"Partial bufffer send (%d / %zu bytes)\n", 2, TUNNEL_LOG_LIMIT},
+	[log_tap_read_failed] = {"Function read failed: %s (%d)\n", 2, TUNNEL_LOG_LIMIT},
+	[log_tap_write_failed] = {"Function write failed: %s (%d)\n", 2, TUNNEL_LOG_LIMIT},
+	[log_tap_partial_write] = {"Partial bufffer written (%d / %zu bytes)\n", 2, TUNNEL_LOG_LIMIT},
+	[log_invalid_datagram] = {"Invalid destination or empty encapsulation packet\n", 0, TUNNEL_LOG_LIMIT},
+	[log_vfrag_create_failed] = {"Error when creating PDU virtual fragment (%s)\n", 1, TUNNEL_LOG_LIMIT},
+	[log_vfrag_length_failed] = {"error when setting fragment length: %s\n", 1, TUNNEL_LOG_LIMIT},
+	[log_vfrag_empty] = {"VFRAG empty\n", 0, TUNNEL_LOG_LIMIT},
+	[log_encap_pdu_failed] = {"VFRAG failed encap: %.2x, vfrag_length: %ld, max_length: %d, len_received: %ld\n",
+	                          4, TUNNEL_LOG_LIMIT},
+	[log_replicate_failed] = {"Error when replicating PDU virtual fragment (%s)\n", 1, TUNNEL_LOG_LIMIT},
+	[log_get_packet_failed] = {"Error when getting packet from PDU: %s | Demanded length: %ld\n", 2, TUNNEL_LOG_LIMIT},
+	[log_frame_send_failed] = {"[Send] Write udp failed\n", 0, TUNNEL_LOG_LIMIT},
+	[log_decap_vfrag_failed] = {"Decapsulation fragment initialization failed: %s (%d), Len decap: %ld, Len received: %ld\n",
+	                            4, TUNNEL_LOG_LIMIT},
+	[log_decap_packet_failed] = {"Error when de-encapsulating GSE packet: %s (%d)\n", 2, TUNNEL_LOG_LIMIT},
+	[log_decap_invalid_length] = {"Error, invalid data length: %s (%d)\n", 2, TUNNEL_LOG_LIMIT},
+	[log_decap_pdu_dropped] = {"PDU incomplete dropped\n", 0, TUNNEL_LOG_LIMIT},
+	[log_invalid_gse_packet] = {"Invalid GSE packet, rest of the frame dropped\n", 0, TUNNEL_LOG_LIMIT},
+	[log_invalid_bb_header] = {"Invalid baseband header, frame dropped\n", 0, TUNNEL_LOG_LIMIT},
+	[log_short_frame] = {"Frame of %ld bytes shorter than an Ethernet header, dropped\n", 1, TUNNEL_LOG_LIMIT},
+};
+
+int tunnel_log_start(void)
+{
+	return log_ring_start(tunnel_log_types, log_type_count, TUNNEL_LOG_RING_LEN);
+}
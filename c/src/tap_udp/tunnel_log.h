@@ -0,0 +1,48 @@
+// Copyright 2023, Viveris Technologies
+// Distributed under the terms of the MIT License
+
+#ifndef __TUNNEL_LOG_H__
+#define __TUNNEL_LOG_H__
+
+#include "log_ring.h"
+
+#define TUNNEL_LOG_RING_LEN 1024 // messages waiting to be printed
+#define TUNNEL_LOG_LIMIT 10      // messages per second of each type
+
+/**
+ * Messages of the processing loops, printed by the logging thread
+ */
+typedef enum {
+	log_udp_recv_failed = 0,
+	log_udp_send_failed,
+	log_udp_sendmsg_failed,
+	log_udp_partial_send,
+	log_tap_read_failed,
+	log_tap_write_failed,
+	log_tap_partial_write,
+	log_invalid_datagram,
+	log_vfrag_create_failed,
+	log_vfrag_length_failed,
+	log_vfrag_empty,
+	log_encap_pdu_failed,
+	log_replicate_failed,
+	log_get_packet_failed,
+	log_frame_send_failed,
+	log_decap_vfrag_failed,
+	log_decap_packet_failed,
+	log_decap_invalid_length,
+	log_decap_pdu_dropped,
+	log_invalid_gse_packet,
+	log_invalid_bb_header,
+	log_short_frame,
+	log_type_count
+} tunnel_log_t;
+
+/**
+ * Start the logging thread of the processing loops
+ *
+ * Return 0 on success, -1 otherwise
+ */
+int tunnel_log_start(void);
+
+#endif
@@ -5,13 +5,20 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <fcntl.h>
 
 #include <sys/socket.h>
 #include <arpa/inet.h>
 #include <netinet/in.h>
 
+#include "tunnel_log.h"
 #include "udp.h"
 
+// Missing from the headers older than Linux 5.11
+#ifndef SO_PREFER_BUSY_POLL
+#define SO_PREFER_BUSY_POLL 69
+#endif
+
 int open_udp(struct udp_addr *local)
 {
 	int fd, val;
@@ -42,6 +49,30 @@ int open_udp(struct udp_addr *local)
 	return fd;
 }
 
+int set_udp_busy_poll(int udp_fd, int usecs)
+{
+	int flags, val;
+
+	if((flags = fcntl(udp_fd, F_GETFL)) < 0 || fcntl(udp_fd, F_SETFL, flags | O_NONBLOCK) < 0)
+	{
+		fprintf(stderr, "Function fcntl failed: %s (%d)\n", strerror(errno), errno);
+		return -1;
+	}
+
+	// Without CAP_NET_ADMIN the time is capped by net.core.busy_read, and
+	// older kernels lack the preference: the socket is only spun then
+	if(setsockopt(udp_fd, SOL_SOCKET, SO_BUSY_POLL, &usecs, sizeof(int)) != 0)
+	{
+		fprintf(stderr, "Function setsockopt failed (SO_BUSY_POLL): %s (%d)\n", strerror(errno), errno);
+	}
+	val = 1;
+	if(setsockopt(udp_fd, SOL_SOCKET, SO_PREFER_BUSY_POLL, &val, sizeof(int)) != 0)
+	{
+		fprintf(stderr, "Function setsockopt failed (SO_PREFER_BUSY_POLL): %s (%d)\n", strerror(errno), errno);
+	}
+	return 0;
+}
+
 int read_udp(int udp_fd, struct udp_addr *remote, size_t capa, unsigned char* buffer, size_t* len)
 {
 	int ret, flags;
@@ -57,13 +88,18 @@ int read_udp(int udp_fd, struct udp_addr *remote, size_t capa, unsigned char* bu
 	addr_len = sizeof(struct sockaddr_in);
 	if((ret = recvfrom(udp_fd, buffer, capa, flags, (struct sockaddr *)(&addr), &addr_len)) < 0)
 	{
-		fprintf(stderr, "Function recvfrom failed: %s (%d)\n", strerror(errno), errno);
+		if(errno == EAGAIN || errno == EWOULDBLOCK)
+		{
+			*len = 0;
+			return 1;
+		}
+		log_ring_write(log_udp_recv_failed, LOG_STR(strerror(errno)), LOG_INT(errno));
 		return -1;
 	}
 	if(addr.sin_addr.s_addr != remote->addr || addr.sin_port != htons(remote->port))
 	{
 		*len = 0;
-		return 1;
+		return 2;
 	}
 	*len = ret;
 
@@ -83,12 +119,48 @@ int write_udp(int udp_fd, struct udp_addr *remote, unsigned char* buffer, size_t
 	flags = MSG_CONFIRM;
 	if((ret = sendto(udp_fd, buffer, len, flags, (const struct sockaddr *)(&addr), sizeof(struct sockaddr_in))) < 0)
 	{
-		fprintf(stderr, "Function sendto failed: %s (%d)\n", strerror(errno), errno);
+		log_ring_write(log_udp_send_failed, LOG_STR(strerror(errno)), LOG_INT(errno));
+		return -1;
+	}
+	else if(ret != (int)len)
+	{
+		log_ring_write(log_udp_partial_send, LOG_INT(ret), LOG_INT(len));
+		return -1;
+	}
+	return 0;
+}
+
+int write_udp_iov(int udp_fd, struct udp_addr *remote, struct iovec* iov, int count)
+{
+	int ret, flags, i;
+	size_t len = 0;
+	struct sockaddr_in addr;
+	struct msghdr msg;
+
+	memset(&addr, 0, sizeof(struct sockaddr_in));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = remote->addr;
+	addr.sin_port = htons(remote->port);
+
+	memset(&msg, 0, sizeof(struct msghdr));
+	msg.msg_name = &addr;
+	msg.msg_namelen = sizeof(struct sockaddr_in);
+	msg.msg_iov = iov;
+	msg.msg_iovlen = count;
+	for(i = 0; i < count; i++)
+	{
+		len += iov[i].iov_len;
+	}
+
+	flags = MSG_CONFIRM;
+	if((ret = sendmsg(udp_fd, &msg, flags)) < 0)
+	{
+		log_ring_write(log_udp_sendmsg_failed, LOG_STR(strerror(errno)), LOG_INT(errno));
 		return -1;
 	}
 	else if(ret != (int)len)
 	{
-		fprintf(stderr, "Partial bufffer send (%d / %zu bytes)\n", ret, len);
+		log_ring_write(log_udp_partial_send, LOG_INT(ret), LOG_INT(len));
 		return -1;
 	}
 	return 0;
@@ -5,6 +5,7 @@
 #define __UDP_H__
 
 #include <stdint.h>
+#include <sys/uio.h>
 
 struct udp_addr
 {
@@ -17,10 +18,19 @@ struct udp_addr
  */
 int open_udp(struct udp_addr *local);
 
+/**
+ * Make an UDP socket non-blocking, and busy poll the device queue for usecs
+ * microseconds when reading it
+ *
+ * Return 0 on success, -1 otherwise
+ */
+int set_udp_busy_poll(int udp_fd, int usecs);
+
 /**
  * Read data from an UDP socket
  *
- * Return 0 on success, 1 on timeout, -1 on error
+ * Return 0 on success, 1 when nothing is waiting on a non-blocking socket,
+ * 2 for data from another sender, -1 on error
  */
 int read_udp(int udp_fd, struct udp_addr *remote, size_t capa, unsigned char* buffer, size_t* len);
 
@@ -31,4 +41,11 @@ int read_udp(int udp_fd, struct udp_addr *remote, size_t capa, unsigned char* bu
  */
 int write_udp(int udp_fd, struct udp_addr *remote, unsigned char* buffer, size_t len);
 
+/**
+ * Write data gathered from several buffers to an UDP socket
+ *
+ * Return 0 on success, -1 on error
+ */
+int write_udp_iov(int udp_fd, struct udp_addr *remote, struct iovec* iov, int count);
+
 #endif
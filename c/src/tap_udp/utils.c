@@ -1,11 +1,16 @@
 // Copyright 2023, Viveris Technologies
 // Distributed under the terms of the MIT License
 
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <limits.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <ctype.h>
+#include <time.h>
 
 #include <net/if.h>
 #include <arpa/inet.h>
@@ -66,6 +71,37 @@ int parse_unsigned_long(const char* str, unsigned long* val)
 	return strlen(end) <= 0 && *val != 0 ? 0 : -1;
 }
 
+int parse_hex_bytes(const char *str, uint8_t *bytes, unsigned int max_count)
+{
+	unsigned int count = 0;
+	unsigned long val;
+	char *end;
+
+	while(count < max_count)
+	{
+		if(!isxdigit((unsigned char)str[0]))
+		{
+			return -1;
+		}
+		val = strtoul(str, &end, 16);
+		if(end - str > 2 || val > 0xff)
+		{
+			return -1;
+		}
+		bytes[count++] = (uint8_t)val;
+		if(*end == '\0')
+		{
+			return count;
+		}
+		if(*end != ':')
+		{
+			return -1;
+		}
+		str = end + 1;
+	}
+	return -1;
+}
+
 void set_time(unsigned long ms, struct timespec* time)
 {
 	time->tv_sec = ms / 1000;
@@ -76,3 +112,106 @@ unsigned long time_to_long(struct timespec time)
 {
 	return time.tv_sec * 1000 + time.tv_nsec / 1000000;
 }
+
+uint64_t monotonic_ms(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+uint64_t monotonic_ns(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+int parse_cpu_list(const char* str, int* cpus, unsigned int count)
+{
+	const char *delimiters = ":";
+	unsigned long tmp;
+	unsigned int i;
+	size_t len;
+	char *buffer;
+	char *save;
+
+	len = strlen(str) + 1;
+	char list[len];
+
+	memcpy(list, str, len);
+	buffer = strtok_r(list, delimiters, &save);
+	for(i = 0; i < count; i++)
+	{
+		if(buffer == NULL)
+		{
+			return -1;
+		}
+		if(strcmp(buffer, "-") == 0)
+		{
+			cpus[i] = -1;
+		}
+		else if(parse_unsigned_long(buffer, &tmp) != 0 || tmp >= CPU_SETSIZE)
+		{
+			return -1;
+		}
+		else
+		{
+			cpus[i] = (int)tmp;
+		}
+		buffer = strtok_r(NULL, delimiters, &save);
+	}
+	return buffer == NULL ? 0 : -1;
+}
+
+int set_thread_cpu(pthread_t thread, int cpu)
+{
+	cpu_set_t set;
+	int ret;
+
+	if(cpu < 0)
+	{
+		return 0;
+	}
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	if((ret = pthread_setaffinity_np(thread, sizeof(cpu_set_t), &set)) != 0)
+	{
+		fprintf(stderr, "Function pthread_setaffinity_np failed (cpu: %d): %s (%d)\n", cpu, strerror(ret), ret);
+		return -1;
+	}
+	return 0;
+}
+
+int set_thread_fifo(pthread_t thread, int priority)
+{
+	struct sched_param param;
+	int ret;
+
+	if(priority == 0)
+	{
+		return 0;
+	}
+	memset(&param, 0, sizeof(struct sched_param));
+	param.sched_priority = priority;
+	if((ret = pthread_setschedparam(thread, SCHED_FIFO, &param)) != 0)
+	{
+		fprintf(stderr, "Function pthread_setschedparam failed (priority: %d): %s (%d)\n", priority, strerror(ret), ret);
+		return -1;
+	}
+	return 0;
+}
+
+int set_nonblocking(int fd)
+{
+	int flags;
+
+	if((flags = fcntl(fd, F_GETFL)) < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0)
+	{
+		fprintf(stderr, "Function fcntl failed: %s (%d)\n", strerror(errno), errno);
+		return -1;
+	}
+	return 0;
+}
@@ -4,6 +4,8 @@
 #ifndef __UTILS_H__
 #define __UTILS_H__
 
+#include <pthread.h>
+
 #include "udp.h"
 
 /**
@@ -20,6 +22,13 @@ int parse_udp_arguments(const char* addr_port, struct udp_addr* addr);
  */
 int parse_unsigned_long(const char* str, unsigned long* val);
 
+/**
+ * Parse up to max_count hexadecimal bytes separated by ':' ("xx:xx:xx")
+ *
+ * Return the number of bytes on success, -1 otherwise
+ */
+int parse_hex_bytes(const char* str, uint8_t* bytes, unsigned int max_count);
+
 /**
  * Set time from millisecond value
  */
@@ -30,4 +39,43 @@ void set_time(unsigned long ms, struct timespec* time);
  */
 unsigned long time_to_long(struct timespec time);
 
+/**
+ * Get the monotonic clock value in milliseconds
+ */
+uint64_t monotonic_ms(void);
+
+/**
+ * Get the monotonic clock value in nanoseconds
+ */
+uint64_t monotonic_ns(void);
+
+/**
+ * Parse a list of CPU indexes separated by ':', "-" leaves an entry unpinned
+ *
+ * Return 0 on success, -1 otherwise
+ */
+int parse_cpu_list(const char* str, int* cpus, unsigned int count);
+
+/**
+ * Pin a thread on a CPU, nothing is done for a negative CPU index
+ *
+ * Return 0 on success, -1 otherwise
+ */
+int set_thread_cpu(pthread_t thread, int cpu);
+
+/**
+ * Run a thread under the SCHED_FIFO real-time policy at a priority, nothing
+ * is done for a null priority
+ *
+ * Return 0 on success, -1 otherwise
+ */
+int set_thread_fifo(pthread_t thread, int priority);
+
+/**
+ * Make the reads and writes of a file descriptor non-blocking
+ *
+ * Return 0 on success, -1 otherwise
+ */
+int set_nonblocking(int fd);
+
 #endif
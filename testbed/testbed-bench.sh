@@ -0,0 +1,295 @@
+#!/bin/bash
+
+# Copyright 2023, Viveris Technologies
+# Distributed under the terms of the MIT License
+
+ROOT=$(dirname $(readlink -e $0))
+REPO=$(dirname ${ROOT})
+TESTBED=${ROOT}/testbed-netns.sh
+PID_FILE=${ROOT}/.pids.netns
+
+# Default matrix
+SIZES="64 512 1400"
+RATES="100M 500M 1G"
+PAYLOADS="0 1500"
+DURATION=10
+BUSY_MODES=0
+OUT_DIR=bench-$(date +%Y%m%d-%H%M%S)
+
+usage() {
+	echo "Usage: $(basename $0) [OPTIONS] [BIN_DIR...]"
+	echo "Benchmark the encap/decap functions on the network namespaces testbed, and compare them in a single report"
+	echo ""
+	echo "    BIN_DIR    the directories where binaries are stored (default: c/src/tap_udp rust/target/release rust_testimonial/target/release)"
+	echo ""
+	echo "Options:"
+	echo ""
+	echo "    -s SIZES"
+	echo "        the UDP payload lengths (bytes) sent by iperf3 (default: \"${SIZES}\")"
+	echo ""
+	echo "    -r RATES"
+	echo "        the rates (bit/s) offered by iperf3 (default: \"${RATES}\")"
+	echo ""
+	echo "    -p PAYLOADS"
+	echo "        the -p PAYLOAD_LEN of the encap function, 0 for frames of variable length (default: \"${PAYLOADS}\")"
+	echo ""
+	echo "    -d DURATION"
+	echo "        the duration (s) of each run (default: ${DURATION})"
+	echo ""
+	echo "    -o OUT_DIR"
+	echo "        the directory of the logs, the results and the report (default: bench-DATE)"
+	echo ""
+	echo "    -B"
+	echo "        run each implementation a second time with busy polling (-B on both sides), reported as IMPL+busy;"
+	echo "        only the implementations whose binaries list -B in their help (the C one) are run, the others are skipped"
+	echo ""
+	echo "The testbed is set up and cleaned up when it does not exist yet. The latency is the round-trip"
+	echo "time of pings sent along the iperf3 traffic: the forward way goes through the tunnel, the return"
+	echo "way does not. The CPU use is the share of a core used by each process during the run."
+}
+
+# Get the CPU time (ticks) used so far by a process
+cpu_ticks() {
+	awk '{ print $14 + $15 }' /proc/$1/stat 2>/dev/null || echo 0
+}
+
+# Check that both binaries of an implementation support busy polling
+busy_poll_supported() {
+	local BIN
+	for BIN in satencap satdecap; do
+		if ! timeout 2 $1/${BIN} -h 2>/dev/null | grep -q -- "\[-B\]"; then
+			return 1
+		fi
+	done
+}
+
+# Check that the tunnel processes are still running
+tunnel_alive() {
+	local PID
+	[ -f ${PID_FILE} ] || return 1
+	for PID in $(cat ${PID_FILE}); do
+		if ! kill -0 ${PID} 2>/dev/null; then
+			return 1
+		fi
+	done
+}
+
+# Get the name of an implementation from its binaries directory
+impl_name() {
+	local REL=$(realpath --relative-to=${REPO} $1)
+	if [ "${REL#..}" != "${REL}" ]; then
+		basename $1
+	else
+		echo ${REL%%/*}
+	fi
+}
+
+# Run one cell of the matrix and append its results to the CSV file, a
+# cell whose iperf3 run fails is recorded with 0 Mbit/s and 100 % loss
+run_cell() {
+	local IMPL=$1
+	local PAYLOAD=$2
+	local SIZE=$3
+	local RATE=$4
+	local NAME=${IMPL}-p${PAYLOAD}-s${SIZE}-r${RATE}
+
+	local DECAP_PID=$(echo $(cat ${PID_FILE}) | cut -d' ' -f1)
+	local ENCAP_PID=$(echo $(cat ${PID_FILE}) | cut -d' ' -f2)
+	local HZ=$(getconf CLK_TCK)
+
+	# Bounded: the one-shot server never gets a client when the tunnel is down
+	ip netns exec encap_rx timeout $((DURATION + 10)) iperf3 -B 10.0.0.1 -s -1 &> ${OUT_DIR}/${NAME}.server.log &
+	local SERVER_PID=$!
+	sleep 0.5
+
+	local START=$(date +%s%N)
+	local ENCAP_START=$(cpu_ticks ${ENCAP_PID})
+	local DECAP_START=$(cpu_ticks ${DECAP_PID})
+
+	ip netns exec encap_tx ping -I 10.0.0.254 -i 0.01 -w ${DURATION} 10.0.0.1 &> ${OUT_DIR}/${NAME}.ping.log &
+	local PING_PID=$!
+	ip netns exec encap_tx timeout $((DURATION + 10)) iperf3 -B 10.0.0.254 -c 10.0.0.1 -u -b ${RATE} -l ${SIZE} -t ${DURATION} -J > ${OUT_DIR}/${NAME}.iperf3.json
+	wait ${PING_PID}
+	wait ${SERVER_PID}
+
+	local ELAPSED_MS=$(( ($(date +%s%N) - START) / 1000000 ))
+	local ENCAP_CPU=$(( ($(cpu_ticks ${ENCAP_PID}) - ENCAP_START) * 100000 / (HZ * ELAPSED_MS) ))
+	local DECAP_CPU=$(( ($(cpu_ticks ${DECAP_PID}) - DECAP_START) * 100000 / (HZ * ELAPSED_MS) ))
+
+	python3 - ${OUT_DIR}/${NAME}.iperf3.json ${OUT_DIR}/${NAME}.ping.log <<EOF >> ${OUT_DIR}/results.csv
+import json, re, sys
+
+try:
+    with open(sys.argv[1]) as f:
+        end = json.load(f)["end"]
+    # Newer iperf3 report the receiver side apart
+    recv = end.get("sum_received", end["sum"])
+    mbps = recv["bits_per_second"] / 1e6
+    loss = end["sum"].get("lost_percent", 0.0)
+except (KeyError, ValueError):
+    mbps, loss = 0.0, 100.0
+
+with open(sys.argv[2]) as f:
+    rtts = sorted(float(m.group(1)) for m in re.finditer(r"time=([0-9.]+) ms", f.read()))
+
+def percentile(ratio):
+    return "%.3f" % rtts[min(len(rtts) - 1, int(ratio * len(rtts)))] if rtts else ""
+
+print(",".join(["${IMPL}", "${PAYLOAD}", "${SIZE}", "${RATE}", "%.1f" % mbps, "%.3f" % loss,
+                percentile(0.5), percentile(0.9), percentile(0.99), "${ENCAP_CPU}", "${DECAP_CPU}"]))
+EOF
+	tail -n 1 ${OUT_DIR}/results.csv
+}
+
+# Write the comparison report of the results
+report() {
+	python3 - ${OUT_DIR}/results.csv > ${OUT_DIR}/report.md <<EOF
+import csv, sys
+
+with open(sys.argv[1]) as f:
+    rows = list(csv.DictReader(f))
+
+print("# Encap/decap benchmark")
+print()
+print("- date: $(date -R)")
+print("- commit: $(git -C ${REPO} rev-parse --short HEAD 2>/dev/null)")
+print("- kernel: $(uname -r)")
+print("- CPU: $(grep -m1 'model name' /proc/cpuinfo | cut -d: -f2 | xargs), $(nproc) cores")
+print("- duration: ${DURATION} s per run")
+print()
+print("Throughput received by iperf3, loss, ping RTT percentiles under load, and share of a core used by each process.")
+print()
+
+cells = []
+for row in rows:
+    cell = (row["size"], row["rate"])
+    if cell not in cells:
+        cells.append(cell)
+
+for size, rate in cells:
+    print("## %s bytes at %sbit/s" % (size, rate))
+    print()
+    print("| implementation | -p | Mbit/s | loss % | RTT p50 ms | RTT p90 ms | RTT p99 ms | encap CPU % | decap CPU % |")
+    print("|---|---|---|---|---|---|---|---|---|")
+    group = [r for r in rows if (r["size"], r["rate"]) == (size, rate)]
+    for r in group:
+        print("| %s | %s | %s | %s | %s | %s | %s | %s | %s |" % (r["impl"], r["payload"], r["mbps"], r["loss"],
+              r["rtt_p50"], r["rtt_p90"], r["rtt_p99"], r["encap_cpu"], r["decap_cpu"]))
+    # Best: the highest throughput under 1% loss, then the lowest CPU use
+    valid = [r for r in group if float(r["loss"]) < 1.0]
+    if valid:
+        best = max(valid, key=lambda r: (float(r["mbps"]), -int(r["encap_cpu"]) - int(r["decap_cpu"])))
+        print()
+        print("Best: %s with -p %s" % (best["impl"], best["payload"]))
+    print()
+EOF
+	cat ${OUT_DIR}/report.md
+}
+
+while getopts "hs:r:p:d:o:B" OPT; do
+	case ${OPT} in
+	s) SIZES=${OPTARG} ;;
+	r) RATES=${OPTARG} ;;
+	p) PAYLOADS=${OPTARG} ;;
+	d) DURATION=${OPTARG} ;;
+	o) OUT_DIR=${OPTARG} ;;
+	B) BUSY_MODES="0 1" ;;
+	h)
+		usage
+		exit 0
+		;;
+	*)
+		usage
+		exit 1
+		;;
+	esac
+done
+shift $((OPTIND - 1))
+
+BIN_DIRS=$*
+if [ -z "${BIN_DIRS}" ]; then
+	# Only the implementations which are built
+	for DIR in ${REPO}/c/src/tap_udp ${REPO}/rust/target/release ${REPO}/rust_testimonial/target/release; do
+		if [ -x "${DIR}/satencap" ] && [ -x "${DIR}/satdecap" ]; then
+			BIN_DIRS="${BIN_DIRS} ${DIR}"
+		else
+			echo "Binaries not found in \"${DIR}\", skipped"
+		fi
+	done
+fi
+for DIR in ${BIN_DIRS}; do
+	if [ ! -x "${DIR}/satencap" ] || [ ! -x "${DIR}/satdecap" ]; then
+		echo "Binaries not found in \"${DIR}\""
+		exit 2
+	fi
+done
+if [ -z "${BIN_DIRS}" ]; then
+	echo "No binaries to benchmark"
+	exit 2
+fi
+for TOOL in iperf3 python3; do
+	if ! command -v ${TOOL} > /dev/null; then
+		echo "Missing tool \"${TOOL}\""
+		exit 2
+	fi
+done
+
+mkdir -p ${OUT_DIR}
+OUT_DIR=$(readlink -e ${OUT_DIR})
+echo "impl,payload,size,rate,mbps,loss,rtt_p50,rtt_p90,rtt_p99,encap_cpu,decap_cpu" > ${OUT_DIR}/results.csv
+
+SETUP=0
+if ! ip netns list | grep -q "^encap_tx"; then
+	${TESTBED} setup
+	SETUP=1
+fi
+
+for DIR in ${BIN_DIRS}; do
+	for BUSY in ${BUSY_MODES}; do
+		IMPL=$(impl_name $(readlink -e ${DIR}))$([ ${BUSY} -eq 1 ] && echo +busy)
+		if [ ${BUSY} -eq 1 ] && ! busy_poll_supported ${DIR}; then
+			echo "Busy polling not supported by the binaries in \"${DIR}\", ${IMPL} skipped"
+			continue
+		fi
+		DEAD=0
+		for PAYLOAD in ${PAYLOADS}; do
+			# Frames of variable length hold up to a whole GSE packet
+			export OPT_ENCAP="-p ${PAYLOAD}"
+			export OPT_DECAP="-p $([ ${PAYLOAD} -eq 0 ] && echo 4095 || echo ${PAYLOAD})"
+			if [ ${BUSY} -eq 1 ]; then
+				# Each spinning process takes a CPU of its own, away from iperf3
+				OPT_ENCAP="${OPT_ENCAP} -B"
+				OPT_DECAP="${OPT_DECAP} -B"
+				if [ $(nproc) -ge 3 ]; then
+					OPT_ENCAP="${OPT_ENCAP} -a $(($(nproc) - 1))"
+					OPT_DECAP="${OPT_DECAP} -a $(($(nproc) - 2)):-:-"
+				fi
+			fi
+			${TESTBED} start ${DIR}
+			sleep 1
+			for SIZE in ${SIZES}; do
+				for RATE in ${RATES}; do
+					if ! tunnel_alive; then
+						echo "Tunnel processes of ${IMPL} with -p ${PAYLOAD} not running, ${IMPL} skipped"
+						DEAD=1
+						break 2
+					fi
+					run_cell ${IMPL} ${PAYLOAD} ${SIZE} ${RATE}
+				done
+			done
+			${TESTBED} stop
+			[ -f ${PID_FILE} ] && ${TESTBED} force-stop
+			mv fwd_encap_tx.log ${OUT_DIR}/${IMPL}-p${PAYLOAD}-encap.log 2>/dev/null
+			mv fwd_encap_rx.log ${OUT_DIR}/${IMPL}-p${PAYLOAD}-decap.log 2>/dev/null
+			if [ ${DEAD} -eq 1 ]; then
+				break
+			fi
+		done
+	done
+done
+
+if [ ${SETUP} -eq 1 ]; then
+	${TESTBED} cleanup
+fi
+
+report